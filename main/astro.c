@@ -0,0 +1,187 @@
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "astro.h"
+#include "util.h"
+
+#define TAG "ASTRO"
+
+#ifndef CONFIG_SITE_LATITUDE_ARCSEC
+#define CONFIG_SITE_LATITUDE_ARCSEC 0
+#endif
+
+#ifndef CONFIG_SITE_LONGITUDE_ARCSEC
+#define CONFIG_SITE_LONGITUDE_ARCSEC 0
+#endif
+
+/* 1 arcsec = 1/15 second of time */
+#define ARCSEC_TO_MILLIS(arcsec) ((int32_t)((int64_t)(arcsec) * 1000 / 15))
+
+/* GMST at J2000.0 (18.697374558h) */
+#define GMST_J2000_MILLIS 67310548
+/* extra sidereal rotation per solar day, in 1/1000 millis (86400000 * 0.00273790935) */
+#define GMST_DAY_GAIN_MICROS 236555368LL
+/* extra sidereal rotation per solar milli, in 1/100000000000 */
+#define GMST_MILLI_GAIN 273790935LL
+#define GMST_MILLI_GAIN_SCALE 100000000000LL
+
+#define TIME_SAMPLES 8
+/* samples whose delay exceeds this multiple of the best one are congested, skip them */
+#define TIME_SAMPLE_MAX_DELAY_FACTOR 3
+/* drift is not estimated before the samples span this long */
+#define DRIFT_MIN_SPAN_MICROS (60LL * 1000000)
+#define DRIFT_MAX_PPB 500000
+
+typedef struct {
+    int64_t local;
+    int64_t offset;
+    uint32_t delay;
+} time_sample_t;
+
+static portMUX_TYPE astro_mux = portMUX_INITIALIZER_UNLOCKED;
+static time_sample_t samples[TIME_SAMPLES];
+static uint8_t sample_count, sample_next;
+
+/* utc = local + offset_ref + (local - local_ref) * drift_ppb / 1e9 */
+static int64_t local_ref, offset_ref;
+static int32_t drift_ppb;
+/* disciplined monotonic time stays continuous when drift_ppb is re-estimated */
+static int64_t mono_base_local, mono_base_disciplined;
+
+static int32_t site_latitude_millis, site_longitude_millis;
+
+void init_astro() {
+    sample_count = 0;
+    sample_next = 0;
+    local_ref = 0;
+    offset_ref = 0;
+    drift_ppb = 0;
+    mono_base_local = 0;
+    mono_base_disciplined = 0;
+    site_latitude_millis = ARCSEC_TO_MILLIS(CONFIG_SITE_LATITUDE_ARCSEC);
+    site_longitude_millis = ARCSEC_TO_MILLIS(CONFIG_SITE_LONGITUDE_ARCSEC);
+}
+
+static int64_t disciplined_locked(int64_t localMicros) {
+    int64_t elapsed = localMicros - mono_base_local;
+    return mono_base_disciplined + elapsed + elapsed * drift_ppb / 1000000000;
+}
+
+void add_time_sample(int64_t localMicros, int64_t utcMicros, uint32_t delayMicros) {
+    portENTER_CRITICAL(&astro_mux);
+    samples[sample_next].local = localMicros;
+    samples[sample_next].offset = utcMicros + delayMicros - localMicros;
+    samples[sample_next].delay = delayMicros;
+    sample_next = (sample_next + 1) % TIME_SAMPLES;
+    if (sample_count < TIME_SAMPLES) sample_count ++;
+
+    uint32_t bestDelay = UINT32_MAX;
+    for (int i = 0; i < sample_count; i ++) {
+        if (samples[i].delay < bestDelay) bestDelay = samples[i].delay;
+    }
+    uint64_t maxDelay = (uint64_t)bestDelay * TIME_SAMPLE_MAX_DELAY_FACTOR + 1000;
+
+    /* least squares of offset over local time, relative to the newest sample to keep the numbers small */
+    int n = 0;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int64_t minLocal = localMicros, maxLocal = localMicros;
+    for (int i = 0; i < sample_count; i ++) {
+        if (samples[i].delay > maxDelay) continue;
+        double x = (double)(samples[i].local - localMicros);
+        double y = (double)(samples[i].offset - samples[(sample_next + TIME_SAMPLES - 1) % TIME_SAMPLES].offset);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+        if (samples[i].local < minLocal) minLocal = samples[i].local;
+        n ++;
+    }
+    double slope = 0;
+    if (n >= 2 && maxLocal - minLocal >= DRIFT_MIN_SPAN_MICROS) {
+        double den = n * sxx - sx * sx;
+        if (den > 0) slope = (n * sxy - sx * sy) / den;
+    }
+    double intercept = (sy - slope * sx) / n;
+
+    int64_t newDrift = (int64_t)(slope * 1000000000.0);
+    if (newDrift > DRIFT_MAX_PPB) newDrift = DRIFT_MAX_PPB;
+    else if (newDrift < -DRIFT_MAX_PPB) newDrift = -DRIFT_MAX_PPB;
+
+    mono_base_disciplined = disciplined_locked(localMicros);
+    mono_base_local = localMicros;
+    drift_ppb = (int32_t)newDrift;
+    local_ref = localMicros;
+    offset_ref = samples[(sample_next + TIME_SAMPLES - 1) % TIME_SAMPLES].offset + (int64_t)intercept;
+    portEXIT_CRITICAL(&astro_mux);
+    LOGI(TAG, "time sample %d/%d: offset %lldus, drift %dppb", n, sample_count, offset_ref, drift_ppb);
+}
+
+bool is_time_synced() {
+    return sample_count > 0;
+}
+
+int32_t get_clock_drift_ppb() {
+    return drift_ppb;
+}
+
+uint8_t get_time_sample_count() {
+    return sample_count;
+}
+
+int64_t get_disciplined_micros(int64_t localMicros) {
+    portENTER_CRITICAL(&astro_mux);
+    int64_t disciplined = disciplined_locked(localMicros);
+    portEXIT_CRITICAL(&astro_mux);
+    return disciplined;
+}
+
+uint64_t get_disciplined_millis() {
+    return get_disciplined_micros(esp_timer_get_time()) / 1000;
+}
+
+int64_t get_utc_micros(int64_t localMicros) {
+    portENTER_CRITICAL(&astro_mux);
+    int64_t utc = localMicros + offset_ref + (localMicros - local_ref) * drift_ppb / 1000000000;
+    portEXIT_CRITICAL(&astro_mux);
+    return utc;
+}
+
+int64_t get_utc_millis() {
+    return get_utc_micros(esp_timer_get_time()) / 1000;
+}
+
+void set_site(int32_t latitudeMillis, int32_t longitudeMillis) {
+    site_latitude_millis = latitudeMillis;
+    site_longitude_millis = longitudeMillis;
+}
+
+int32_t get_site_latitude_millis() {
+    return site_latitude_millis;
+}
+
+int32_t get_site_longitude_millis() {
+    return site_longitude_millis;
+}
+
+/* GMST = 18.697374558h + 1.00273790935 * (UT - J2000), all in integers */
+int32_t get_gmst_millis(int64_t utcMillis) {
+    int64_t sinceJ2000 = utcMillis - J2000_UNIX_MILLIS;
+    int64_t days = sinceJ2000 / DAY_MILLIS;
+    int64_t rem = sinceJ2000 % DAY_MILLIS;
+    if (rem < 0) {
+        rem += DAY_MILLIS;
+        days --;
+    }
+    int64_t dayGain = (days * GMST_DAY_GAIN_MICROS) % (DAY_MILLIS * 1000LL);
+    if (dayGain < 0) dayGain += DAY_MILLIS * 1000LL;
+    int64_t gmst = GMST_J2000_MILLIS + rem + rem * GMST_MILLI_GAIN / GMST_MILLI_GAIN_SCALE + dayGain / 1000;
+    return (int32_t)(gmst % DAY_MILLIS);
+}
+
+int32_t get_lst_millis() {
+    int64_t lst = (int64_t)get_gmst_millis(get_utc_millis()) + site_longitude_millis;
+    lst %= DAY_MILLIS;
+    if (lst < 0) lst += DAY_MILLIS;
+    return (int32_t)lst;
+}
+
+/* in (-12h, 12h], positive west of the meridian */
+int32_t get_hour_angle_millis(int32_t raMillis) {
+    return angle_diff_millis(get_lst_millis(), raMillis);
+}
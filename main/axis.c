@@ -0,0 +1,238 @@
+#include <stddef.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "axis.h"
+#include "mount_config.h"
+#include "perf.h"
+#include "trace.h"
+#include "capture.h"
+#include "util.h"
+
+#define TAG "AXIS"
+
+#define DUTY_RES LEDC_TIMER_13_BIT
+#define DUTY (((1 << DUTY_RES) - 1) / 2)
+
+#ifndef CONFIG_RA_REVERSE
+#define CONFIG_RA_REVERSE false
+#endif
+
+#ifndef CONFIG_DEC_REVERSE
+#define CONFIG_DEC_REVERSE false
+#endif
+
+#ifdef CONFIG_FOCUSER_ENABLED
+#ifndef CONFIG_FOCUSER_REVERSE
+#define CONFIG_FOCUSER_REVERSE false
+#endif
+
+/* lash is taken up by the final approach of a move, the speed unit is mHz */
+static const int32_t focuser_lash_pulses = 0;
+static const uint32_t focuser_millihz_per_speed_q24 = 1 << 24;
+#endif
+
+axis_t mount_axes[AXES] = {
+    {
+        .name = "RA",
+        .lash_pulses = &mount_constants.ra_backlash_pulses,
+        .en_pin = CONFIG_GPIO_RA_EN,
+        .dir_pin = CONFIG_GPIO_RA_DIR,
+        .reverse = CONFIG_RA_REVERSE,
+        .channel = {
+            .channel = LEDC_CHANNEL_0,
+            .timer_sel = LEDC_TIMER_0,
+            .duty = 0,
+            .gpio_num = CONFIG_GPIO_RA_PUL,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+        },
+        .timer = {
+            .freq_hz = 1000, // set from the mount geometry on start
+            .duty_resolution = DUTY_RES,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+            .timer_num = LEDC_TIMER_0
+        },
+        .min_speed = RA_SPEED_MIN,
+        .max_speed = RA_SPEED_MAX,
+        .millihz_per_speed_q24 = &mount_constants.ra_millihz_per_speed_q24,
+    },
+    {
+        .name = "DEC",
+        .lash_pulses = &mount_constants.dec_backlash_pulses,
+        .en_pin = CONFIG_GPIO_DEC_EN,
+        .dir_pin = CONFIG_GPIO_DEC_DIR,
+        .reverse = CONFIG_DEC_REVERSE,
+        .channel = {
+            .channel = LEDC_CHANNEL_1,
+            .timer_sel = LEDC_TIMER_1,
+            .duty = 0,
+            .gpio_num = CONFIG_GPIO_DEC_PUL,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+        },
+        .timer = {
+            .freq_hz = 1000, // set from the mount geometry on start
+            .duty_resolution = DUTY_RES,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+            .timer_num = LEDC_TIMER_1
+        },
+        .min_speed = DEC_SPEED_MIN,
+        .max_speed = DEC_SPEED_MAX,
+        .millihz_per_speed_q24 = &mount_constants.dec_millihz_per_speed_q24,
+    },
+#ifdef CONFIG_FOCUSER_ENABLED
+    {
+        .name = "FOCUSER",
+        .lash_pulses = &focuser_lash_pulses,
+        .en_pin = CONFIG_GPIO_FOCUSER_EN,
+        .dir_pin = CONFIG_GPIO_FOCUSER_DIR,
+        .reverse = CONFIG_FOCUSER_REVERSE,
+        .channel = {
+            .channel = LEDC_CHANNEL_2,
+            .timer_sel = LEDC_TIMER_2,
+            .duty = 0,
+            .gpio_num = CONFIG_GPIO_FOCUSER_PUL,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+        },
+        .timer = {
+            .freq_hz = CONFIG_FOCUSER_STEP_RATE,
+            .duty_resolution = DUTY_RES,
+            .speed_mode = LEDC_HIGH_SPEED_MODE,
+            .timer_num = LEDC_TIMER_2
+        },
+        .min_speed = 1000,
+        .max_speed = CONFIG_FOCUSER_STEP_RATE * 1000,
+        .millihz_per_speed_q24 = &focuser_millihz_per_speed_q24,
+    },
+#endif
+};
+
+void init_axes() {
+    for (int i = 0; i < AXES; i ++) {
+        axis_t* axis = &mount_axes[i];
+        gpio_pad_select_gpio(axis->dir_pin);
+        gpio_set_direction(axis->dir_pin, GPIO_MODE_OUTPUT);
+        gpio_set_level(axis->dir_pin, 1);
+
+        gpio_pad_select_gpio(axis->en_pin);
+        gpio_set_direction(axis->en_pin, GPIO_MODE_OUTPUT);
+        gpio_set_level(axis->en_pin, 1);
+    }
+}
+
+static axis_t* get_encoder_axis(rencoder_t* encoder) {
+    return (axis_t*)((char*)encoder - offsetof(axis_t, encoder));
+}
+
+/* a reversal first has to cross the gear lash before the axis moves */
+static void encoder_dir_callback(rencoder_t* target, bool dir, void* args) {
+    axis_t* axis = get_encoder_axis(target);
+    if (dir) {//to positive
+        if (axis->is_clearing_backlash == 1) { 
+            //already clearing positive clearing, do nothing
+        } else if (axis->is_clearing_backlash == -1) { //negative clearing
+            //covert to positive clearing
+            axis->is_clearing_backlash = 1;
+            axis->backlash_pulses = axis->backlash_pulses - *axis->lash_pulses; //expected_pulses_after_negative_clearing
+        } else { //not clearing
+            axis->is_clearing_backlash = 1;
+            axis->backlash_pulses = rencoder_value(target);
+        }
+    } else { //to negative
+        if (axis->is_clearing_backlash == 1) { 
+            axis->is_clearing_backlash = -1;
+            axis->backlash_pulses = axis->backlash_pulses + *axis->lash_pulses; //expected_pulses_after_positive_clearing
+        } else if (axis->is_clearing_backlash == -1) { //negative clearing
+            
+        } else { //not clearing
+            axis->is_clearing_backlash = -1;
+            axis->backlash_pulses = rencoder_value(target);
+        }
+    }
+}
+
+static void encoder_pul_callback(rencoder_t* target, int32_t pul, int8_t diff, void* args) {
+    axis_t* axis = get_encoder_axis(target);
+    CAPTURE_ENCODER(axis->channel.channel, diff, pul);
+    int32_t lash = *axis->lash_pulses;
+    if (axis->is_clearing_backlash == 1) {
+        if (pul >= axis->backlash_pulses + lash) {//clearing finished
+            int32_t diff_after_clear = pul - axis->backlash_pulses - lash;
+            axis->is_clearing_backlash = false;
+            axis->actual_pulses += diff_after_clear;
+        }
+    } else if (axis->is_clearing_backlash == -1) {
+        if (pul <= axis->backlash_pulses - lash) {//clearing finished
+            int32_t diff_after_clear = pul - axis->backlash_pulses + lash;
+            axis->is_clearing_backlash = false;
+            axis->actual_pulses += diff_after_clear;
+        }
+    } else {
+        axis->actual_pulses += diff;
+    }
+}
+
+esp_err_t axis_start_encoder(axis_t* axis, gpio_num_t a, gpio_num_t b, bool reverse) {
+    axis->is_clearing_backlash = false;
+    axis->actual_pulses = 0;
+    return rencoder_start(&axis->encoder, a, b, encoder_pul_callback, encoder_dir_callback, reverse);
+}
+
+void axis_start_motor(axis_t* axis) {
+    axis->timer.freq_hz = axis_get_step_freq(axis, SPEED_PER_CYCLE);
+    ledc_channel_config(&axis->channel);
+    ledc_timer_config(&axis->timer);
+}
+
+int32_t axis_get_step_millihz(const axis_t* axis, int32_t speed) {
+    return (int32_t)(((int64_t)speed * *axis->millihz_per_speed_q24) >> 24);
+}
+
+int axis_get_step_freq(const axis_t* axis, int32_t speed) {
+    int32_t absSpeed = speed < 0 ? -speed : speed;
+    if (absSpeed < axis->min_speed) return 0;
+    if (absSpeed > axis->max_speed) absSpeed = axis->max_speed;
+    int freq = axis_get_step_millihz(axis, absSpeed) / 1000;
+    return speed < 0 ? -freq : freq;
+}
+
+static void apply_step_rate(axis_t* axis, int32_t speed) {
+    int freq = axis_get_step_freq(axis, speed);
+    gpio_set_level(axis->dir_pin, (speed < 0) == axis->reverse ? 1 : 0);
+    if (freq == 0) {
+        ledc_set_duty(LEDC_HIGH_SPEED_MODE, axis->channel.channel, 0);
+        ledc_update_duty(LEDC_HIGH_SPEED_MODE, axis->channel.channel);
+        gpio_set_level(axis->en_pin, 1);
+    } else {
+        ledc_set_freq(LEDC_HIGH_SPEED_MODE, axis->timer.timer_num, freq < 0 ? -freq : freq);
+        ledc_set_duty(LEDC_HIGH_SPEED_MODE, axis->channel.channel, DUTY);        
+        ledc_update_duty(LEDC_HIGH_SPEED_MODE, axis->channel.channel);
+        gpio_set_level(axis->en_pin, 0);
+    }
+}
+
+/*
+ * The motion task and the guide and backlash timers on the other core all
+ * set rates. Only the request is taken under the lock; whoever finds a newer
+ * one after driving the pins drives them again, so the latest rate stays.
+ */
+static portMUX_TYPE rate_mux = portMUX_INITIALIZER_UNLOCKED;
+
+int axis_set_step_rate(axis_t* axis, int32_t speed) {
+    int freq = axis_get_step_freq(axis, speed);
+    // on every rate change, a LOGI here would hold the motors for the UART
+    TRACE(TRACE_AXIS_RATE, axis->channel.channel, freq);
+    CAPTURE_RATE(axis->channel.channel, freq);
+    portENTER_CRITICAL(&rate_mux);
+    axis->step_speed = speed;
+    uint32_t request = ++axis->rate_requests;
+    portEXIT_CRITICAL(&rate_mux);
+    for (;;) {
+        apply_step_rate(axis, speed);
+        portENTER_CRITICAL(&rate_mux);
+        bool latest = axis->rate_requests == request;
+        speed = axis->step_speed;
+        request = axis->rate_requests;
+        portEXIT_CRITICAL(&rate_mux);
+        if (latest) break;
+    }
+    return freq;
+}
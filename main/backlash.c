@@ -0,0 +1,117 @@
+#include "esp_timer.h"
+#include "backlash.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+#include "util.h"
+
+#define TAG "BACKLASH"
+
+/* 8x sidereal, the dead band of a few dozen pulses is crossed well within a window */
+#define CALIBRATION_SPEED (8 * SPEED_PER_CYCLE)
+#define WINDOW_MICROS (3 * 1000000)
+#define REVERSALS 6
+/* the encoder is read against a truncated commanded count, it may seem ahead by this much */
+#define JITTER_PULSES 2
+
+/*
+ * The axis is driven back and forth in windows of equal length. The first
+ * window only preloads the gears, after every reversal the motion commanded
+ * to the motor is compared with what the encoder saw: the difference is what
+ * the gear lash swallowed. The result is the mean over all reversals.
+ */
+static backlash_drive_callback drive_callback;
+static backlash_finished_callback finished_callback;
+static esp_timer_handle_t timer;
+static volatile bool calibrating = false;
+static uint8_t calibrating_axis;
+static int reversal;
+static int sign;
+static int step_rate;
+static int64_t window_start;
+static int32_t window_start_pulses;
+static int32_t lash_sum;
+
+static int32_t get_raw_pulses() {
+    return calibrating_axis == BACKLASH_AXIS_RA ? get_ra_pulses_raw() : get_dec_pulses_raw();
+}
+
+static void start_window(int64_t now) {
+    step_rate = drive_callback(calibrating_axis, sign * CALIBRATION_SPEED);
+    window_start = now;
+    window_start_pulses = get_raw_pulses();
+    esp_timer_start_once(timer, WINDOW_MICROS);
+}
+
+static void finish(int32_t pulses) {
+    calibrating = false;
+    drive_callback(calibrating_axis, 0);
+    finished_callback(calibrating_axis, pulses);
+}
+
+static void backlash_timer_callback(void* args) {
+    if (!calibrating) return;
+    int64_t now = esp_timer_get_time();
+    if (reversal > 0) {
+        uint32_t geometry[GEOMETRY_FIELDS];
+        get_mount_geometry(geometry);
+        int offset = calibrating_axis == BACKLASH_AXIS_RA ? GEOMETRY_RA_GEAR_RATIO : GEOMETRY_DEC_GEAR_RATIO;
+        int64_t steps_per_encoder_cycle = (int64_t)geometry[offset + GEOMETRY_RA_CYCLE_STEPS] * geometry[offset + GEOMETRY_RA_RESOLUTION];
+        int64_t steps = (int64_t)(step_rate < 0 ? -step_rate : step_rate) * (now - window_start) / 1000000;
+        int32_t commanded = (int32_t)(steps * geometry[offset + GEOMETRY_RA_ENCODER_PULSES] / steps_per_encoder_cycle);
+        int32_t seen = get_raw_pulses() - window_start_pulses;
+        if (seen < 0) seen = -seen;
+        int32_t lash = commanded - seen;
+        LOGI(TAG, "reversal %d: commanded %d, seen %d, lash %d", reversal, commanded, seen, lash);
+        if (lash < -JITTER_PULSES || seen == 0) {
+            // the encoder ran ahead of the motor or did not move at all, nothing to trust
+            LOGE(TAG, "calibration failed on reversal %d", reversal);
+            finish(-1);
+            return;
+        }
+        if (lash < 0) lash = 0;
+        lash_sum += lash;
+    }
+    if (reversal == REVERSALS) {
+        int32_t pulses = (lash_sum + REVERSALS / 2) / REVERSALS;
+        LOGI(TAG, "axis %d backlash %d pulses", calibrating_axis, pulses);
+        finish(pulses);
+        return;
+    }
+    reversal ++;
+    sign = -sign;
+    start_window(now);
+}
+
+esp_err_t init_backlash(backlash_drive_callback drive, backlash_finished_callback finished) {
+    drive_callback = drive;
+    finished_callback = finished;
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = backlash_timer_callback
+    };
+    return esp_timer_create(&args, &timer);
+}
+
+esp_err_t start_backlash_calibration(uint8_t axis) {
+    if (calibrating) return ESP_ERR_INVALID_STATE;
+    if (axis != BACKLASH_AXIS_RA && axis != BACKLASH_AXIS_DEC) return ESP_ERR_INVALID_ARG;
+    calibrating = true;
+    calibrating_axis = axis;
+    reversal = 0;
+    sign = 1;
+    lash_sum = 0;
+    LOGI(TAG, "calibrating axis %d", axis);
+    start_window(esp_timer_get_time());
+    return ESP_OK;
+}
+
+void abort_backlash_calibration() {
+    if (!calibrating) return;
+    esp_timer_stop(timer);
+    LOGI(TAG, "calibration aborted");
+    finish(-1);
+}
+
+bool is_calibrating_backlash() {
+    return calibrating;
+}
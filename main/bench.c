@@ -0,0 +1,87 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_BENCHMARK
+#include "esp_timer.h"
+#include "bench.h"
+#include "perf.h"
+#include "astro.h"
+#include "axis.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+#include "slew.h"
+#include "telescope.h"
+#include "util.h"
+
+#define TAG "BENCH"
+
+#define INPUTS 256
+#define ITERATIONS 4096
+/* the fastest of a few runs, the others caught an interrupt or the other task */
+#define RUNS 5
+
+static int32_t angles[INPUTS], decMecs[INPUTS], speeds[INPUTS];
+static volatile int32_t sink;
+static volatile double sinkDouble;
+
+/* fixed inputs, every unit sees the same numbers */
+static uint32_t lcg(uint32_t* state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+static void fill_inputs() {
+    uint32_t state = 1;
+    for (int i = 0; i < INPUTS; i ++) {
+        // RA mostly in range, an eighth a day or two off like an unwrapped sum
+        int32_t turns = (lcg(&state) & 7) == 0 ? (int32_t)(lcg(&state) % 5) - 2 : 0;
+        angles[i] = lcg(&state) % DAY_MILLIS + turns * DAY_MILLIS;
+        // mechanical dec spans both sides of the pier, -90 to 270 degrees
+        decMecs[i] = (int32_t)(lcg(&state) % DAY_MILLIS) - DAY_MILLIS / 4;
+        // tracking and guiding around sidereal, some slews
+        speeds[i] = (lcg(&state) & 3) == 0 ? (int32_t)(lcg(&state) % (32 * SPEED_PER_CYCLE)) - 16 * SPEED_PER_CYCLE
+            : SPEED_PER_CYCLE + (int32_t)(lcg(&state) % SPEED_PER_CYCLE) - SPEED_PER_CYCLE / 2;
+    }
+}
+
+/* cycles of the loop itself, indexing and the volatile store, taken off every other result */
+static uint32_t baseline;
+
+static void report(const char* name, uint32_t cycles) {
+    cycles = cycles > baseline ? cycles - baseline : 0;
+    uint32_t perOp = (cycles + ITERATIONS / 2) / ITERATIONS;
+    LOGI(TAG, "%-24s %6u cycles/op %6u ns/op", name, perOp, perOp * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+#define BENCH_BEST(best, body) do {                             \
+    best = UINT32_MAX;                                          \
+    for (int run = 0; run < RUNS; run ++) {                     \
+        uint32_t start = perf_ccount();                         \
+        for (int n = 0; n < ITERATIONS; n ++) {                 \
+            int i = n % INPUTS;                                 \
+            (void)i; /* the angle getters take no input */      \
+            body;                                               \
+        }                                                       \
+        uint32_t cycles = perf_ccount() - start;                \
+        if (cycles < best) best = cycles;                       \
+    }                                                           \
+} while (0)
+
+#define BENCH(name, body) do {                                  \
+    uint32_t best;                                              \
+    BENCH_BEST(best, body);                                     \
+    report(name, best);                                         \
+} while (0)
+
+void run_benchmarks() {
+    fill_inputs();
+    BENCH_BEST(baseline, sink = angles[i]);
+    LOGI(TAG, "loop overhead of %u cycles/op taken off", (baseline + ITERATIONS / 2) / ITERATIONS);
+    BENCH("get_ra_angle_millis", sink = get_ra_angle_millis());
+    BENCH("get_dec_angle_millis", sink = get_dec_angle_millis());
+    BENCH("decMecMillis2decMillis", sink = decMecMillis2decMillis(decMecs[i], NULL));
+    BENCH("getRaDiff", sink = getRaDiff(angles[i], angles[(i + 1) % INPUTS]));
+    BENCH("get_hour_angle_millis", sink = get_hour_angle_millis(angles[i]));
+    BENCH("RA_PULSES_MILLIS", sink = RA_PULSES_MILLIS(angles[i]));
+    BENCH("axis_get_step_freq", sink = axis_get_step_freq(&mount_axes[AXIS_RA], speeds[i]));
+    BENCH("dist", sinkDouble = dist(angles[i], decMecs[i]));
+}
+#endif
@@ -0,0 +1,119 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_CAPTURE
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "string.h"
+#include "capture.h"
+#include "util.h"
+
+#define TAG "CAPTURE"
+
+#define RING_BYTES (CONFIG_CAPTURE_RING_KB * 1024)
+
+/* offsets count every byte ever written, the ring keeps whole records from tail to head */
+static portMUX_TYPE capture_mux = portMUX_INITIALIZER_UNLOCKED;
+#ifdef CONFIG_STATIC_ALLOCATION
+static uint8_t ring_storage[RING_BYTES];
+static uint8_t* ring = ring_storage;
+#else
+static uint8_t* ring;
+#endif
+static uint32_t head, tail;
+static volatile uint8_t mode = CAPTURE_OFF;
+
+/* a memcpy up to the end of the ring, a second one only for what wraps to its start */
+static void IRAM_ATTR put(const void* data, uint32_t len) {
+    uint32_t at = head % RING_BYTES;
+    uint32_t first = len < RING_BYTES - at ? len : RING_BYTES - at;
+    memcpy(ring + at, data, first);
+    memcpy(ring, (const uint8_t*)data + first, len - first);
+    head += len;
+}
+
+static uint32_t IRAM_ATTR record_size_at(uint32_t offset) {
+    return CAPTURE_HEADER_SIZE + (ring[(offset + 1) % RING_BYTES] | ring[(offset + 2) % RING_BYTES] << 8);
+}
+
+/* called from the encoder isr as well */
+static void IRAM_ATTR write_record(uint8_t type, const void* payload, uint32_t len) {
+    if (mode == CAPTURE_OFF) return;
+    uint32_t size = CAPTURE_HEADER_SIZE + len;
+    // could never be kept, nor described by the header
+    if (size > RING_BYTES || len > UINT16_MAX) return;
+    uint8_t header[CAPTURE_HEADER_SIZE] = { type, (uint8_t)len, (uint8_t)(len >> 8) };
+    uint32_t time = (uint32_t)esp_timer_get_time();
+    memcpy(header + 3, &time, sizeof(time));
+    portENTER_CRITICAL(&capture_mux);
+    while (head + size - tail > RING_BYTES) {
+        tail += record_size_at(tail);
+    }
+    put(header, CAPTURE_HEADER_SIZE);
+    put(payload, len);
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+esp_err_t start_capture(uint8_t newMode, const void* snapshot, uint8_t len) {
+    if (newMode == CAPTURE_OFF) {
+        stop_capture();
+        return ESP_OK;
+    }
+    if (!ring) {
+        // PSRAM when the board has it, the internal heap otherwise
+        ring = heap_caps_malloc(RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!ring) ring = heap_caps_malloc(RING_BYTES, MALLOC_CAP_8BIT);
+        if (!ring) {
+            LOGE(TAG, "no memory for a %d byte ring", RING_BYTES);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    portENTER_CRITICAL(&capture_mux);
+    head = 0;
+    tail = 0;
+    mode = newMode;
+    portEXIT_CRITICAL(&capture_mux);
+    write_record(CAPTURE_RECORD_START, snapshot, len);
+    LOGI(TAG, "capturing, mode %d", newMode);
+    return ESP_OK;
+}
+
+void stop_capture() {
+    mode = CAPTURE_OFF;
+}
+
+uint8_t get_capture_mode() {
+    return mode;
+}
+
+int capture_read(uint32_t* from, uint32_t* headOut, uint8_t* out, int max) {
+    if (!ring) {
+        *headOut = 0;
+        return 0;
+    }
+    portENTER_CRITICAL(&capture_mux);
+    if ((int32_t)(*from - tail) < 0 || (int32_t)(head - *from) < 0) *from = tail;
+    int count = head - *from;
+    if (count > max) count = max;
+    for (int i = 0; i < count; i ++) {
+        out[i] = ring[(*from + i) % RING_BYTES];
+    }
+    *headOut = head;
+    portEXIT_CRITICAL(&capture_mux);
+    return count;
+}
+
+void IRAM_ATTR capture_encoder(uint8_t channel, int8_t diff, int32_t pulses) {
+    uint8_t payload[6] = { channel, (uint8_t)diff };
+    memcpy(payload + 2, &pulses, sizeof(pulses));
+    write_record(CAPTURE_RECORD_ENCODER, payload, sizeof(payload));
+}
+
+void capture_command(const char* buf, size_t len) {
+    write_record(CAPTURE_RECORD_COMMAND, buf, len);
+}
+
+void capture_rate(uint8_t channel, int32_t freq) {
+    uint8_t payload[5] = { channel };
+    memcpy(payload + 1, &freq, sizeof(freq));
+    write_record(CAPTURE_RECORD_RATE, payload, sizeof(payload));
+}
+#endif
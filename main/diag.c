@@ -0,0 +1,98 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_DIAGNOSTICS
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "string.h"
+#include "diag.h"
+#include "util.h"
+
+#define TAG "DIAG"
+
+#define SAMPLE_MICROS (1000 * 1000)
+/* room for the tasks IDF and lwip start on top of ours */
+#define MAX_SAMPLED_TASKS 32
+
+static portMUX_TYPE diag_mux = portMUX_INITIALIZER_UNLOCKED;
+static diag_stats_t stats;
+static esp_timer_handle_t sample_timer;
+/* too big for the stack of the timer task */
+static TaskStatus_t task_status[MAX_SAMPLED_TASKS];
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t last_total, last_idle[portNUM_PROCESSORS];
+#endif
+
+static void sample_cpu_load(UBaseType_t count, uint32_t total, uint8_t* load) {
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint32_t elapsed = total - last_total;
+    last_total = total;
+    for (int core = 0; core < portNUM_PROCESSORS; core ++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        for (UBaseType_t i = 0; i < count; i ++) {
+            if (task_status[i].xHandle != idle) continue;
+            uint32_t idled = task_status[i].ulRunTimeCounter - last_idle[core];
+            last_idle[core] = task_status[i].ulRunTimeCounter;
+            // the counter runs on both cores, so each idle task can reach elapsed
+            load[core] = elapsed && idled < elapsed ? 100 - (uint64_t)idled * 100 / elapsed : 0;
+        }
+    }
+#else
+    memset(load, DIAG_CPU_LOAD_UNKNOWN, portNUM_PROCESSORS);
+#endif
+}
+
+static void sample_timer_callback(void* args) {
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(task_status, MAX_SAMPLED_TASKS, &total);
+    diag_stats_t sample = {
+        .free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        .min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        .largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+        .free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+    };
+    sample_cpu_load(count, total, sample.cpu_load);
+    sample.task_count = count < DIAG_MAX_TASKS ? count : DIAG_MAX_TASKS;
+    for (int i = 0; i < sample.task_count; i ++) {
+        diag_task_t* task = &sample.tasks[i];
+        strncpy(task->name, task_status[i].pcTaskName, DIAG_TASK_NAME_LEN - 1);
+        task->stack_free = task_status[i].usStackHighWaterMark;
+        task->core = task_status[i].xCoreID == tskNO_AFFINITY ? DIAG_CORE_ANY : task_status[i].xCoreID;
+        task->priority = task_status[i].uxCurrentPriority;
+    }
+    portENTER_CRITICAL(&diag_mux);
+    memcpy(&stats, &sample, sizeof(diag_stats_t));
+    portEXIT_CRITICAL(&diag_mux);
+}
+
+esp_err_t init_diag() {
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = sample_timer_callback
+    };
+    esp_err_t err = esp_timer_create(&args, &sample_timer);
+    if (err != ESP_OK) return err;
+    sample_timer_callback(NULL);
+    LOGI(TAG, "sampling %d tasks", stats.task_count);
+    return esp_timer_start_periodic(sample_timer, SAMPLE_MICROS);
+}
+
+void get_diag_stats(diag_stats_t* out) {
+    portENTER_CRITICAL(&diag_mux);
+    memcpy(out, &stats, sizeof(diag_stats_t));
+    portEXIT_CRITICAL(&diag_mux);
+}
+
+void get_diag_summary(uint16_t* min_stack_free, uint8_t* max_cpu_load) {
+    uint32_t stack = DIAG_STACK_FREE_UNKNOWN;
+    uint8_t load = 0;
+    portENTER_CRITICAL(&diag_mux);
+    for (int i = 0; i < stats.task_count; i ++) {
+        if (stats.tasks[i].stack_free < stack) stack = stats.tasks[i].stack_free;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core ++) {
+        if (stats.cpu_load[core] > load) load = stats.cpu_load[core];
+    }
+    portEXIT_CRITICAL(&diag_mux);
+    *min_stack_free = stack;
+    *max_cpu_load = load;
+}
+#endif
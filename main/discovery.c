@@ -0,0 +1,73 @@
+#include <ctype.h>
+#include <stdio.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "discovery.h"
+#include "axis.h"
+#include "protocol.h"
+#include "util.h"
+
+#ifdef CONFIG_SERVER_MDNS
+#include "mdns.h"
+#endif
+
+#define TAG "DISCOVERY"
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+#ifdef CONFIG_SERVER_MDNS
+/* the axes this build drives, lower case and comma separated: ra,dec[,focuser] */
+static void get_axes_txt(char* out, size_t size) {
+    size_t len = 0;
+    out[0] = 0;
+    for (int i = 0; i < AXES; i ++) {
+        if (i && len + 1 < size) out[len ++] = ',';
+        for (const char* c = mount_axes[i].name; *c && len + 1 < size; c ++) {
+            out[len ++] = tolower((unsigned char)*c);
+        }
+        out[len] = 0;
+    }
+}
+#endif
+
+/*
+ * The command service is advertised once through mDNS/DNS-SD, afterwards the
+ * responder only answers queries. TXT records tell the client everything it
+ * used to learn from the broadcast sweep.
+ */
+esp_err_t init_discovery(uint16_t commandPort, uint16_t statusPort) {
+#ifdef CONFIG_SERVER_MDNS
+    static char statusPortStr[6];
+    static char axesStr[32];
+    sprintf(statusPortStr, "%d", statusPort);
+    get_axes_txt(axesStr, sizeof(axesStr));
+    mdns_txt_item_t txt[] = {
+        { "proto", STR(PROTOCOL_VERSION) },
+        { "axes", axesStr },
+        { "status", statusPortStr },
+    };
+    esp_err_t err = mdns_init();
+    if (err != ESP_OK) {
+        LOGE(TAG, "mdns init failed: %d", err);
+        return err;
+    }
+    mdns_hostname_set(CONFIG_SERVER_MDNS_HOSTNAME);
+    mdns_instance_name_set("ESP32 Telescope Controller");
+    err = mdns_service_add(NULL, DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, commandPort, txt, LEN(txt));
+    if (err != ESP_OK) {
+        LOGE(TAG, "mdns service add failed: %d", err);
+        return err;
+    }
+    LOGI(TAG, "advertising %s.%s on %d", DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, commandPort);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t discovery_handle_system_event(void *ctx, system_event_t *event) {
+#ifdef CONFIG_SERVER_MDNS
+    return mdns_handle_system_event(ctx, event);
+#else
+    return ESP_OK;
+#endif
+}
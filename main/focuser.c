@@ -0,0 +1,255 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_FOCUSER_ENABLED
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "focuser.h"
+#include "axis.h"
+#include "util.h"
+
+#define TAG "FOCUSER"
+
+#ifndef CONFIG_FOCUSER_REVERSE_RENCODER
+#define CONFIG_FOCUSER_REVERSE_RENCODER false
+#endif
+
+/* the axis speed unit is mHz for the focuser */
+#define STEP_SPEED (CONFIG_FOCUSER_STEP_RATE * 1000)
+/* closed loop corrections after a move when the encoder disagrees */
+#define MAX_CORRECTIONS 2
+#define TEMP_COMP_INTERVAL_MICROS (10 * 1000000)
+
+/* set up and started with the mount axes */
+static axis_t* const focuser_axis = &mount_axes[AXIS_FOCUSER];
+
+/*
+ * Without an encoder the position is dead reckoned from the step rate the
+ * LEDC timer really runs at and the time it ran. A move is one or two legs:
+ * inward moves overshoot by the backlash and finish outward.
+ *
+ * Commands change the state from the command task, the end of a leg and the
+ * temperature compensation from the esp_timer task; each takes focuser_lock
+ * for all it does, focuser_mux only keeps the position readable anywhere.
+ */
+static SemaphoreHandle_t focuser_lock;
+#ifdef CONFIG_STATIC_ALLOCATION
+static StaticSemaphore_t focuser_lock_buffer;
+#endif
+static portMUX_TYPE focuser_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t move_timer, temp_timer;
+static focuser_temperature_callback temperature_callback;
+static int32_t position; //at leg_start, in steps
+#ifdef CONFIG_FOCUSER_ENCODER
+static int32_t encoder_offset; //position minus the encoder count in steps
+#endif
+static int32_t target;
+static int32_t leg_target;
+static int leg_freq; //signed, 0 when standing
+static int64_t leg_start;
+static int64_t leg_end; //when the move timer is due, it may fire late for a leg started since
+static int corrections;
+static int32_t temperature = FOCUSER_TEMPERATURE_UNKNOWN;
+static int32_t temp_coefficient;
+static int32_t temp_reference, temp_reference_position;
+
+static int32_t get_position_at(int64_t now) {
+#ifdef CONFIG_FOCUSER_ENCODER
+    return encoder_offset + focuser_axis->actual_pulses * CONFIG_FOCUSER_STEPS_PER_PULSE;
+#else
+    return position + (int32_t)((int64_t)leg_freq * (now - leg_start) / 1000000);
+#endif
+}
+
+static void start_leg(int32_t to) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&focuser_mux);
+    position = get_position_at(now);
+    int32_t steps = to - position;
+    portEXIT_CRITICAL(&focuser_mux);
+    leg_target = to;
+    if (steps == 0) {
+        leg_end = esp_timer_get_time();
+        esp_timer_start_once(move_timer, 0);
+        return;
+    }
+    int freq = axis_set_step_rate(focuser_axis, steps < 0 ? -STEP_SPEED : STEP_SPEED);
+    now = esp_timer_get_time();
+    portENTER_CRITICAL(&focuser_mux);
+    leg_freq = freq;
+    leg_start = now;
+    portEXIT_CRITICAL(&focuser_mux);
+    int64_t duration = (int64_t)(steps < 0 ? -steps : steps) * 1000000 / (freq < 0 ? -freq : freq);
+    leg_end = now + duration;
+    esp_timer_start_once(move_timer, duration);
+}
+
+static void stop_motor() {
+    axis_set_step_rate(focuser_axis, 0);
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&focuser_mux);
+    position = get_position_at(now);
+    leg_freq = 0;
+    leg_start = now;
+    portEXIT_CRITICAL(&focuser_mux);
+}
+
+static void end_leg() {
+    stop_motor();
+#ifndef CONFIG_FOCUSER_ENCODER
+    //dead reckoning is off by the timer latency at most, the leg did what was asked
+    position = leg_target;
+#endif
+    if (leg_target != target) {
+        start_leg(target);
+        return;
+    }
+    if (position != target && corrections < MAX_CORRECTIONS) {
+        corrections ++;
+        LOGI(TAG, "correcting %d steps", target - position);
+        start_leg(target < position ? target - CONFIG_FOCUSER_BACKLASH_STEPS : target);
+        return;
+    }
+    LOGI(TAG, "at %d, target %d", position, target);
+}
+
+static void move_timer_callback(void* args) {
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    // not for a leg a command started while this waited for the lock
+    if (esp_timer_get_time() >= leg_end) end_leg();
+    xSemaphoreGive(focuser_lock);
+}
+
+static void move_to(int32_t to) {
+    esp_timer_stop(move_timer);
+    int32_t current = get_position_at(esp_timer_get_time());
+    target = to;
+    corrections = 0;
+    temp_reference = FOCUSER_TEMPERATURE_UNKNOWN;
+    int32_t first = to;
+    if (to < current && CONFIG_FOCUSER_BACKLASH_STEPS > 0) {
+        first = to - CONFIG_FOCUSER_BACKLASH_STEPS;
+        if (first < 0) first = 0;
+    }
+    LOGI(TAG, "move from %d to %d via %d", current, to, first);
+    start_leg(first);
+}
+
+static void compensate_temperature() {
+    if (!temp_coefficient || temperature == FOCUSER_TEMPERATURE_UNKNOWN || is_focuser_moving()) return;
+    if (temp_reference == FOCUSER_TEMPERATURE_UNKNOWN) {
+        temp_reference = temperature;
+        temp_reference_position = target;
+        return;
+    }
+    int32_t compensated = temp_reference_position + (int32_t)((int64_t)(temperature - temp_reference) * temp_coefficient / 1000000);
+    if (compensated < 0 || compensated > CONFIG_FOCUSER_MAX_POSITION || compensated == target) return;
+    LOGI(TAG, "temperature %d mC, compensating to %d", temperature, compensated);
+    int32_t reference = temp_reference, referencePosition = temp_reference_position;
+    move_to(compensated);
+    // a compensation move keeps the reference
+    temp_reference = reference;
+    temp_reference_position = referencePosition;
+}
+
+static void temp_timer_callback(void* args) {
+    if (temperature_callback) {
+        int32_t reading = temperature_callback();
+        if (reading != FOCUSER_TEMPERATURE_UNKNOWN) temperature = reading;
+    }
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    compensate_temperature();
+    xSemaphoreGive(focuser_lock);
+}
+
+esp_err_t init_focuser(focuser_temperature_callback temperature) {
+    temperature_callback = temperature;
+    temp_reference = FOCUSER_TEMPERATURE_UNKNOWN;
+#ifdef CONFIG_STATIC_ALLOCATION
+    focuser_lock = xSemaphoreCreateMutexStatic(&focuser_lock_buffer);
+#else
+    focuser_lock = xSemaphoreCreateMutex();
+    if (!focuser_lock) return ESP_ERR_NO_MEM;
+#endif
+    esp_err_t err;
+#ifdef CONFIG_FOCUSER_ENCODER
+    err = axis_start_encoder(focuser_axis, CONFIG_GPIO_FOCUSER_RENCODER_A, CONFIG_GPIO_FOCUSER_RENCODER_B, CONFIG_FOCUSER_REVERSE_RENCODER);
+    if (err != ESP_OK) return err;
+#endif
+    esp_timer_create_args_t moveArgs = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = move_timer_callback
+    };
+    err = esp_timer_create(&moveArgs, &move_timer);
+    if (err != ESP_OK) return err;
+    esp_timer_create_args_t tempArgs = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = temp_timer_callback
+    };
+    err = esp_timer_create(&tempArgs, &temp_timer);
+    if (err != ESP_OK) return err;
+    return esp_timer_start_periodic(temp_timer, TEMP_COMP_INTERVAL_MICROS);
+}
+
+esp_err_t focuser_move_to(int32_t to) {
+    if (to < 0 || to > CONFIG_FOCUSER_MAX_POSITION) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    move_to(to);
+    xSemaphoreGive(focuser_lock);
+    return ESP_OK;
+}
+
+void focuser_halt() {
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    esp_timer_stop(move_timer);
+    stop_motor();
+    target = position;
+    leg_target = position;
+    temp_reference = FOCUSER_TEMPERATURE_UNKNOWN;
+    LOGI(TAG, "halted at %d", position);
+    xSemaphoreGive(focuser_lock);
+}
+
+esp_err_t focuser_sync(int32_t to) {
+    if (to < 0 || to > CONFIG_FOCUSER_MAX_POSITION) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    if (is_focuser_moving()) {
+        xSemaphoreGive(focuser_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&focuser_mux);
+#ifdef CONFIG_FOCUSER_ENCODER
+    encoder_offset = to - focuser_axis->actual_pulses * CONFIG_FOCUSER_STEPS_PER_PULSE;
+#endif
+    position = to;
+    target = to;
+    leg_target = to;
+    portEXIT_CRITICAL(&focuser_mux);
+    temp_reference = FOCUSER_TEMPERATURE_UNKNOWN;
+    xSemaphoreGive(focuser_lock);
+    return ESP_OK;
+}
+
+void focuser_set_temp_coefficient(int32_t milli_steps_per_degree) {
+    xSemaphoreTake(focuser_lock, portMAX_DELAY);
+    temp_coefficient = milli_steps_per_degree;
+    temp_reference = FOCUSER_TEMPERATURE_UNKNOWN;
+    xSemaphoreGive(focuser_lock);
+}
+
+void focuser_set_temperature(int32_t milli_celsius) {
+    temperature = milli_celsius;
+}
+
+bool is_focuser_moving() {
+    return leg_freq != 0 || leg_target != target;
+}
+
+void get_focuser_state(focuser_state_t* state) {
+    portENTER_CRITICAL(&focuser_mux);
+    state->position = get_position_at(esp_timer_get_time());
+    portEXIT_CRITICAL(&focuser_mux);
+    state->target = target;
+    state->temperature = temperature;
+    state->temp_coefficient = temp_coefficient;
+    state->moving = is_focuser_moving();
+}
+#endif
@@ -0,0 +1,277 @@
+#include "esp_timer.h"
+#include "guide.h"
+#include "util.h"
+#include "trace.h"
+
+#define TAG "GUIDE"
+
+/* guide corrections are book-kept in 1/1000 microsteps */
+#define MILLISTEPS 1000
+/* never carry more than this over to the next pulse */
+#define MAX_RESIDUAL_MILLISTEPS (16 * MILLISTEPS)
+/* the lash is crossed at this multiple of the guide rate */
+#define BURST_MULTIPLIER 8
+
+/*
+ * A pulse of t ms at guide rate r is a correction of exactly r * t microsteps.
+ * The correction is injected into the step generator of the affected axis
+ * only, and the injection is held for owed / (actually applied rate delta),
+ * so the LEDC frequency quantization does not bias the correction. When the
+ * injection ends, the steps really delivered are measured against the clock
+ * and the residual (timer latency) is carried over to the next pulse.
+ *
+ * Every axis owns its own timer so that a RA and a Dec correction can run at
+ * the same time. A pulse arriving on an axis that is already guiding is
+ * coalesced into the running one: the same direction extends it, the
+ * opposite direction cancels out against the steps still owed.
+ *
+ * A correction opposite to the previous one on an axis whose motor stands
+ * still between pulses reverses the motor, and the first steps would only
+ * cross the gear lash. Those steps are added to the correction and injected
+ * first, at BURST_MULTIPLIER times the guide rate.
+ */
+typedef struct {
+    uint8_t dir;
+    int8_t last_sign;      //direction of the last correction, 0 before the first one
+    int64_t owed;          //signed millisteps still to deliver, as of segment_start
+    int64_t lash;          //millisteps of the owed ones that only cross the gear lash
+    int rate;              //signed step rate in Hz currently injected
+    int8_t multiplier;     //of the guide rate, BURST_MULTIPLIER while crossing the lash
+    int64_t segment_start;
+    int64_t deadline;
+    esp_timer_handle_t timer;
+} guide_axis_t;
+
+static guide_get_step_rate_callback get_rate_callback;
+static guide_apply_step_rate_callback apply_rate_callback;
+static guide_get_backlash_steps_callback get_backlash_callback;
+static guide_finished_callback finished_callback;
+static guide_axis_t axes[GUIDE_AXES];
+static portMUX_TYPE guide_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t get_axis(uint8_t dir) {
+    return (dir == PULSE_GUIDING_DIR_NORTH || dir == PULSE_GUIDING_DIR_SOUTH) ? GUIDE_AXIS_DEC : GUIDE_AXIS_RA;
+}
+
+static int8_t get_dir_sign(uint8_t dir) {
+    switch (dir) {
+        case PULSE_GUIDING_DIR_NORTH:
+        case PULSE_GUIDING_DIR_WEST:
+            return 1;
+        case PULSE_GUIDING_DIR_SOUTH:
+        case PULSE_GUIDING_DIR_EAST:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+static uint8_t get_signed_dir(uint8_t axis, int64_t sign) {
+    if (sign == 0) return PULSE_GUIDING_NONE;
+    if (axis == GUIDE_AXIS_RA) {
+        return sign > 0 ? PULSE_GUIDING_DIR_WEST : PULSE_GUIDING_DIR_EAST;
+    } else {
+        return sign > 0 ? PULSE_GUIDING_DIR_NORTH : PULSE_GUIDING_DIR_SOUTH;
+    }
+}
+
+/* must be called with guide_mux held */
+static void settle_delivered(guide_axis_t* self, int64_t now) {
+    if (self->rate != 0) {
+        int64_t delivered = (int64_t)self->rate * (now - self->segment_start) * MILLISTEPS / 1000000;
+        self->owed -= delivered;
+        if (self->multiplier > 1) {
+            self->lash -= delivered < 0 ? -delivered : delivered;
+            if (self->lash < 0) self->lash = 0;
+        }
+    }
+    self->segment_start = now;
+}
+
+/* injects what is owed, the lash first at the burst rate; false if nothing can be injected */
+static bool start_injection(uint8_t axis) {
+    guide_axis_t* self = &axes[axis];
+    portENTER_CRITICAL(&guide_mux);
+    int64_t owed = self->owed;
+    int8_t nextSign = owed >= MILLISTEPS ? 1 : (owed <= -MILLISTEPS ? -1 : 0);
+    int8_t multiplier = self->lash > 0 ? BURST_MULTIPLIER : 1;
+    portEXIT_CRITICAL(&guide_mux);
+
+    int rate = apply_rate_callback(axis, nextSign * multiplier);
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&guide_mux);
+    settle_delivered(self, now);
+    if (rate == 0 || (rate > 0) != (self->owed > 0)) {
+        //the step generator cannot represent this correction, keep it owed
+        nextSign = 0;
+        rate = 0;
+        multiplier = 1;
+        self->lash = 0;
+    }
+    int64_t segment = self->owed;
+    if (multiplier > 1) {
+        int64_t absOwed = segment < 0 ? -segment : segment;
+        int64_t burst = self->lash < absOwed ? self->lash : absOwed;
+        segment = segment < 0 ? -burst : burst;
+    }
+    self->rate = rate;
+    self->multiplier = multiplier;
+    self->dir = get_signed_dir(axis, nextSign);
+    int64_t duration = rate ? segment * 1000000 / MILLISTEPS / rate : 0;
+    self->deadline = now + duration;
+    portEXIT_CRITICAL(&guide_mux);
+
+    if (nextSign) {
+        esp_timer_start_once(self->timer, duration);
+    }
+    return nextSign != 0;
+}
+
+static void guide_timer_callback(void* args) {
+    uint8_t axis = (uint8_t)(int)args;
+    guide_axis_t* self = &axes[axis];
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&guide_mux);
+    if (self->dir == PULSE_GUIDING_NONE || now < self->deadline) {
+        //stale expiry of a pulse that has been extended meanwhile
+        portEXIT_CRITICAL(&guide_mux);
+        return;
+    }
+    bool burstEnded = self->multiplier > 1;
+    if (burstEnded) {
+        //the lash is taken up, go on at the guide rate
+        self->lash = 0;
+    } else {
+        self->dir = PULSE_GUIDING_NONE;
+    }
+    portEXIT_CRITICAL(&guide_mux);
+
+    if (burstEnded) {
+        if (start_injection(axis)) return;
+    } else {
+        apply_rate_callback(axis, 0);
+        now = esp_timer_get_time();
+        portENTER_CRITICAL(&guide_mux);
+        settle_delivered(self, now);
+        self->rate = 0;
+        portEXIT_CRITICAL(&guide_mux);
+    }
+
+    portENTER_CRITICAL(&guide_mux);
+    if (self->owed > MAX_RESIDUAL_MILLISTEPS) self->owed = MAX_RESIDUAL_MILLISTEPS;
+    else if (self->owed < -MAX_RESIDUAL_MILLISTEPS) self->owed = -MAX_RESIDUAL_MILLISTEPS;
+    portEXIT_CRITICAL(&guide_mux);
+    finished_callback(axis);
+}
+
+esp_err_t init_guide(guide_get_step_rate_callback get_rate, guide_apply_step_rate_callback apply_rate, guide_get_backlash_steps_callback get_backlash, guide_finished_callback finished) {
+    get_rate_callback = get_rate;
+    apply_rate_callback = apply_rate;
+    get_backlash_callback = get_backlash;
+    finished_callback = finished;
+    for (int i = 0; i < GUIDE_AXES; i ++) {
+        axes[i].dir = PULSE_GUIDING_NONE;
+        axes[i].last_sign = 0;
+        axes[i].owed = 0;
+        axes[i].lash = 0;
+        axes[i].rate = 0;
+        axes[i].multiplier = 1;
+        axes[i].segment_start = 0;
+        axes[i].deadline = 0;
+        esp_timer_create_args_t args = {
+            .dispatch_method = ESP_TIMER_TASK,
+            .callback = guide_timer_callback,
+            .arg = (void*)i
+        };
+        esp_err_t err = esp_timer_create(&args, &axes[i].timer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+bool guide_pulse(uint8_t dir, int32_t pulseLengthMillis) {
+    int8_t sign = get_dir_sign(dir);
+    if (sign == 0 || pulseLengthMillis <= 0) {
+        return false;
+    }
+    uint8_t axis = get_axis(dir);
+    guide_axis_t* self = &axes[axis];
+    int32_t guideRate = get_rate_callback(axis);
+    if (guideRate <= 0) {
+        return false;
+    }
+    int32_t backlashSteps = self->last_sign == -sign ? get_backlash_callback(axis) : 0;
+
+    esp_timer_stop(self->timer);
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&guide_mux);
+    settle_delivered(self, now);
+    self->owed += (int64_t)sign * guideRate * pulseLengthMillis / 1000;
+    self->owed += (int64_t)sign * backlashSteps * MILLISTEPS;
+    self->lash += (int64_t)backlashSteps * MILLISTEPS;
+    self->last_sign = sign;
+    portEXIT_CRITICAL(&guide_mux);
+
+    start_injection(axis);
+    TRACE(TRACE_GUIDE_PULSE, axis << 8 | dir, pulseLengthMillis);
+    return true;
+}
+
+void abort_pulse_guiding() {
+    for (int i = 0; i < GUIDE_AXES; i ++) {
+        esp_timer_stop(axes[i].timer);
+        portENTER_CRITICAL(&guide_mux);
+        bool active = axes[i].dir != PULSE_GUIDING_NONE;
+        axes[i].dir = PULSE_GUIDING_NONE;
+        axes[i].owed = 0;
+        axes[i].lash = 0;
+        axes[i].rate = 0;
+        axes[i].multiplier = 1;
+        portEXIT_CRITICAL(&guide_mux);
+        if (active) {
+            apply_rate_callback(i, 0);
+        }
+    }
+}
+
+bool is_pulse_guiding() {
+    return axes[GUIDE_AXIS_RA].dir != PULSE_GUIDING_NONE || axes[GUIDE_AXIS_DEC].dir != PULSE_GUIDING_NONE;
+}
+
+uint8_t get_pulse_guiding_dir(uint8_t axis) {
+    return axes[axis].dir;
+}
+
+uint32_t get_pulse_guiding_remaining_millis(uint8_t axis) {
+    portENTER_CRITICAL(&guide_mux);
+    int64_t remaining = axes[axis].dir == PULSE_GUIDING_NONE ? 0 : axes[axis].deadline - esp_timer_get_time();
+    portEXIT_CRITICAL(&guide_mux);
+    return remaining > 0 ? (uint32_t)((remaining + 999) / 1000) : 0;
+}
+
+int32_t get_pulse_guiding_residual_steps(uint8_t axis) {
+    portENTER_CRITICAL(&guide_mux);
+    int64_t owed = axes[axis].owed;
+    portEXIT_CRITICAL(&guide_mux);
+    return (int32_t)(owed / MILLISTEPS);
+}
+
+const char* get_pulse_dir_descr(uint8_t dir) {
+    switch (dir) {
+        case PULSE_GUIDING_DIR_WEST:
+        return "west";
+        case PULSE_GUIDING_DIR_EAST:
+        return "east";
+        case PULSE_GUIDING_DIR_NORTH:
+        return "north";
+        case PULSE_GUIDING_DIR_SOUTH:
+        return "south";
+        case PULSE_GUIDING_NONE:
+        return "none";
+        default:
+        return "unknown";
+    }
+}
@@ -1,13 +1,60 @@
-#ifndef __ASTRO_H
-
-#define __ASTRO_H
-#define SIDEREAL_DAY_MILLIS 86164092
-#define DAY_MILLIS 86400000
-
-#endif
-
-// typedef struct ra_angle {
-//     uint64_t
-// } ra_angle_t;
-
+#ifndef __ASTRO_H
+
+#define __ASTRO_H
+#include "freertos/FreeRTOS.h"
+
+#define SIDEREAL_DAY_MILLIS 86164092
+#define DAY_MILLIS 86400000
+
+/* 2000-01-01T12:00:00Z in unix millis */
+#define J2000_UNIX_MILLIS 946728000000LL
+
+/*
+ * Angles in millis, DAY_MILLIS is a full turn. Constant time for any
+ * int32, so a corrupt sync or packet cannot stall a timer callback.
+ */
+/* to [0, 360) */
+static inline int32_t wrap_day_millis(int32_t millis) {
+    int32_t wrapped = millis % DAY_MILLIS;
+    return wrapped < 0 ? wrapped + DAY_MILLIS : wrapped;
+}
+
+/* to (-180, 180] */
+static inline int32_t wrap_half_day_millis(int32_t millis) {
+    int32_t wrapped = wrap_day_millis(millis);
+    return wrapped > DAY_MILLIS / 2 ? wrapped - DAY_MILLIS : wrapped;
+}
+
+/* signed shortest arc from b to a, in (-180, 180] */
+static inline int32_t angle_diff_millis(int32_t a, int32_t b) {
+    return wrap_half_day_millis((int32_t)(((int64_t)a - b) % DAY_MILLIS));
+}
+
+void init_astro();
+
+/* one NTP-style exchange: utc as sent by the client, delay is the client's one-way delay estimate */
+void add_time_sample(int64_t localMicros, int64_t utcMicros, uint32_t delayMicros);
+bool is_time_synced();
+int32_t get_clock_drift_ppb();
+uint8_t get_time_sample_count();
+
+int64_t get_disciplined_micros(int64_t localMicros);
+uint64_t get_disciplined_millis();
+int64_t get_utc_micros(int64_t localMicros);
+int64_t get_utc_millis();
+
+void set_site(int32_t latitudeMillis, int32_t longitudeMillis);
+int32_t get_site_latitude_millis();
+int32_t get_site_longitude_millis();
+
+int32_t get_gmst_millis(int64_t utcMillis);
+int32_t get_lst_millis();
+int32_t get_hour_angle_millis(int32_t raMillis);
+
+#endif
+
+// typedef struct ra_angle {
+//     uint64_t
+// } ra_angle_t;
+
 // getRAMillisFrom() 
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef __AXIS_H
+#define __AXIS_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "rencoder.h"
+
+#define AXIS_RA 0
+#define AXIS_DEC 1
+#define MOUNT_AXES 2
+/* the focuser follows the mount axes in the table */
+#ifdef CONFIG_FOCUSER_ENABLED
+#define AXIS_FOCUSER 2
+#define AXES 3
+#else
+#define AXES MOUNT_AXES
+#endif
+
+/*
+ * Everything one axis needs from encoder to step generator. Speeds are in
+ * the protocol unit, 15000 per cycle per (sidereal) day.
+ */
+typedef struct axis {
+    const char* name;
+    /* encoder and gear lash */
+    rencoder_t encoder;
+    int8_t is_clearing_backlash;
+    int32_t backlash_pulses; //raw count the clearing started from
+    volatile int32_t actual_pulses; //pulses that really moved the axis, written by the encoder isr only
+    const int32_t* lash_pulses; //dead band in encoder pulses
+    /* motor */
+    gpio_num_t en_pin, dir_pin;
+    bool reverse;
+    ledc_channel_config_t channel;
+    ledc_timer_config_t timer;
+    /* limits and rate */
+    int32_t min_speed, max_speed;
+    const uint32_t* millihz_per_speed_q24;
+    int32_t step_speed; //latest speed asked for, under the rate lock
+    uint32_t rate_requests;
+} axis_t;
+
+extern axis_t mount_axes[AXES];
+
+/* sets up the motor gpios of all axes, motors stay disabled */
+void init_axes();
+esp_err_t axis_start_encoder(axis_t* axis, gpio_num_t a, gpio_num_t b, bool reverse);
+/* configures the step generator, at one cycle per day */
+void axis_start_motor(axis_t* axis);
+int32_t axis_get_step_millihz(const axis_t* axis, int32_t speed);
+/* signed step frequency the LEDC timer runs at for the speed, 0 when stopped */
+int axis_get_step_freq(const axis_t* axis, int32_t speed);
+/* returns the signed step frequency applied */
+int axis_set_step_rate(axis_t* axis, int32_t speed);
+#endif
@@ -0,0 +1,19 @@
+#ifndef __BACKLASH_H
+#define __BACKLASH_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define BACKLASH_AXIS_RA 0
+#define BACKLASH_AXIS_DEC 1
+
+/* drive the axis at speed (15000 per cycle per day), return the signed step rate in Hz applied */
+typedef int (*backlash_drive_callback)(uint8_t axis, int32_t speed);
+/* pulses is the measured dead band in encoder pulses, negative if aborted or failed */
+typedef void (*backlash_finished_callback)(uint8_t axis, int32_t pulses);
+
+esp_err_t init_backlash(backlash_drive_callback drive, backlash_finished_callback finished);
+esp_err_t start_backlash_calibration(uint8_t axis);
+void abort_backlash_calibration();
+bool is_calibrating_backlash();
+#endif
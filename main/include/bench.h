@@ -0,0 +1,8 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include "freertos/FreeRTOS.h"
+
+/* times the per-tick math and logs cycles and ns per call, after init_mount and init_mount_config */
+void run_benchmarks();
+#endif
@@ -0,0 +1,50 @@
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define CAPTURE_OFF 0
+#define CAPTURE_RING 1 //kept in the ring, read with CMD_GET_CAPTURE
+#define CAPTURE_STREAM 2 //also pushed to the client that started it
+
+/*
+ * Records are a type, a 16 bit payload length, the low 32 bits of
+ * esp_timer_get_time() and the payload, little endian as in memory.
+ * Keep in sync with tools/capture_replay.py.
+ */
+#define CAPTURE_RECORD_START 1 //snapshot given to start_capture()
+#define CAPTURE_RECORD_ENCODER 2 //uint8 LEDC channel of the axis, int8 diff, int32 raw pulses
+#define CAPTURE_RECORD_COMMAND 3 //the datagram as received, never CMD_SET_WIFI
+#define CAPTURE_RECORD_RATE 4 //uint8 LEDC channel, int32 signed step frequency
+#define CAPTURE_HEADER_SIZE 7
+
+#ifdef CONFIG_CAPTURE
+
+/* clears the ring and starts with a START record carrying the snapshot */
+esp_err_t start_capture(uint8_t mode, const void* snapshot, uint8_t len);
+void stop_capture();
+uint8_t get_capture_mode();
+/*
+ * Copies up to max bytes from offset *from on. An offset the ring already
+ * dropped moves up to the oldest record kept. *head is the next offset.
+ */
+int capture_read(uint32_t* from, uint32_t* head, uint8_t* out, int max);
+
+void capture_encoder(uint8_t channel, int8_t diff, int32_t pulses);
+void capture_command(const char* buf, size_t len);
+void capture_rate(uint8_t channel, int32_t freq);
+
+#define CAPTURE_ENCODER(channel, diff, pulses) capture_encoder(channel, diff, pulses)
+#define CAPTURE_COMMAND(buf, len) capture_command(buf, len)
+#define CAPTURE_RATE(channel, freq) capture_rate(channel, freq)
+
+#else
+
+#define CAPTURE_ENCODER(channel, diff, pulses)
+#define CAPTURE_COMMAND(buf, len)
+#define CAPTURE_RATE(channel, freq)
+
+#endif
+#endif
@@ -0,0 +1,43 @@
+#ifndef __DIAG_H
+#define __DIAG_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/*
+ * Stack headroom of every task, heap fragmentation and core load, sampled
+ * once a second so stacks can be sized from what the field really uses.
+ */
+#define DIAG_MAX_TASKS 16
+#define DIAG_TASK_NAME_LEN 16
+#define DIAG_CORE_ANY 0xff //task not pinned to a core
+#define DIAG_CPU_LOAD_UNKNOWN 0xff //without CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define DIAG_STACK_FREE_UNKNOWN 0xffff
+
+typedef struct diag_task {
+    char name[DIAG_TASK_NAME_LEN];
+    uint32_t stack_free; //lowest free stack since the task started, in bytes
+    uint8_t core;
+    uint8_t priority;
+} diag_task_t;
+
+typedef struct diag_stats {
+    uint32_t free_heap;
+    uint32_t min_free_heap; //lowest since boot
+    uint32_t largest_free_block; //much lower than free_heap means fragmentation
+    uint32_t free_internal; //internal RAM only, what DMA and tasks need
+    uint8_t cpu_load[portNUM_PROCESSORS]; //percent over the last second
+    uint8_t task_count; //tasks beyond DIAG_MAX_TASKS are left out
+    diag_task_t tasks[DIAG_MAX_TASKS];
+} diag_stats_t;
+
+#ifdef CONFIG_DIAGNOSTICS
+
+esp_err_t init_diag();
+void get_diag_stats(diag_stats_t* stats);
+/* least stack headroom of any task and the load of the busiest core, for the status frame */
+void get_diag_summary(uint16_t* min_stack_free, uint8_t* max_cpu_load);
+
+#endif
+#endif
@@ -0,0 +1,13 @@
+#ifndef __DISCOVERY_H
+#define __DISCOVERY_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_event_loop.h"
+
+#define DISCOVERY_SERVICE_TYPE "_telescope"
+#define DISCOVERY_SERVICE_PROTO "_udp"
+
+esp_err_t init_discovery(uint16_t commandPort, uint16_t statusPort);
+esp_err_t discovery_handle_system_event(void *ctx, system_event_t *event);
+#endif
@@ -0,0 +1,32 @@
+#ifndef __FOCUSER_H
+#define __FOCUSER_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define FOCUSER_TEMPERATURE_UNKNOWN INT32_MIN
+
+/* on-board temperature in milli degrees Celsius, FOCUSER_TEMPERATURE_UNKNOWN if there is no reading */
+typedef int32_t (*focuser_temperature_callback)();
+
+typedef struct focuser_state {
+    int32_t position; //in steps
+    int32_t target; //in steps
+    int32_t temperature; //in milli degrees Celsius
+    int32_t temp_coefficient; //in milli steps per degree Celsius, 0 when off
+    bool moving;
+} focuser_state_t;
+
+esp_err_t init_focuser(focuser_temperature_callback temperature);
+/* absolute move, the final approach is always outward so the backlash is taken up */
+esp_err_t focuser_move_to(int32_t position);
+void focuser_halt();
+/* redefines the current position */
+esp_err_t focuser_sync(int32_t position);
+/* temperature compensation, 0 turns it off; the current focus is the reference */
+void focuser_set_temp_coefficient(int32_t milli_steps_per_degree);
+/* temperature pushed by a client, overrides the callback until the next reading */
+void focuser_set_temperature(int32_t milli_celsius);
+bool is_focuser_moving();
+void get_focuser_state(focuser_state_t* state);
+#endif
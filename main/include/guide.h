@@ -0,0 +1,34 @@
+#ifndef __GUIDE_H
+#define __GUIDE_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define PULSE_GUIDING_NONE 0
+#define PULSE_GUIDING_DIR_WEST 4
+#define PULSE_GUIDING_DIR_EAST 3
+#define PULSE_GUIDING_DIR_NORTH 1
+#define PULSE_GUIDING_DIR_SOUTH 2
+
+#define GUIDE_AXIS_RA 0
+#define GUIDE_AXIS_DEC 1
+#define GUIDE_AXES 2
+
+/* guide rate of the axis in 1/1000 microsteps per second */
+typedef int32_t (*guide_get_step_rate_callback)(uint8_t axis);
+/* apply base rate plus dir times the guide rate (0, +-1, +-BURST_MULTIPLIER of guide.c) to the step generator,
+   return the signed step rate in Hz actually added on top of the base rate */
+typedef int (*guide_apply_step_rate_callback)(uint8_t axis, int8_t dir);
+/* microsteps the motor needs to cross the gear lash when a correction reverses it, 0 if corrections never reverse the motor */
+typedef int32_t (*guide_get_backlash_steps_callback)(uint8_t axis);
+typedef void (*guide_finished_callback)(uint8_t axis);
+
+esp_err_t init_guide(guide_get_step_rate_callback get_rate, guide_apply_step_rate_callback apply_rate, guide_get_backlash_steps_callback get_backlash, guide_finished_callback finished);
+bool guide_pulse(uint8_t dir, int32_t pulseLengthMillis);
+void abort_pulse_guiding();
+bool is_pulse_guiding();
+uint8_t get_pulse_guiding_dir(uint8_t axis);
+uint32_t get_pulse_guiding_remaining_millis(uint8_t axis);
+int32_t get_pulse_guiding_residual_steps(uint8_t axis);
+const char* get_pulse_dir_descr(uint8_t dir);
+#endif
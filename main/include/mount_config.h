@@ -0,0 +1,55 @@
+#ifndef __MOUNT_CONFIG_H
+#define __MOUNT_CONFIG_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/* mount geometry fields, all uint32 */
+#define GEOMETRY_RA_GEAR_RATIO 0
+#define GEOMETRY_RA_RESOLUTION 1 //pulses per motor step
+#define GEOMETRY_RA_CYCLE_STEPS 2 //motor steps per motor cycle
+#define GEOMETRY_RA_ENCODER_PULSES 3 //encoder pulses per encoder cycle
+#define GEOMETRY_RA_BACKLASH_PULSES 4 //in encoder pulses
+#define GEOMETRY_DEC_GEAR_RATIO 5
+#define GEOMETRY_DEC_RESOLUTION 6
+#define GEOMETRY_DEC_CYCLE_STEPS 7
+#define GEOMETRY_DEC_ENCODER_PULSES 8
+#define GEOMETRY_DEC_BACKLASH_PULSES 9
+#define GEOMETRY_FIELDS 10
+
+/*
+ * Derived from the geometry once, so the step rate and encoder paths only
+ * do integer multiplies. Speeds are in the protocol unit, 15000 per cycle
+ * per (sidereal) day.
+ */
+typedef struct mount_constants {
+    uint32_t ra_millihz_per_speed_q24; //step rate for one speed unit, Q8.24 mHz
+    uint32_t dec_millihz_per_speed_q24;
+    int64_t ra_millis_per_pulse_q24; //axis angle of one encoder pulse, Q.24 sidereal millis
+    int64_t dec_millis_per_pulse_q24; //Q.24 millis
+    int32_t ra_backlash_pulses;
+    int32_t dec_backlash_pulses;
+    int32_t ra_backlash_steps; //motor microsteps to cross the dead band
+    int32_t dec_backlash_steps;
+} mount_constants_t;
+
+extern mount_constants_t mount_constants;
+
+#define SPEED_PER_CYCLE 15000
+/* what the protocol takes and the step generators run, 30 cycles per day at most */
+#define RA_SPEED_MAX 450000
+#define RA_SPEED_MIN 150
+#define DEC_SPEED_MAX 450000
+#define DEC_SPEED_MIN 150
+#define RA_PULSES_MILLIS(pulses) ((int32_t)(((int64_t)(pulses) * mount_constants.ra_millis_per_pulse_q24) >> 24))
+#define DEC_PULSES_MILLIS(pulses) ((int32_t)(((int64_t)(pulses) * mount_constants.dec_millis_per_pulse_q24) >> 24))
+
+/* loads the geometry from nvs, the Kconfig one if none was stored */
+esp_err_t init_mount_config();
+void get_mount_geometry(uint32_t* values);
+/* validates, stores and applies a new geometry */
+esp_err_t set_mount_geometry(const uint32_t* values);
+/* validates and applies a new geometry without waiting for flash, save_mount_geometry() stores it */
+esp_err_t apply_mount_geometry(const uint32_t* values);
+esp_err_t save_mount_geometry();
+#endif
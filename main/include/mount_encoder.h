@@ -1,15 +1,34 @@
-#include "freertos/FreeRTOS.h"
-
-void init_mount();
-
-int32_t get_ra_pulses_raw();
-int32_t get_dec_pulses_raw();
-bool get_ra_direction();
-bool get_dec_direction();
-int32_t get_ra_pulses();
-int32_t get_dec_pulses();
-int32_t get_ra_angle_millis();
-int32_t get_dec_angle_millis();
-int32_t get_dec_mechnical_angle_millis();
-
+#include "freertos/FreeRTOS.h"
+
+typedef struct mount_motion {
+    int64_t timestamp; //esp_timer_get_time() at sampling, in micro seconds
+    int32_t ra, dec; //in millis
+    int32_t ra_velocity, dec_velocity; //in millis per second
+} mount_motion_t;
+
+/* everything needed to resume the encoder position after a restart */
+typedef struct mount_state {
+    int32_t reset_ra_angle_millis, reset_dec_angle_millis;
+    int32_t ra_actual_pulses, dec_actual_pulses;
+    int32_t elapsed_millis; //since the encoder reset
+    int64_t reset_utc_millis; //utc of the encoder reset, 0 when unknown
+} mount_state_t;
+
+void init_mount();
+
+int32_t get_ra_pulses_raw();
+int32_t get_dec_pulses_raw();
+bool get_ra_direction();
+bool get_dec_direction();
+int32_t get_ra_pulses();
+int32_t get_dec_pulses();
+int32_t get_ra_angle_millis();
+int32_t get_dec_angle_millis();
+int32_t get_dec_mechnical_angle_millis();
+void get_mount_motion(mount_motion_t* motion);
+
+void get_mount_state(mount_state_t* state);
+void restore_mount_state(const mount_state_t* state);
+void mount_time_synced();
+
 void set_angles(int32_t ra_angle_millis, int32_t dec_angle_millis);
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef __MOUNT_FSM_H
+#define __MOUNT_FSM_H
+
+#include "freertos/FreeRTOS.h"
+
+/* what the mount is doing, one at a time */
+#define MOUNT_STATE_IDLE 0
+#define MOUNT_STATE_TRACKING 1
+#define MOUNT_STATE_GUIDING 2 //pulse guiding, on top of tracking or not
+#define MOUNT_STATE_SLEWING 3 //goto or meridian flip
+#define MOUNT_STATE_CALIBRATING 4 //backlash calibration
+#define MOUNT_STATE_FAULT 5 //a limit tripped, until it clears or the client moves the mount again
+#define MOUNT_STATES 6
+#define MOUNT_STATE_REFUSED 0xff //from mount_fsm_next(), the event is not allowed in the state
+
+#define MOUNT_EVENT_TRACKING_ON 0
+#define MOUNT_EVENT_TRACKING_OFF 1
+#define MOUNT_EVENT_MOVE 2 //the client set an axis speed
+#define MOUNT_EVENT_SYNC 3 //sync, side of pier, geometry or pointing model, the motors keep their rates
+#define MOUNT_EVENT_GUIDE_START 4
+#define MOUNT_EVENT_GUIDE_END 5
+#define MOUNT_EVENT_SLEW_START 6
+#define MOUNT_EVENT_SLEW_END 7 //arrived or aborted
+#define MOUNT_EVENT_CALIBRATE_START 8
+#define MOUNT_EVENT_CALIBRATE_END 9
+#define MOUNT_EVENT_LIMIT_TRIPPED 10
+#define MOUNT_EVENT_LIMITS_CLEARED 11
+#define MOUNT_EVENTS 12
+
+/* the transition table, tracking is the flag of the mount snapshot */
+uint8_t mount_fsm_next(uint8_t state, uint8_t event, bool tracking);
+/* takes the transition on the published state, false when the state refuses the event */
+bool mount_fsm_dispatch(uint8_t event);
+/* sets the tracking flag (0, 1 north, -1 south) together with its event, unless refused */
+bool mount_fsm_set_tracking(int8_t tracking);
+/*
+ * GUIDE_START while a pulse runs and GUIDE_END when none does, the guide
+ * state read in the same write as the transition. Called after every pulse
+ * started or ended, the last call leaves the state of the pulses then running.
+ */
+bool mount_fsm_follow_guiding();
+/* whether the current state would take the event, without taking it */
+bool mount_fsm_accepts(uint8_t event);
+uint8_t get_mount_fsm_state();
+const char* get_mount_state_descr(uint8_t state);
+#endif
@@ -0,0 +1,32 @@
+#ifndef __MOUNT_LIMITS_H
+#define __MOUNT_LIMITS_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/* soft limit fields, all int32 millis */
+#define LIMIT_FIELD_MERIDIAN 0 //how far the mount may track past the meridian
+#define LIMIT_FIELD_DEC_MIN 1 //mechanical dec, 0 to 180 degrees on the normal side
+#define LIMIT_FIELD_DEC_MAX 2
+#define LIMIT_FIELD_HORIZON 3 //lowest altitude
+#define LIMIT_FIELDS 4
+
+/* active limits */
+#define LIMIT_MERIDIAN 0x01
+#define LIMIT_DEC 0x02
+#define LIMIT_HORIZON 0x04
+#define LIMIT_SWITCH_RA 0x08
+#define LIMIT_SWITCH_DEC 0x10
+
+/* called from the limit check whenever the active limits change, tripped are the new ones */
+typedef void (*limits_changed_callback)(uint8_t active, uint8_t tripped);
+
+/* loads the soft limits from nvs and arms the switches, after init_axes and init_mount */
+esp_err_t init_limits(limits_changed_callback callback);
+void get_soft_limits(int32_t* values);
+/* validates, stores and applies new soft limits */
+esp_err_t set_soft_limits(const int32_t* values);
+uint8_t get_active_limits();
+/* the speed an axis may run at, 0 when it would go further into a limit */
+int32_t limits_filter_speed(uint8_t axis, int32_t speed);
+#endif
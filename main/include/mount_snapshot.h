@@ -0,0 +1,31 @@
+#ifndef __MOUNT_SNAPSHOT_H
+#define __MOUNT_SNAPSHOT_H
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * What the commands, the slew timer and the callbacks share, published as
+ * a whole so a broadcast or a status frame never mixes two updates. Speeds
+ * are in the protocol unit, 15000 per cycle per (sidereal) day.
+ */
+typedef struct mount_snapshot {
+    uint8_t state; //MOUNT_STATE_* of mount_fsm.h
+    int8_t tracking; //0 off, 1 north, -1 south
+    uint8_t side_of_pier; //0 normal (east), 1 beyond the pole (west)
+    int32_t ra_speed, dec_speed;
+    int32_t ra_guide_speed, dec_guide_speed;
+    bool slewing;
+    uint8_t slew_phase; //SLEW_PHASE_* of slew.h
+    uint16_t slew_progress; //in permille
+    uint32_t slew_time_to_go_millis;
+} mount_snapshot_t;
+
+/* a consistent copy of the last published state, lock free */
+void get_mount_snapshot(mount_snapshot_t* snapshot);
+/*
+ * The published state to change in place, until mount_snapshot_write_end().
+ * Only stores go in between, no logging and no calls that could block.
+ */
+mount_snapshot_t* mount_snapshot_write_begin();
+void mount_snapshot_write_end();
+#endif
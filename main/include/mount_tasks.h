@@ -0,0 +1,69 @@
+#ifndef __MOUNT_TASKS_H
+#define __MOUNT_TASKS_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "axis.h"
+
+/*
+ * Where the work runs. WiFi, lwip and the esp_timer task live on core 0,
+ * so core 1 is left to the motion task, which applies the step rates of
+ * commands, slews and limits. The network task parses commands on core 0
+ * and the display task redraws there below it, so the bit-banged i2c never
+ * holds a motor update. Guide pulses and backlash calibration still switch
+ * their axis from their esp_timer callbacks, which time them. Flash writes
+ * stall the cache for milliseconds, so timers only post them to the
+ * storage task, which runs lowest but the display.
+ */
+#ifdef CONFIG_FREERTOS_UNICORE
+#define MOTION_TASK_CORE 0
+#else
+#define MOTION_TASK_CORE 1
+#endif
+#define NETWORK_TASK_CORE 0
+#define DISPLAY_TASK_CORE 0
+#define STORAGE_TASK_CORE 0
+
+#define MOTION_TASK_PRIORITY 20 //above lwip (18), below the esp_timer task (22)
+#define NETWORK_TASK_PRIORITY 5
+#define STORAGE_TASK_PRIORITY 2
+#define DISPLAY_TASK_PRIORITY 1
+
+#define MOTION_TASK_STACK 2048
+#define NETWORK_TASK_STACK 4096
+#define DISPLAY_TASK_STACK 3072 //sprintf with %f
+#define STORAGE_TASK_STACK 3072 //nvs writes
+
+#define MOTION_QUEUE_LENGTH 8
+
+/* axes of post_motion() */
+#define MOTION_AXIS(axis) (1 << (axis))
+#define MOTION_ALL_AXES ((1 << MOUNT_AXES) - 1)
+
+/* work of post_storage() */
+#define STORAGE_PERSIST (1 << 0)
+#define STORAGE_GEOMETRY (1 << 1)
+
+/* recomputes the step rate of the axes in the MOTION_AXIS() mask */
+typedef void (*motion_apply_callback)(uint8_t axes);
+typedef void (*display_refresh_callback)();
+/* writes to flash whatever the STORAGE_ bits in work ask for */
+typedef void (*storage_callback)(uint8_t work);
+
+/* the motion task calls apply for every batch of requests, then asks for a redraw */
+esp_err_t start_motion_task(motion_apply_callback apply);
+/* redraws are dropped until the display task runs */
+esp_err_t start_display_task(display_refresh_callback refresh);
+esp_err_t start_storage_task(storage_callback store);
+/*
+ * Asks the motion task to apply the current speeds of the axes, a
+ * MOTION_AXIS() mask. received_at is the esp_timer_get_time() of the
+ * command behind it, 0 for anything else.
+ */
+void post_motion(uint8_t axes, int64_t received_at);
+/* coalesced, any number of posts before the redraw give one */
+void post_display();
+/* coalesced like redraws, safe from esp_timer callbacks */
+void post_storage(uint8_t work);
+#endif
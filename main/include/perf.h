@@ -0,0 +1,64 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#ifndef __XTENSA__
+#include <time.h>
+#endif
+
+/*
+ * Cycle count histograms of the hot paths. Bucket i counts the samples of
+ * 2^(i-1) up to 2^i - 1 cycles, bucket 0 the ones of 0 cycles. Everything
+ * below compiles to nothing without CONFIG_PERF_HISTOGRAMS.
+ */
+#define PERF_PARSE_COMMAND 0
+#define PERF_UPDATE_STEPPER 1
+#define PERF_UPDATE_DISPLAY 2
+#define PERF_SSD1306_REFRESH 3
+#define PERF_ENCODER_ISR 4
+#define PERF_SLEW_TIMER 5
+#define PERF_COMMAND_TO_MOTOR 6 //from recvfrom() to the step rate change on the motion task
+#define PERF_STAGES 7
+
+#define PERF_BUCKETS 32
+
+typedef struct perf_histogram {
+    uint32_t count;
+    uint32_t max; //in cycles
+    uint32_t buckets[PERF_BUCKETS];
+} perf_histogram_t;
+
+/* cycle counter of the calling core, on the host builds the monotonic clock counted at the configured core frequency */
+static inline uint32_t perf_ccount() {
+#ifdef __XTENSA__
+    uint32_t ccount;
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+    return ccount;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000);
+#endif
+}
+
+#ifdef CONFIG_PERF_HISTOGRAMS
+
+void perf_record(uint8_t stage, uint32_t cycles);
+/* latencies that cross tasks, and with them cores, are timed by esp_timer and recorded as cycles */
+void perf_record_since(uint8_t stage, int64_t since);
+/* copies one histogram, optionally clearing it */
+void get_perf_histogram(uint8_t stage, perf_histogram_t* histogram, bool reset);
+
+#define PERF_BEGIN(stage) uint32_t perf_begin_##stage = perf_ccount()
+#define PERF_END(stage) perf_record(stage, perf_ccount() - perf_begin_##stage)
+#define PERF_SINCE(stage, since) perf_record_since(stage, since)
+
+#else
+
+#define PERF_BEGIN(stage)
+#define PERF_END(stage)
+#define PERF_SINCE(stage, since)
+
+#endif
+#endif
@@ -0,0 +1,37 @@
+#ifndef __PERSIST_H
+#define __PERSIST_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/* journaled fields, all int32 */
+#define PERSIST_RESET_RA 0
+#define PERSIST_RESET_DEC 1
+#define PERSIST_RA_PULSES 2
+#define PERSIST_DEC_PULSES 3
+#define PERSIST_ELAPSED 4
+#define PERSIST_RESET_UTC_HI 5
+#define PERSIST_RESET_UTC_LO 6
+#define PERSIST_SIDE_OF_PIER 7
+#define PERSIST_RA_GUIDE_SPEED 8
+#define PERSIST_DEC_GUIDE_SPEED 9
+#define PERSIST_FIELDS 10
+#define PERSIST_ALL_FIELDS ((1 << PERSIST_FIELDS) - 1)
+
+typedef struct persist_stats {
+    uint32_t records; //journal records written since boot
+    uint32_t snapshots; //compactions written since boot
+    uint32_t bytes; //bytes handed to nvs since boot
+    uint32_t changed_bytes; //bytes of state that actually changed
+    uint32_t replay_micros; //time spent replaying the journal at boot
+    uint32_t replayed; //records replayed at boot
+} persist_stats_t;
+
+/* replays the journal, fills values and the mask of the fields found */
+esp_err_t init_persist(int32_t* values, uint32_t* mask);
+/* to be called periodically with the current state, writes at a bounded rate */
+void persist_tick(const int32_t* values);
+/* the next tick writes as soon as the minimum interval allows */
+void persist_mark_urgent();
+void get_persist_stats(persist_stats_t* stats);
+#endif
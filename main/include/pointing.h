@@ -0,0 +1,29 @@
+#ifndef __POINTING_H
+#define __POINTING_H
+
+#include "freertos/FreeRTOS.h"
+
+#define POINTING_MAX_POINTS 16
+
+/* model terms, mount position = sky position + correction */
+#define POINTING_IH 0 // hour angle index error
+#define POINTING_ID 1 // declination index error
+#define POINTING_ME 2 // polar axis elevation error
+#define POINTING_MA 3 // polar axis azimuth error
+#define POINTING_CH 4 // collimation error
+#define POINTING_NP 5 // non-perpendicularity of the axes
+#define POINTING_TF 6 // tube flexure
+#define POINTING_TERMS 7
+
+void init_pointing();
+void clear_pointing_model();
+uint8_t get_pointing_point_count();
+uint8_t get_pointing_term_count();
+int32_t get_pointing_term_millis(uint8_t term);
+int32_t get_pointing_rms_millis();
+
+/* record a sync: where the sky target really is and where the uncorrected mount thinks it is */
+void add_pointing_point(int32_t skyRaMillis, int32_t skyDecMillis, int32_t mountRaMillis, int32_t mountDecMillis, uint8_t sideOfPier);
+void pointing_sky_to_mount(int32_t* raMillis, int32_t* decMillis, uint8_t sideOfPier);
+void pointing_mount_to_sky(int32_t* raMillis, int32_t* decMillis, uint8_t sideOfPier);
+#endif
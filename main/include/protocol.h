@@ -1,43 +1,341 @@
-#ifndef __PROTOCOL_H
-#define __PROTOCOL_H
-
-#include "freertos/FreeRTOS.h"
-
-#define BROADCAST_IP(B) (*((uint32_t*)(B)))
-#define BROADCAST_PORT(B) (*((uint16_t*)((B) + 4)))
-#define BROADCAST_RA(B) (*((int32_t*)((B) + 6)))
-#define BROADCAST_DEC(B) (*((int32_t*)((B) + 10)))
-#define BROADCAST_SLEWING(B) (*((uint8_t*)((B) + 14)))
-#define BROADCAST_TRACKING(B) (*((uint8_t*)((B) + 15)))
-#define BROADCAST_RA_SPEED(B) (*((int32_t*)((B) + 16)))
-#define BROADCAST_DEC_SPEED(B) (*((int32_t*)((B) + 20)))
-#define BROADCAST_SIDE_OF_PIER(B) (*((uint8_t*)((B) + 24)))
-#define BROADCAST_SIZE 25
-
-typedef struct broadcast {
-    uint8_t buffer[BROADCAST_SIZE];
-} broadcast_t;
-
-void set_broadcast_fields(
-    broadcast_t *target,
-    uint32_t ip,
-    uint16_t port,
-    int32_t ra, //in millis
-    int32_t dec, //in millis
-    bool slewing,
-    bool tracking,
-    int32_t ra_speed, // in milli seconds per sidereal second
-    int32_t dec_speed, // in milli seconds per second 
-    uint8_t side_of_pier // 0: Normal (East); 1: Beyond the pole (West)
-);
-
-
-    // /* IP     */ *(uint32_t*)(buffer    )  = htonl(my_ip_num);
-    // /* Port   */ *(uint16_t*)(buffer + 4)  = htons(UDP_PORT);
-    // /* RADIR  */ *(uint8_t* )(buffer + 6)  = get_ra_direction() ? 1 : 0;
-    // /* RATICK */ *(int32_t* )(buffer + 7)  = htonl(get_ra_pulses_raw());
-    // /* DECDIR */ *(uint8_t* )(buffer + 11) = get_dec_direction() ? 1 : 0;
-    // /* DECTICK*/ *(int32_t* )(buffer + 12) = htonl(get_dec_pulses_raw());
-
-
+#ifndef __PROTOCOL_H
+#define __PROTOCOL_H
+
+#include "freertos/FreeRTOS.h"
+
+/* bumped whenever a frame or command is added, advertised in the mDNS TXT record */
+#define PROTOCOL_VERSION 14
+
+#define BROADCAST_IP(B) (*((uint32_t*)(B)))
+#define BROADCAST_PORT(B) (*((uint16_t*)((B) + 4)))
+#define BROADCAST_RA(B) (*((int32_t*)((B) + 6)))
+#define BROADCAST_DEC(B) (*((int32_t*)((B) + 10)))
+#define BROADCAST_SLEWING(B) (*((uint8_t*)((B) + 14)))
+#define BROADCAST_TRACKING(B) (*((uint8_t*)((B) + 15)))
+#define BROADCAST_RA_SPEED(B) (*((int32_t*)((B) + 16)))
+#define BROADCAST_DEC_SPEED(B) (*((int32_t*)((B) + 20)))
+#define BROADCAST_SIDE_OF_PIER(B) (*((uint8_t*)((B) + 24)))
+#define BROADCAST_SIZE 25
+
+typedef struct broadcast {
+    uint8_t buffer[BROADCAST_SIZE];
+} broadcast_t;
+
+/* status frame, timestamped so clients can extrapolate between frames */
+#define STATUS_FRAME_TYPE 0x53
+#define STATUS_TYPE(B) (*((uint8_t*)(B)))
+#define STATUS_FLAGS(B) (*((uint8_t*)((B) + 1)))
+#define STATUS_SLEW_PHASE(B) (*((uint8_t*)((B) + 2)))
+#define STATUS_SIDE_OF_PIER(B) (*((uint8_t*)((B) + 3)))
+#define STATUS_TIMESTAMP_HI(B) (*((uint32_t*)((B) + 4)))
+#define STATUS_TIMESTAMP_LO(B) (*((uint32_t*)((B) + 8)))
+#define STATUS_RA(B) (*((int32_t*)((B) + 12)))
+#define STATUS_DEC(B) (*((int32_t*)((B) + 16)))
+#define STATUS_RA_VELOCITY(B) (*((int32_t*)((B) + 20)))
+#define STATUS_DEC_VELOCITY(B) (*((int32_t*)((B) + 24)))
+#define STATUS_SLEW_ETA(B) (*((uint32_t*)((B) + 28)))
+#define STATUS_LIMITS(B) (*((uint8_t*)((B) + 32))) //LIMIT_* of mount_limits.h
+#define STATUS_CPU_LOAD(B) (*((uint8_t*)((B) + 33))) //busiest core in percent, 0xff unknown
+#define STATUS_STACK_FREE(B) (*((uint16_t*)((B) + 34))) //least stack headroom of any task in bytes, 0xffff unknown
+#define STATUS_SIZE 36
+
+#define STATUS_FLAG_SLEWING 0x01
+#define STATUS_FLAG_TRACKING 0x02
+#define STATUS_FLAG_GUIDING_RA 0x04
+#define STATUS_FLAG_GUIDING_DEC 0x08
+#define STATUS_FLAG_FOCUSER_MOVING 0x10
+#define STATUS_FLAG_LIMIT 0x20
+#define STATUS_FLAG_FLIPPING 0x40
+
+typedef struct status {
+    uint8_t buffer[STATUS_SIZE];
+} __attribute__((aligned(4))) status_t;
+
+/* clock offset exchange: origin is echoed untouched, receive/transmit are esp_timer_get_time() */
+#define CLOCK_FRAME_TYPE 0x43
+#define CLOCK_TYPE(B) (*((uint8_t*)(B)))
+#define CLOCK_ORIGIN_HI(B) (*((uint32_t*)((B) + 4)))
+#define CLOCK_ORIGIN_LO(B) (*((uint32_t*)((B) + 8)))
+#define CLOCK_RECEIVE_HI(B) (*((uint32_t*)((B) + 12)))
+#define CLOCK_RECEIVE_LO(B) (*((uint32_t*)((B) + 16)))
+#define CLOCK_TRANSMIT_HI(B) (*((uint32_t*)((B) + 20)))
+#define CLOCK_TRANSMIT_LO(B) (*((uint32_t*)((B) + 24)))
+#define CLOCK_SIZE 28
+
+typedef struct clock_sync {
+    uint8_t buffer[CLOCK_SIZE];
+} __attribute__((aligned(4))) clock_sync_t;
+
+/* disciplined time, reply to a time sync */
+#define TIME_FRAME_TYPE 0x54
+#define TIME_TYPE(B) (*((uint8_t*)(B)))
+#define TIME_SAMPLES(B) (*((uint8_t*)((B) + 1)))
+#define TIME_DRIFT(B) (*((int32_t*)((B) + 4)))
+#define TIME_UTC_HI(B) (*((uint32_t*)((B) + 8)))
+#define TIME_UTC_LO(B) (*((uint32_t*)((B) + 12)))
+#define TIME_LST(B) (*((int32_t*)((B) + 16)))
+#define TIME_SIZE 20
+
+typedef struct time_sync {
+    uint8_t buffer[TIME_SIZE];
+} __attribute__((aligned(4))) time_sync_t;
+
+/* fitted pointing model, terms in millis in the order of pointing.h */
+#define POINTING_MODEL_FRAME_TYPE 0x50
+#define POINTING_MODEL_TYPE(B) (*((uint8_t*)(B)))
+#define POINTING_MODEL_POINTS(B) (*((uint8_t*)((B) + 1)))
+#define POINTING_MODEL_TERMS(B) (*((uint8_t*)((B) + 2)))
+#define POINTING_MODEL_RMS(B) (*((int32_t*)((B) + 4)))
+#define POINTING_MODEL_TERM(B, I) (*((int32_t*)((B) + 8 + 4 * (I))))
+#define POINTING_MODEL_MAX_TERMS 7
+#define POINTING_MODEL_SIZE (8 + 4 * POINTING_MODEL_MAX_TERMS)
+
+typedef struct pointing_model {
+    uint8_t buffer[POINTING_MODEL_SIZE];
+} __attribute__((aligned(4))) pointing_model_t;
+
+/* mount geometry, fields in the order of mount_config.h */
+#define MOUNT_CONFIG_FRAME_TYPE 0x47
+#define MOUNT_CONFIG_TYPE(B) (*((uint8_t*)(B)))
+#define MOUNT_CONFIG_FIELD(B, I) (*((uint32_t*)((B) + 4 + 4 * (I))))
+#define MOUNT_CONFIG_FIELDS 10
+#define MOUNT_CONFIG_SIZE (4 + 4 * MOUNT_CONFIG_FIELDS)
+
+typedef struct mount_config {
+    uint8_t buffer[MOUNT_CONFIG_SIZE];
+} __attribute__((aligned(4))) mount_config_t;
+
+/* soft limits, fields in the order of mount_limits.h */
+#define LIMITS_FRAME_TYPE 0x4C
+#define LIMITS_TYPE(B) (*((uint8_t*)(B)))
+#define LIMITS_ACTIVE(B) (*((uint8_t*)((B) + 1)))
+#define LIMITS_FIELD(B, I) (*((int32_t*)((B) + 4 + 4 * (I))))
+#define LIMITS_FIELDS 4
+#define LIMITS_SIZE (4 + 4 * LIMITS_FIELDS)
+
+typedef struct limits_frame {
+    uint8_t buffer[LIMITS_SIZE];
+} __attribute__((aligned(4))) limits_frame_t;
+
+/* one cycle count histogram of perf.h */
+#define PERF_FRAME_TYPE 0x48
+#define PERF_TYPE(B) (*((uint8_t*)(B)))
+#define PERF_STAGE(B) (*((uint8_t*)((B) + 1)))
+#define PERF_COUNT(B) (*((uint32_t*)((B) + 4)))
+#define PERF_MAX(B) (*((uint32_t*)((B) + 8)))
+#define PERF_BUCKET(B, I) (*((uint32_t*)((B) + 12 + 4 * (I))))
+#define PERF_FRAME_BUCKETS 32
+#define PERF_SIZE (12 + 4 * PERF_FRAME_BUCKETS)
+
+typedef struct perf_frame {
+    uint8_t buffer[PERF_SIZE];
+} __attribute__((aligned(4))) perf_frame_t;
+
+/* events of one core's trace ring, see trace.h */
+#define TRACE_FRAME_TYPE 0x52
+#define TRACE_TYPE(B) (*((uint8_t*)(B)))
+#define TRACE_CORE(B) (*((uint8_t*)((B) + 1)))
+#define TRACE_COUNT(B) (*((uint8_t*)((B) + 2)))
+#define TRACE_FIRST(B) (*((uint32_t*)((B) + 4))) //sequence number of the first event
+#define TRACE_HEAD(B) (*((uint32_t*)((B) + 8))) //sequence number the ring writes next
+#define TRACE_EVENT_ID(B, I) (*((uint16_t*)((B) + 12 + 16 * (I))))
+#define TRACE_EVENT_TIME(B, I) (*((uint32_t*)((B) + 16 + 16 * (I))))
+#define TRACE_EVENT_A(B, I) (*((int32_t*)((B) + 20 + 16 * (I))))
+#define TRACE_EVENT_B(B, I) (*((int32_t*)((B) + 24 + 16 * (I))))
+#define TRACE_FRAME_EVENTS 32
+#define TRACE_SIZE (12 + 16 * TRACE_FRAME_EVENTS)
+
+typedef struct trace_frame {
+    uint8_t buffer[TRACE_SIZE];
+} __attribute__((aligned(4))) trace_frame_t;
+
+/* a slice of the capture ring at an absolute offset, see capture.h */
+#define CAPTURE_FRAME_TYPE 0x44
+#define CAPTURE_TYPE(B) (*((uint8_t*)(B)))
+#define CAPTURE_MODE(B) (*((uint8_t*)((B) + 1)))
+#define CAPTURE_LENGTH(B) (*((uint16_t*)((B) + 2)))
+#define CAPTURE_OFFSET(B) (*((uint32_t*)((B) + 4)))
+#define CAPTURE_HEAD(B) (*((uint32_t*)((B) + 8)))
+#define CAPTURE_DATA(B) ((uint8_t*)((B) + 12))
+#define CAPTURE_FRAME_BYTES 1024
+#define CAPTURE_SIZE (12 + CAPTURE_FRAME_BYTES)
+
+typedef struct capture_frame {
+    uint8_t buffer[CAPTURE_SIZE];
+} __attribute__((aligned(4))) capture_frame_t;
+
+/* stack, heap and load telemetry of diag.h */
+#define DIAG_FRAME_TYPE 0x49
+#define DIAG_TYPE(B) (*((uint8_t*)(B)))
+#define DIAG_TASK_COUNT(B) (*((uint8_t*)((B) + 1)))
+#define DIAG_CPU_LOAD(B, I) (*((uint8_t*)((B) + 2 + (I)))) //percent per core, 0xff unknown
+#define DIAG_FREE_HEAP(B) (*((uint32_t*)((B) + 4)))
+#define DIAG_MIN_FREE_HEAP(B) (*((uint32_t*)((B) + 8)))
+#define DIAG_LARGEST_FREE_BLOCK(B) (*((uint32_t*)((B) + 12)))
+#define DIAG_FREE_INTERNAL(B) (*((uint32_t*)((B) + 16)))
+#define DIAG_TASK_NAME(B, I) ((char*)((B) + 20 + 24 * (I))) //16 bytes, nul padded
+#define DIAG_TASK_STACK_FREE(B, I) (*((uint32_t*)((B) + 36 + 24 * (I))))
+#define DIAG_TASK_CORE(B, I) (*((uint8_t*)((B) + 40 + 24 * (I)))) //0xff not pinned
+#define DIAG_TASK_PRIORITY(B, I) (*((uint8_t*)((B) + 41 + 24 * (I))))
+#define DIAG_FRAME_CORES 2
+#define DIAG_FRAME_TASKS 16
+#define DIAG_SIZE (20 + 24 * DIAG_FRAME_TASKS)
+
+typedef struct diag_frame {
+    uint8_t buffer[DIAG_SIZE];
+} __attribute__((aligned(4))) diag_frame_t;
+
+/* focuser state, broadcast with the status frame when the focuser is enabled */
+#define FOCUSER_FRAME_TYPE 0x46
+#define FOCUSER_TYPE(B) (*((uint8_t*)(B)))
+#define FOCUSER_FLAGS(B) (*((uint8_t*)((B) + 1)))
+#define FOCUSER_POSITION(B) (*((int32_t*)((B) + 4)))
+#define FOCUSER_TARGET(B) (*((int32_t*)((B) + 8)))
+#define FOCUSER_TEMPERATURE(B) (*((int32_t*)((B) + 12)))
+#define FOCUSER_TEMP_COEFFICIENT(B) (*((int32_t*)((B) + 16)))
+#define FOCUSER_SIZE 20
+
+#define FOCUSER_FLAG_MOVING 0x01
+#define FOCUSER_FLAG_TEMP_COMP 0x02
+
+typedef struct focuser_frame {
+    uint8_t buffer[FOCUSER_SIZE];
+} __attribute__((aligned(4))) focuser_frame_t;
+
+void set_broadcast_fields(
+    broadcast_t *target,
+    uint32_t ip,
+    uint16_t port,
+    int32_t ra, //in millis
+    int32_t dec, //in millis
+    bool slewing,
+    bool tracking,
+    int32_t ra_speed, // in milli seconds per sidereal second
+    int32_t dec_speed, // in milli seconds per second 
+    uint8_t side_of_pier // 0: Normal (East); 1: Beyond the pole (West)
+);
+
+void set_status_fields(
+    status_t *target,
+    int64_t timestamp, // esp_timer_get_time() at sampling, in micro seconds
+    int32_t ra, //in millis
+    int32_t dec, //in millis
+    int32_t ra_velocity, //in millis per second
+    int32_t dec_velocity, //in millis per second
+    uint8_t slew_phase,
+    uint32_t slew_eta, //in milli seconds
+    uint8_t flags,
+    uint8_t side_of_pier,
+    uint8_t limits,
+    uint8_t cpu_load, // in percent
+    uint16_t stack_free // in bytes
+);
+
+void set_clock_fields(
+    clock_sync_t *target,
+    const uint8_t *origin, // 8 bytes from the request, echoed as is
+    int64_t receive, // in micro seconds
+    int64_t transmit // in micro seconds
+);
+
+void set_time_fields(
+    time_sync_t *target,
+    uint8_t samples,
+    int32_t drift, // in ppb
+    int64_t utc, // unix time in milli seconds
+    int32_t lst // in millis
+);
+
+void set_pointing_model_fields(
+    pointing_model_t *target,
+    uint8_t points,
+    uint8_t terms, // number of fitted terms
+    int32_t rms, // in millis
+    const int32_t *values // POINTING_MODEL_MAX_TERMS terms in millis
+);
+
+void set_mount_config_fields(
+    mount_config_t *target,
+    const uint32_t *values // MOUNT_CONFIG_FIELDS fields
+);
+
+void set_limits_fields(
+    limits_frame_t *target,
+    uint8_t active,
+    const int32_t *values // LIMITS_FIELDS fields in millis
+);
+
+void set_perf_fields(
+    perf_frame_t *target,
+    uint8_t stage,
+    uint32_t count,
+    uint32_t max, // in cycles
+    const uint32_t *buckets // PERF_FRAME_BUCKETS log2 buckets
+);
+
+/* returns the frame length for count events */
+int set_trace_fields(
+    trace_frame_t *target,
+    uint8_t core,
+    uint8_t count,
+    uint32_t first,
+    uint32_t head
+);
+
+void set_trace_event_fields(
+    trace_frame_t *target,
+    int index,
+    uint16_t id,
+    uint32_t time, // in micro seconds, low 32 bits
+    int32_t a,
+    int32_t b
+);
+
+/* the data is copied to CAPTURE_DATA() by the caller, returns the frame length */
+int set_capture_fields(
+    capture_frame_t *target,
+    uint8_t mode,
+    uint16_t length,
+    uint32_t offset,
+    uint32_t head
+);
+
+/* returns the frame length for count tasks */
+int set_diag_fields(
+    diag_frame_t *target,
+    uint8_t count,
+    const uint8_t *cpu_load, // DIAG_FRAME_CORES loads in percent
+    uint32_t free_heap, // in bytes, as are the next three
+    uint32_t min_free_heap,
+    uint32_t largest_free_block,
+    uint32_t free_internal
+);
+
+void set_diag_task_fields(
+    diag_frame_t *target,
+    int index,
+    const char *name,
+    uint32_t stack_free, // in bytes
+    uint8_t core,
+    uint8_t priority
+);
+
+void set_focuser_fields(
+    focuser_frame_t *target,
+    uint8_t flags,
+    int32_t position, // in steps
+    int32_t target_position, // in steps
+    int32_t temperature, // in milli degrees Celsius
+    int32_t temp_coefficient // in milli steps per degree Celsius
+);
+
+
+    // /* IP     */ *(uint32_t*)(buffer    )  = htonl(my_ip_num);
+    // /* Port   */ *(uint16_t*)(buffer + 4)  = htons(UDP_PORT);
+    // /* RADIR  */ *(uint8_t* )(buffer + 6)  = get_ra_direction() ? 1 : 0;
+    // /* RATICK */ *(int32_t* )(buffer + 7)  = htonl(get_ra_pulses_raw());
+    // /* DECDIR */ *(uint8_t* )(buffer + 11) = get_dec_direction() ? 1 : 0;
+    // /* DECTICK*/ *(int32_t* )(buffer + 12) = htonl(get_dec_pulses_raw());
+
+
 #endif
\ No newline at end of file
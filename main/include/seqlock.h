@@ -0,0 +1,43 @@
+#ifndef __SEQLOCK_H
+#define __SEQLOCK_H
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Readers copy without locking and retry when a write overlapped, writers
+ * hold a spinlock for the few stores so they neither interleave nor get
+ * preempted halfway. Never write from an isr, readers there would spin on
+ * their own core.
+ */
+typedef struct seqlock {
+    volatile uint32_t sequence; //odd while a write is in progress
+    portMUX_TYPE writer;
+} seqlock_t;
+
+#define SEQLOCK_INITIALIZER { .sequence = 0, .writer = portMUX_INITIALIZER_UNLOCKED }
+
+static inline void seqlock_write_begin(seqlock_t* lock) {
+    portENTER_CRITICAL(&lock->writer);
+    lock->sequence ++;
+    __sync_synchronize();
+}
+
+static inline void seqlock_write_end(seqlock_t* lock) {
+    __sync_synchronize();
+    lock->sequence ++;
+    portEXIT_CRITICAL(&lock->writer);
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t* lock) {
+    uint32_t sequence;
+    while ((sequence = lock->sequence) & 1);
+    __sync_synchronize();
+    return sequence;
+}
+
+/* true when the copy made since seqlock_read_begin() may be torn */
+static inline bool seqlock_read_retry(const seqlock_t* lock, uint32_t sequence) {
+    __sync_synchronize();
+    return lock->sequence != sequence;
+}
+#endif
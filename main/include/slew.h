@@ -1,15 +1,31 @@
-#ifndef __SLEW_H
-#define __SLEW_H
-
-#include "freertos/FreeRTOS.h"
-#include "esp_err.h"
-
-typedef void (*slew_set_motor_speed_callback)(double raCyclesPerSiderealDay, double decCyclesPerDay);
-
-esp_err_t init_slew(slew_set_motor_speed_callback callback);
-bool is_slewing();
-void abort_slew();
-void slew_to_coordinates(int32_t raMillis, int32_t decMillis);
-double get_slew_progress();
-uint32_t get_slew_time_to_go_millis();
+#ifndef __SLEW_H
+#define __SLEW_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define SLEW_PHASE_IDLE 0
+#define SLEW_PHASE_CRUISE 1
+#define SLEW_PHASE_APPROACH 2
+
+typedef void (*slew_set_motor_speed_callback)(double raCyclesPerSiderealDay, double decCyclesPerDay);
+/* whether an automatic meridian flip may take over the mount now */
+typedef bool (*slew_can_flip_callback)();
+/* a flip arrived, the mount is on side with the given mount coordinates */
+typedef void (*slew_flipped_callback)(uint8_t side, int32_t raMillis, int32_t decMillis);
+
+esp_err_t init_slew(slew_set_motor_speed_callback callback, slew_can_flip_callback canFlip, slew_flipped_callback flipped);
+bool is_slewing();
+bool is_meridian_flipping();
+/* slews to the current position on the other side of the pier */
+esp_err_t slew_meridian_flip();
+void abort_slew();
+/* ESP_ERR_INVALID_STATE when the mount state refuses a slew */
+esp_err_t slew_to_coordinates(int32_t raMillis, int32_t decMillis);
+double get_slew_progress();
+uint32_t get_slew_time_to_go_millis();
+uint8_t get_slew_phase();
+/* signed shortest way from target to current, in millis */
+int32_t getRaDiff(int32_t target, int32_t current);
+double dist(double a, double b);
 #endif
\ No newline at end of file
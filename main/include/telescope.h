@@ -1,6 +1,13 @@
-#include "freertos/FreeRTOS.h"
-
-uint8_t getSideOfPier();
-int32_t decMillis2decMecMillis(int32_t decMillis);
-int32_t decMecMillis2decMillis(int32_t decMecMillis, uint8_t* parseSideOfPier);
-void setSideOfPierWithDecMecMillis(int32_t decMecMillis);
\ No newline at end of file
+#include "freertos/FreeRTOS.h"
+#include "persist.h"
+
+uint8_t getSideOfPier();
+int32_t decMillis2decMecMillis(int32_t decMillis);
+int32_t decMecMillis2decMillis(int32_t decMecMillis, uint8_t* parseSideOfPier);
+void setSideOfPierWithDecMecMillis(int32_t decMecMillis);
+
+/* the START record of a capture: the journaled fields, tracking, ra and dec speed */
+#define CAPTURE_SNAPSHOT_FIELDS (PERSIST_FIELDS + 3)
+void collectCaptureSnapshot(int32_t* values);
+/* the mount as it was when the capture started, for a replay; a slew in progress is not in it */
+void restoreCaptureSnapshot(const int32_t* values);
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Binary events for the hot paths, where LOGI would format and wait for
+ * the UART. Keep the ids in sync with tools/trace_to_chrome.py.
+ */
+#define TRACE_AXIS_RATE 1 //LEDC channel (0 RA, 1 Dec, 2 focuser), signed step frequency in Hz
+#define TRACE_SLEW_TICK 2 //ra diff, dec diff in millis
+#define TRACE_SLEW_SLOWDOWN 3 //speed in cycles per day, check interval in ms
+#define TRACE_GUIDE_PULSE 4 //axis << 8 | direction, pulse length in ms
+#define TRACE_COMMAND_BEGIN 5 //command, length
+#define TRACE_COMMAND_END 6 //command, result
+
+typedef struct trace_event {
+    uint16_t id;
+    uint32_t time; //esp_timer_get_time(), low 32 bits
+    int32_t a, b;
+} trace_event_t;
+
+#ifdef CONFIG_TRACE
+
+void trace(uint16_t id, int32_t a, int32_t b);
+/*
+ * Copies up to max events of the core's ring from sequence number *from on,
+ * moving *from up to the first event still in the ring. Returns the count,
+ * *head is the sequence number the ring will write next.
+ */
+int trace_read(uint8_t core, uint32_t* from, uint32_t* head, trace_event_t* events, int max);
+
+#define TRACE(id, a, b) trace(id, a, b)
+
+#else
+
+#define TRACE(id, a, b)
+
+#endif
+#endif
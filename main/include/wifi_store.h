@@ -0,0 +1,18 @@
+#ifndef __WIFI_STORE_H
+#define __WIFI_STORE_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define WIFI_SSID_MAX 32
+#define WIFI_PASS_MAX 64
+
+typedef struct wifi_credentials {
+    char ssid[WIFI_SSID_MAX + 1];
+    char pass[WIFI_PASS_MAX + 1];
+} wifi_credentials_t;
+
+/* station credentials from nvs, the Kconfig ones if none were stored */
+void load_wifi_credentials(wifi_credentials_t* credentials);
+esp_err_t save_wifi_credentials(const wifi_credentials_t* credentials);
+#endif
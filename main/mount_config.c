@@ -0,0 +1,134 @@
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "string.h"
+#include "mount_config.h"
+#include "astro.h"
+#include "util.h"
+
+#define TAG "MOUNT_CONFIG"
+
+#define CONFIG_NAMESPACE "mount"
+#define GEOMETRY_KEY "geometry"
+/* the top speed must not overflow the Q24 multiply into int32 mHz */
+#define SPEED_LIMIT (30 * SPEED_PER_CYCLE)
+
+mount_constants_t mount_constants;
+static uint32_t geometry[GEOMETRY_FIELDS] = {
+    CONFIG_RA_GEAR_RATIO,
+    CONFIG_RA_RESOLUTION,
+    CONFIG_RA_CYCLE_STEPS,
+    CONFIG_GPIO_RA_RENCODER_PULSES,
+    CONFIG_RA_BACKLASH_PULSES,
+    CONFIG_DEC_GEAR_RATIO,
+    CONFIG_DEC_RESOLUTION,
+    CONFIG_DEC_CYCLE_STEPS,
+    CONFIG_GPIO_DEC_RENCODER_PULSES,
+    CONFIG_DEC_BACKLASH_PULSES,
+};
+
+static uint64_t get_millihz_per_speed_q24(const uint32_t* values, int offset, uint32_t day_millis) {
+    uint64_t steps_per_cycle = (uint64_t)values[offset + GEOMETRY_RA_CYCLE_STEPS] * values[offset + GEOMETRY_RA_RESOLUTION] * values[offset + GEOMETRY_RA_GEAR_RATIO];
+    // steps per cycle * 1000000 mHz / speed per cycle / day millis
+    return (steps_per_cycle * 1000000 / SPEED_PER_CYCLE << 24) / day_millis;
+}
+
+static int64_t get_millis_per_pulse_q24(const uint32_t* values, int offset, uint32_t day_millis) {
+    uint64_t pulses_per_cycle = (uint64_t)values[offset + GEOMETRY_RA_ENCODER_PULSES] * values[offset + GEOMETRY_RA_GEAR_RATIO];
+    return ((int64_t)day_millis << 24) / pulses_per_cycle;
+}
+
+static int32_t get_backlash_steps(const uint32_t* values, int offset) {
+    uint64_t steps_per_cycle = (uint64_t)values[offset + GEOMETRY_RA_CYCLE_STEPS] * values[offset + GEOMETRY_RA_RESOLUTION];
+    return (int32_t)(values[offset + GEOMETRY_RA_BACKLASH_PULSES] * steps_per_cycle / values[offset + GEOMETRY_RA_ENCODER_PULSES]);
+}
+
+static bool is_valid_geometry(const uint32_t* values) {
+    for (int offset = 0; offset < GEOMETRY_FIELDS; offset += GEOMETRY_DEC_GEAR_RATIO) {
+        if (!values[offset + GEOMETRY_RA_GEAR_RATIO] || !values[offset + GEOMETRY_RA_RESOLUTION]
+            || !values[offset + GEOMETRY_RA_CYCLE_STEPS] || !values[offset + GEOMETRY_RA_ENCODER_PULSES]) return false;
+        if (values[offset + GEOMETRY_RA_BACKLASH_PULSES] > values[offset + GEOMETRY_RA_ENCODER_PULSES]) return false;
+        uint64_t rate = get_millihz_per_speed_q24(values, offset, DAY_MILLIS < SIDEREAL_DAY_MILLIS ? DAY_MILLIS : SIDEREAL_DAY_MILLIS);
+        if (rate == 0 || rate > UINT32_MAX || ((rate * SPEED_LIMIT) >> 24) > INT32_MAX) return false;
+    }
+    return true;
+}
+
+static void apply_geometry() {
+    mount_constants_t constants = {
+        .ra_millihz_per_speed_q24 = get_millihz_per_speed_q24(geometry, GEOMETRY_RA_GEAR_RATIO, SIDEREAL_DAY_MILLIS),
+        .dec_millihz_per_speed_q24 = get_millihz_per_speed_q24(geometry, GEOMETRY_DEC_GEAR_RATIO, DAY_MILLIS),
+        .ra_millis_per_pulse_q24 = get_millis_per_pulse_q24(geometry, GEOMETRY_RA_GEAR_RATIO, SIDEREAL_DAY_MILLIS),
+        .dec_millis_per_pulse_q24 = get_millis_per_pulse_q24(geometry, GEOMETRY_DEC_GEAR_RATIO, DAY_MILLIS),
+        .ra_backlash_pulses = geometry[GEOMETRY_RA_BACKLASH_PULSES],
+        .dec_backlash_pulses = geometry[GEOMETRY_DEC_BACKLASH_PULSES],
+        .ra_backlash_steps = get_backlash_steps(geometry, GEOMETRY_RA_GEAR_RATIO),
+        .dec_backlash_steps = get_backlash_steps(geometry, GEOMETRY_DEC_GEAR_RATIO),
+    };
+    mount_constants = constants;
+}
+
+esp_err_t init_mount_config() {
+    nvs_handle handle;
+    if (nvs_open(CONFIG_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        uint32_t stored[GEOMETRY_FIELDS];
+        size_t len = sizeof(stored);
+        if (nvs_get_blob(handle, GEOMETRY_KEY, stored, &len) == ESP_OK && len == sizeof(stored)) {
+            if (is_valid_geometry(stored)) {
+                memcpy(geometry, stored, sizeof(geometry));
+                LOGI(TAG, "using stored geometry");
+            } else {
+                LOGE(TAG, "stored geometry is invalid, using defaults");
+            }
+        }
+        nvs_close(handle);
+    }
+    if (!is_valid_geometry(geometry)) {
+        LOGE(TAG, "invalid geometry");
+        return ESP_ERR_INVALID_ARG;
+    }
+    apply_geometry();
+    return ESP_OK;
+}
+
+void get_mount_geometry(uint32_t* values) {
+    memcpy(values, geometry, sizeof(geometry));
+}
+
+static esp_err_t store_geometry(const uint32_t* values) {
+    nvs_handle handle;
+    esp_err_t err = nvs_open(CONFIG_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "nvs open failed: %d", err);
+        return err;
+    }
+    err = nvs_set_blob(handle, GEOMETRY_KEY, values, sizeof(geometry));
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "saving geometry failed: %d", err);
+    }
+    return err;
+}
+
+esp_err_t set_mount_geometry(const uint32_t* values) {
+    if (!is_valid_geometry(values)) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = store_geometry(values);
+    if (err != ESP_OK) return err;
+    memcpy(geometry, values, sizeof(geometry));
+    apply_geometry();
+    return ESP_OK;
+}
+
+esp_err_t apply_mount_geometry(const uint32_t* values) {
+    if (!is_valid_geometry(values)) return ESP_ERR_INVALID_ARG;
+    memcpy(geometry, values, sizeof(geometry));
+    apply_geometry();
+    return ESP_OK;
+}
+
+esp_err_t save_mount_geometry() {
+    uint32_t values[GEOMETRY_FIELDS];
+    memcpy(values, geometry, sizeof(values));
+    return store_geometry(values);
+}
@@ -1,192 +1,216 @@
-#include "mount_encoder.h"
-#include "util.h"
-#include "sdkconfig.h"
-#include "rencoder.h"
-#include "astro.h"
-#include "telescope.h"
-
-uint64_t encoder_reset_time;
-int32_t reset_ra_angle_millis, reset_dec_angle_millis;
-rencoder_t ra_encoder, dec_encoder;
-int32_t ra_pulses, dec_pulses;
-int8_t ra_is_clearing_backlash, dec_is_clearing_backlash;
-int32_t ra_backlash_pulses, dec_backlash_pulses;
-int32_t ra_actual_pulses, dec_actual_pulses;
-
-#define TAG "MOUNT_ENCODER"
-
-#ifndef CONFIG_RA_REVERSE_RENCODER
-#define CONFIG_RA_REVERSE_RENCODER false
-#endif
-
-#ifndef CONFIG_DEC_REVERSE_RENCODER
-#define CONFIG_DEC_REVERSE_RENCODER false
-#endif
-
-void ra_encoder_dir_callback(rencoder_t* target, bool dir, void* args);
-void ra_encoder_pul_callback(rencoder_t* target, int32_t pul, int8_t diff, void* args);
-void dec_encoder_dir_callback(rencoder_t* target, bool dir, void* args);
-void dec_encoder_pul_callback(rencoder_t* target, int32_t pul, int8_t diff, void* args);
-
-void init_mount(){
-    ESP_ERROR_CHECK_ALLOW_INVALID_STATE(rencoder_init());
-    ESP_ERROR_CHECK(rencoder_start(&ra_encoder, CONFIG_GPIO_RA_RENCODER_A, CONFIG_GPIO_RA_RENCODER_B, ra_encoder_pul_callback, ra_encoder_dir_callback, CONFIG_RA_REVERSE_RENCODER));
-    ESP_ERROR_CHECK(rencoder_start(&dec_encoder, CONFIG_GPIO_DEC_RENCODER_A, CONFIG_GPIO_DEC_RENCODER_B, dec_encoder_pul_callback, dec_encoder_dir_callback, CONFIG_DEC_REVERSE_RENCODER));
-    encoder_reset_time = currentTimeMillis();
-    ra_pulses = 0;
-    dec_pulses = 0;
-    ra_is_clearing_backlash = false;
-    dec_is_clearing_backlash = false;
-    ra_actual_pulses = 0;
-    dec_actual_pulses = 0;
-    reset_ra_angle_millis = 0;
-    reset_dec_angle_millis = 0;
-}
-
-int32_t get_ra_pulses_raw() {
-    return rencoder_value(&ra_encoder);
-}
-
-int32_t get_dec_pulses_raw() {
-    return rencoder_value(&dec_encoder);
-}
-
-bool get_ra_direction() {
-    return rencoder_getdirection(&ra_encoder);
-}
-
-bool get_dec_direction() {
-    return rencoder_getdirection(&dec_encoder);
-}
-
-int32_t get_ra_pulses() {
-    return ra_actual_pulses;
-}
-
-int32_t get_dec_pulses() {
-    return dec_actual_pulses;
-}
-
-//RA_BACKLASH_PULSES
-void ra_encoder_dir_callback(rencoder_t* target, bool dir, void* args) {
-    if (dir) {//to positive
-        if (ra_is_clearing_backlash == 1) { 
-            //already clearing positive clearing, do nothing
-        } else if (ra_is_clearing_backlash == -1) { //negative clearing
-            //covert to positive clearing
-            // LOGI(TAG, "negative clearing backlash revert to positive");
-            ra_is_clearing_backlash = 1;
-            ra_backlash_pulses = ra_backlash_pulses - CONFIG_RA_BACKLASH_PULSES; //expected_pulses_after_negative_clearing
-        } else { //not clearing
-            // LOGI(TAG, "positive clearing backlash");
-            ra_is_clearing_backlash = 1;
-            ra_backlash_pulses = get_ra_pulses_raw();
-        }
-    } else { //to negative
-        if (ra_is_clearing_backlash == 1) { 
-            // LOGI(TAG, "positive clearing backlash revert to negative");
-            ra_is_clearing_backlash = -1;
-            ra_backlash_pulses = ra_backlash_pulses + CONFIG_RA_BACKLASH_PULSES; //expected_pulses_after_positive_clearing
-        } else if (ra_is_clearing_backlash == -1) { //negative clearing
-            
-        } else { //not clearing
-            // LOGI(TAG, "negative clearing backlash");
-            ra_is_clearing_backlash = -1;
-            ra_backlash_pulses = get_ra_pulses_raw();
-        }
-    }
-}
-
-void ra_encoder_pul_callback(rencoder_t* target, int32_t pul, int8_t diff, void* args){
-    if (ra_is_clearing_backlash == 1) {
-        if (pul >= ra_backlash_pulses + CONFIG_RA_BACKLASH_PULSES) {//clearing finished
-            int32_t diff_after_clear = pul - ra_backlash_pulses - CONFIG_RA_BACKLASH_PULSES;
-            ra_is_clearing_backlash = false;
-            ra_actual_pulses += diff_after_clear;
-        }
-    } else if (ra_is_clearing_backlash == -1) {
-        if (pul <= ra_backlash_pulses - CONFIG_RA_BACKLASH_PULSES) {//clearing finished
-            int32_t diff_after_clear = pul - ra_backlash_pulses + CONFIG_RA_BACKLASH_PULSES;
-            ra_is_clearing_backlash = false;
-            ra_actual_pulses += diff_after_clear;
-        }
-    } else {
-        ra_actual_pulses += diff;
-    }
-}
-
-void dec_encoder_dir_callback(rencoder_t* target, bool dir, void* args){
-    if (dir) {//to positive
-        if (dec_is_clearing_backlash == 1) { 
-            //already clearing positive clearing, do nothing
-        } else if (dec_is_clearing_backlash == -1) { //negative clearing
-            //covert to positive clearing
-            // LOGI(TAG, "negative clearing backlash revert to positive");
-            dec_is_clearing_backlash = 1;
-            dec_backlash_pulses = dec_backlash_pulses - CONFIG_DEC_BACKLASH_PULSES; //expected_pulses_after_negative_clearing
-        } else { //not clearing
-            // LOGI(TAG, "positive clearing backlash");
-            dec_is_clearing_backlash = 1;
-            dec_backlash_pulses = get_dec_pulses_raw();
-        }
-    } else { //to negative
-        if (dec_is_clearing_backlash == 1) { 
-            // LOGI(TAG, "positive clearing backlash revert to negative");
-            dec_is_clearing_backlash = -1;
-            dec_backlash_pulses = dec_backlash_pulses + CONFIG_DEC_BACKLASH_PULSES; //expected_pulses_after_positive_clearing
-        } else if (dec_is_clearing_backlash == -1) { //negative clearing
-            
-        } else { //not clearing
-            // LOGI(TAG, "negative clearing backlash");
-            dec_is_clearing_backlash = -1;
-            dec_backlash_pulses = get_dec_pulses_raw();
-        }
-    }
-}
-
-void dec_encoder_pul_callback(rencoder_t* target, int32_t pul, int8_t diff, void* args){
-    if (dec_is_clearing_backlash == 1) {
-        if (pul >= dec_backlash_pulses + CONFIG_DEC_BACKLASH_PULSES) {//clearing finished
-            int32_t diff_after_clear = pul - dec_backlash_pulses - CONFIG_DEC_BACKLASH_PULSES;
-            dec_is_clearing_backlash = false;
-            dec_actual_pulses += diff_after_clear;
-        }
-    } else if (dec_is_clearing_backlash == -1) {
-        if (pul <= dec_backlash_pulses - CONFIG_DEC_BACKLASH_PULSES) {//clearing finished
-            int32_t diff_after_clear = pul - dec_backlash_pulses + CONFIG_DEC_BACKLASH_PULSES;
-            dec_is_clearing_backlash = false;
-            dec_actual_pulses += diff_after_clear;
-        }
-    } else {
-        dec_actual_pulses += diff;
-    }
-}
-
-double ra_pulse_ratio = ((double) SIDEREAL_DAY_MILLIS) / (CONFIG_GPIO_RA_RENCODER_PULSES * CONFIG_RA_GEAR_RATIO);
-double dec_pulse_ratio = ((double) DAY_MILLIS) / (CONFIG_GPIO_DEC_RENCODER_PULSES * CONFIG_DEC_GEAR_RATIO);
-double ra_time_ratio = ((double) DAY_MILLIS / (double) SIDEREAL_DAY_MILLIS);
-
-int32_t get_ra_angle_millis() {
-    double time_offset_millis = currentTimeMillis() - encoder_reset_time;
-    double ra_moved_millis = (double)(ra_pulse_ratio * ra_actual_pulses);
-    return (int32_t)(ra_time_ratio * (reset_ra_angle_millis + time_offset_millis - ra_moved_millis));
-}
-
-int32_t get_dec_angle_millis() {
-    return decMecMillis2decMillis(get_dec_mechnical_angle_millis(), NULL);
-}
-
-int32_t get_dec_mechnical_angle_millis() {
-    int32_t dec_moved_millis = (int32_t)(dec_pulse_ratio * dec_actual_pulses);
-    return reset_dec_angle_millis + dec_moved_millis;
-}
-
-void set_angles(int32_t ra_angle_day_millis, int32_t dec_angle_day_millis) {
-    encoder_reset_time = currentTimeMillis();
-    int32_t ra_angle_sidereal_millis = (int32_t)((double)ra_angle_day_millis / ra_time_ratio);
-    reset_ra_angle_millis = ra_angle_sidereal_millis;
-    reset_dec_angle_millis = decMillis2decMecMillis(dec_angle_day_millis);
-
-    ra_actual_pulses = 0;
-    dec_actual_pulses = 0;
+#include "esp_timer.h"
+#include "mount_encoder.h"
+#include "util.h"
+#include "sdkconfig.h"
+#include "rencoder.h"
+#include "astro.h"
+#include "telescope.h"
+#include "mount_config.h"
+#include "axis.h"
+#include "seqlock.h"
+
+/*
+ * Where the angles count from. The encoder isr is the only writer of
+ * actual_pulses, a reset moves the baselines instead, and readers in any
+ * task get the whole reference from one seqlock copy.
+ */
+typedef struct encoder_reference {
+    int64_t reset_time; //get_disciplined_millis() at the reset
+    int32_t reset_ra_angle_millis, reset_dec_angle_millis;
+    int32_t ra_pulses_at_reset, dec_pulses_at_reset;
+    int64_t pending_reset_utc_millis; //utc of reset_time from a restored state, applied once the clock gets synced
+} encoder_reference_t;
+static seqlock_t reference_lock = SEQLOCK_INITIALIZER;
+static encoder_reference_t reference;
+/* the backlash state machine of each axis lives in axis.c */
+static axis_t* const ra_axis = &mount_axes[AXIS_RA];
+static axis_t* const dec_axis = &mount_axes[AXIS_DEC];
+
+#define TAG "MOUNT_ENCODER"
+
+#ifndef CONFIG_RA_REVERSE_RENCODER
+#define CONFIG_RA_REVERSE_RENCODER false
+#endif
+
+#ifndef CONFIG_DEC_REVERSE_RENCODER
+#define CONFIG_DEC_REVERSE_RENCODER false
+#endif
+
+void init_mount(){
+    ESP_ERROR_CHECK_ALLOW_INVALID_STATE(rencoder_init());
+    ESP_ERROR_CHECK(axis_start_encoder(ra_axis, CONFIG_GPIO_RA_RENCODER_A, CONFIG_GPIO_RA_RENCODER_B, CONFIG_RA_REVERSE_RENCODER));
+    ESP_ERROR_CHECK(axis_start_encoder(dec_axis, CONFIG_GPIO_DEC_RENCODER_A, CONFIG_GPIO_DEC_RENCODER_B, CONFIG_DEC_REVERSE_RENCODER));
+    int64_t now = get_disciplined_millis();
+    seqlock_write_begin(&reference_lock);
+    reference.reset_time = now;
+    reference.reset_ra_angle_millis = 0;
+    reference.reset_dec_angle_millis = 0;
+    reference.ra_pulses_at_reset = ra_axis->actual_pulses;
+    reference.dec_pulses_at_reset = dec_axis->actual_pulses;
+    reference.pending_reset_utc_millis = 0;
+    seqlock_write_end(&reference_lock);
+}
+
+static void get_reference(encoder_reference_t* copy) {
+    uint32_t sequence;
+    do {
+        sequence = seqlock_read_begin(&reference_lock);
+        *copy = reference;
+    } while (seqlock_read_retry(&reference_lock, sequence));
+}
+
+int32_t get_ra_pulses_raw() {
+    return rencoder_value(&ra_axis->encoder);
+}
+
+int32_t get_dec_pulses_raw() {
+    return rencoder_value(&dec_axis->encoder);
+}
+
+bool get_ra_direction() {
+    return rencoder_getdirection(&ra_axis->encoder);
+}
+
+bool get_dec_direction() {
+    return rencoder_getdirection(&dec_axis->encoder);
+}
+
+/* pulses moved since the last reset */
+int32_t get_ra_pulses() {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    return ra_axis->actual_pulses - ref.ra_pulses_at_reset;
+}
+
+int32_t get_dec_pulses() {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    return dec_axis->actual_pulses - ref.dec_pulses_at_reset;
+}
+
+double ra_time_ratio = ((double) DAY_MILLIS / (double) SIDEREAL_DAY_MILLIS);
+
+static int32_t get_ra_angle_millis_at(const encoder_reference_t* ref, uint64_t time_millis) {
+    double time_offset_millis = (double)((int64_t)time_millis - ref->reset_time);
+    double ra_moved_millis = RA_PULSES_MILLIS(ra_axis->actual_pulses - ref->ra_pulses_at_reset);
+    return (int32_t)(ra_time_ratio * (ref->reset_ra_angle_millis + time_offset_millis - ra_moved_millis));
+}
+
+static int32_t get_dec_mechnical_angle_millis_of(const encoder_reference_t* ref) {
+    int32_t dec_moved_millis = DEC_PULSES_MILLIS(dec_axis->actual_pulses - ref->dec_pulses_at_reset);
+    return ref->reset_dec_angle_millis + dec_moved_millis;
+}
+
+int32_t get_ra_angle_millis() {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    return get_ra_angle_millis_at(&ref, get_disciplined_millis());
+}
+
+int32_t get_dec_angle_millis() {
+    return decMecMillis2decMillis(get_dec_mechnical_angle_millis(), NULL);
+}
+
+int32_t get_dec_mechnical_angle_millis() {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    return get_dec_mechnical_angle_millis_of(&ref);
+}
+
+/* velocity is estimated over at least VELOCITY_WINDOW_MICROS, shorter windows only see encoder quantization */
+#define VELOCITY_WINDOW_MICROS 1000000
+static portMUX_TYPE motion_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t velocity_base_time = -1;
+static int32_t velocity_base_ra, velocity_base_dec;
+static int32_t ra_velocity, dec_velocity;
+
+void get_mount_motion(mount_motion_t* motion) {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    int64_t now = esp_timer_get_time();
+    int32_t ra = get_ra_angle_millis_at(&ref, get_disciplined_micros(now) / 1000);
+    int32_t dec = decMecMillis2decMillis(get_dec_mechnical_angle_millis_of(&ref), NULL);
+    portENTER_CRITICAL(&motion_mux);
+    if (velocity_base_time < 0) {
+        velocity_base_time = now;
+        velocity_base_ra = ra;
+        velocity_base_dec = dec;
+    } else if (now - velocity_base_time >= VELOCITY_WINDOW_MICROS) {
+        int32_t ra_moved = angle_diff_millis(ra, velocity_base_ra);
+        int64_t window = now - velocity_base_time;
+        ra_velocity = (int32_t)((int64_t)ra_moved * 1000000 / window);
+        dec_velocity = (int32_t)((int64_t)(dec - velocity_base_dec) * 1000000 / window);
+        velocity_base_time = now;
+        velocity_base_ra = ra;
+        velocity_base_dec = dec;
+    }
+    motion->timestamp = now;
+    motion->ra = ra;
+    motion->dec = dec;
+    motion->ra_velocity = ra_velocity;
+    motion->dec_velocity = dec_velocity;
+    portEXIT_CRITICAL(&motion_mux);
+}
+
+void get_mount_state(mount_state_t* state) {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    int64_t now = get_disciplined_millis();
+    state->reset_ra_angle_millis = ref.reset_ra_angle_millis;
+    state->reset_dec_angle_millis = ref.reset_dec_angle_millis;
+    state->ra_actual_pulses = ra_axis->actual_pulses - ref.ra_pulses_at_reset;
+    state->dec_actual_pulses = dec_axis->actual_pulses - ref.dec_pulses_at_reset;
+    state->elapsed_millis = (int32_t)(now - ref.reset_time);
+    if (is_time_synced()) {
+        state->reset_utc_millis = get_utc_millis() - state->elapsed_millis;
+    } else {
+        state->reset_utc_millis = ref.pending_reset_utc_millis;
+    }
+}
+
+/*
+ * Without a synced clock nothing tells how long we were down, so RA resumes as
+ * if no time had passed since the state was saved. If the saved state knew
+ * its utc, RA is corrected exactly by mount_time_synced().
+ */
+void restore_mount_state(const mount_state_t* state) {
+    int64_t reset_time = get_disciplined_millis() - state->elapsed_millis;
+    seqlock_write_begin(&reference_lock);
+    reference.reset_time = reset_time;
+    reference.reset_ra_angle_millis = state->reset_ra_angle_millis;
+    reference.reset_dec_angle_millis = state->reset_dec_angle_millis;
+    reference.ra_pulses_at_reset = ra_axis->actual_pulses - state->ra_actual_pulses;
+    reference.dec_pulses_at_reset = dec_axis->actual_pulses - state->dec_actual_pulses;
+    reference.pending_reset_utc_millis = state->reset_utc_millis;
+    seqlock_write_end(&reference_lock);
+}
+
+void mount_time_synced() {
+    encoder_reference_t ref;
+    get_reference(&ref);
+    if (ref.pending_reset_utc_millis == 0) return;
+    int64_t reset_time = get_disciplined_millis() - (get_utc_millis() - ref.pending_reset_utc_millis);
+    seqlock_write_begin(&reference_lock);
+    reference.reset_time = reset_time;
+    reference.pending_reset_utc_millis = 0;
+    seqlock_write_end(&reference_lock);
+}
+
+void set_angles(int32_t ra_angle_day_millis, int32_t dec_angle_day_millis) {
+    int64_t now = get_disciplined_millis();
+    int32_t ra_angle_sidereal_millis = (int32_t)((double)ra_angle_day_millis / ra_time_ratio);
+    int32_t dec_mec_millis = decMillis2decMecMillis(dec_angle_day_millis);
+
+    seqlock_write_begin(&reference_lock);
+    reference.reset_time = now;
+    reference.reset_ra_angle_millis = ra_angle_sidereal_millis;
+    reference.reset_dec_angle_millis = dec_mec_millis;
+    reference.ra_pulses_at_reset = ra_axis->actual_pulses;
+    reference.dec_pulses_at_reset = dec_axis->actual_pulses;
+    reference.pending_reset_utc_millis = 0;
+    seqlock_write_end(&reference_lock);
+
+    portENTER_CRITICAL(&motion_mux);
+    velocity_base_time = -1;
+    portEXIT_CRITICAL(&motion_mux);
 }
\ No newline at end of file
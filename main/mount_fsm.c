@@ -0,0 +1,98 @@
+#include "esp_timer.h"
+#include "guide.h"
+#include "mount_fsm.h"
+#include "mount_snapshot.h"
+#include "util.h"
+
+#define TAG "MOUNT_FSM"
+
+/* targets besides the states, resolved by mount_fsm_next() */
+#define REFUSED MOUNT_STATE_REFUSED
+#define BASE 0xfe //tracking or idle, whichever the tracking flag says
+/* an event for take(), resolved there from whether a pulse runs */
+#define GUIDE_FOLLOW 0xfd
+
+/*
+ * One row per state, one column per event. Ends of something the state is
+ * not doing are stale and keep the state. A tripped limit wins everywhere,
+ * slews and calibrations are aborted by whoever reports it.
+ */
+static const uint8_t transitions[MOUNT_STATES][MOUNT_EVENTS] = {
+    /*                            TRACKING_ON              TRACKING_OFF             MOVE                     SYNC                     GUIDE_START              GUIDE_END                SLEW_START               SLEW_END                 CALIBRATE_START          CALIBRATE_END            LIMIT_TRIPPED            LIMITS_CLEARED */
+    [MOUNT_STATE_IDLE]        = { MOUNT_STATE_TRACKING,    MOUNT_STATE_IDLE,        MOUNT_STATE_IDLE,        MOUNT_STATE_IDLE,        MOUNT_STATE_GUIDING,     MOUNT_STATE_IDLE,        MOUNT_STATE_SLEWING,     MOUNT_STATE_IDLE,        MOUNT_STATE_CALIBRATING, MOUNT_STATE_IDLE,        MOUNT_STATE_FAULT,       MOUNT_STATE_IDLE },
+    [MOUNT_STATE_TRACKING]    = { MOUNT_STATE_TRACKING,    MOUNT_STATE_IDLE,        MOUNT_STATE_TRACKING,    MOUNT_STATE_TRACKING,    MOUNT_STATE_GUIDING,     MOUNT_STATE_TRACKING,    MOUNT_STATE_SLEWING,     MOUNT_STATE_TRACKING,    MOUNT_STATE_CALIBRATING, MOUNT_STATE_TRACKING,    MOUNT_STATE_FAULT,       MOUNT_STATE_TRACKING },
+    [MOUNT_STATE_GUIDING]     = { MOUNT_STATE_GUIDING,     MOUNT_STATE_GUIDING,     MOUNT_STATE_GUIDING,     MOUNT_STATE_GUIDING,     MOUNT_STATE_GUIDING,     BASE,                    REFUSED,                 MOUNT_STATE_GUIDING,     REFUSED,                 MOUNT_STATE_GUIDING,     MOUNT_STATE_FAULT,       MOUNT_STATE_GUIDING },
+    [MOUNT_STATE_SLEWING]     = { REFUSED,                 REFUSED,                 REFUSED,                 REFUSED,                 REFUSED,                 MOUNT_STATE_SLEWING,     REFUSED,                 BASE,                    REFUSED,                 MOUNT_STATE_SLEWING,     MOUNT_STATE_FAULT,       MOUNT_STATE_SLEWING },
+    [MOUNT_STATE_CALIBRATING] = { REFUSED,                 REFUSED,                 REFUSED,                 REFUSED,                 REFUSED,                 MOUNT_STATE_CALIBRATING, REFUSED,                 MOUNT_STATE_CALIBRATING, REFUSED,                 BASE,                    MOUNT_STATE_FAULT,       MOUNT_STATE_CALIBRATING },
+    [MOUNT_STATE_FAULT]       = { MOUNT_STATE_TRACKING,    MOUNT_STATE_IDLE,        BASE,                    MOUNT_STATE_FAULT,       REFUSED,                 MOUNT_STATE_FAULT,       MOUNT_STATE_SLEWING,     MOUNT_STATE_FAULT,       REFUSED,                 MOUNT_STATE_FAULT,       MOUNT_STATE_FAULT,       BASE },
+};
+
+static const char* state_descr[MOUNT_STATES] = {
+    [MOUNT_STATE_IDLE] = "idle",
+    [MOUNT_STATE_TRACKING] = "tracking",
+    [MOUNT_STATE_GUIDING] = "guiding",
+    [MOUNT_STATE_SLEWING] = "slewing",
+    [MOUNT_STATE_CALIBRATING] = "calibrating",
+    [MOUNT_STATE_FAULT] = "fault",
+};
+
+uint8_t mount_fsm_next(uint8_t state, uint8_t event, bool tracking) {
+    if (state >= MOUNT_STATES || event >= MOUNT_EVENTS) return REFUSED;
+    uint8_t next = transitions[state][event];
+    if (next == BASE) {
+        next = tracking ? MOUNT_STATE_TRACKING : MOUNT_STATE_IDLE;
+    }
+    return next;
+}
+
+/* the transition and, if set_tracking, the new tracking flag in one write */
+static bool take(uint8_t event, bool set_tracking, int8_t tracking) {
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    if (event == GUIDE_FOLLOW) {
+        // read in the write, a pulse starting or ending after it takes the transition again
+        event = is_pulse_guiding() ? MOUNT_EVENT_GUIDE_START : MOUNT_EVENT_GUIDE_END;
+    }
+    uint8_t state = snapshot->state;
+    uint8_t next = mount_fsm_next(state, event, snapshot->tracking != 0);
+    if (next != REFUSED) {
+        snapshot->state = next;
+        if (set_tracking) snapshot->tracking = tracking;
+    }
+    mount_snapshot_write_end();
+    if (next == REFUSED) {
+        LOGI(TAG, "event %d refused while %s", event, get_mount_state_descr(state));
+        return false;
+    }
+    if (next != state) {
+        LOGI(TAG, "%s -> %s on event %d", get_mount_state_descr(state), get_mount_state_descr(next), event);
+    }
+    return true;
+}
+
+bool mount_fsm_dispatch(uint8_t event) {
+    return take(event, false, 0);
+}
+
+bool mount_fsm_set_tracking(int8_t tracking) {
+    return take(tracking ? MOUNT_EVENT_TRACKING_ON : MOUNT_EVENT_TRACKING_OFF, true, tracking);
+}
+
+bool mount_fsm_follow_guiding() {
+    return take(GUIDE_FOLLOW, false, 0);
+}
+
+bool mount_fsm_accepts(uint8_t event) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return mount_fsm_next(snapshot.state, event, snapshot.tracking != 0) != REFUSED;
+}
+
+uint8_t get_mount_fsm_state() {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.state;
+}
+
+const char* get_mount_state_descr(uint8_t state) {
+    return state < MOUNT_STATES ? state_descr[state] : "unknown";
+}
@@ -0,0 +1,253 @@
+#include <math.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "string.h"
+#include "mount_limits.h"
+#include "axis.h"
+#include "astro.h"
+#include "mount_encoder.h"
+#include "telescope.h"
+#include "util.h"
+
+#define TAG "LIMITS"
+
+#define LIMITS_NAMESPACE "limits"
+#define SOFT_LIMITS_KEY "soft"
+/* tracking covers 0.1 s in about 1.5 arc seconds, far below any sane margin */
+#define CHECK_INTERVAL_MICROS (100 * 1000)
+#define DEGREE_MILLIS (DAY_MILLIS / 360)
+#define MILLIS_TO_RAD(M) ((M) * M_PI * 2 / DAY_MILLIS)
+
+#define BLOCK_POSITIVE 0x01
+#define BLOCK_NEGATIVE 0x02
+
+static limits_changed_callback changed_callback;
+static esp_timer_handle_t check_timer;
+static int32_t soft_limits[LIMIT_FIELDS] = {
+    CONFIG_LIMIT_MERIDIAN_MINUTES * 60 * 1000,
+    CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS,
+    CONFIG_LIMIT_DEC_MAX_DEGREES * DEGREE_MILLIS,
+    CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS,
+};
+static volatile uint8_t active_limits;
+/* directions blocked by a switch, latched by the isr until the switch releases */
+static volatile uint8_t switch_blocked[MOUNT_AXES];
+/* last speed let through, the isr blocks the direction the axis ran into the switch */
+static volatile int32_t last_speed[MOUNT_AXES];
+
+static bool is_valid_limits(const int32_t* values) {
+    if (values[LIMIT_FIELD_MERIDIAN] < 0 || values[LIMIT_FIELD_MERIDIAN] > DAY_MILLIS / 2) return false;
+    if (values[LIMIT_FIELD_DEC_MIN] >= values[LIMIT_FIELD_DEC_MAX]) return false;
+    if (values[LIMIT_FIELD_DEC_MIN] < -DAY_MILLIS / 4 || values[LIMIT_FIELD_DEC_MAX] > DAY_MILLIS * 3 / 4) return false;
+    if (values[LIMIT_FIELD_HORIZON] < -DAY_MILLIS / 4 || values[LIMIT_FIELD_HORIZON] > DAY_MILLIS / 4) return false;
+    return true;
+}
+
+#if defined(CONFIG_LIMIT_SWITCH_RA) || defined(CONFIG_LIMIT_SWITCH_DEC)
+static const gpio_num_t switch_pins[MOUNT_AXES] = {
+#ifdef CONFIG_LIMIT_SWITCH_RA
+    [AXIS_RA] = CONFIG_GPIO_LIMIT_SWITCH_RA,
+#else
+    [AXIS_RA] = GPIO_NUM_MAX,
+#endif
+#ifdef CONFIG_LIMIT_SWITCH_DEC
+    [AXIS_DEC] = CONFIG_GPIO_LIMIT_SWITCH_DEC,
+#else
+    [AXIS_DEC] = GPIO_NUM_MAX,
+#endif
+};
+
+/*
+ * Switches are active low, the motor driver is disabled right here and the
+ * check timer does the rest. A switch closing on a standing axis could be
+ * either end, both directions stay blocked until it opens again.
+ */
+static void IRAM_ATTR switch_isr_handler(void* arg) {
+    uint8_t axis = (uint8_t)(int)arg;
+    if (gpio_get_level(switch_pins[axis])) return;
+    gpio_set_level(mount_axes[axis].en_pin, 1);
+    int32_t speed = last_speed[axis];
+    switch_blocked[axis] = speed > 0 ? BLOCK_POSITIVE : speed < 0 ? BLOCK_NEGATIVE : BLOCK_POSITIVE | BLOCK_NEGATIVE;
+}
+
+static esp_err_t start_switches() {
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        if (switch_pins[i] == GPIO_NUM_MAX) continue;
+        gpio_config_t config = {
+            .pin_bit_mask = 1ULL << switch_pins[i],
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_NEGEDGE,
+        };
+        esp_err_t err = gpio_config(&config);
+        if (err != ESP_OK) return err;
+        // the isr service is installed by the encoders
+        err = gpio_isr_handler_add(switch_pins[i], switch_isr_handler, (void*)i);
+        if (err != ESP_OK) return err;
+        // nothing tells which end a switch closed at boot is, the axis stays put until it opens
+        if (!gpio_get_level(switch_pins[i])) {
+            LOGE(TAG, "%s switch closed at boot", mount_axes[i].name);
+            switch_blocked[i] = BLOCK_POSITIVE | BLOCK_NEGATIVE;
+        }
+    }
+    return ESP_OK;
+}
+
+/* a released switch unblocks its axis */
+static uint8_t check_switches() {
+    uint8_t limits = 0;
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        if (switch_pins[i] == GPIO_NUM_MAX) continue;
+        if (gpio_get_level(switch_pins[i])) {
+            if (switch_blocked[i]) LOGI(TAG, "%s switch released", mount_axes[i].name);
+            switch_blocked[i] = 0;
+        } else {
+            limits |= i == AXIS_RA ? LIMIT_SWITCH_RA : LIMIT_SWITCH_DEC;
+        }
+    }
+    return limits;
+}
+#else
+static esp_err_t start_switches() {
+    return ESP_OK;
+}
+
+static uint8_t check_switches() {
+    return 0;
+}
+#endif
+
+/*
+ * The blocked direction is the one that drives further into the limit, so
+ * the mount can always be moved back out. A positive RA speed increases the
+ * hour angle, a positive Dec speed increases the mechanical dec.
+ */
+static uint8_t check_soft_limits(uint8_t* blocked) {
+    uint8_t limits = 0;
+    int32_t decMec = get_dec_mechnical_angle_millis();
+    if (decMec >= soft_limits[LIMIT_FIELD_DEC_MAX]) {
+        blocked[AXIS_DEC] |= BLOCK_POSITIVE;
+        limits |= LIMIT_DEC;
+    } else if (decMec <= soft_limits[LIMIT_FIELD_DEC_MIN]) {
+        blocked[AXIS_DEC] |= BLOCK_NEGATIVE;
+        limits |= LIMIT_DEC;
+    }
+    // hour angle and altitude are unknown until the clock is synced
+    if (!is_time_synced()) return limits;
+
+    // halfway through a flip the dec axis is past the pole, the RA labels are 12h off until it ends
+    uint8_t side;
+    int32_t decMillis = decMecMillis2decMillis(decMec, &side);
+    int32_t ha = get_hour_angle_millis(get_ra_angle_millis());
+    if (side != getSideOfPier()) ha = wrap_half_day_millis(ha + DAY_MILLIS / 2);
+    // on the normal side the mount looks west, past the meridian is east
+    if (side == 0 && ha <= -soft_limits[LIMIT_FIELD_MERIDIAN]) {
+        blocked[AXIS_RA] |= BLOCK_NEGATIVE;
+        limits |= LIMIT_MERIDIAN;
+    } else if (side != 0 && ha >= soft_limits[LIMIT_FIELD_MERIDIAN]) {
+        blocked[AXIS_RA] |= BLOCK_POSITIVE;
+        limits |= LIMIT_MERIDIAN;
+    }
+
+    double haRad = MILLIS_TO_RAD(ha);
+    double dec = MILLIS_TO_RAD(decMillis);
+    double lat = MILLIS_TO_RAD(get_site_latitude_millis());
+    double sinAlt = sin(lat) * sin(dec) + cos(lat) * cos(dec) * cos(haRad);
+    if (sinAlt <= sin(MILLIS_TO_RAD(soft_limits[LIMIT_FIELD_HORIZON]))) {
+        limits |= LIMIT_HORIZON;
+        // signs of the altitude gradient, cos(alt) is positive
+        double altPerHa = -cos(lat) * cos(dec) * sin(haRad);
+        double altPerDec = sin(lat) * cos(dec) - cos(lat) * sin(dec) * cos(haRad);
+        if (side != 0) altPerDec = -altPerDec; //mechanical dec runs backwards beyond the pole
+        if (altPerHa < 0) blocked[AXIS_RA] |= BLOCK_POSITIVE;
+        else if (altPerHa > 0) blocked[AXIS_RA] |= BLOCK_NEGATIVE;
+        if (altPerDec < 0) blocked[AXIS_DEC] |= BLOCK_POSITIVE;
+        else if (altPerDec > 0) blocked[AXIS_DEC] |= BLOCK_NEGATIVE;
+    }
+    return limits;
+}
+
+static void check_timer_callback(void* args) {
+    uint8_t blocked[MOUNT_AXES] = { 0 };
+    uint8_t limits = check_soft_limits(blocked) | check_switches();
+    uint8_t previous = active_limits;
+    if (limits == previous) return;
+    active_limits = limits;
+    uint8_t tripped = limits & ~previous;
+    if (tripped) {
+        LOGI(TAG, "limits tripped: 0x%02x", tripped);
+    }
+    if (changed_callback) changed_callback(limits, tripped);
+}
+
+esp_err_t init_limits(limits_changed_callback callback) {
+    changed_callback = callback;
+    nvs_handle handle;
+    if (nvs_open(LIMITS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        int32_t stored[LIMIT_FIELDS];
+        size_t len = sizeof(stored);
+        if (nvs_get_blob(handle, SOFT_LIMITS_KEY, stored, &len) == ESP_OK && len == sizeof(stored)) {
+            if (is_valid_limits(stored)) {
+                memcpy(soft_limits, stored, sizeof(soft_limits));
+                LOGI(TAG, "using stored soft limits");
+            } else {
+                LOGE(TAG, "stored soft limits are invalid, using defaults");
+            }
+        }
+        nvs_close(handle);
+    }
+    if (!is_valid_limits(soft_limits)) {
+        LOGE(TAG, "invalid soft limits");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = start_switches();
+    if (err != ESP_OK) return err;
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = check_timer_callback
+    };
+    err = esp_timer_create(&args, &check_timer);
+    if (err != ESP_OK) return err;
+    return esp_timer_start_periodic(check_timer, CHECK_INTERVAL_MICROS);
+}
+
+void get_soft_limits(int32_t* values) {
+    memcpy(values, soft_limits, sizeof(soft_limits));
+}
+
+esp_err_t set_soft_limits(const int32_t* values) {
+    if (!is_valid_limits(values)) return ESP_ERR_INVALID_ARG;
+    nvs_handle handle;
+    esp_err_t err = nvs_open(LIMITS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "nvs open failed: %d", err);
+        return err;
+    }
+    err = nvs_set_blob(handle, SOFT_LIMITS_KEY, values, sizeof(soft_limits));
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "saving soft limits failed: %d", err);
+        return err;
+    }
+    memcpy(soft_limits, values, sizeof(soft_limits));
+    return ESP_OK;
+}
+
+uint8_t get_active_limits() {
+    return active_limits;
+}
+
+/* the soft limits against the angles right now, a slew covers a lot more than tracking between two checks */
+int32_t limits_filter_speed(uint8_t axis, int32_t speed) {
+    uint8_t blocked[MOUNT_AXES] = { 0 };
+    check_soft_limits(blocked);
+    blocked[axis] |= switch_blocked[axis];
+    if ((speed > 0 && (blocked[axis] & BLOCK_POSITIVE)) || (speed < 0 && (blocked[axis] & BLOCK_NEGATIVE))) {
+        speed = 0;
+    }
+    last_speed[axis] = speed;
+    return speed;
+}
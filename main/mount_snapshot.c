@@ -0,0 +1,26 @@
+#include "string.h"
+#include "seqlock.h"
+#include "mount_snapshot.h"
+
+static seqlock_t lock = SEQLOCK_INITIALIZER;
+static mount_snapshot_t published = {
+    .ra_guide_speed = 7500,
+    .dec_guide_speed = 7500,
+};
+
+void get_mount_snapshot(mount_snapshot_t* snapshot) {
+    uint32_t sequence;
+    do {
+        sequence = seqlock_read_begin(&lock);
+        memcpy(snapshot, (const void*)&published, sizeof(mount_snapshot_t));
+    } while (seqlock_read_retry(&lock, sequence));
+}
+
+mount_snapshot_t* mount_snapshot_write_begin() {
+    seqlock_write_begin(&lock);
+    return &published;
+}
+
+void mount_snapshot_write_end() {
+    seqlock_write_end(&lock);
+}
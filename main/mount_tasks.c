@@ -0,0 +1,155 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "mount_tasks.h"
+#include "perf.h"
+#include "util.h"
+
+#define TAG "TASKS"
+
+typedef struct motion_request {
+    int64_t received_at;
+} motion_request_t;
+
+static motion_apply_callback apply_callback;
+static display_refresh_callback refresh_callback;
+static storage_callback store_callback;
+static QueueHandle_t motion_queue;
+static QueueHandle_t display_queue;
+static QueueHandle_t storage_queue;
+/* axes posted since the last apply, a full queue drops requests but never their axes */
+static portMUX_TYPE pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t pending_axes;
+static uint8_t pending_storage;
+
+#ifdef CONFIG_STATIC_ALLOCATION
+static StackType_t motion_stack[MOTION_TASK_STACK];
+static StaticTask_t motion_task_buffer;
+static uint8_t motion_queue_storage[MOTION_QUEUE_LENGTH * sizeof(motion_request_t)];
+static StaticQueue_t motion_queue_buffer;
+static StackType_t display_stack[DISPLAY_TASK_STACK];
+static StaticTask_t display_task_buffer;
+static uint8_t display_queue_storage[1];
+static StaticQueue_t display_queue_buffer;
+static StackType_t storage_stack[STORAGE_TASK_STACK];
+static StaticTask_t storage_task_buffer;
+static uint8_t storage_queue_storage[1];
+static StaticQueue_t storage_queue_buffer;
+#endif
+
+/* applies once for whatever is queued, to the axes any of it asked for */
+static void motion_task(void* args) {
+    motion_request_t request;
+    int64_t received[MOTION_QUEUE_LENGTH];
+    while (1) {
+        xQueueReceive(motion_queue, &request, portMAX_DELAY);
+        int count = 0;
+        do {
+            received[count ++] = request.received_at;
+        } while (count < MOTION_QUEUE_LENGTH && xQueueReceive(motion_queue, &request, 0));
+        portENTER_CRITICAL(&pending_mux);
+        uint8_t axes = pending_axes;
+        pending_axes = 0;
+        portEXIT_CRITICAL(&pending_mux);
+        if (axes) apply_callback(axes);
+        for (int i = 0; i < count; i ++) {
+            if (received[i]) PERF_SINCE(PERF_COMMAND_TO_MOTOR, received[i]);
+        }
+        post_display();
+    }
+}
+
+static void display_task(void* args) {
+    uint8_t token;
+    while (1) {
+        xQueueReceive(display_queue, &token, portMAX_DELAY);
+        refresh_callback();
+    }
+}
+
+static void storage_task(void* args) {
+    uint8_t token;
+    while (1) {
+        xQueueReceive(storage_queue, &token, portMAX_DELAY);
+        portENTER_CRITICAL(&pending_mux);
+        uint8_t work = pending_storage;
+        pending_storage = 0;
+        portEXIT_CRITICAL(&pending_mux);
+        if (work) store_callback(work);
+    }
+}
+
+esp_err_t start_motion_task(motion_apply_callback apply) {
+    apply_callback = apply;
+#ifdef CONFIG_STATIC_ALLOCATION
+    motion_queue = xQueueCreateStatic(MOTION_QUEUE_LENGTH, sizeof(motion_request_t), motion_queue_storage, &motion_queue_buffer);
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(motion_task, "motion", MOTION_TASK_STACK, NULL,
+        MOTION_TASK_PRIORITY, motion_stack, &motion_task_buffer, MOTION_TASK_CORE);
+    if (!task) return ESP_FAIL;
+#else
+    motion_queue = xQueueCreate(MOTION_QUEUE_LENGTH, sizeof(motion_request_t));
+    if (!motion_queue) return ESP_ERR_NO_MEM;
+    if (xTaskCreatePinnedToCore(motion_task, "motion", MOTION_TASK_STACK, NULL,
+        MOTION_TASK_PRIORITY, NULL, MOTION_TASK_CORE) != pdPASS) return ESP_ERR_NO_MEM;
+#endif
+    LOGI(TAG, "motion task on core %d", MOTION_TASK_CORE);
+    return ESP_OK;
+}
+
+esp_err_t start_display_task(display_refresh_callback refresh) {
+    if (display_queue) return ESP_OK;
+    refresh_callback = refresh;
+#ifdef CONFIG_STATIC_ALLOCATION
+    display_queue = xQueueCreateStatic(1, sizeof(uint8_t), display_queue_storage, &display_queue_buffer);
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(display_task, "display", DISPLAY_TASK_STACK, NULL,
+        DISPLAY_TASK_PRIORITY, display_stack, &display_task_buffer, DISPLAY_TASK_CORE);
+    if (!task) return ESP_FAIL;
+#else
+    display_queue = xQueueCreate(1, sizeof(uint8_t));
+    if (!display_queue) return ESP_ERR_NO_MEM;
+    if (xTaskCreatePinnedToCore(display_task, "display", DISPLAY_TASK_STACK, NULL,
+        DISPLAY_TASK_PRIORITY, NULL, DISPLAY_TASK_CORE) != pdPASS) return ESP_ERR_NO_MEM;
+#endif
+    return ESP_OK;
+}
+
+esp_err_t start_storage_task(storage_callback store) {
+    store_callback = store;
+#ifdef CONFIG_STATIC_ALLOCATION
+    storage_queue = xQueueCreateStatic(1, sizeof(uint8_t), storage_queue_storage, &storage_queue_buffer);
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(storage_task, "storage", STORAGE_TASK_STACK, NULL,
+        STORAGE_TASK_PRIORITY, storage_stack, &storage_task_buffer, STORAGE_TASK_CORE);
+    if (!task) return ESP_FAIL;
+#else
+    storage_queue = xQueueCreate(1, sizeof(uint8_t));
+    if (!storage_queue) return ESP_ERR_NO_MEM;
+    if (xTaskCreatePinnedToCore(storage_task, "storage", STORAGE_TASK_STACK, NULL,
+        STORAGE_TASK_PRIORITY, NULL, STORAGE_TASK_CORE) != pdPASS) return ESP_ERR_NO_MEM;
+#endif
+    return ESP_OK;
+}
+
+void post_motion(uint8_t axes, int64_t received_at) {
+    motion_request_t request = { .received_at = received_at };
+    portENTER_CRITICAL(&pending_mux);
+    pending_axes |= axes;
+    portEXIT_CRITICAL(&pending_mux);
+    // a full queue already holds requests that will apply these speeds
+    xQueueSend(motion_queue, &request, 0);
+}
+
+void post_display() {
+    if (!display_queue) return;
+    uint8_t token = 0;
+    xQueueOverwrite(display_queue, &token);
+}
+
+void post_storage(uint8_t work) {
+    if (!storage_queue) return;
+    portENTER_CRITICAL(&pending_mux);
+    pending_storage |= work;
+    portEXIT_CRITICAL(&pending_mux);
+    uint8_t token = 0;
+    xQueueOverwrite(storage_queue, &token);
+}
@@ -0,0 +1,33 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_PERF_HISTOGRAMS
+#include "esp_timer.h"
+#include "string.h"
+#include "perf.h"
+
+static portMUX_TYPE perf_mux = portMUX_INITIALIZER_UNLOCKED;
+static perf_histogram_t histograms[PERF_STAGES];
+
+/* called from the encoder isr as well */
+void IRAM_ATTR perf_record(uint8_t stage, uint32_t cycles) {
+    int bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
+    if (bucket >= PERF_BUCKETS) bucket = PERF_BUCKETS - 1;
+    perf_histogram_t* histogram = &histograms[stage];
+    portENTER_CRITICAL(&perf_mux);
+    histogram->count ++;
+    histogram->buckets[bucket] ++;
+    if (cycles > histogram->max) histogram->max = cycles;
+    portEXIT_CRITICAL(&perf_mux);
+}
+
+void perf_record_since(uint8_t stage, int64_t since) {
+    int64_t cycles = (esp_timer_get_time() - since) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    perf_record(stage, cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles);
+}
+
+void get_perf_histogram(uint8_t stage, perf_histogram_t* histogram, bool reset) {
+    portENTER_CRITICAL(&perf_mux);
+    memcpy(histogram, &histograms[stage], sizeof(perf_histogram_t));
+    if (reset) memset(&histograms[stage], 0, sizeof(perf_histogram_t));
+    portEXIT_CRITICAL(&perf_mux);
+}
+#endif
@@ -0,0 +1,224 @@
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "string.h"
+#include "stdio.h"
+#include "persist.h"
+#include "util.h"
+
+#define TAG "PERSIST"
+
+#ifndef CONFIG_PERSIST_INTERVAL_SECONDS
+#define CONFIG_PERSIST_INTERVAL_SECONDS 30
+#endif
+
+#define PERSIST_NAMESPACE "mount"
+#define SNAPSHOT_KEY "snap"
+/* every JOURNAL_SLOTS-th write is a snapshot, so slot 0 is never used by a record */
+#define JOURNAL_SLOTS 32
+#define RECORD_MAX_SIZE (5 + 5 + PERSIST_FIELDS * 5)
+#define PERSIST_INTERVAL_MICROS (CONFIG_PERSIST_INTERVAL_SECONDS * 1000000LL)
+#define PERSIST_MIN_INTERVAL_MICROS (2 * 1000000LL)
+
+/*
+ * Append-only journal on top of nvs. A record holds the sequence number, the
+ * mask of the changed fields and their zigzag varint deltas against the
+ * previous record, usually a handful of bytes. Records go round robin into
+ * JOURNAL_SLOTS keys; whenever the ring would wrap a full snapshot is written
+ * instead, which makes every older record stale. Boot replays the snapshot
+ * and then the records following it, stopping at the first gap.
+ */
+typedef struct {
+    uint32_t seq;
+    uint32_t mask;
+    int32_t values[PERSIST_FIELDS];
+} snapshot_t;
+
+static nvs_handle handle;
+static bool opened = false;
+static uint32_t seq;
+static int32_t persisted[PERSIST_FIELDS];
+static uint32_t persisted_mask;
+static int64_t last_write;
+static bool urgent;
+static persist_stats_t stats;
+
+static size_t put_varint(uint8_t* p, uint32_t v) {
+    size_t len = 0;
+    while (v >= 0x80) {
+        p[len ++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[len ++] = v;
+    return len;
+}
+
+static size_t get_varint(const uint8_t* p, size_t len, uint32_t* v) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < len && i < 5; i ++) {
+        result |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *v = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+#define ZIGZAG(v) (((uint32_t)(v) << 1) ^ (uint32_t)((v) >> 31))
+#define UNZIGZAG(v) ((int32_t)((v) >> 1) ^ -(int32_t)((v) & 1))
+
+static void get_slot_key(char* key, uint32_t slot) {
+    sprintf(key, "j%02d", slot);
+}
+
+/* applies a record on top of values, returns false if it is malformed, values may be half done then */
+static bool apply_record(const uint8_t* record, size_t len, uint32_t* recordSeq, int32_t* values, uint32_t* mask) {
+    uint32_t recordMask;
+    size_t pos = get_varint(record, len, recordSeq);
+    if (!pos) return false;
+    size_t n = get_varint(record + pos, len - pos, &recordMask);
+    if (!n) return false;
+    pos += n;
+    for (int i = 0; i < PERSIST_FIELDS; i ++) {
+        if (!(recordMask & (1 << i))) continue;
+        uint32_t delta;
+        n = get_varint(record + pos, len - pos, &delta);
+        if (!n) return false;
+        pos += n;
+        values[i] += UNZIGZAG(delta);
+    }
+    *mask |= recordMask;
+    return pos == len;
+}
+
+esp_err_t init_persist(int32_t* values, uint32_t* mask) {
+    int64_t start = esp_timer_get_time();
+    memset(values, 0, sizeof(int32_t) * PERSIST_FIELDS);
+    *mask = 0;
+    seq = 0;
+    esp_err_t err = nvs_open(PERSIST_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "nvs_open failed: %d", err);
+        return err;
+    }
+    opened = true;
+
+    snapshot_t snapshot;
+    size_t len = sizeof(snapshot);
+    if (nvs_get_blob(handle, SNAPSHOT_KEY, &snapshot, &len) == ESP_OK && len == sizeof(snapshot)) {
+        seq = snapshot.seq;
+        memcpy(values, snapshot.values, sizeof(snapshot.values));
+        *mask = snapshot.mask;
+    }
+
+    //records are replayed in sequence order, the ring slot follows from the sequence
+    uint32_t replayed = 0;
+    while (true) {
+        uint32_t next = seq + 1;
+        if (next % JOURNAL_SLOTS == 0) break; //a snapshot was due here and is missing
+        char key[8];
+        uint8_t record[RECORD_MAX_SIZE];
+        get_slot_key(key, next % JOURNAL_SLOTS);
+        len = sizeof(record);
+        if (nvs_get_blob(handle, key, record, &len) != ESP_OK) break;
+        // a record torn by a power cut is dropped whole, not applied up to the tear
+        uint32_t recordSeq, recordMask = *mask;
+        int32_t recordValues[PERSIST_FIELDS];
+        memcpy(recordValues, values, sizeof(recordValues));
+        if (!apply_record(record, len, &recordSeq, recordValues, &recordMask) || recordSeq != next) break;
+        memcpy(values, recordValues, sizeof(recordValues));
+        *mask = recordMask;
+        seq = next;
+        replayed ++;
+    }
+
+    memcpy(persisted, values, sizeof(persisted));
+    persisted_mask = *mask;
+    last_write = esp_timer_get_time();
+    stats.replayed = replayed;
+    stats.replay_micros = (uint32_t)(esp_timer_get_time() - start);
+    LOGI(TAG, "replayed %d records up to seq %d in %dus", replayed, seq, stats.replay_micros);
+    return ESP_OK;
+}
+
+static esp_err_t write_snapshot(uint32_t newSeq, const int32_t* values) {
+    snapshot_t snapshot;
+    snapshot.seq = newSeq;
+    snapshot.mask = PERSIST_ALL_FIELDS;
+    memcpy(snapshot.values, values, sizeof(snapshot.values));
+    esp_err_t err = nvs_set_blob(handle, SNAPSHOT_KEY, &snapshot, sizeof(snapshot));
+    if (err == ESP_OK) {
+        stats.snapshots ++;
+        stats.bytes += sizeof(snapshot);
+    }
+    return err;
+}
+
+static esp_err_t write_record(uint32_t newSeq, uint32_t dirty, const int32_t* values) {
+    uint8_t record[RECORD_MAX_SIZE];
+    size_t len = put_varint(record, newSeq);
+    len += put_varint(record + len, dirty);
+    for (int i = 0; i < PERSIST_FIELDS; i ++) {
+        if (!(dirty & (1 << i))) continue;
+        int32_t delta = values[i] - persisted[i];
+        len += put_varint(record + len, ZIGZAG(delta));
+    }
+    char key[8];
+    get_slot_key(key, newSeq % JOURNAL_SLOTS);
+    esp_err_t err = nvs_set_blob(handle, key, record, len);
+    if (err == ESP_OK) {
+        stats.records ++;
+        stats.bytes += len;
+    }
+    return err;
+}
+
+void persist_tick(const int32_t* values) {
+    if (!opened) return;
+    int64_t now = esp_timer_get_time();
+    int64_t sinceLast = now - last_write;
+    if (sinceLast < PERSIST_MIN_INTERVAL_MICROS) return;
+    if (!urgent && sinceLast < PERSIST_INTERVAL_MICROS) return;
+
+    uint32_t dirty = 0;
+    for (int i = 0; i < PERSIST_FIELDS; i ++) {
+        if (!(persisted_mask & (1 << i)) || values[i] != persisted[i]) {
+            dirty |= 1 << i;
+        }
+    }
+    urgent = false;
+    last_write = now;
+    if (!dirty) return;
+
+    uint32_t newSeq = seq + 1;
+    esp_err_t err;
+    if (newSeq % JOURNAL_SLOTS == 0 || persisted_mask != PERSIST_ALL_FIELDS) {
+        //compaction, everything before newSeq becomes stale
+        newSeq = (newSeq + JOURNAL_SLOTS - 1) / JOURNAL_SLOTS * JOURNAL_SLOTS;
+        err = write_snapshot(newSeq, values);
+    } else {
+        err = write_record(newSeq, dirty, values);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK) {
+        LOGE(TAG, "write failed: %d", err);
+        return;
+    }
+    for (int i = 0; i < PERSIST_FIELDS; i ++) {
+        if (dirty & (1 << i)) stats.changed_bytes += sizeof(int32_t);
+    }
+    seq = newSeq;
+    memcpy(persisted, values, sizeof(persisted));
+    persisted_mask = PERSIST_ALL_FIELDS;
+}
+
+void persist_mark_urgent() {
+    urgent = true;
+}
+
+void get_persist_stats(persist_stats_t* target) {
+    memcpy(target, &stats, sizeof(stats));
+}
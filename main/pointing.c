@@ -0,0 +1,224 @@
+#include "esp_timer.h"
+#include "math.h"
+#include "string.h"
+#include "pointing.h"
+#include "astro.h"
+#include "util.h"
+
+#define TAG "POINTING"
+
+#define MILLIS_TO_RAD(m) ((double)(m) * (2 * M_PI) / DAY_MILLIS)
+#define RAD_TO_MILLIS(r) ((r) * DAY_MILLIS / (2 * M_PI))
+
+/*
+ * TPoint style model for a german equatorial mount. For every sync point the
+ * hour angle error (scaled by cos dec to be an arc on the sky) and the
+ * declination error give two equations in the model terms:
+ *
+ *   dH cos d = IH cos d + ME sin h sin d - MA cos h sin d + p CH + p NP sin d + TF cos f sin h
+ *   dD       = ID + ME cos h + MA sin h + TF (cos f cos h sin d - sin f cos d)
+ *
+ * p is +1/-1 by side of pier. The terms are fitted by linear least squares over
+ * the normal equations, only as many terms as the points can determine.
+ */
+typedef struct {
+    int32_t ha, dec; // sky position at sync time
+    int32_t dh, dd;  // mount - sky
+    int8_t pier;
+} pointing_point_t;
+
+static pointing_point_t points[POINTING_MAX_POINTS];
+static uint8_t point_count, point_next;
+static double terms[POINTING_TERMS];
+static uint8_t term_count;
+static int32_t rms_millis;
+static portMUX_TYPE pointing_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* partial derivatives of the hour angle (sky arc) and declination equations */
+static void get_coefficients(double h, double d, int8_t pier, double latitude, double* ch, double* cd) {
+    double sh = sin(h), chh = cos(h), sd = sin(d), cdd = cos(d);
+    double sf = sin(latitude), cf = cos(latitude);
+    ch[POINTING_IH] = cdd;  cd[POINTING_IH] = 0;
+    ch[POINTING_ID] = 0;    cd[POINTING_ID] = 1;
+    ch[POINTING_ME] = sh * sd;  cd[POINTING_ME] = chh;
+    ch[POINTING_MA] = -chh * sd; cd[POINTING_MA] = sh;
+    ch[POINTING_CH] = pier; cd[POINTING_CH] = 0;
+    ch[POINTING_NP] = pier * sd; cd[POINTING_NP] = 0;
+    ch[POINTING_TF] = cf * sh; cd[POINTING_TF] = cf * chh * sd - sf * cdd;
+}
+
+static uint8_t get_solvable_terms(uint8_t count) {
+    if (!is_time_synced()) return count ? 2 : 0; // without LST only the index terms make sense
+    if (count >= 4) return 7;
+    if (count == 3) return 6;
+    if (count == 2) return 4;
+    return count ? 2 : 0;
+}
+
+/* gaussian elimination with partial pivoting, n <= POINTING_TERMS */
+static bool solve(double a[POINTING_TERMS][POINTING_TERMS], double* b, uint8_t n) {
+    for (int col = 0; col < n; col ++) {
+        int pivot = col;
+        for (int row = col + 1; row < n; row ++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+        }
+        if (fabs(a[pivot][col]) < 1e-12) return false;
+        if (pivot != col) {
+            for (int k = 0; k < n; k ++) {
+                double t = a[col][k]; a[col][k] = a[pivot][k]; a[pivot][k] = t;
+            }
+            double t = b[col]; b[col] = b[pivot]; b[pivot] = t;
+        }
+        for (int row = col + 1; row < n; row ++) {
+            double f = a[row][col] / a[col][col];
+            for (int k = col; k < n; k ++) a[row][k] -= f * a[col][k];
+            b[row] -= f * b[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; row --) {
+        double s = b[row];
+        for (int k = row + 1; k < n; k ++) s -= a[row][k] * b[k];
+        b[row] = s / a[row][row];
+    }
+    return true;
+}
+
+static void fit() {
+    double a[POINTING_TERMS][POINTING_TERMS] = {{0}};
+    double b[POINTING_TERMS] = {0};
+    double latitude = MILLIS_TO_RAD(get_site_latitude_millis());
+    uint8_t n = get_solvable_terms(point_count);
+    while (n > 0) {
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        for (int i = 0; i < point_count; i ++) {
+            double ch[POINTING_TERMS], cd[POINTING_TERMS];
+            double d = MILLIS_TO_RAD(points[i].dec);
+            get_coefficients(MILLIS_TO_RAD(points[i].ha), d, points[i].pier, latitude, ch, cd);
+            double yh = MILLIS_TO_RAD(points[i].dh) * cos(d);
+            double yd = MILLIS_TO_RAD(points[i].dd);
+            for (int r = 0; r < n; r ++) {
+                for (int c = 0; c < n; c ++) {
+                    a[r][c] += ch[r] * ch[c] + cd[r] * cd[c];
+                }
+                b[r] += ch[r] * yh + cd[r] * yd;
+            }
+        }
+        if (solve(a, b, n)) break;
+        // degenerate geometry (e.g. all points on one star), drop terms in the steps of get_solvable_terms
+        n = n == POINTING_TERMS ? n - 1 : n > 2 ? n - 2 : 0;
+    }
+
+    double fitted[POINTING_TERMS];
+    double sumSquares = 0;
+    for (int i = 0; i < POINTING_TERMS; i ++) {
+        fitted[i] = i < n ? b[i] : 0;
+    }
+    for (int i = 0; i < point_count; i ++) {
+        double ch[POINTING_TERMS], cd[POINTING_TERMS];
+        double d = MILLIS_TO_RAD(points[i].dec);
+        get_coefficients(MILLIS_TO_RAD(points[i].ha), d, points[i].pier, latitude, ch, cd);
+        double rh = MILLIS_TO_RAD(points[i].dh) * cos(d), rd = MILLIS_TO_RAD(points[i].dd);
+        for (int k = 0; k < POINTING_TERMS; k ++) {
+            rh -= ch[k] * fitted[k];
+            rd -= cd[k] * fitted[k];
+        }
+        sumSquares += rh * rh + rd * rd;
+    }
+    portENTER_CRITICAL(&pointing_mux);
+    memcpy(terms, fitted, sizeof(terms));
+    term_count = n;
+    rms_millis = point_count ? (int32_t)RAD_TO_MILLIS(sqrt(sumSquares / point_count)) : 0;
+    portEXIT_CRITICAL(&pointing_mux);
+}
+
+void init_pointing() {
+    clear_pointing_model();
+}
+
+void clear_pointing_model() {
+    portENTER_CRITICAL(&pointing_mux);
+    point_count = 0;
+    point_next = 0;
+    term_count = 0;
+    rms_millis = 0;
+    for (int i = 0; i < POINTING_TERMS; i ++) terms[i] = 0;
+    portEXIT_CRITICAL(&pointing_mux);
+}
+
+uint8_t get_pointing_point_count() {
+    return point_count;
+}
+
+uint8_t get_pointing_term_count() {
+    return term_count;
+}
+
+int32_t get_pointing_term_millis(uint8_t term) {
+    return term < POINTING_TERMS ? (int32_t)RAD_TO_MILLIS(terms[term]) : 0;
+}
+
+int32_t get_pointing_rms_millis() {
+    return rms_millis;
+}
+
+
+void add_pointing_point(int32_t skyRaMillis, int32_t skyDecMillis, int32_t mountRaMillis, int32_t mountDecMillis, uint8_t sideOfPier) {
+    int64_t start = esp_timer_get_time();
+    pointing_point_t* point = &points[point_next];
+    point->ha = get_hour_angle_millis(skyRaMillis);
+    point->dec = skyDecMillis;
+    point->dh = angle_diff_millis(skyRaMillis, mountRaMillis); // ha = lst - ra
+    point->dd = mountDecMillis - skyDecMillis;
+    point->pier = sideOfPier ? -1 : 1;
+    point_next = (point_next + 1) % POINTING_MAX_POINTS;
+    if (point_count < POINTING_MAX_POINTS) point_count ++;
+    fit();
+    LOGI(TAG, "%d points, %d terms, rms %d millis, fit took %lldus", point_count, term_count, rms_millis, esp_timer_get_time() - start);
+    for (int i = 0; i < term_count; i ++) {
+        LOGI(TAG, "term %d: %d millis", i, get_pointing_term_millis(i));
+    }
+}
+
+static void get_correction(int32_t raMillis, int32_t decMillis, uint8_t sideOfPier, int32_t* dh, int32_t* dd) {
+    if (term_count == 0) {
+        *dh = 0;
+        *dd = 0;
+        return;
+    }
+    double ch[POINTING_TERMS], cd[POINTING_TERMS], model[POINTING_TERMS];
+    double d = MILLIS_TO_RAD(decMillis);
+    get_coefficients(MILLIS_TO_RAD(get_hour_angle_millis(raMillis)), d, sideOfPier ? -1 : 1, MILLIS_TO_RAD(get_site_latitude_millis()), ch, cd);
+    portENTER_CRITICAL(&pointing_mux);
+    memcpy(model, terms, sizeof(model));
+    portEXIT_CRITICAL(&pointing_mux);
+    double h = 0, dec = 0;
+    for (int k = 0; k < POINTING_TERMS; k ++) {
+        h += ch[k] * model[k];
+        dec += cd[k] * model[k];
+    }
+    double cosd = cos(d);
+    if (cosd < 0.01) cosd = 0.01; // close to the pole, hour angle is meaningless anyway
+    *dh = (int32_t)RAD_TO_MILLIS(h / cosd);
+    *dd = (int32_t)RAD_TO_MILLIS(dec);
+}
+
+void pointing_sky_to_mount(int32_t* raMillis, int32_t* decMillis, uint8_t sideOfPier) {
+    int32_t dh, dd;
+    get_correction(*raMillis, *decMillis, sideOfPier, &dh, &dd);
+    *raMillis -= dh;
+    *decMillis += dd;
+}
+
+/* the model is given in sky coordinates, two fixed point iterations are plenty for arcminute terms */
+void pointing_mount_to_sky(int32_t* raMillis, int32_t* decMillis, uint8_t sideOfPier) {
+    int32_t ra = *raMillis, dec = *decMillis;
+    for (int i = 0; i < 2; i ++) {
+        int32_t dh, dd;
+        get_correction(ra, dec, sideOfPier, &dh, &dd);
+        ra = *raMillis + dh;
+        dec = *decMillis - dd;
+    }
+    *raMillis = ra;
+    *decMillis = dec;
+}
@@ -1,25 +1,245 @@
-#include "protocol.h"
-#include "lwip/sockets.h"
-
-void set_broadcast_fields(
-    broadcast_t *target,
-    uint32_t ip,
-    uint16_t port,
-    int32_t ra, //in millis
-    int32_t dec, //in millis
-    bool slewing,
-    bool tracking,
-    int32_t ra_speed, // in milli seconds per sidereal second
-    int32_t dec_speed, // in milli seconds per second 
-    uint8_t side_of_pier // 0: Normal (East); 1: Beyond the pole (West)
-) {
-    BROADCAST_IP(target->buffer) = htonl(ip);
-    BROADCAST_PORT(target->buffer) = htons(port);
-    BROADCAST_RA(target->buffer) = htonl(ra);
-    BROADCAST_DEC(target->buffer) = htonl(dec);
-    BROADCAST_SLEWING(target->buffer) = slewing ? 1 : 0;
-    BROADCAST_TRACKING(target->buffer) = tracking ? 1 : 0;
-    BROADCAST_RA_SPEED(target->buffer) = htonl(ra_speed);
-    BROADCAST_DEC_SPEED(target->buffer) = htonl(dec_speed);
-    BROADCAST_SIDE_OF_PIER(target->buffer) = side_of_pier;
-}
\ No newline at end of file
+#include "protocol.h"
+#include "lwip/sockets.h"
+#include "string.h"
+
+void set_broadcast_fields(
+    broadcast_t *target,
+    uint32_t ip,
+    uint16_t port,
+    int32_t ra, //in millis
+    int32_t dec, //in millis
+    bool slewing,
+    bool tracking,
+    int32_t ra_speed, // in milli seconds per sidereal second
+    int32_t dec_speed, // in milli seconds per second 
+    uint8_t side_of_pier // 0: Normal (East); 1: Beyond the pole (West)
+) {
+    BROADCAST_IP(target->buffer) = htonl(ip);
+    BROADCAST_PORT(target->buffer) = htons(port);
+    BROADCAST_RA(target->buffer) = htonl(ra);
+    BROADCAST_DEC(target->buffer) = htonl(dec);
+    BROADCAST_SLEWING(target->buffer) = slewing ? 1 : 0;
+    BROADCAST_TRACKING(target->buffer) = tracking ? 1 : 0;
+    BROADCAST_RA_SPEED(target->buffer) = htonl(ra_speed);
+    BROADCAST_DEC_SPEED(target->buffer) = htonl(dec_speed);
+    BROADCAST_SIDE_OF_PIER(target->buffer) = side_of_pier;
+}
+
+void set_status_fields(
+    status_t *target,
+    int64_t timestamp,
+    int32_t ra,
+    int32_t dec,
+    int32_t ra_velocity,
+    int32_t dec_velocity,
+    uint8_t slew_phase,
+    uint32_t slew_eta,
+    uint8_t flags,
+    uint8_t side_of_pier,
+    uint8_t limits,
+    uint8_t cpu_load,
+    uint16_t stack_free
+) {
+    memset(target->buffer, 0, STATUS_SIZE);
+    STATUS_TYPE(target->buffer) = STATUS_FRAME_TYPE;
+    STATUS_FLAGS(target->buffer) = flags;
+    STATUS_SLEW_PHASE(target->buffer) = slew_phase;
+    STATUS_SIDE_OF_PIER(target->buffer) = side_of_pier;
+    STATUS_TIMESTAMP_HI(target->buffer) = htonl((uint32_t)(timestamp >> 32));
+    STATUS_TIMESTAMP_LO(target->buffer) = htonl((uint32_t)timestamp);
+    STATUS_RA(target->buffer) = htonl(ra);
+    STATUS_DEC(target->buffer) = htonl(dec);
+    STATUS_RA_VELOCITY(target->buffer) = htonl(ra_velocity);
+    STATUS_DEC_VELOCITY(target->buffer) = htonl(dec_velocity);
+    STATUS_SLEW_ETA(target->buffer) = htonl(slew_eta);
+    STATUS_LIMITS(target->buffer) = limits;
+    STATUS_CPU_LOAD(target->buffer) = cpu_load;
+    STATUS_STACK_FREE(target->buffer) = htons(stack_free);
+}
+
+void set_clock_fields(
+    clock_sync_t *target,
+    const uint8_t *origin,
+    int64_t receive,
+    int64_t transmit
+) {
+    memset(target->buffer, 0, CLOCK_SIZE);
+    CLOCK_TYPE(target->buffer) = CLOCK_FRAME_TYPE;
+    memcpy(&CLOCK_ORIGIN_HI(target->buffer), origin, 8);
+    CLOCK_RECEIVE_HI(target->buffer) = htonl((uint32_t)(receive >> 32));
+    CLOCK_RECEIVE_LO(target->buffer) = htonl((uint32_t)receive);
+    CLOCK_TRANSMIT_HI(target->buffer) = htonl((uint32_t)(transmit >> 32));
+    CLOCK_TRANSMIT_LO(target->buffer) = htonl((uint32_t)transmit);
+}
+
+
+void set_time_fields(
+    time_sync_t *target,
+    uint8_t samples,
+    int32_t drift,
+    int64_t utc,
+    int32_t lst
+) {
+    memset(target->buffer, 0, TIME_SIZE);
+    TIME_TYPE(target->buffer) = TIME_FRAME_TYPE;
+    TIME_SAMPLES(target->buffer) = samples;
+    TIME_DRIFT(target->buffer) = htonl(drift);
+    TIME_UTC_HI(target->buffer) = htonl((uint32_t)(utc >> 32));
+    TIME_UTC_LO(target->buffer) = htonl((uint32_t)utc);
+    TIME_LST(target->buffer) = htonl(lst);
+}
+
+void set_pointing_model_fields(
+    pointing_model_t *target,
+    uint8_t points,
+    uint8_t terms,
+    int32_t rms,
+    const int32_t *values
+) {
+    memset(target->buffer, 0, POINTING_MODEL_SIZE);
+    POINTING_MODEL_TYPE(target->buffer) = POINTING_MODEL_FRAME_TYPE;
+    POINTING_MODEL_POINTS(target->buffer) = points;
+    POINTING_MODEL_TERMS(target->buffer) = terms;
+    POINTING_MODEL_RMS(target->buffer) = htonl(rms);
+    for (int i = 0; i < POINTING_MODEL_MAX_TERMS; i ++) {
+        POINTING_MODEL_TERM(target->buffer, i) = htonl(values[i]);
+    }
+}
+void set_mount_config_fields(
+    mount_config_t *target,
+    const uint32_t *values
+) {
+    memset(target->buffer, 0, MOUNT_CONFIG_SIZE);
+    MOUNT_CONFIG_TYPE(target->buffer) = MOUNT_CONFIG_FRAME_TYPE;
+    for (int i = 0; i < MOUNT_CONFIG_FIELDS; i ++) {
+        MOUNT_CONFIG_FIELD(target->buffer, i) = htonl(values[i]);
+    }
+}
+
+void set_limits_fields(
+    limits_frame_t *target,
+    uint8_t active,
+    const int32_t *values
+) {
+    memset(target->buffer, 0, LIMITS_SIZE);
+    LIMITS_TYPE(target->buffer) = LIMITS_FRAME_TYPE;
+    LIMITS_ACTIVE(target->buffer) = active;
+    for (int i = 0; i < LIMITS_FIELDS; i ++) {
+        LIMITS_FIELD(target->buffer, i) = htonl(values[i]);
+    }
+}
+
+void set_perf_fields(
+    perf_frame_t *target,
+    uint8_t stage,
+    uint32_t count,
+    uint32_t max,
+    const uint32_t *buckets
+) {
+    memset(target->buffer, 0, PERF_SIZE);
+    PERF_TYPE(target->buffer) = PERF_FRAME_TYPE;
+    PERF_STAGE(target->buffer) = stage;
+    PERF_COUNT(target->buffer) = htonl(count);
+    PERF_MAX(target->buffer) = htonl(max);
+    for (int i = 0; i < PERF_FRAME_BUCKETS; i ++) {
+        PERF_BUCKET(target->buffer, i) = htonl(buckets[i]);
+    }
+}
+
+int set_trace_fields(
+    trace_frame_t *target,
+    uint8_t core,
+    uint8_t count,
+    uint32_t first,
+    uint32_t head
+) {
+    memset(target->buffer, 0, TRACE_SIZE);
+    TRACE_TYPE(target->buffer) = TRACE_FRAME_TYPE;
+    TRACE_CORE(target->buffer) = core;
+    TRACE_COUNT(target->buffer) = count;
+    TRACE_FIRST(target->buffer) = htonl(first);
+    TRACE_HEAD(target->buffer) = htonl(head);
+    return 12 + 16 * count;
+}
+
+void set_trace_event_fields(
+    trace_frame_t *target,
+    int index,
+    uint16_t id,
+    uint32_t time,
+    int32_t a,
+    int32_t b
+) {
+    TRACE_EVENT_ID(target->buffer, index) = htons(id);
+    TRACE_EVENT_TIME(target->buffer, index) = htonl(time);
+    TRACE_EVENT_A(target->buffer, index) = htonl(a);
+    TRACE_EVENT_B(target->buffer, index) = htonl(b);
+}
+
+int set_capture_fields(
+    capture_frame_t *target,
+    uint8_t mode,
+    uint16_t length,
+    uint32_t offset,
+    uint32_t head
+) {
+    CAPTURE_TYPE(target->buffer) = CAPTURE_FRAME_TYPE;
+    CAPTURE_MODE(target->buffer) = mode;
+    CAPTURE_LENGTH(target->buffer) = htons(length);
+    CAPTURE_OFFSET(target->buffer) = htonl(offset);
+    CAPTURE_HEAD(target->buffer) = htonl(head);
+    return 12 + length;
+}
+
+int set_diag_fields(
+    diag_frame_t *target,
+    uint8_t count,
+    const uint8_t *cpu_load,
+    uint32_t free_heap,
+    uint32_t min_free_heap,
+    uint32_t largest_free_block,
+    uint32_t free_internal
+) {
+    memset(target->buffer, 0, DIAG_SIZE);
+    DIAG_TYPE(target->buffer) = DIAG_FRAME_TYPE;
+    DIAG_TASK_COUNT(target->buffer) = count;
+    for (int i = 0; i < DIAG_FRAME_CORES; i ++) {
+        DIAG_CPU_LOAD(target->buffer, i) = cpu_load[i];
+    }
+    DIAG_FREE_HEAP(target->buffer) = htonl(free_heap);
+    DIAG_MIN_FREE_HEAP(target->buffer) = htonl(min_free_heap);
+    DIAG_LARGEST_FREE_BLOCK(target->buffer) = htonl(largest_free_block);
+    DIAG_FREE_INTERNAL(target->buffer) = htonl(free_internal);
+    return 20 + 24 * count;
+}
+
+void set_diag_task_fields(
+    diag_frame_t *target,
+    int index,
+    const char *name,
+    uint32_t stack_free,
+    uint8_t core,
+    uint8_t priority
+) {
+    strncpy(DIAG_TASK_NAME(target->buffer, index), name, 16);
+    DIAG_TASK_STACK_FREE(target->buffer, index) = htonl(stack_free);
+    DIAG_TASK_CORE(target->buffer, index) = core;
+    DIAG_TASK_PRIORITY(target->buffer, index) = priority;
+}
+
+void set_focuser_fields(
+    focuser_frame_t *target,
+    uint8_t flags,
+    int32_t position,
+    int32_t target_position,
+    int32_t temperature,
+    int32_t temp_coefficient
+) {
+    memset(target->buffer, 0, FOCUSER_SIZE);
+    FOCUSER_TYPE(target->buffer) = FOCUSER_FRAME_TYPE;
+    FOCUSER_FLAGS(target->buffer) = flags;
+    FOCUSER_POSITION(target->buffer) = htonl(position);
+    FOCUSER_TARGET(target->buffer) = htonl(target_position);
+    FOCUSER_TEMPERATURE(target->buffer) = htonl(temperature);
+    FOCUSER_TEMP_COEFFICIENT(target->buffer) = htonl(temp_coefficient);
+}
@@ -1,145 +1,271 @@
-#include "esp_timer.h"
-#include "slew.h"
-#include "mount_encoder.h"
-#include "math.h"
-#include "util.h"
-#include "astro.h"
-#include "telescope.h"
-
-#define TAG "SLEW"
-
-slew_set_motor_speed_callback motor_callback;
-bool slewing = false;
-int32_t raStartMillis = 0, decStartMillis = 0;
-int32_t raTargetMillis = 0, decTargetMillis = 0;
-int speed;
-int checkIntervalMillis;
-double distance;
-double progress;
-uint32_t timeToGoMillis;
-esp_timer_handle_t slewTimer;
-
-#define MAX_SPEED 16
-#define TOLERANCE_MILLIS 1000 
-#define CHECK_INTERVAL_MILLIS 1000
-#define MIN_CHECK_INTERVAL_MILLIS 125
-#define MIN_SPEED 1
-
-
-double dist(double a, double b) {
-    return sqrt(a*a + b*b);
-}
-
-double get_slew_progress() {
-    return 1 - progress;
-}
-
-uint32_t get_slew_time_to_go_millis(){
-    return timeToGoMillis;
-}
-
-int32_t getRaDiff(int32_t target, int32_t current) {
-    int32_t targetGreater, targetLess;
-    
-    targetGreater = target;
-    while(targetGreater > current) targetGreater -= DAY_MILLIS;
-    while(targetGreater < current) targetGreater += DAY_MILLIS;
-
-    targetLess = targetGreater - DAY_MILLIS;
-    
-    int32_t diffGreater = current - targetGreater;
-    int32_t diffLess = current - targetLess;
-
-    return abs(diffGreater) < abs(diffLess) ? diffGreater : diffLess;
-}
-
-void slew_timer_callback(void* _) {
-    int32_t raDiff = getRaDiff(raTargetMillis, get_ra_angle_millis());
-    int32_t decDiff = decTargetMillis - get_dec_mechnical_angle_millis();
-    int32_t absRaDiff;
-    int32_t raReverse;
-    int32_t absDecDiff;
-    int32_t decReverse;
-    if (raDiff > 0) {
-        absRaDiff = raDiff;
-        raReverse = 1;
-    } else {
-        absRaDiff = -raDiff;
-        raReverse = -1;
-    }
-    if (decDiff > 0) {
-        absDecDiff = decDiff;
-        decReverse = 1;
-    } else {
-        absDecDiff = -decDiff;
-        decReverse = -1;
-    }
-    if (absRaDiff < TOLERANCE_MILLIS && absDecDiff < TOLERANCE_MILLIS) {
-        slewing = false;
-        motor_callback(0, 0);
-        return;
-    }
-    double raSpeedFactor, decSpeedFactor;
-    if (absRaDiff < absDecDiff) {
-        raSpeedFactor = (double)absRaDiff / (double)absDecDiff;
-        decSpeedFactor = 1;
-        timeToGoMillis = absDecDiff / speed;
-    } else {
-        raSpeedFactor = 1;
-        decSpeedFactor = (double)absDecDiff / (double)absRaDiff;
-        timeToGoMillis = absRaDiff / speed;
-    }
-    while (timeToGoMillis < checkIntervalMillis * 4) {
-        LOGI(TAG, "Near target, slow down");
-        bool anySlowDown = false;
-        if (checkIntervalMillis > MIN_CHECK_INTERVAL_MILLIS) {
-            checkIntervalMillis /= 2;
-            anySlowDown = true;
-        }
-        if (speed > MIN_SPEED) {
-            speed /= 2;
-            timeToGoMillis *= 2;
-            anySlowDown = true;
-        }
-        if (!anySlowDown) {
-            break;
-        }
-    }
-    motor_callback(speed * raSpeedFactor * raReverse, speed * decSpeedFactor * decReverse);
-    double distanceNow = dist(raDiff, decDiff);
-    progress = distanceNow / distance;
-    LOGI(TAG, "distance: %.2f/%.2f raDiff: %d, decDiff: %d, time: %d", distanceNow, distance, raDiff, decDiff, timeToGoMillis / 1000);
-    esp_timer_start_once(slewTimer, checkIntervalMillis * 1000);
-}
-
-esp_err_t init_slew(slew_set_motor_speed_callback callback) {
-    motor_callback = callback;
-    esp_timer_create_args_t args = {
-        .dispatch_method = ESP_TIMER_TASK,
-        .callback = slew_timer_callback
-    };
-    return esp_timer_create(&args, &slewTimer);
-}
-
-bool is_slewing(){
-    return slewing;
-}
-
-void abort_slew() {
-    motor_callback(0, 0);
-    esp_timer_stop(slewTimer);
-    slewing = false;
-}
-
-void slew_to_coordinates(int32_t raMillis, int32_t decMillis){
-    raStartMillis = get_ra_angle_millis();
-    decStartMillis = get_dec_mechnical_angle_millis();
-    raTargetMillis = raMillis;
-    decTargetMillis = decMillis2decMecMillis(decMillis);
-    distance = dist(getRaDiff(raTargetMillis, raStartMillis), decTargetMillis - decStartMillis);
-    slewing = true;
-    speed = MAX_SPEED;
-    checkIntervalMillis = CHECK_INTERVAL_MILLIS;
-    slew_timer_callback(NULL);
-}
-
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "slew.h"
+#include "mount_encoder.h"
+#include "mount_config.h"
+#include "math.h"
+#include "util.h"
+#include "astro.h"
+#include "telescope.h"
+#include "pointing.h"
+#include "perf.h"
+#include "trace.h"
+#include "mount_snapshot.h"
+#include "mount_fsm.h"
+
+#define TAG "SLEW"
+
+slew_set_motor_speed_callback motor_callback;
+slew_can_flip_callback can_flip_callback;
+slew_flipped_callback flipped_callback;
+bool slewing = false;
+bool flipping = false;
+int8_t raDirection = 0; //forced RA motor direction while far from the target, 0 for the shortest way
+int64_t flipStartedAt;
+int32_t raStartMillis = 0, decStartMillis = 0;
+int32_t raTargetMillis = 0, decTargetMillis = 0;
+int speed, cruiseSpeed;
+int checkIntervalMillis;
+double distance;
+double progress;
+uint32_t timeToGoMillis;
+esp_timer_handle_t slewTimer;
+esp_timer_handle_t flipCheckTimer;
+
+#define MAX_SPEED 16
+/* the step generator ceiling, 12h of RA still take 24 minutes at 30 cycles per day */
+#define FLIP_SPEED (RA_SPEED_MAX / SPEED_PER_CYCLE)
+#define TOLERANCE_MILLIS 1000 
+#define CHECK_INTERVAL_MILLIS 1000
+#define MIN_CHECK_INTERVAL_MILLIS 125
+#define MIN_SPEED 1
+
+
+double dist(double a, double b) {
+    return sqrt(a*a + b*b);
+}
+
+/* the getters read what the timer published last, the variables above belong to the slew timer */
+double get_slew_progress() {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.slew_progress / 1000.0;
+}
+
+uint32_t get_slew_time_to_go_millis(){
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.slew_time_to_go_millis;
+}
+
+uint8_t get_slew_phase() {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.slew_phase;
+}
+
+static void publish_slew() {
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->slewing = slewing;
+    snapshot->slew_phase = !slewing ? SLEW_PHASE_IDLE : speed < cruiseSpeed ? SLEW_PHASE_APPROACH : SLEW_PHASE_CRUISE;
+    snapshot->slew_progress = slewing ? (1 - progress) * 1000 : 0;
+    snapshot->slew_time_to_go_millis = slewing ? timeToGoMillis : 0;
+    mount_snapshot_write_end();
+}
+
+int32_t getRaDiff(int32_t target, int32_t current) {
+    return angle_diff_millis(current, target);
+}
+
+/* a flip turns RA by 12h, the shortest way is ambiguous and may run through the counterweight-up side */
+int32_t getSlewRaDiff(int32_t current) {
+    int32_t raDiff = getRaDiff(raTargetMillis, current);
+    if (raDirection && (raDiff > 0) != (raDirection > 0) && abs(raDiff) > DAY_MILLIS / 4) {
+        raDiff += raDirection > 0 ? DAY_MILLIS : -DAY_MILLIS;
+    }
+    return raDiff;
+}
+
+void finish_flip() {
+    flipping = false;
+    // the RA axis turned by 12h, relabel it so the mount coordinates stay sky coordinates
+    int32_t ra = wrap_day_millis(get_ra_angle_millis() - DAY_MILLIS / 2);
+    int32_t dec = get_dec_angle_millis();
+    uint8_t side = getSideOfPier() ? 0 : 1;
+    LOGI(TAG, "meridian flip done in %d s", (int32_t)((esp_timer_get_time() - flipStartedAt) / 1000000));
+    flipped_callback(side, ra, dec);
+}
+
+void slew_timer_callback(void* _) {
+    PERF_BEGIN(PERF_SLEW_TIMER);
+    int32_t raDiff = getSlewRaDiff(get_ra_angle_millis());
+    int32_t decDiff = decTargetMillis - get_dec_mechnical_angle_millis();
+    int32_t absRaDiff;
+    int32_t raReverse;
+    int32_t absDecDiff;
+    int32_t decReverse;
+    if (raDiff > 0) {
+        absRaDiff = raDiff;
+        raReverse = 1;
+    } else {
+        absRaDiff = -raDiff;
+        raReverse = -1;
+    }
+    if (decDiff > 0) {
+        absDecDiff = decDiff;
+        decReverse = 1;
+    } else {
+        absDecDiff = -decDiff;
+        decReverse = -1;
+    }
+    if (absRaDiff < TOLERANCE_MILLIS && absDecDiff < TOLERANCE_MILLIS) {
+        slewing = false;
+        publish_slew();
+        motor_callback(0, 0);
+        mount_fsm_dispatch(MOUNT_EVENT_SLEW_END);
+        if (flipping) finish_flip();
+        PERF_END(PERF_SLEW_TIMER);
+        return;
+    }
+    double raSpeedFactor, decSpeedFactor;
+    if (absRaDiff < absDecDiff) {
+        raSpeedFactor = (double)absRaDiff / (double)absDecDiff;
+        decSpeedFactor = 1;
+        timeToGoMillis = absDecDiff / speed;
+    } else {
+        raSpeedFactor = 1;
+        decSpeedFactor = (double)absDecDiff / (double)absRaDiff;
+        timeToGoMillis = absRaDiff / speed;
+    }
+    while (timeToGoMillis < checkIntervalMillis * 4) {
+        bool anySlowDown = false;
+        if (checkIntervalMillis > MIN_CHECK_INTERVAL_MILLIS) {
+            checkIntervalMillis /= 2;
+            anySlowDown = true;
+        }
+        if (speed > MIN_SPEED) {
+            speed /= 2;
+            timeToGoMillis *= 2;
+            anySlowDown = true;
+        }
+        if (!anySlowDown) {
+            break;
+        }
+        TRACE(TRACE_SLEW_SLOWDOWN, speed, checkIntervalMillis);
+    }
+    motor_callback(speed * raSpeedFactor * raReverse, speed * decSpeedFactor * decReverse);
+    double distanceNow = dist(raDiff, decDiff);
+    progress = distanceNow / distance;
+    publish_slew();
+    TRACE(TRACE_SLEW_TICK, raDiff, decDiff);
+    esp_timer_start_once(slewTimer, checkIntervalMillis * 1000);
+    PERF_END(PERF_SLEW_TIMER);
+}
+
+#ifdef CONFIG_MERIDIAN_FLIP
+/* side 1 looks east, tracking carries it past the meridian towards the limit */
+void flip_check_timer_callback(void* _) {
+    if (slewing || getSideOfPier() == 0 || !is_time_synced()) return;
+    if (get_hour_angle_millis(get_ra_angle_millis()) < CONFIG_MERIDIAN_FLIP_MINUTES * 60 * 1000) return;
+    if (!can_flip_callback()) return;
+    slew_meridian_flip();
+}
+#endif
+
+esp_err_t init_slew(slew_set_motor_speed_callback callback, slew_can_flip_callback canFlip, slew_flipped_callback flipped) {
+    motor_callback = callback;
+    can_flip_callback = canFlip;
+    flipped_callback = flipped;
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = slew_timer_callback
+    };
+    esp_err_t err = esp_timer_create(&args, &slewTimer);
+#ifdef CONFIG_MERIDIAN_FLIP
+    if (err != ESP_OK) return err;
+    esp_timer_create_args_t flipArgs = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = flip_check_timer_callback
+    };
+    err = esp_timer_create(&flipArgs, &flipCheckTimer);
+    if (err != ESP_OK) return err;
+    err = esp_timer_start_periodic(flipCheckTimer, CHECK_INTERVAL_MILLIS * 1000);
+#endif
+    return err;
+}
+
+bool is_meridian_flipping() {
+    return flipping;
+}
+
+bool is_slewing(){
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.slewing;
+}
+
+void abort_slew() {
+    motor_callback(0, 0);
+    esp_timer_stop(slewTimer);
+    slewing = false;
+    publish_slew();
+    mount_fsm_dispatch(MOUNT_EVENT_SLEW_END);
+    if (flipping) {
+        // the dec side follows the axis, RA keeps its labels until the client syncs or sets the side
+        flipping = false;
+        LOGE(TAG, "meridian flip aborted");
+    }
+}
+
+static void start_slew(int32_t raMountMillis, int32_t decMecMillis, int maxSpeed) {
+    raStartMillis = get_ra_angle_millis();
+    decStartMillis = get_dec_mechnical_angle_millis();
+    raTargetMillis = raMountMillis;
+    decTargetMillis = decMecMillis;
+    distance = dist(getSlewRaDiff(raStartMillis), decTargetMillis - decStartMillis);
+    slewing = true;
+    progress = 1;
+    speed = cruiseSpeed = maxSpeed;
+    checkIntervalMillis = CHECK_INTERVAL_MILLIS;
+    slew_timer_callback(NULL);
+}
+
+/*
+ * The same sky position on the other side: mechanical dec mirrors at the
+ * pole and the RA axis turns by 12h, back through counterweight-down. The
+ * pointing model is applied per side, so the target goes through the sky.
+ */
+esp_err_t slew_meridian_flip() {
+    if (!mount_fsm_accepts(MOUNT_EVENT_SLEW_START)) return ESP_ERR_INVALID_STATE;
+    uint8_t side = getSideOfPier();
+    uint8_t newSide = side ? 0 : 1;
+    int32_t ra = get_ra_angle_millis();
+    int32_t dec = get_dec_angle_millis();
+    pointing_mount_to_sky(&ra, &dec, side);
+    pointing_sky_to_mount(&ra, &dec, newSide);
+    int32_t decMec = newSide ? DAY_MILLIS / 2 - dec : dec;
+    uint8_t parsedSide;
+    if (decMecMillis2decMillis(decMec, &parsedSide) != dec || parsedSide != newSide) {
+        LOGE(TAG, "no flipped position for dec %d", dec);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int32_t raMount = wrap_day_millis(ra + DAY_MILLIS / 2);
+    if (!mount_fsm_dispatch(MOUNT_EVENT_SLEW_START)) return ESP_ERR_INVALID_STATE;
+    // back through counterweight-down is decreasing hour angle on side 1, increasing on side 0
+    raDirection = side ? -1 : 1;
+    flipping = true;
+    flipStartedAt = esp_timer_get_time();
+    LOGI(TAG, "meridian flip to side %d, dec mechanical %d", newSide, decMec);
+    start_slew(raMount, decMec, FLIP_SPEED);
+    return ESP_OK;
+}
+
+esp_err_t slew_to_coordinates(int32_t raMillis, int32_t decMillis){
+    if (!mount_fsm_dispatch(MOUNT_EVENT_SLEW_START)) return ESP_ERR_INVALID_STATE;
+    pointing_sky_to_mount(&raMillis, &decMillis, getSideOfPier());
+    raDirection = 0;
+    start_slew(raMillis, decMillis2decMecMillis(decMillis), MAX_SPEED);
+    return ESP_OK;
+}
+
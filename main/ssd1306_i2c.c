@@ -32,6 +32,7 @@
 #include "stdlib.h"
 #include "string.h"
 #include "esp_log.h"
+#include "sdkconfig.h"
 
 
 /**
@@ -116,6 +117,46 @@ typedef struct _oled_i2c_ctx
 
 oled_i2c_ctx *_ctxs[2] = { NULL };
 
+#ifdef CONFIG_STATIC_ALLOCATION
+// Both panels at the largest size, so the heap is never touched
+static oled_i2c_ctx _ctx_storage[2];
+static uint8_t _buffer_storage[2][1024];
+#endif
+
+
+static oled_i2c_ctx *_ctx_alloc(uint8_t id)
+{
+#ifdef CONFIG_STATIC_ALLOCATION
+    memset(&_ctx_storage[id], 0, sizeof(oled_i2c_ctx));
+    return &_ctx_storage[id];
+#else
+    // zeroed, so the failure path never frees a garbage buffer pointer
+    return calloc(1, sizeof(oled_i2c_ctx));
+#endif
+}
+
+
+static uint8_t *_buffer_alloc(uint8_t id, size_t size)
+{
+#ifdef CONFIG_STATIC_ALLOCATION
+    return _buffer_storage[id];
+#else
+    return malloc(size);
+#endif
+}
+
+
+static void _ctx_free(oled_i2c_ctx *ctx)
+{
+#ifndef CONFIG_STATIC_ALLOCATION
+    if (ctx == NULL)
+        return;
+    if (ctx->buffer)
+        free(ctx->buffer);
+    free(ctx);
+#endif
+}
+
 
 bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
 {
@@ -131,8 +172,7 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
     // free old context (if any)
     ssd1306_term(id);
 
-    ctx = malloc(sizeof(oled_i2c_ctx));
-//    memset(&ctx,0,sizeof(oled_i2c_ctx));
+    ctx = _ctx_alloc(id);
     if (ctx == NULL)
     {
 //        dmsg_err_puts("Alloc OLED context failed.");
@@ -144,13 +184,12 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
 #if (PANEL0_TYPE != 0)
   #if (PANEL0_TYPE == SSD1306_128x64)
         ctx->type = SSD1306_128x64;
-        ctx->buffer = malloc(1024); // 128 * 64 / 8
+        ctx->buffer = _buffer_alloc(id, 1024); // 128 * 64 / 8
         ctx->width = 128;
         ctx->height = 64;
   #elif (PANEL0_TYPE == SSD1306_128x32)
         ctx->type = SSD1306_128x32;
-        ctx->buffer = malloc(512);  // 128 * 32 / 8
-//        memset(&(ctx->buffer),0,512);
+        ctx->buffer = _buffer_alloc(id, 512);  // 128 * 32 / 8
         ctx->width = 128;
         ctx->height = 32;
   #else
@@ -182,13 +221,12 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
 #if (PANEL1_PANEL_TYPE != 0)
   #if (PANEL1_PANEL_TYPE ==SSD1306_128x64)
         ctx->type = SSD1306_128x64;
-        ctx->buffer = malloc(1024); // 128 * 64 / 8
-//        memset(&(ctx->buffer),0,1024);
+        ctx->buffer = _buffer_alloc(id, 1024); // 128 * 64 / 8
         ctx->width = 128;
         ctx->height = 64;
   #elif (PANEL1_PANEL_TYPE == SSD1306_128x32)
         ctx->type = SSD1306_128x32;
-        ctx->buffer = zalloc(512);  // 128 * 32 / 8
+        ctx->buffer = _buffer_alloc(id, 512);  // 128 * 32 / 8
         ctx->width = 128;
         ctx->height = 32;
   #else
@@ -296,8 +334,7 @@ bool ssd1306_init(uint8_t id,uint8_t scl_pin, uint8_t sda_pin)
     return true;
 
 oled_init_fail:
-    if (ctx && ctx->buffer) free(ctx->buffer);
-    if (ctx) free(ctx);
+    _ctx_free(ctx);
     return false;
 }
 
@@ -312,9 +349,7 @@ void ssd1306_term(uint8_t id)
     _command(ctx->address, 0x8d); // SSD1306_CHARGEPUMP
     _command(ctx->address, 0x10); // Charge pump off
 
-    if (ctx->buffer)
-        free(ctx->buffer);
-    free(ctx);
+    _ctx_free(ctx);
 
     _ctxs[id] = NULL;
 }
@@ -1,789 +1,1573 @@
-#include <stdio.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "driver/gpio.h"
-#include "sdkconfig.h"
-#include "driver/ledc.h"
-#include "esp_err.h"
-#include "esp_log.h"
-#include "esp_wifi.h"
-#include "esp_timer.h"
-#include "esp_event_loop.h"
-#include "nvs_flash.h"
-#include "freertos/event_groups.h"
-
-#include "lwip/err.h"
-#include "lwip/sockets.h"
-#include "lwip/sys.h"
-#include <lwip/netdb.h>
-
-#include "util.h"
-#include "ssd1306.h"
-#include "fonts.h"
-
-#include "astro.h"
-#include "mount_encoder.h"
-
-#include "protocol.h"
-#include "slew.h"
-
-const static char *TAG = "Telescope";
-
-/* ------ consts ---------- */
-#define RA_CYCLE_MAX 30
-#define RA_CYCLE_MIN 0.01
-#define DEC_CYCLE_MAX 30
-#define DEC_CYCLE_MIN 0.01
-#define RA_SPEED_MAX 450000
-#define RA_SPEED_MIN 150
-#define DEC_SPEED_MAX 450000
-#define DEC_SPEED_MIN 150
-// #define RA_BACKLASH_TICKS 23
-// #define DEC_BACKLASH_TICKS 21
-// #define RA_TICKS_PER_CYCLE 312000
-// #define DEC_TICKS_PER_CYCLE 156000
-
-/* ------ utils ----------- */
-#define DUTY_RES LEDC_TIMER_13_BIT
-#define DUTY (((1 << DUTY_RES) - 1) / 2)
-// #define LOGI(tag, format, ...)
-// #define LOGE(tag, format, ...)
-/* ------ configs ---------- */
-#define WIFI_SSID   CONFIG_WIFI_SSID
-#define WIFI_PASS   CONFIG_WIFI_PASS
-
-#define UDP_PORT CONFIG_SERVER_PORT
-
-#define DISPLAY_SCL (CONFIG_DISPLAY_SCL)
-#define DISPLAY_SDA (CONFIG_DISPLAY_SDA)
-
-#define GPIO_RA_EN  (CONFIG_GPIO_RA_EN)
-#define GPIO_RA_DIR (CONFIG_GPIO_RA_DIR)
-#define GPIO_RA_PUL (CONFIG_GPIO_RA_PUL)
-
-#define RA_GEAR_RATIO ((double)(CONFIG_RA_GEAR_RATIO))
-#define RA_RESOLUTION ((double)(CONFIG_RA_RESOLUTION))
-#define RA_CYCLE_STEPS ((double)(CONFIG_RA_CYCLE_STEPS))
-
-#define GPIO_DEC_EN  (CONFIG_GPIO_DEC_EN)
-#define GPIO_DEC_DIR (CONFIG_GPIO_DEC_DIR)
-#define GPIO_DEC_PUL (CONFIG_GPIO_DEC_PUL)
-
-#define DEC_GEAR_RATIO ((double)(CONFIG_DEC_GEAR_RATIO))
-#define DEC_RESOLUTION ((double)(CONFIG_DEC_RESOLUTION))
-#define DEC_CYCLE_STEPS ((double)(CONFIG_DEC_CYCLE_STEPS))
-
-#ifndef CONFIG_RA_REVERSE
-#define CONFIG_RA_REVERSE false
-#endif
-
-#ifndef CONFIG_DEC_REVERSE
-#define CONFIG_DEC_REVERSE false
-#endif
-
-/* ---------- FREQS ---------- */
-#define RA_FREQ(cyclesPerSiderealDay) ((int)(RA_CYCLE_STEPS * RA_GEAR_RATIO * RA_RESOLUTION * (cyclesPerSiderealDay) * 1000 / SIDEREAL_DAY_MILLIS))
-#define DEC_FREQ(cyclesPerDay) ((int)(DEC_CYCLE_STEPS * DEC_GEAR_RATIO * DEC_RESOLUTION * (cyclesPerDay) * 1000 / DAY_MILLIS))
-
-#define CMD_PING 0
-#define CMD_SET_TRACKING 1
-#define CMD_SET_RA_SPEED 2
-#define CMD_SET_DEC_SPEED 3
-#define CMD_PULSE_GUIDING 4
-#define CMD_SET_RA_GUIDE_SPEED 5
-#define CMD_SET_DEC_GUIDE_SPEED 6
-#define CMD_SYNC_TO_TARGET 7
-#define CMD_SLEW_TO_TARGET 8
-#define CMD_ABORT_SLEW 9
-#define CMD_SET_SIDE_OF_PIER 10
-
-#define PULSE_GUIDING_NONE 0
-#define PULSE_GUIDING_DIR_WEST 4
-#define PULSE_GUIDING_DIR_EAST 3
-#define PULSE_GUIDING_DIR_NORTH 1
-#define PULSE_GUIDING_DIR_SOUTH 2
-
-ledc_channel_config_t ra_pmw_channel = {
-    .channel = LEDC_CHANNEL_0,
-    .timer_sel = LEDC_TIMER_0,
-    .duty = 0,
-    .gpio_num = GPIO_RA_PUL,
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-};
-
-ledc_timer_config_t ra_pmw_timer = {
-    .freq_hz = RA_FREQ(1),
-    .duty_resolution = DUTY_RES,
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-    .timer_num = LEDC_TIMER_0
-};
-
-ledc_channel_config_t dec_pmw_channel = {
-    .channel = LEDC_CHANNEL_1,
-    .timer_sel = LEDC_TIMER_1,
-    .duty = 0,
-    .gpio_num = GPIO_DEC_PUL,
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-};
-
-ledc_timer_config_t dec_pmw_timer = {
-    .freq_hz = DEC_FREQ(1),
-    .duty_resolution = DUTY_RES,
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-    .timer_num = LEDC_TIMER_1
-};
-
-typedef struct {
-    char * title;
-    char * line1;
-    char * line2;
-    char * line3;
-    char line_font;
-    char title_font;
-} display_t;
-
-bool displayEnabled = false;
-void updateDisplay(display_t *content) {
-    if (!displayEnabled) return;
-    ssd1306_clear(0);    
-    ssd1306_select_font(0, content->title_font ? content->title_font - 1 : 1);
-    if (content->title) ssd1306_draw_string(0, 1, 3, content->title, 1, 0);
-    ssd1306_select_font(0, content->line_font ? content->line_font - 1 : 1);
-    if (content->line1) ssd1306_draw_string(0, 1, 19, content->line1, 1, 0);
-    if (content->line2) ssd1306_draw_string(0, 1, 35, content->line2, 1, 0);
-    if (content->line3) ssd1306_draw_string(0, 1, 51, content->line3, 1, 0);
-    // ssd1306_draw_rectangle(0, 0, 0, 128, 16, 1);
-	// ssd1306_draw_rectangle(0, 0, 16, 128, 48, 1);
-    ssd1306_refresh(0, true);
-}
-int8_t tracking = 0;
-char pulseGuiding = 0;
-int raSpeed = 0, decSpeed = 0, raGuideSpeed = 7500, decGuideSpeed = 7500;
-uint8_t sideOfPier = 0;
-
-char my_ip[] = "255.255.255.255";
-uint32_t my_ip_num;
-char my_ip_port[] = "255.255.255.255:12345";
-uint16_t my_ip_port_num;
-char stepper_line1[] = "R.A. +00.0000 r/d";
-char stepper_line2[] = "Dec  +00.0000 r/d";
-char stepper_line3[] = "GUIDING/N  TRACKING/N";
-display_t stepper_display = {
-    .title = my_ip_port,
-    .line1 = stepper_line1,
-    .line2 = stepper_line2,
-    .line3 = stepper_line3,
-    .line_font = 1
-};
-
-void updateStepper() {
-    double raCyclesPerSiderealDay = raSpeed / 15000.0;
-    double decCyclesPerDay = decSpeed / 15000.0;
-
-    char* guidingstr = "   ";
-    switch (pulseGuiding) {
-        case PULSE_GUIDING_DIR_NORTH:
-            guidingstr = "G/N";
-            decCyclesPerDay += decGuideSpeed / 15000.0;
-            break;
-        case PULSE_GUIDING_DIR_SOUTH:
-            guidingstr = "G/S";
-            decCyclesPerDay -= decGuideSpeed / 15000.0;
-            break;
-        case PULSE_GUIDING_DIR_WEST:
-            guidingstr = "G/W";
-            raCyclesPerSiderealDay += raGuideSpeed / 15000.0;
-            break;
-        case PULSE_GUIDING_DIR_EAST:
-            guidingstr = "G/E";
-            raCyclesPerSiderealDay -= raGuideSpeed / 15000.0;
-            break;
-    }
-
-    if (tracking) {
-        raCyclesPerSiderealDay += 1;
-    }
-
-    sprintf(stepper_line1, "R.A. %+8.4f r/d", raCyclesPerSiderealDay);
-    sprintf(stepper_line2, "Dec  %+8.4f r/d", decCyclesPerDay);
-    char* trackingstr = "   ";
-    if (tracking > 0) {
-        trackingstr = "T/N";
-    } else if (tracking < 0) {
-        trackingstr = "T/W";
-    }
-    
-    if (!is_slewing()) {
-        sprintf(stepper_line3, "%s               %s",guidingstr, trackingstr);
-    } else {
-        sprintf(stepper_line3, "                     ");
-        int progress = (int)(get_slew_progress() * 100.0);
-        int timeToGo = get_slew_time_to_go_millis() / 1000;
-        sprintf(stepper_line3, "Slew %d%% eta %02d:%02d", progress, timeToGo / 60, timeToGo % 60);
-    }
-    updateDisplay(&stepper_display);
-
-    if (raCyclesPerSiderealDay < 0) {
-        raCyclesPerSiderealDay = -raCyclesPerSiderealDay;
-        if (CONFIG_RA_REVERSE) {
-            gpio_set_level(GPIO_RA_DIR, 1);
-        } else {
-            gpio_set_level(GPIO_RA_DIR, 0);
-        }        
-    } else {
-        if (CONFIG_RA_REVERSE) {
-            gpio_set_level(GPIO_RA_DIR, 0);
-        } else {
-            gpio_set_level(GPIO_RA_DIR, 1);
-        }
-    }
-
-    int rafreq = RA_FREQ(raCyclesPerSiderealDay);
-    if (raCyclesPerSiderealDay < RA_CYCLE_MIN || rafreq == 0) {
-        LOGI(TAG, "RA Stop");
-        ledc_set_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel, 0);
-        ledc_update_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel);
-        gpio_set_level(GPIO_RA_EN, 1);
-    } else {
-        if (raCyclesPerSiderealDay > RA_CYCLE_MAX) raCyclesPerSiderealDay = RA_CYCLE_MAX;        
-        LOGI(TAG, "RA Freq: %d", rafreq);
-        ledc_set_freq(LEDC_HIGH_SPEED_MODE, ra_pmw_timer.timer_num, rafreq);
-        ledc_set_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel, DUTY);        
-        ledc_update_duty(LEDC_HIGH_SPEED_MODE, ra_pmw_channel.channel);
-        gpio_set_level(GPIO_RA_EN, 0);
-    }
-
-    if (decCyclesPerDay < 0) {
-        decCyclesPerDay = -decCyclesPerDay;
-        if (CONFIG_DEC_REVERSE) {
-            gpio_set_level(GPIO_DEC_DIR, 1);
-        } else {
-            gpio_set_level(GPIO_DEC_DIR, 0);
-        } 
-    } else {
-        if (CONFIG_DEC_REVERSE) {
-            gpio_set_level(GPIO_DEC_DIR, 0);
-        } else {
-            gpio_set_level(GPIO_DEC_DIR, 1);
-        } 
-    }
-
-
-    int decfreq = DEC_FREQ(decCyclesPerDay);
-    if (decCyclesPerDay < DEC_CYCLE_MIN || decfreq == 0) {
-        LOGI(TAG, "DEC Stop");
-        ledc_set_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel, 0);
-        ledc_update_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel);
-        gpio_set_level(GPIO_DEC_EN, 1);
-    } else {
-        if (decCyclesPerDay > DEC_CYCLE_MAX) decCyclesPerDay = DEC_CYCLE_MAX;        
-        LOGI(TAG, "DEC Freq: %d", decfreq);
-        ledc_set_freq(LEDC_HIGH_SPEED_MODE, dec_pmw_timer.timer_num, decfreq);
-        ledc_set_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel, DUTY);        
-        ledc_update_duty(LEDC_HIGH_SPEED_MODE, dec_pmw_channel.channel);
-        gpio_set_level(GPIO_DEC_EN, 0);
-    }
-}
-
-void slewCallback(double raCyclesPerSiderealDay, double decCyclesPerDay) {
-    raSpeed = raCyclesPerSiderealDay * 15000.0;
-    decSpeed = decCyclesPerDay * 15000.0;
-    updateStepper();
-}
-
-char ackBuf[18];
-int8_t* ackTracking = (int8_t*)ackBuf;
-char* ackPulseGuiding = ackBuf + 1;
-int* ackRaSpeed = (int*)(ackBuf + 2);
-int* ackDecSpeed = (int*)(ackBuf + 6);
-int* ackRaGuideSpeed = (int*)(ackBuf + 10);
-int* ackDecGuideSpeed = (int*)(ackBuf + 14);
-
-void sendAck(int sock, struct sockaddr_in *addr, socklen_t addrlen) {    
-    *ackTracking = tracking;
-    *ackPulseGuiding = pulseGuiding;
-    *ackRaSpeed = ntohl(raSpeed);
-    *ackDecSpeed = ntohl(decSpeed);
-    *ackRaGuideSpeed = ntohl(raGuideSpeed);
-    *ackDecGuideSpeed = ntohl(decGuideSpeed);
-    LOGI(TAG, "ack to %s:%d", inet_ntoa(addr->sin_addr), addr->sin_port);
-    sendto(sock, ackBuf, LEN(ackBuf), 0, (struct sockaddr *) addr, addrlen);    
-}
-
-esp_timer_handle_t pulseGuidingTimer;
-struct sockaddr_in lastPulseGuidingFrom;
-socklen_t lastPulseGuidingFromLen;
-int lastPulseGuidingSocket;
-
-void pulseGuidingFinished(void* args) {
-    pulseGuiding = PULSE_GUIDING_NONE;
-    updateStepper();
-    LOGI(TAG, "pulseGuide finished");
-    sendAck(lastPulseGuidingSocket, &lastPulseGuidingFrom, lastPulseGuidingFromLen);
-}
-
-const char* getPulseDirDescr(int dir){
-    switch (dir) {
-        case PULSE_GUIDING_DIR_WEST:
-        return "west";
-        case PULSE_GUIDING_DIR_EAST:
-        return "east";
-        case PULSE_GUIDING_DIR_NORTH:
-        return "north";
-        case PULSE_GUIDING_DIR_SOUTH:
-        return "south";
-        default:
-        return "unknown";
-    }
-}
-
-int parse_command(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
-    char* cmd = buf;
-    switch(*cmd) {
-        case CMD_PING: {
-            if (len != 1) return 0;
-            LOGI(TAG, "ping");
-        } break;
-        case CMD_SET_TRACKING: {
-            if (len != 2) return 0;
-            if (is_slewing()) return 0;
-            int8_t* newTracking = (int8_t*)(buf + 1);
-            tracking = *newTracking;
-            updateStepper();
-            LOGI(TAG, "setTracking: %s", tracking ? (tracking > 0 ? "YES/N" : "YES/S") : "NO");
-        } break;
-        case CMD_SET_RA_SPEED: {
-            if (len != 5) return 0;
-            if (is_slewing()) return 0;
-            int* newRaSpeed = (int*)(buf + 1);
-            raSpeed = ntohl(*newRaSpeed);
-            if (raSpeed > RA_SPEED_MAX) raSpeed = RA_SPEED_MAX;
-            else if (raSpeed > RA_SPEED_MIN);
-            else if (raSpeed > -RA_SPEED_MIN) raSpeed = 0;
-            else if (raSpeed > -RA_SPEED_MAX);
-            else raSpeed = -RA_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setRaSpeed: %f", raSpeed / 1000.0);
-        } break;
-        case CMD_SET_DEC_SPEED: {
-            if (len != 5) return 0;
-            if (is_slewing()) return 0;
-            int* newDecSpeed = (int*)(buf + 1);
-            decSpeed = ntohl(*newDecSpeed);
-            if (decSpeed > DEC_SPEED_MAX) decSpeed = DEC_SPEED_MAX;
-            else if (decSpeed > DEC_SPEED_MIN);
-            else if (decSpeed > -DEC_SPEED_MIN) decSpeed = 0;
-            else if (decSpeed > -DEC_SPEED_MAX);
-            else decSpeed = -DEC_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setDecSpeed: %f", decSpeed / 1000.0);
-        } break;
-        case CMD_PULSE_GUIDING: {
-            if (len != 4) return 0;
-            if (is_slewing()) return 0;
-            if (pulseGuiding) return 0;
-            char* dir = (char*)(buf + 1);
-            short* pulseLengthN = (short*)(buf + 2);
-            short pulseLength = htons(*pulseLengthN);
-            pulseGuiding = *dir;
-            updateStepper();
-            lastPulseGuidingFromLen = fromlen;
-            memcpy(&lastPulseGuidingFrom, from, fromlen);
-            lastPulseGuidingSocket = fromSocket;
-            esp_timer_start_once(pulseGuidingTimer, pulseLength * 1000);
-            LOGI(TAG, "pulseGuide: %s in %dms", getPulseDirDescr(*dir), pulseLength);
-        } break;
-        case CMD_SET_RA_GUIDE_SPEED: {
-            if (len != 5) return 0;
-            int* newRaGuideSpeed = (int*)(buf + 1);
-            raGuideSpeed = ntohl(*newRaGuideSpeed);
-            if (raGuideSpeed > RA_SPEED_MAX) raGuideSpeed = RA_SPEED_MAX;
-            else if (raGuideSpeed > RA_SPEED_MIN);
-            else if (raGuideSpeed > -RA_SPEED_MIN) raGuideSpeed = 0;
-            else if (raGuideSpeed > -RA_SPEED_MAX);
-            else raGuideSpeed = -RA_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setRaGuideSpeed: %f", raSpeed / 1000.0);
-        } break;
-        case CMD_SET_DEC_GUIDE_SPEED: {
-            if (len != 5) return 0;
-            int* newDecGuideSpeed = (int*)(buf + 1);
-            decGuideSpeed = ntohl(*newDecGuideSpeed);
-            if (decGuideSpeed > DEC_SPEED_MAX) decGuideSpeed = DEC_SPEED_MAX;
-            else if (decGuideSpeed > DEC_SPEED_MIN);
-            else if (decGuideSpeed > -DEC_SPEED_MIN) decGuideSpeed = 0;
-            else if (decGuideSpeed > -DEC_SPEED_MAX);
-            else decGuideSpeed = -DEC_SPEED_MAX;
-            updateStepper();
-            LOGI(TAG, "setDecGuideSpeed: %f", decGuideSpeed / 1000.0);
-        } break;
-        case CMD_SYNC_TO_TARGET: {
-            if (len != 9) return 0;
-            if (is_slewing()) return 0;
-            int* raMillisPtr = (int*)(buf + 1);
-            int* decMillisPtr = (int*)(buf + 5);
-            int raMillis = ntohl(*raMillisPtr);
-            int decMillis = ntohl(*decMillisPtr);
-            set_angles(raMillis, decMillis);
-            LOGI(TAG, "syncTo: %d, %d", raMillis, decMillis);
-        }break;
-        case CMD_SLEW_TO_TARGET: {
-            if (is_slewing()) return 0;
-            if (pulseGuiding) return 0;
-            int* raMillisPtr = (int*)(buf + 1);
-            int* decMillisPtr = (int*)(buf + 5);
-            int raMillis = ntohl(*raMillisPtr);
-            int decMillis = ntohl(*decMillisPtr);
-            slew_to_coordinates(raMillis, decMillis);
-            LOGI(TAG, "slewTo: %d, %d", raMillis, decMillis);
-        }break;
-        case CMD_ABORT_SLEW: {
-            if (!is_slewing()) return 0;
-            abort_slew();
-            LOGI(TAG, "abortSlew");
-        }break;
-        case CMD_SET_SIDE_OF_PIER: {
-            if (len != 2) return 0;
-            if (is_slewing()) return 0;
-            int8_t* newSideOfPier = (int8_t*)(buf + 1);
-            sideOfPier = *newSideOfPier;
-            int32_t ra = get_ra_angle_millis();
-            int32_t dec = get_dec_angle_millis();
-            set_angles(ra, dec);
-            LOGI(TAG, "setSideOfPier: %s", sideOfPier ? "BeyondThePole/West" : "Normal/East");
-        }break;
-        default:
-        LOGI(TAG, "Unknown command: %d", *buf);
-        return 0;
-        break;
-    }
-    return 1;
-}
-
-
-
-void udp_server(void *pvParameter) {
-
-    LOGI(TAG, "Server Started");
-
-    //bind loop
-    while (1) {
-        struct sockaddr_in saddr = { 0 };
-        int sock = -1;
-        int err = 0;
-        
-        sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
-        if (sock < 0) {
-            LOGE(TAG, "Failed to create socket. Error %d", errno);
-            LOGE(TAG, "Retry After 1 second");
-            SLEEP(1000);
-            continue;
-        }
-
-        saddr.sin_family = PF_INET;
-        saddr.sin_port = htons(UDP_PORT);
-        saddr.sin_addr.s_addr = htonl(INADDR_ANY);
-        err = bind(sock, (struct sockaddr *)&saddr, sizeof(struct sockaddr_in));
-        if (err < 0) {
-            LOGE(TAG, "Failed to bind socket. Error %d", errno);
-            LOGE(TAG, "Retry After 1 second");
-            SLEEP(1000);
-            continue;
-        }
-
-        LOGI(TAG, "Server started at %d", UDP_PORT);
-
-        updateStepper();
-
-        //recv loop
-        while (1) {
-            char buf[129];
-            struct sockaddr_in from;
-            socklen_t fromlen;
-            int count = recvfrom(sock, buf, 128, 0, (struct sockaddr *) &from, &fromlen);
-            if (count <= 0) {
-                continue;
-            }
-            parse_command(buf, count, sock, &from, fromlen);
-            sendAck(sock, &from, fromlen);
-        }
-    }
-}
-
-static EventGroupHandle_t wifi_event_group;
-const static int CONNECTED_BIT = BIT0;
-esp_err_t err;
-bool connected = false;
-
-void stepper_gpio_init(){
-    gpio_pad_select_gpio(GPIO_RA_DIR);
-    gpio_set_direction(GPIO_RA_DIR, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_RA_DIR, 1);
-
-    gpio_pad_select_gpio(GPIO_RA_EN);
-    gpio_set_direction(GPIO_RA_EN, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_RA_EN, 1);
-
-    gpio_pad_select_gpio(GPIO_DEC_DIR);
-    gpio_set_direction(GPIO_DEC_DIR, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_DEC_DIR, 1);
-
-    gpio_pad_select_gpio(GPIO_DEC_EN);
-    gpio_set_direction(GPIO_DEC_EN, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_DEC_EN, 1);
-}
-
-esp_timer_handle_t autoDiscoverTimer;
-
-#define brdcPorts (CONFIG_SERVER_BROADCAST_PORT_LENGTH)
-int brdcFd = -1;
-struct sockaddr_in theirAddr[brdcPorts];
-
-void autoDiscoverTick(void* args) {
-    if (brdcFd == -1) {
-        brdcFd = socket(PF_INET, SOCK_DGRAM, 0);
-            if (brdcFd == -1) {
-            LOGE(TAG, "autoDiscover socket fail: %d", errno);
-            SLEEP(1000);
-            esp_restart();
-        }
-        int optval = 1;//这个值一定要设置，否则可能导致sendto()失败  
-        setsockopt(brdcFd, SOL_SOCKET, SO_BROADCAST | SO_REUSEADDR, &optval, sizeof(int));
-        for (int i = 0; i < brdcPorts; i ++) {
-            memset(&theirAddr[i], 0, sizeof(struct sockaddr_in));  
-            theirAddr[i].sin_family = AF_INET;
-            theirAddr[i].sin_addr.s_addr = inet_addr("255.255.255.255");  
-            theirAddr[i].sin_port = htons(CONFIG_SERVER_BROADCAST_PORT_START + i);                  
-        }
-    }
-    
-    broadcast_t data;
-    set_broadcast_fields(&data, 
-        my_ip_num,
-        UDP_PORT,
-        get_ra_angle_millis(),
-        get_dec_angle_millis(),
-        is_slewing(),
-        tracking,
-        raSpeed,
-        decSpeed,
-        sideOfPier
-    );
-    
-    for (int i = 0; i < brdcPorts; i ++) {
-        sendto(brdcFd, data.buffer, BROADCAST_SIZE, 0, (struct sockaddr *)&(theirAddr[i]), sizeof(struct sockaddr));
-    }    
-}
-
-static void wait_wifi(void *p)
-{
-    while (1) {
-        LOGI(TAG, "Waiting for AP connection...");
-        int dots = 0;
-        EventBits_t bits = xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, 1000 / portTICK_PERIOD_MS);
-        while(!bits) {
-            dots = (dots + 1) % 4;
-            char searching[20] = "Searching WiFi \0\0\0\0";
-            for (int i = 0; i < dots; i ++) {
-                searching[i + (15/* "Searching WiFi ".length */)] = '.';
-            }
-            display_t disp = {
-                .title = searching,
-                .line1 = "WiFi config:",
-                .line2 = "SSID: "WIFI_SSID,
-                .line3 = "PASS: "WIFI_PASS,
-            };
-            updateDisplay(&disp);
-            bits = xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, 1000 / portTICK_PERIOD_MS);
-        }
-        LOGI(TAG, "Connected to AP");
-
-        connected = true;
-
-        SLEEP(1000);
-
-        esp_timer_create_args_t args = {
-            .dispatch_method = ESP_TIMER_TASK,
-            .callback = pulseGuidingFinished
-        };
-        if (esp_timer_create(&args, &pulseGuidingTimer) != ESP_OK) {
-            LOGI(TAG, "Failed to create pulse guiding timers");
-            SLEEP(1000);
-            esp_restart();
-        }
-
-        esp_timer_create_args_t argsAutoDiscover = {
-            .dispatch_method = ESP_TIMER_TASK,
-            .callback = autoDiscoverTick
-        };
-        if (esp_timer_create(&argsAutoDiscover, &autoDiscoverTimer) != ESP_OK) {
-            LOGI(TAG, "Failed to create auto discover timers");
-            SLEEP(1000);
-            esp_restart();
-        }
-        esp_timer_start_periodic(autoDiscoverTimer, 1000 * 1000);
-        
-        ledc_channel_config(&ra_pmw_channel);
-        ledc_timer_config(&ra_pmw_timer);
-
-        ledc_channel_config(&dec_pmw_channel);
-        ledc_timer_config(&dec_pmw_timer);
-
-        udp_server(NULL);
-    }
-
-    vTaskDelete(NULL);
-}
-
-static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
-{
-    switch(event->event_id) {
-    case SYSTEM_EVENT_STA_START:
-        esp_wifi_connect();
-        break;
-    case SYSTEM_EVENT_STA_GOT_IP:
-        sprintf(my_ip, "%s", inet_ntoa(event->event_info.got_ip.ip_info.ip));
-        my_ip_num = ntohl(event->event_info.got_ip.ip_info.ip.addr);
-        sprintf(my_ip_port, "%s:%d", my_ip, UDP_PORT);
-        xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
-        break;
-    case SYSTEM_EVENT_STA_DISCONNECTED:
-        if (!connected) {
-            esp_wifi_connect();
-            xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
-        } else {
-            for (int i = 3; i > 0; i --) {
-                char buf[20];
-                sprintf(buf, "Restart in %d sec", i);
-                LOGE(TAG, "WiFi disconnected, %s", buf);
-                display_t disp = {
-                    .title = "WiFi Disconnected",
-                    .line1 = buf,
-                    .line2 = "",
-                    .line3 = "",
-                };
-                updateDisplay(&disp);
-                SLEEP(1000);
-            }
-            esp_restart();        
-        }
-        break;
-    default:
-        break;
-    }
-    return ESP_OK;
-}
-
-static void wifi_conn_init(void)
-{
-    tcpip_adapter_init();
-    wifi_event_group = xEventGroupCreate();
-    ESP_ERROR_CHECK( esp_event_loop_init(wifi_event_handler, NULL) );
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
-    ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-        },
-    };
-    ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
-    ESP_ERROR_CHECK( esp_wifi_start() );
-}
-
-void app_main(void)
-{
-    LOGI("BOOT", "App main");
-    LOGI("BOOT", "esp_timer_init");
-    ESP_ERROR_CHECK_ALLOW_INVALID_STATE(esp_timer_init());
-    LOGI("BOOT", "stepper_gpio_init");
-    stepper_gpio_init();    
-    LOGI("BOOT", "nvs_flash_init");
-    ESP_ERROR_CHECK(nvs_flash_init());
-    LOGI("BOOT", "init_mount");
-    init_mount();
-    LOGI("BOOT", "init_slew");
-    init_slew(slewCallback);
-    LOGI("BOOT", "ssd1306_init");
-    if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
-        LOGI(TAG, "Display inited");
-        displayEnabled = true;
-    } else {
-        LOGE(TAG, "Cannot init display, try again in 1 sec");
-        SLEEP(1000);
-        if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
-            LOGI(TAG, "Display inited");
-            displayEnabled = true;
-        } else {
-            LOGE(TAG, "Cannot init display");
-            displayEnabled = false;
-        }
-    }
-    display_t disp = {
-        .title = "Searching WiFi",
-        .line1 = "WiFi config:",
-        .line2 = "SSID: "WIFI_SSID,
-        .line3 = "PASS: "WIFI_PASS,
-    };
-    LOGI("BOOT", "updateDisplay");
-    updateDisplay(&disp);
-    LOGI("BOOT", "wifi_conn_init");
-    wifi_conn_init();
-    LOGI("BOOT", "xTaskCreate wait_wifi");
-    xTaskCreate(wait_wifi, TAG, 4096, NULL, 5, NULL);
-}
-
-uint8_t getSideOfPier() {
-    return sideOfPier;
-}
-
-
-/* 90  - 21600000 */
-/* 180 - 43200000 */
-/* 270 - 64800000 */
-/* 360 - 86400000 */
-int32_t decMillis2decMecMillis(int32_t decMillis) {
-    if (sideOfPier) {
-        return 43200000 - decMillis;
-    } else {
-        return decMillis;
-    }
-}
-
-int32_t decMecMillis2decMillis(int32_t decMecMillis, uint8_t* parseSideOfPier) {
-    while (decMecMillis < 0) {
-        decMecMillis += 86400000;
-    }
-    while (decMecMillis >= 86400000) {
-        decMecMillis -= 86400000;
-    }/* 0 - 360 */
-    if (decMecMillis < 21600000) {
-        if (parseSideOfPier) {
-            *parseSideOfPier = 0;
-        }    
-        return decMecMillis;
-    }
-    if (decMecMillis > 64800000) {
-        if (parseSideOfPier) {
-            *parseSideOfPier = 0;
-        }
-        return decMecMillis - 86400000;
-    }
-    /* 90 - 270 */
-    if (parseSideOfPier) {
-        *parseSideOfPier = 1;
-    }
-    return 43200000 - decMecMillis;
-}
-
-void setSideOfPierWithDecMecMillis(int32_t decMecMillis) {
-    decMecMillis2decMillis(decMecMillis, &sideOfPier);
-}
-
-
-
-
-
-
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "sdkconfig.h"
+#include "driver/ledc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_event_loop.h"
+#include "nvs_flash.h"
+#include "freertos/event_groups.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include <lwip/netdb.h>
+
+#include "util.h"
+#include "ssd1306.h"
+#include "fonts.h"
+
+#include "astro.h"
+#include "mount_encoder.h"
+
+#include "protocol.h"
+#include "slew.h"
+#include "guide.h"
+#include "discovery.h"
+#include "pointing.h"
+#include "persist.h"
+#include "wifi_store.h"
+#include "mount_config.h"
+#include "backlash.h"
+#include "axis.h"
+#include "focuser.h"
+#include "mount_limits.h"
+#include "perf.h"
+#include "trace.h"
+#include "bench.h"
+#include "capture.h"
+#include "diag.h"
+#include "mount_tasks.h"
+#include "mount_snapshot.h"
+#include "mount_fsm.h"
+#include "telescope.h"
+
+const static char *TAG = "Telescope";
+
+/* ------ consts ---------- */
+#define RA_CYCLE_MAX 30
+#define RA_CYCLE_MIN 0.01
+#define DEC_CYCLE_MAX 30
+#define DEC_CYCLE_MIN 0.01
+// #define RA_BACKLASH_TICKS 23
+// #define DEC_BACKLASH_TICKS 21
+// #define RA_TICKS_PER_CYCLE 312000
+// #define DEC_TICKS_PER_CYCLE 156000
+
+/* ------ utils ----------- */
+// #define LOGI(tag, format, ...)
+// #define LOGE(tag, format, ...)
+/* ------ configs ---------- */
+#define UDP_PORT CONFIG_SERVER_PORT
+
+
+#define DISPLAY_SCL (CONFIG_DISPLAY_SCL)
+#define DISPLAY_SDA (CONFIG_DISPLAY_SDA)
+
+
+#define CMD_PING 0
+#define CMD_SET_TRACKING 1
+#define CMD_SET_RA_SPEED 2
+#define CMD_SET_DEC_SPEED 3
+#define CMD_PULSE_GUIDING 4
+#define CMD_SET_RA_GUIDE_SPEED 5
+#define CMD_SET_DEC_GUIDE_SPEED 6
+#define CMD_SYNC_TO_TARGET 7
+#define CMD_SLEW_TO_TARGET 8
+#define CMD_ABORT_SLEW 9
+#define CMD_SET_SIDE_OF_PIER 10
+#define CMD_GET_CLOCK 11
+#define CMD_GET_STATUS 12
+#define CMD_SYNC_TIME 13
+#define CMD_SET_SITE 14
+#define CMD_CLEAR_POINTING_MODEL 15
+#define CMD_GET_POINTING_MODEL 16
+#define CMD_SET_WIFI 17
+#define CMD_SET_MOUNT_CONFIG 18
+#define CMD_GET_MOUNT_CONFIG 19
+#define CMD_CALIBRATE_BACKLASH 20
+#define CMD_FOCUSER_MOVE 21
+#define CMD_FOCUSER_HALT 22
+#define CMD_FOCUSER_SYNC 23
+#define CMD_FOCUSER_SET_TEMP_COMP 24
+#define CMD_FOCUSER_SET_TEMPERATURE 25
+#define CMD_GET_FOCUSER 26
+#define CMD_SET_LIMITS 27
+#define CMD_GET_LIMITS 28
+#define CMD_GET_PERF 29
+#define CMD_GET_TRACE 30
+#define CMD_SET_TRACE_STREAM 31
+#define CMD_SET_CAPTURE 32
+#define CMD_GET_CAPTURE 33
+#define CMD_GET_DIAG 34
+
+/* parse_command result when the command has sent its own reply instead of an ack */
+#define CMD_REPLIED 2
+
+typedef struct {
+    char * title;
+    char * line1;
+    char * line2;
+    char * line3;
+    char line_font;
+    char title_font;
+} display_t;
+
+bool displayEnabled = false;
+void updateDisplay(display_t *content) {
+    if (!displayEnabled) return;
+    PERF_BEGIN(PERF_UPDATE_DISPLAY);
+    ssd1306_clear(0);    
+    ssd1306_select_font(0, content->title_font ? content->title_font - 1 : 1);
+    if (content->title) ssd1306_draw_string(0, 1, 3, content->title, 1, 0);
+    ssd1306_select_font(0, content->line_font ? content->line_font - 1 : 1);
+    if (content->line1) ssd1306_draw_string(0, 1, 19, content->line1, 1, 0);
+    if (content->line2) ssd1306_draw_string(0, 1, 35, content->line2, 1, 0);
+    if (content->line3) ssd1306_draw_string(0, 1, 51, content->line3, 1, 0);
+    // ssd1306_draw_rectangle(0, 0, 0, 128, 16, 1);
+	// ssd1306_draw_rectangle(0, 0, 16, 128, 48, 1);
+    PERF_BEGIN(PERF_SSD1306_REFRESH);
+    ssd1306_refresh(0, true);
+    PERF_END(PERF_SSD1306_REFRESH);
+    PERF_END(PERF_UPDATE_DISPLAY);
+}
+
+char my_ip[] = "255.255.255.255";
+uint32_t my_ip_num;
+char my_ip_port[] = "255.255.255.255:12345";
+uint16_t my_ip_port_num;
+wifi_credentials_t wifiCredentials;
+char wifi_ssid_line[6 + WIFI_SSID_MAX + 1];
+char wifi_pass_line[6 + WIFI_PASS_MAX + 1];
+bool wifiCredentialsChanged = false;
+esp_timer_handle_t reconnectTimer;
+char stepper_line1[] = "R.A. +00.0000 r/d";
+char stepper_line2[] = "Dec  +00.0000 r/d";
+char stepper_line3[] = "GUIDING/N  TRACKING/N";
+display_t stepper_display = {
+    .title = my_ip_port,
+    .line1 = stepper_line1,
+    .line2 = stepper_line2,
+    .line3 = stepper_line3,
+    .line_font = 1
+};
+
+int8_t getGuideDirSign(uint8_t axis) {
+    switch (get_pulse_guiding_dir(axis)) {
+        case PULSE_GUIDING_DIR_NORTH:
+        case PULSE_GUIDING_DIR_WEST:
+            return 1;
+        case PULSE_GUIDING_DIR_SOUTH:
+        case PULSE_GUIDING_DIR_EAST:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+/* speeds in milli seconds per (sidereal) second, SPEED_PER_CYCLE is one cycle per day */
+int32_t getRaSpeed(int8_t guideDir) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    int32_t speed = snapshot.ra_speed + guideDir * snapshot.ra_guide_speed;
+    if (snapshot.tracking) {
+        speed += SPEED_PER_CYCLE;
+    }
+    return speed;
+}
+
+int32_t getDecSpeed(int8_t guideDir) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.dec_speed + guideDir * snapshot.dec_guide_speed;
+}
+
+/* the clamp of the speed commands, below min the axis stops */
+int32_t clampSpeed(int32_t speed, int32_t min, int32_t max) {
+    if (speed > max) return max;
+    else if (speed > min) return speed;
+    else if (speed > -min) return 0;
+    else if (speed > -max) return speed;
+    else return -max;
+}
+
+double getRaCyclesPerSiderealDay(int8_t guideDir) {
+    return getRaSpeed(guideDir) / (double)SPEED_PER_CYCLE;
+}
+
+double getDecCyclesPerDay(int8_t guideDir) {
+    return getDecSpeed(guideDir) / (double)SPEED_PER_CYCLE;
+}
+
+void updateStepperDisplay() {
+    double raCyclesPerSiderealDay = getRaCyclesPerSiderealDay(getGuideDirSign(GUIDE_AXIS_RA));
+    double decCyclesPerDay = getDecCyclesPerDay(getGuideDirSign(GUIDE_AXIS_DEC));
+
+    char guidingstr[] = "   ";
+    switch (get_pulse_guiding_dir(GUIDE_AXIS_DEC)) {
+        case PULSE_GUIDING_DIR_NORTH:
+            guidingstr[1] = 'N';
+            break;
+        case PULSE_GUIDING_DIR_SOUTH:
+            guidingstr[1] = 'S';
+            break;
+    }
+    switch (get_pulse_guiding_dir(GUIDE_AXIS_RA)) {
+        case PULSE_GUIDING_DIR_WEST:
+            guidingstr[2] = 'W';
+            break;
+        case PULSE_GUIDING_DIR_EAST:
+            guidingstr[2] = 'E';
+            break;
+    }
+    if (guidingstr[1] != ' ' || guidingstr[2] != ' ') {
+        guidingstr[0] = 'G';
+        if (guidingstr[1] == ' ') guidingstr[1] = '/';
+        if (guidingstr[2] == ' ') guidingstr[2] = '/';
+    }
+
+    sprintf(stepper_line1, "R.A. %+8.4f r/d", raCyclesPerSiderealDay);
+    sprintf(stepper_line2, "Dec  %+8.4f r/d", decCyclesPerDay);
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    char* trackingstr = "   ";
+    if (snapshot.tracking > 0) {
+        trackingstr = "T/N";
+    } else if (snapshot.tracking < 0) {
+        trackingstr = "T/W";
+    }
+    
+    if (!snapshot.slewing) {
+        sprintf(stepper_line3, "%s               %s",guidingstr, trackingstr);
+    } else {
+        sprintf(stepper_line3, "                     ");
+        int progress = snapshot.slew_progress / 10;
+        int timeToGo = snapshot.slew_time_to_go_millis / 1000;
+        sprintf(stepper_line3, "Slew %d%% eta %02d:%02d", progress, timeToGo / 60, timeToGo % 60);
+    }
+    updateDisplay(&stepper_display);
+}
+
+/* runs on the motion task, which asks the display task for the redraw afterwards */
+void applyStepper(uint8_t axes) {
+    PERF_BEGIN(PERF_UPDATE_STEPPER);
+    if (axes & MOTION_AXIS(AXIS_RA)) {
+        axis_set_step_rate(&mount_axes[AXIS_RA], limits_filter_speed(AXIS_RA, getRaSpeed(getGuideDirSign(GUIDE_AXIS_RA))));
+    }
+    if (axes & MOTION_AXIS(AXIS_DEC)) {
+        axis_set_step_rate(&mount_axes[AXIS_DEC], limits_filter_speed(AXIS_DEC, getDecSpeed(getGuideDirSign(GUIDE_AXIS_DEC))));
+    }
+    PERF_END(PERF_UPDATE_STEPPER);
+}
+
+/* axes is a MOTION_AXIS() mask, only those get their rate recomputed */
+void updateStepper(uint8_t axes) {
+    post_motion(axes, 0);
+}
+
+int64_t commandReceivedAt;
+
+/* for the commands, so their latency to the motors is measured */
+void commandUpdateStepper(uint8_t axes) {
+    post_motion(axes, commandReceivedAt);
+}
+
+int32_t guideGetStepRate(uint8_t axis) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    if (axis == GUIDE_AXIS_RA) {
+        return axis_get_step_millihz(&mount_axes[AXIS_RA], snapshot.ra_guide_speed);
+    } else {
+        return axis_get_step_millihz(&mount_axes[AXIS_DEC], snapshot.dec_guide_speed);
+    }
+}
+
+/* the motor only reverses between corrections when it does not outrun the guide rate */
+int32_t guideGetBacklashSteps(uint8_t axis) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    if (axis == GUIDE_AXIS_RA) {
+        int32_t base = getRaSpeed(0);
+        return (base < 0 ? -base : base) < snapshot.ra_guide_speed ? mount_constants.ra_backlash_steps : 0;
+    } else {
+        int32_t base = getDecSpeed(0);
+        return (base < 0 ? -base : base) < snapshot.dec_guide_speed ? mount_constants.dec_backlash_steps : 0;
+    }
+}
+
+/* switches only the guided axis, so the pulse timing is not disturbed by the other axis or the display */
+int guideApplyStepRate(uint8_t axis, int8_t dir) {
+    if (axis == GUIDE_AXIS_RA) {
+        int base = axis_get_step_freq(&mount_axes[AXIS_RA], limits_filter_speed(AXIS_RA, getRaSpeed(0)));
+        return axis_set_step_rate(&mount_axes[AXIS_RA], limits_filter_speed(AXIS_RA, getRaSpeed(dir))) - base;
+    } else {
+        int base = axis_get_step_freq(&mount_axes[AXIS_DEC], limits_filter_speed(AXIS_DEC, getDecSpeed(0)));
+        return axis_set_step_rate(&mount_axes[AXIS_DEC], limits_filter_speed(AXIS_DEC, getDecSpeed(dir))) - base;
+    }
+}
+
+void slewCallback(double raCyclesPerSiderealDay, double decCyclesPerDay) {
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->ra_speed = raCyclesPerSiderealDay * SPEED_PER_CYCLE;
+    snapshot->dec_speed = decCyclesPerDay * SPEED_PER_CYCLE;
+    mount_snapshot_write_end();
+    updateStepper(MOTION_ALL_AXES);
+}
+
+char ackBuf[22];
+int8_t* ackTracking = (int8_t*)ackBuf;
+char* ackPulseGuiding = ackBuf + 1;
+int* ackRaSpeed = (int*)(ackBuf + 2);
+int* ackDecSpeed = (int*)(ackBuf + 6);
+int* ackRaGuideSpeed = (int*)(ackBuf + 10);
+int* ackDecGuideSpeed = (int*)(ackBuf + 14);
+uint16_t* ackRaPulseRemaining = (uint16_t*)(ackBuf + 18);
+uint16_t* ackDecPulseRemaining = (uint16_t*)(ackBuf + 20);
+
+uint16_t getPulseRemainingField(uint8_t axis) {
+    uint32_t remaining = get_pulse_guiding_remaining_millis(axis);
+    return htons(remaining > 0xffff ? 0xffff : remaining);
+}
+
+void sendAck(int sock, struct sockaddr_in *addr, socklen_t addrlen) {    
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    *ackTracking = snapshot.tracking;
+    *ackPulseGuiding = get_pulse_guiding_dir(GUIDE_AXIS_RA) ? get_pulse_guiding_dir(GUIDE_AXIS_RA) : get_pulse_guiding_dir(GUIDE_AXIS_DEC);
+    *ackRaSpeed = ntohl(snapshot.ra_speed);
+    *ackDecSpeed = ntohl(snapshot.dec_speed);
+    *ackRaGuideSpeed = ntohl(snapshot.ra_guide_speed);
+    *ackDecGuideSpeed = ntohl(snapshot.dec_guide_speed);
+    *ackRaPulseRemaining = getPulseRemainingField(GUIDE_AXIS_RA);
+    *ackDecPulseRemaining = getPulseRemainingField(GUIDE_AXIS_DEC);
+    LOGI(TAG, "ack to %s:%d", inet_ntoa(addr->sin_addr), addr->sin_port);
+    sendto(sock, ackBuf, LEN(ackBuf), 0, (struct sockaddr *) addr, addrlen);    
+}
+
+void fillStatus(status_t *status) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    mount_motion_t motion;
+    get_mount_motion(&motion);
+    pointing_mount_to_sky(&motion.ra, &motion.dec, snapshot.side_of_pier);
+    uint8_t flags = 0;
+    if (snapshot.slewing) flags |= STATUS_FLAG_SLEWING;
+    if (snapshot.tracking) flags |= STATUS_FLAG_TRACKING;
+    if (get_pulse_guiding_dir(GUIDE_AXIS_RA)) flags |= STATUS_FLAG_GUIDING_RA;
+    if (get_pulse_guiding_dir(GUIDE_AXIS_DEC)) flags |= STATUS_FLAG_GUIDING_DEC;
+    uint8_t limits = get_active_limits();
+    if (limits) flags |= STATUS_FLAG_LIMIT;
+    if (is_meridian_flipping()) flags |= STATUS_FLAG_FLIPPING;
+#ifdef CONFIG_FOCUSER_ENABLED
+    if (is_focuser_moving()) flags |= STATUS_FLAG_FOCUSER_MOVING;
+#endif
+    uint16_t stackFree = DIAG_STACK_FREE_UNKNOWN;
+    uint8_t cpuLoad = DIAG_CPU_LOAD_UNKNOWN;
+#ifdef CONFIG_DIAGNOSTICS
+    get_diag_summary(&stackFree, &cpuLoad);
+#endif
+    set_status_fields(status,
+        motion.timestamp,
+        motion.ra,
+        motion.dec,
+        motion.ra_velocity,
+        motion.dec_velocity,
+        snapshot.slew_phase,
+        snapshot.slew_time_to_go_millis,
+        flags,
+        snapshot.side_of_pier,
+        limits,
+        cpuLoad,
+        stackFree
+    );
+}
+
+#ifdef CONFIG_FOCUSER_ENABLED
+void fillFocuser(focuser_frame_t *frame) {
+    focuser_state_t state;
+    get_focuser_state(&state);
+    uint8_t flags = 0;
+    if (state.moving) flags |= FOCUSER_FLAG_MOVING;
+    if (state.temp_coefficient) flags |= FOCUSER_FLAG_TEMP_COMP;
+    set_focuser_fields(frame,
+        flags,
+        state.position,
+        state.target,
+        state.temperature,
+        state.temp_coefficient
+    );
+}
+#endif
+
+int8_t backlashSavedTracking;
+int backlashSavedRaSpeed, backlashSavedDecSpeed;
+
+
+int backlashDrive(uint8_t axis, int32_t speed) {
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    if (axis == BACKLASH_AXIS_RA) {
+        snapshot->ra_speed = speed;
+    } else {
+        snapshot->dec_speed = speed;
+    }
+    mount_snapshot_write_end();
+    if (axis == BACKLASH_AXIS_RA) {
+        return axis_set_step_rate(&mount_axes[AXIS_RA], limits_filter_speed(AXIS_RA, getRaSpeed(0)));
+    } else {
+        return axis_set_step_rate(&mount_axes[AXIS_DEC], limits_filter_speed(AXIS_DEC, getDecSpeed(0)));
+    }
+}
+
+/* from the calibration timer, the new backlash applies at once and goes to flash from the storage task */
+void backlashFinished(uint8_t axis, int32_t pulses) {
+    if (pulses >= 0) {
+        uint32_t geometry[GEOMETRY_FIELDS];
+        get_mount_geometry(geometry);
+        geometry[axis == BACKLASH_AXIS_RA ? GEOMETRY_RA_BACKLASH_PULSES : GEOMETRY_DEC_BACKLASH_PULSES] = pulses;
+        if (apply_mount_geometry(geometry) == ESP_OK) {
+            post_storage(STORAGE_GEOMETRY);
+        } else {
+            LOGE(TAG, "backlash %d pulses rejected", pulses);
+        }
+    }
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->tracking = backlashSavedTracking;
+    snapshot->ra_speed = backlashSavedRaSpeed;
+    snapshot->dec_speed = backlashSavedDecSpeed;
+    mount_snapshot_write_end();
+    mount_fsm_dispatch(MOUNT_EVENT_CALIBRATE_END);
+    updateStepper(MOTION_ALL_AXES);
+    LOGI(TAG, "calibrateBacklash finished on %s: %d", axis == BACKLASH_AXIS_RA ? "RA" : "DEC", pulses);
+}
+
+/* only a tracking mount flips by itself, anything the client started comes first */
+bool slewCanFlip() {
+    return get_mount_fsm_state() == MOUNT_STATE_TRACKING;
+}
+
+/* tracking ran on through the flip, only the side and the RA labels change */
+void slewFlipped(uint8_t side, int32_t ra, int32_t dec) {
+    mount_snapshot_write_begin()->side_of_pier = side;
+    mount_snapshot_write_end();
+    set_angles(ra, dec);
+    persist_mark_urgent();
+    LOGI(TAG, "meridianFlip: %s", side ? "BeyondThePole/West" : "Normal/East");
+}
+
+/* a new limit stops whatever drove the mount into it, any change re-applies the filtered speeds */
+void limitsChanged(uint8_t active, uint8_t tripped) {
+    if (tripped) {
+        if (is_slewing()) abort_slew();
+        if (is_calibrating_backlash()) abort_backlash_calibration();
+        if (limits_filter_speed(AXIS_RA, getRaSpeed(0)) == 0) {
+            mount_snapshot_write_begin()->tracking = 0;
+            mount_snapshot_write_end();
+        }
+        mount_fsm_dispatch(MOUNT_EVENT_LIMIT_TRIPPED);
+        LOGI(TAG, "limits 0x%02x tripped", tripped);
+    } else if (!active) {
+        mount_fsm_dispatch(MOUNT_EVENT_LIMITS_CLEARED);
+    }
+    updateStepper(MOTION_ALL_AXES);
+}
+
+#ifdef CONFIG_TRACE
+/* returns the frame length, *from moves past the events sent */
+int fillTrace(trace_frame_t *frame, uint8_t core, uint32_t *from) {
+    trace_event_t events[TRACE_FRAME_EVENTS];
+    uint32_t head;
+    int count = trace_read(core, from, &head, events, TRACE_FRAME_EVENTS);
+    int len = set_trace_fields(frame, core, count, *from, head);
+    for (int i = 0; i < count; i ++) {
+        set_trace_event_fields(frame, i, events[i].id, events[i].time, events[i].a, events[i].b);
+    }
+    *from += count;
+    return len;
+}
+
+esp_timer_handle_t traceStreamTimer;
+struct sockaddr_in traceStreamTo;
+socklen_t traceStreamToLen;
+int traceStreamSocket = -1;
+uint32_t traceStreamFrom[portNUM_PROCESSORS];
+
+#define TRACE_STREAM_MAX_FRAMES 4
+
+void traceStreamTick(void* args) {
+    for (int core = 0; core < portNUM_PROCESSORS; core ++) {
+        for (int i = 0; i < TRACE_STREAM_MAX_FRAMES; i ++) {
+            trace_frame_t frame;
+            int len = fillTrace(&frame, core, &traceStreamFrom[core]);
+            if (TRACE_COUNT(frame.buffer) == 0) break;
+            sendto(traceStreamSocket, frame.buffer, len, 0, (struct sockaddr *) &traceStreamTo, traceStreamToLen);
+        }
+    }
+}
+#endif
+
+#ifdef CONFIG_CAPTURE
+/* frames are too big for the stacks of the command task and the timer task */
+capture_frame_t captureReply, captureStreamFrame;
+esp_timer_handle_t captureStreamTimer;
+struct sockaddr_in captureStreamTo;
+socklen_t captureStreamToLen;
+int captureStreamSocket = -1;
+uint32_t captureStreamFrom;
+
+#define CAPTURE_STREAM_MAX_FRAMES 8
+
+void collectPersistValues(int32_t* values);
+void applyPersistValues(const int32_t* values);
+
+/* the journaled state plus what only lives in the command handlers */
+void collectCaptureSnapshot(int32_t* values) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    collectPersistValues(values);
+    values[PERSIST_FIELDS] = snapshot.tracking;
+    values[PERSIST_FIELDS + 1] = snapshot.ra_speed;
+    values[PERSIST_FIELDS + 2] = snapshot.dec_speed;
+}
+
+void restoreCaptureSnapshot(const int32_t* values) {
+    applyPersistValues(values);
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->ra_speed = values[PERSIST_FIELDS + 1];
+    snapshot->dec_speed = values[PERSIST_FIELDS + 2];
+    mount_snapshot_write_end();
+    mount_fsm_set_tracking(values[PERSIST_FIELDS]);
+    commandUpdateStepper(MOTION_AXIS(AXIS_RA) | MOTION_AXIS(AXIS_DEC));
+}
+
+int fillCapture(capture_frame_t *frame, uint32_t *from) {
+    uint32_t head;
+    int count = capture_read(from, &head, CAPTURE_DATA(frame->buffer), CAPTURE_FRAME_BYTES);
+    int len = set_capture_fields(frame, get_capture_mode(), count, *from, head);
+    *from += count;
+    return len;
+}
+
+void captureStreamTick(void* args) {
+    for (int i = 0; i < CAPTURE_STREAM_MAX_FRAMES; i ++) {
+        int len = fillCapture(&captureStreamFrame, &captureStreamFrom);
+        if (ntohs(CAPTURE_LENGTH(captureStreamFrame.buffer)) == 0) break;
+        sendto(captureStreamSocket, captureStreamFrame.buffer, len, 0, (struct sockaddr *) &captureStreamTo, captureStreamToLen);
+    }
+}
+#endif
+
+#ifdef CONFIG_DIAGNOSTICS
+/* kept off the stack of the command task, the one diagnostics are watching */
+diag_stats_t diagStats;
+diag_frame_t diagReply;
+#endif
+
+struct sockaddr_in lastPulseGuidingFrom;
+socklen_t lastPulseGuidingFromLen;
+int lastPulseGuidingSocket = -1;
+
+void pulseGuidingFinished(uint8_t axis) {
+    // the other axis, or a pulse the command task started meanwhile, may still guide
+    mount_fsm_follow_guiding();
+    post_display();
+    LOGI(TAG, "pulseGuide finished on %s", axis == GUIDE_AXIS_RA ? "RA" : "DEC");
+    if (lastPulseGuidingSocket >= 0) {
+        sendAck(lastPulseGuidingSocket, &lastPulseGuidingFrom, lastPulseGuidingFromLen);
+    }
+}
+
+int parse_command(char* buf, unsigned int len, int fromSocket, struct sockaddr_in* from, socklen_t fromlen) {
+    char* cmd = buf;
+    switch(*cmd) {
+        case CMD_PING: {
+            if (len != 1) return 0;
+            LOGI(TAG, "ping");
+        } break;
+        case CMD_SET_TRACKING: {
+            if (len != 2) return 0;
+            int8_t* newTracking = (int8_t*)(buf + 1);
+            if (!mount_fsm_set_tracking(*newTracking)) return 0;
+            commandUpdateStepper(MOTION_AXIS(AXIS_RA));
+            LOGI(TAG, "setTracking: %s", *newTracking ? (*newTracking > 0 ? "YES/N" : "YES/S") : "NO");
+        } break;
+        case CMD_SET_RA_SPEED: {
+            if (len != 5) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_MOVE)) return 0;
+            int* newRaSpeed = (int*)(buf + 1);
+            int32_t raSpeed = clampSpeed(ntohl(*newRaSpeed), RA_SPEED_MIN, RA_SPEED_MAX);
+            mount_snapshot_write_begin()->ra_speed = raSpeed;
+            mount_snapshot_write_end();
+            commandUpdateStepper(MOTION_AXIS(AXIS_RA));
+            LOGI(TAG, "setRaSpeed: %f", raSpeed / 1000.0);
+        } break;
+        case CMD_SET_DEC_SPEED: {
+            if (len != 5) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_MOVE)) return 0;
+            int* newDecSpeed = (int*)(buf + 1);
+            int32_t decSpeed = clampSpeed(ntohl(*newDecSpeed), DEC_SPEED_MIN, DEC_SPEED_MAX);
+            mount_snapshot_write_begin()->dec_speed = decSpeed;
+            mount_snapshot_write_end();
+            commandUpdateStepper(MOTION_AXIS(AXIS_DEC));
+            LOGI(TAG, "setDecSpeed: %f", decSpeed / 1000.0);
+        } break;
+        case CMD_PULSE_GUIDING: {
+            if (len != 4) return 0;
+            // guiding before the pulse starts, its end may come from the guide timer at once
+            if (!mount_fsm_dispatch(MOUNT_EVENT_GUIDE_START)) return 0;
+            char* dir = (char*)(buf + 1);
+            short* pulseLengthN = (short*)(buf + 2);
+            short pulseLength = htons(*pulseLengthN);
+            bool started = guide_pulse(*dir, pulseLength);
+            // a pulse refused, or one that only cancelled a residual, ends here unless an earlier one still runs,
+            // and one the guide timer ended guiding for just before it started guides again
+            mount_fsm_follow_guiding();
+            if (!started) return 0;
+            post_display();
+            lastPulseGuidingFromLen = fromlen;
+            memcpy(&lastPulseGuidingFrom, from, fromlen);
+            lastPulseGuidingSocket = fromSocket;
+            LOGI(TAG, "pulseGuide: %s in %dms", get_pulse_dir_descr(*dir), pulseLength);
+        } break;
+        case CMD_SET_RA_GUIDE_SPEED: {
+            if (len != 5) return 0;
+            int* newRaGuideSpeed = (int*)(buf + 1);
+            int32_t raGuideSpeed = clampSpeed(ntohl(*newRaGuideSpeed), RA_SPEED_MIN, RA_SPEED_MAX);
+            mount_snapshot_write_begin()->ra_guide_speed = raGuideSpeed;
+            mount_snapshot_write_end();
+            commandUpdateStepper(MOTION_AXIS(AXIS_RA));
+            persist_mark_urgent();
+            LOGI(TAG, "setRaGuideSpeed: %f", raGuideSpeed / 1000.0);
+        } break;
+        case CMD_SET_DEC_GUIDE_SPEED: {
+            if (len != 5) return 0;
+            int* newDecGuideSpeed = (int*)(buf + 1);
+            int32_t decGuideSpeed = clampSpeed(ntohl(*newDecGuideSpeed), DEC_SPEED_MIN, DEC_SPEED_MAX);
+            mount_snapshot_write_begin()->dec_guide_speed = decGuideSpeed;
+            mount_snapshot_write_end();
+            commandUpdateStepper(MOTION_AXIS(AXIS_DEC));
+            persist_mark_urgent();
+            LOGI(TAG, "setDecGuideSpeed: %f", decGuideSpeed / 1000.0);
+        } break;
+        case CMD_SYNC_TO_TARGET: {
+            if (len != 9) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_SYNC)) return 0;
+            int* raMillisPtr = (int*)(buf + 1);
+            int* decMillisPtr = (int*)(buf + 5);
+            int raMillis = ntohl(*raMillisPtr);
+            int decMillis = ntohl(*decMillisPtr);
+            if (get_pointing_point_count() == 0) {
+                //first sync defines the encoder zero, later ones feed the pointing model
+                set_angles(raMillis, decMillis);
+            }
+            add_pointing_point(raMillis, decMillis, get_ra_angle_millis(), get_dec_angle_millis(), getSideOfPier());
+            persist_mark_urgent();
+            LOGI(TAG, "syncTo: %d, %d", raMillis, decMillis);
+        }break;
+        case CMD_SLEW_TO_TARGET: {
+            int* raMillisPtr = (int*)(buf + 1);
+            int* decMillisPtr = (int*)(buf + 5);
+            int raMillis = ntohl(*raMillisPtr);
+            int decMillis = ntohl(*decMillisPtr);
+            if (slew_to_coordinates(raMillis, decMillis) != ESP_OK) return 0;
+            LOGI(TAG, "slewTo: %d, %d", raMillis, decMillis);
+        }break;
+        case CMD_ABORT_SLEW: {
+            switch (get_mount_fsm_state()) {
+                case MOUNT_STATE_CALIBRATING:
+                    abort_backlash_calibration();
+                    break;
+                case MOUNT_STATE_SLEWING:
+                    abort_slew();
+                    LOGI(TAG, "abortSlew");
+                    break;
+                default:
+                    return 0;
+            }
+        }break;
+        case CMD_SET_SIDE_OF_PIER: {
+            if (len != 2) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_SYNC)) return 0;
+            int8_t* newSideOfPier = (int8_t*)(buf + 1);
+            mount_snapshot_write_begin()->side_of_pier = *newSideOfPier;
+            mount_snapshot_write_end();
+            int32_t ra = get_ra_angle_millis();
+            int32_t dec = get_dec_angle_millis();
+            set_angles(ra, dec);
+            persist_mark_urgent();
+            LOGI(TAG, "setSideOfPier: %s", *newSideOfPier ? "BeyondThePole/West" : "Normal/East");
+        }break;
+        case CMD_GET_CLOCK: {
+            if (len != 9) return 0;
+            clock_sync_t reply;
+            set_clock_fields(&reply, (uint8_t*)(buf + 1), commandReceivedAt, esp_timer_get_time());
+            sendto(fromSocket, reply.buffer, CLOCK_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+        case CMD_GET_STATUS: {
+            if (len != 1) return 0;
+            status_t reply;
+            fillStatus(&reply);
+            sendto(fromSocket, reply.buffer, STATUS_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+        case CMD_SYNC_TIME: {
+            if (len != 13) return 0;
+            uint32_t* utcHiPtr = (uint32_t*)(buf + 1);
+            uint32_t* utcLoPtr = (uint32_t*)(buf + 5);
+            uint32_t* delayPtr = (uint32_t*)(buf + 9);
+            int64_t utcMicros = (int64_t)(((uint64_t)ntohl(*utcHiPtr) << 32) | ntohl(*utcLoPtr));
+            add_time_sample(commandReceivedAt, utcMicros, ntohl(*delayPtr));
+            mount_time_synced();
+            persist_mark_urgent();
+            time_sync_t reply;
+            set_time_fields(&reply, get_time_sample_count(), get_clock_drift_ppb(), get_utc_millis(), get_lst_millis());
+            sendto(fromSocket, reply.buffer, TIME_SIZE, 0, (struct sockaddr *) from, fromlen);
+            LOGI(TAG, "syncTime: lst %d", get_lst_millis());
+            return CMD_REPLIED;
+        }break;
+        case CMD_CLEAR_POINTING_MODEL: {
+            if (len != 1) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_SYNC)) return 0;
+            clear_pointing_model();
+            LOGI(TAG, "clearPointingModel");
+        }break;
+        case CMD_GET_POINTING_MODEL: {
+            if (len != 1) return 0;
+            pointing_model_t reply;
+            int32_t terms[POINTING_TERMS];
+            for (int i = 0; i < POINTING_TERMS; i ++) {
+                terms[i] = get_pointing_term_millis(i);
+            }
+            set_pointing_model_fields(&reply, get_pointing_point_count(), get_pointing_term_count(), get_pointing_rms_millis(), terms);
+            sendto(fromSocket, reply.buffer, POINTING_MODEL_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+        case CMD_SET_SITE: {
+            if (len != 9) return 0;
+            int* latitudePtr = (int*)(buf + 1);
+            int* longitudePtr = (int*)(buf + 5);
+            int latitude = ntohl(*latitudePtr);
+            int longitude = ntohl(*longitudePtr);
+            if (latitude > DAY_MILLIS / 4 || latitude < -DAY_MILLIS / 4) return 0;
+            if (longitude > DAY_MILLIS / 2 || longitude < -DAY_MILLIS / 2) return 0;
+            set_site(latitude, longitude);
+            LOGI(TAG, "setSite: %d, %d", latitude, longitude);
+        }break;
+        case CMD_SET_MOUNT_CONFIG: {
+            if (len != 1 + 4 * GEOMETRY_FIELDS) return 0;
+            uint32_t values[GEOMETRY_FIELDS];
+            for (int i = 0; i < GEOMETRY_FIELDS; i ++) {
+                values[i] = ntohl(*(uint32_t*)(buf + 1 + 4 * i));
+            }
+            if (!mount_fsm_dispatch(MOUNT_EVENT_SYNC)) return 0;
+            // keep the current position, the pulses counted so far belong to the old geometry
+            int32_t ra = get_ra_angle_millis();
+            int32_t dec = get_dec_angle_millis();
+            if (set_mount_geometry(values) != ESP_OK) return 0;
+            set_angles(ra, dec);
+            commandUpdateStepper(MOTION_ALL_AXES);
+            persist_mark_urgent();
+            LOGI(TAG, "setMountConfig: ra %d/%d, dec %d/%d", values[GEOMETRY_RA_GEAR_RATIO], values[GEOMETRY_RA_ENCODER_PULSES], values[GEOMETRY_DEC_GEAR_RATIO], values[GEOMETRY_DEC_ENCODER_PULSES]);
+        }break;
+        case CMD_GET_MOUNT_CONFIG: {
+            if (len != 1) return 0;
+            mount_config_t reply;
+            uint32_t values[GEOMETRY_FIELDS];
+            get_mount_geometry(values);
+            set_mount_config_fields(&reply, values);
+            sendto(fromSocket, reply.buffer, MOUNT_CONFIG_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+        case CMD_CALIBRATE_BACKLASH: {
+            if (len != 2) return 0;
+            if (!mount_fsm_dispatch(MOUNT_EVENT_CALIBRATE_START)) return 0;
+            uint8_t axis = buf[1];
+            mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+            backlashSavedTracking = snapshot->tracking;
+            backlashSavedRaSpeed = snapshot->ra_speed;
+            backlashSavedDecSpeed = snapshot->dec_speed;
+            snapshot->tracking = 0;
+            snapshot->ra_speed = 0;
+            snapshot->dec_speed = 0;
+            mount_snapshot_write_end();
+            commandUpdateStepper(MOTION_ALL_AXES);
+            if (start_backlash_calibration(axis) != ESP_OK) {
+                backlashFinished(axis, -1);
+                return 0;
+            }
+            LOGI(TAG, "calibrateBacklash: %s", axis == BACKLASH_AXIS_RA ? "RA" : "DEC");
+        }break;
+        case CMD_SET_LIMITS: {
+            if (len != 1 + 4 * LIMIT_FIELDS) return 0;
+            int32_t values[LIMIT_FIELDS];
+            for (int i = 0; i < LIMIT_FIELDS; i ++) {
+                values[i] = ntohl(*(int32_t*)(buf + 1 + 4 * i));
+            }
+            if (set_soft_limits(values) != ESP_OK) return 0;
+            LOGI(TAG, "setLimits: meridian %d, dec %d..%d, horizon %d", values[LIMIT_FIELD_MERIDIAN], values[LIMIT_FIELD_DEC_MIN], values[LIMIT_FIELD_DEC_MAX], values[LIMIT_FIELD_HORIZON]);
+        }break;
+        case CMD_GET_LIMITS: {
+            if (len != 1) return 0;
+            limits_frame_t reply;
+            int32_t values[LIMIT_FIELDS];
+            get_soft_limits(values);
+            set_limits_fields(&reply, get_active_limits(), values);
+            sendto(fromSocket, reply.buffer, LIMITS_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+#ifdef CONFIG_PERF_HISTOGRAMS
+        case CMD_GET_PERF: {
+            if (len != 3) return 0;
+            uint8_t stage = buf[1];
+            if (stage >= PERF_STAGES) return 0;
+            perf_histogram_t histogram;
+            get_perf_histogram(stage, &histogram, buf[2]);
+            perf_frame_t reply;
+            set_perf_fields(&reply, stage, histogram.count, histogram.max, histogram.buckets);
+            sendto(fromSocket, reply.buffer, PERF_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+#endif
+#ifdef CONFIG_TRACE
+        case CMD_GET_TRACE: {
+            if (len != 6) return 0;
+            uint8_t core = buf[1];
+            if (core >= portNUM_PROCESSORS) return 0;
+            uint32_t traceFrom = ntohl(*(uint32_t*)(buf + 2));
+            trace_frame_t reply;
+            int replyLen = fillTrace(&reply, core, &traceFrom);
+            sendto(fromSocket, reply.buffer, replyLen, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+        case CMD_SET_TRACE_STREAM: {
+            if (len != 2) return 0;
+            esp_timer_stop(traceStreamTimer);
+            if (buf[1]) {
+                traceStreamToLen = fromlen;
+                memcpy(&traceStreamTo, from, fromlen);
+                traceStreamSocket = fromSocket;
+                esp_timer_start_periodic(traceStreamTimer, 100 * 1000);
+            }
+            LOGI(TAG, "traceStream: %d", buf[1]);
+        }break;
+#endif
+#ifdef CONFIG_DIAGNOSTICS
+        case CMD_GET_DIAG: {
+            if (len != 1) return 0;
+            get_diag_stats(&diagStats);
+            uint8_t cpuLoad[DIAG_FRAME_CORES] = { DIAG_CPU_LOAD_UNKNOWN, DIAG_CPU_LOAD_UNKNOWN };
+            for (int i = 0; i < portNUM_PROCESSORS && i < DIAG_FRAME_CORES; i ++) {
+                cpuLoad[i] = diagStats.cpu_load[i];
+            }
+            int replyLen = set_diag_fields(&diagReply, diagStats.task_count, cpuLoad,
+                diagStats.free_heap, diagStats.min_free_heap, diagStats.largest_free_block, diagStats.free_internal);
+            for (int i = 0; i < diagStats.task_count; i ++) {
+                diag_task_t* task = &diagStats.tasks[i];
+                set_diag_task_fields(&diagReply, i, task->name, task->stack_free, task->core, task->priority);
+            }
+            sendto(fromSocket, diagReply.buffer, replyLen, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+#endif
+#ifdef CONFIG_CAPTURE
+        case CMD_SET_CAPTURE: {
+            if (len != 2) return 0;
+            uint8_t mode = buf[1];
+            if (mode > CAPTURE_STREAM) return 0;
+            esp_timer_stop(captureStreamTimer);
+            int32_t snapshot[CAPTURE_SNAPSHOT_FIELDS];
+            collectCaptureSnapshot(snapshot);
+            if (start_capture(mode, snapshot, sizeof(snapshot)) != ESP_OK) return 0;
+            if (mode == CAPTURE_STREAM) {
+                captureStreamToLen = fromlen;
+                memcpy(&captureStreamTo, from, fromlen);
+                captureStreamSocket = fromSocket;
+                captureStreamFrom = 0;
+                esp_timer_start_periodic(captureStreamTimer, 100 * 1000);
+            }
+            LOGI(TAG, "setCapture: %d", mode);
+        }break;
+        case CMD_GET_CAPTURE: {
+            if (len != 5) return 0;
+            uint32_t captureFrom = ntohl(*(uint32_t*)(buf + 1));
+            int replyLen = fillCapture(&captureReply, &captureFrom);
+            sendto(fromSocket, captureReply.buffer, replyLen, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+#endif
+#ifdef CONFIG_FOCUSER_ENABLED
+        case CMD_FOCUSER_MOVE: {
+            if (len != 5) return 0;
+            int32_t position = ntohl(*(int32_t*)(buf + 1));
+            if (focuser_move_to(position) != ESP_OK) return 0;
+            LOGI(TAG, "focuserMove: %d", position);
+        }break;
+        case CMD_FOCUSER_HALT: {
+            if (len != 1) return 0;
+            focuser_halt();
+        }break;
+        case CMD_FOCUSER_SYNC: {
+            if (len != 5) return 0;
+            int32_t position = ntohl(*(int32_t*)(buf + 1));
+            if (focuser_sync(position) != ESP_OK) return 0;
+            LOGI(TAG, "focuserSync: %d", position);
+        }break;
+        case CMD_FOCUSER_SET_TEMP_COMP: {
+            if (len != 5) return 0;
+            int32_t coefficient = ntohl(*(int32_t*)(buf + 1));
+            focuser_set_temp_coefficient(coefficient);
+            LOGI(TAG, "focuserTempComp: %d", coefficient);
+        }break;
+        case CMD_FOCUSER_SET_TEMPERATURE: {
+            if (len != 5) return 0;
+            focuser_set_temperature(ntohl(*(int32_t*)(buf + 1)));
+        }break;
+        case CMD_GET_FOCUSER: {
+            if (len != 1) return 0;
+            focuser_frame_t reply;
+            fillFocuser(&reply);
+            sendto(fromSocket, reply.buffer, FOCUSER_SIZE, 0, (struct sockaddr *) from, fromlen);
+            return CMD_REPLIED;
+        }break;
+#endif
+        case CMD_SET_WIFI: {
+            if (len < 3) return 0;
+            unsigned int ssidLen = (uint8_t)buf[1];
+            if (ssidLen == 0 || ssidLen > WIFI_SSID_MAX || len < 3 + ssidLen) return 0;
+            unsigned int passLen = (uint8_t)buf[2 + ssidLen];
+            if (passLen > WIFI_PASS_MAX || len != 3 + ssidLen + passLen) return 0;
+            wifi_credentials_t credentials = { 0 };
+            memcpy(credentials.ssid, buf + 2, ssidLen);
+            memcpy(credentials.pass, buf + 3 + ssidLen, passLen);
+            if (save_wifi_credentials(&credentials) != ESP_OK) return 0;
+            wifiCredentials = credentials;
+            wifiCredentialsChanged = true;
+            // let the ack go out before the station drops the link
+            esp_timer_stop(reconnectTimer);
+            esp_timer_start_once(reconnectTimer, 500 * 1000);
+            LOGI(TAG, "setWifi: %s", credentials.ssid);
+        }break;
+        default:
+        LOGI(TAG, "Unknown command: %d", *buf);
+        return 0;
+        break;
+    }
+    return 1;
+}
+
+
+
+static EventGroupHandle_t wifi_event_group;
+const static int STA_CONNECTED_BIT = BIT0;
+const static int AP_STARTED_BIT = BIT1;
+const static int NETWORK_BITS = BIT0 | BIT1;
+esp_err_t err;
+bool connected = false;
+
+/* bumped on every new IP, sockets bound under an older generation are reopened */
+volatile uint32_t networkGeneration = 0;
+
+bool isNetworkUp() {
+    return (xEventGroupGetBits(wifi_event_group) & NETWORK_BITS) != 0;
+}
+
+void udp_server(void *pvParameter) {
+
+    LOGI(TAG, "Server Started");
+
+    //bind loop
+    while (1) {
+        struct sockaddr_in saddr = { 0 };
+        int sock = -1;
+        int err = 0;
+
+        xEventGroupWaitBits(wifi_event_group, NETWORK_BITS, false, false, portMAX_DELAY);
+        uint32_t generation = networkGeneration;
+        
+        sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (sock < 0) {
+            LOGE(TAG, "Failed to create socket. Error %d", errno);
+            LOGE(TAG, "Retry After 1 second");
+            SLEEP(1000);
+            continue;
+        }
+
+        saddr.sin_family = PF_INET;
+        saddr.sin_port = htons(UDP_PORT);
+        saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+        err = bind(sock, (struct sockaddr *)&saddr, sizeof(struct sockaddr_in));
+        if (err < 0) {
+            LOGE(TAG, "Failed to bind socket. Error %d", errno);
+            LOGE(TAG, "Retry After 1 second");
+            close(sock);
+            SLEEP(1000);
+            continue;
+        }
+        // wake up once a second to notice a reconnect
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        LOGI(TAG, "Server started at %s", my_ip_port);
+
+        updateStepper(MOTION_ALL_AXES);
+
+        //recv loop
+        while (generation == networkGeneration) {
+            char buf[129];
+            struct sockaddr_in from;
+            socklen_t fromlen = sizeof(from);
+            int count = recvfrom(sock, buf, 128, 0, (struct sockaddr *) &from, &fromlen);
+            if (count <= 0) {
+                continue;
+            }
+            commandReceivedAt = esp_timer_get_time();
+            // credentials stay out of captures, which leave the unit in plain text
+            if (buf[0] != CMD_SET_WIFI) {
+                CAPTURE_COMMAND(buf, count);
+            }
+            PERF_BEGIN(PERF_PARSE_COMMAND);
+            TRACE(TRACE_COMMAND_BEGIN, buf[0], count);
+            int replied = parse_command(buf, count, sock, &from, fromlen);
+            TRACE(TRACE_COMMAND_END, buf[0], replied);
+            PERF_END(PERF_PARSE_COMMAND);
+            if (replied != CMD_REPLIED) {
+                sendAck(sock, &from, fromlen);
+            }
+        }
+        LOGI(TAG, "Network changed, rebinding server");
+        close(sock);
+    }
+}
+
+esp_timer_handle_t persistTimer;
+
+void collectPersistValues(int32_t* values) {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    mount_state_t state;
+    get_mount_state(&state);
+    values[PERSIST_RESET_RA] = state.reset_ra_angle_millis;
+    values[PERSIST_RESET_DEC] = state.reset_dec_angle_millis;
+    values[PERSIST_RA_PULSES] = state.ra_actual_pulses;
+    values[PERSIST_DEC_PULSES] = state.dec_actual_pulses;
+    values[PERSIST_ELAPSED] = state.elapsed_millis;
+    values[PERSIST_RESET_UTC_HI] = (int32_t)(state.reset_utc_millis >> 32);
+    values[PERSIST_RESET_UTC_LO] = (int32_t)state.reset_utc_millis;
+    values[PERSIST_SIDE_OF_PIER] = snapshot.side_of_pier;
+    values[PERSIST_RA_GUIDE_SPEED] = snapshot.ra_guide_speed;
+    values[PERSIST_DEC_GUIDE_SPEED] = snapshot.dec_guide_speed;
+}
+
+/* the journal writes to flash, which must not stall the esp_timer task */
+void persistTick(void* args) {
+    post_storage(STORAGE_PERSIST);
+}
+
+void storeState(uint8_t work) {
+    if (work & STORAGE_PERSIST) {
+        int32_t values[PERSIST_FIELDS];
+        collectPersistValues(values);
+        persist_tick(values);
+    }
+    if (work & STORAGE_GEOMETRY) {
+        save_mount_geometry();
+    }
+}
+
+void applyPersistValues(const int32_t* values) {
+    mount_state_t state = {
+        .reset_ra_angle_millis = values[PERSIST_RESET_RA],
+        .reset_dec_angle_millis = values[PERSIST_RESET_DEC],
+        .ra_actual_pulses = values[PERSIST_RA_PULSES],
+        .dec_actual_pulses = values[PERSIST_DEC_PULSES],
+        .elapsed_millis = values[PERSIST_ELAPSED],
+        .reset_utc_millis = ((int64_t)values[PERSIST_RESET_UTC_HI] << 32) | (uint32_t)values[PERSIST_RESET_UTC_LO],
+    };
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->side_of_pier = values[PERSIST_SIDE_OF_PIER];
+    snapshot->ra_guide_speed = values[PERSIST_RA_GUIDE_SPEED];
+    snapshot->dec_guide_speed = values[PERSIST_DEC_GUIDE_SPEED];
+    mount_snapshot_write_end();
+    restore_mount_state(&state);
+}
+
+void restorePersistedState() {
+    int32_t values[PERSIST_FIELDS];
+    uint32_t mask;
+    if (init_persist(values, &mask) != ESP_OK || mask != PERSIST_ALL_FIELDS) {
+        LOGI(TAG, "No mount state to restore");
+        return;
+    }
+    applyPersistValues(values);
+    LOGI(TAG, "Mount state restored, side of pier %d", values[PERSIST_SIDE_OF_PIER]);
+}
+
+
+esp_timer_handle_t autoDiscoverTimer;
+
+#ifdef CONFIG_SERVER_BROADCAST_SWEEP
+#define brdcPorts (CONFIG_SERVER_BROADCAST_PORT_LENGTH)
+#else
+#define brdcPorts 1 /* clients find us through mDNS, status goes to the start port only */
+#endif
+#define BRDC_IFS 2
+int brdcFd = -1;
+uint32_t brdcGeneration = 0;
+struct sockaddr_in theirAddr[BRDC_IFS][brdcPorts];
+uint32_t brdcIp[BRDC_IFS];
+
+/* directed broadcast per interface, 255.255.255.255 would only leave through the default one */
+void setupBroadcastAddresses() {
+    const tcpip_adapter_if_t ifs[BRDC_IFS] = { TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_IF_AP };
+    for (int j = 0; j < BRDC_IFS; j ++) {
+        tcpip_adapter_ip_info_t info;
+        brdcIp[j] = 0;
+        if (tcpip_adapter_get_ip_info(ifs[j], &info) != ESP_OK || info.ip.addr == 0) continue;
+        brdcIp[j] = info.ip.addr;
+        for (int i = 0; i < brdcPorts; i ++) {
+            memset(&theirAddr[j][i], 0, sizeof(struct sockaddr_in));
+            theirAddr[j][i].sin_family = AF_INET;
+            theirAddr[j][i].sin_addr.s_addr = info.ip.addr | ~info.netmask.addr;
+            theirAddr[j][i].sin_port = htons(CONFIG_SERVER_BROADCAST_PORT_START + i);
+        }
+    }
+}
+
+void autoDiscoverTick(void* args) {
+    if (!isNetworkUp()) return;
+    if (brdcFd != -1 && brdcGeneration != networkGeneration) {
+        close(brdcFd);
+        brdcFd = -1;
+    }
+    if (brdcFd == -1) {
+        brdcFd = socket(PF_INET, SOCK_DGRAM, 0);
+        if (brdcFd == -1) {
+            LOGE(TAG, "autoDiscover socket fail: %d", errno);
+            return;
+        }
+        brdcGeneration = networkGeneration;
+        int optval = 1;//这个值一定要设置，否则可能导致sendto()失败  
+        setsockopt(brdcFd, SOL_SOCKET, SO_BROADCAST | SO_REUSEADDR, &optval, sizeof(int));
+        setupBroadcastAddresses();
+    }
+    
+    /* one snapshot for the broadcast, the status frame takes its own */
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    int32_t ra = get_ra_angle_millis();
+    int32_t dec = get_dec_angle_millis();
+    pointing_mount_to_sky(&ra, &dec, snapshot.side_of_pier);
+
+    status_t status;
+    fillStatus(&status);
+#ifdef CONFIG_FOCUSER_ENABLED
+    focuser_frame_t focuser;
+    fillFocuser(&focuser);
+#endif
+
+    EventBits_t bits = xEventGroupGetBits(wifi_event_group);
+    for (int j = 0; j < BRDC_IFS; j ++) {
+        if (!brdcIp[j] || !(bits & (j == 0 ? STA_CONNECTED_BIT : AP_STARTED_BIT))) continue;
+        broadcast_t data;
+        set_broadcast_fields(&data, 
+            ntohl(brdcIp[j]),
+            UDP_PORT,
+            ra,
+            dec,
+            snapshot.slewing,
+            snapshot.tracking,
+            snapshot.ra_speed,
+            snapshot.dec_speed,
+            snapshot.side_of_pier
+        );
+        for (int i = 0; i < brdcPorts; i ++) {
+            sendto(brdcFd, data.buffer, BROADCAST_SIZE, 0, (struct sockaddr *)&(theirAddr[j][i]), sizeof(struct sockaddr));
+            sendto(brdcFd, status.buffer, STATUS_SIZE, 0, (struct sockaddr *)&(theirAddr[j][i]), sizeof(struct sockaddr));
+#ifdef CONFIG_FOCUSER_ENABLED
+            sendto(brdcFd, focuser.buffer, FOCUSER_SIZE, 0, (struct sockaddr *)&(theirAddr[j][i]), sizeof(struct sockaddr));
+#endif
+        }
+    }
+}
+
+static void wait_wifi(void *p)
+{
+    while (1) {
+        LOGI(TAG, "Waiting for AP connection...");
+        int dots = 0;
+        EventBits_t bits = xEventGroupWaitBits(wifi_event_group, NETWORK_BITS, false, false, 1000 / portTICK_PERIOD_MS);
+        while(!bits) {
+            dots = (dots + 1) % 4;
+            char searching[20] = "Searching WiFi \0\0\0\0";
+            for (int i = 0; i < dots; i ++) {
+                searching[i + (15/* "Searching WiFi ".length */)] = '.';
+            }
+            display_t disp = {
+                .title = searching,
+                .line1 = "WiFi config:",
+                .line2 = wifi_ssid_line,
+                .line3 = wifi_pass_line,
+            };
+            updateDisplay(&disp);
+            bits = xEventGroupWaitBits(wifi_event_group, NETWORK_BITS, false, false, 1000 / portTICK_PERIOD_MS);
+        }
+        LOGI(TAG, "%s", (bits & STA_CONNECTED_BIT) ? "Connected to AP" : "SoftAP started");
+
+        connected = true;
+
+        SLEEP(1000);
+
+        esp_timer_start_periodic(autoDiscoverTimer, 1000 * 1000);
+        
+        for (int i = 0; i < AXES; i ++) {
+            axis_start_motor(&mount_axes[i]);
+        }
+        // from here on the display only redraws from its own task
+        ESP_ERROR_CHECK(start_display_task(updateStepperDisplay));
+
+        udp_server(NULL);
+    }
+
+    vTaskDelete(NULL);
+}
+
+void updateWifiLines() {
+    sprintf(wifi_ssid_line, "SSID: %s", wifiCredentials.ssid);
+    sprintf(wifi_pass_line, "PASS: %s", wifiCredentials.pass);
+}
+
+void applyStationConfig() {
+    wifi_config_t wifi_config = { 0 };
+    strncpy((char*)wifi_config.sta.ssid, wifiCredentials.ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char*)wifi_config.sta.password, wifiCredentials.pass, sizeof(wifi_config.sta.password));
+    ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+}
+
+#ifndef CONFIG_WIFI_MODE_STA_ONLY
+/* WPA2 needs at least 8 characters, and an open SoftAP would hand the mount to anyone in range */
+bool startSoftAp() {
+    if (strlen(CONFIG_WIFI_AP_PASS) < 8) {
+        LOGE(TAG, "Not starting SoftAP %s, its password needs at least 8 characters", CONFIG_WIFI_AP_SSID);
+        return false;
+    }
+    wifi_config_t ap_config = {
+        .ap = {
+            .ssid = CONFIG_WIFI_AP_SSID,
+            .password = CONFIG_WIFI_AP_PASS,
+            .max_connection = 4,
+            .authmode = WIFI_AUTH_WPA_WPA2_PSK,
+        },
+    };
+    ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_APSTA) );
+    ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_AP, &ap_config) );
+    return true;
+}
+#endif
+
+/* shows the station address when there is one, the SoftAP one otherwise */
+void updateMyIp() {
+    EventBits_t bits = xEventGroupGetBits(wifi_event_group);
+    tcpip_adapter_ip_info_t info;
+    tcpip_adapter_if_t ifx = (bits & STA_CONNECTED_BIT) ? TCPIP_ADAPTER_IF_STA : TCPIP_ADAPTER_IF_AP;
+    if (!(bits & NETWORK_BITS) || tcpip_adapter_get_ip_info(ifx, &info) != ESP_OK) return;
+    sprintf(my_ip, "%s", inet_ntoa(info.ip));
+    my_ip_num = ntohl(info.ip.addr);
+    sprintf(my_ip_port, "%s:%d", my_ip, UDP_PORT);
+}
+
+#ifdef CONFIG_WIFI_MODE_AP_FALLBACK
+esp_timer_handle_t apFallbackTimer;
+
+/* the station keeps retrying in the background, the SoftAP just makes the mount usable meanwhile */
+void apFallbackTick(void* args) {
+    if (xEventGroupGetBits(wifi_event_group) & STA_CONNECTED_BIT) return;
+    LOGI(TAG, "No AP after %d sec, starting SoftAP %s", CONFIG_WIFI_AP_FALLBACK_SECONDS, CONFIG_WIFI_AP_SSID);
+    startSoftAp();
+}
+#endif
+
+#define RECONNECT_MIN_MILLIS 1000
+#define RECONNECT_MAX_MILLIS (CONFIG_WIFI_RECONNECT_MAX_SECONDS * 1000)
+
+uint32_t reconnectDelayMillis = RECONNECT_MIN_MILLIS;
+uint32_t reconnectAttempts = 0;
+int64_t disconnectedAt = 0;
+
+void reconnectTick(void* args) {
+    if (wifiCredentialsChanged) {
+        wifiCredentialsChanged = false;
+        applyStationConfig();
+        updateWifiLines();
+        reconnectDelayMillis = RECONNECT_MIN_MILLIS;
+        if (xEventGroupGetBits(wifi_event_group) & STA_CONNECTED_BIT) {
+            // the disconnect event schedules the reconnect
+            esp_wifi_disconnect();
+            return;
+        }
+    }
+    reconnectAttempts ++;
+    LOGI(TAG, "WiFi reconnect attempt %d", reconnectAttempts);
+    esp_wifi_connect();
+}
+
+/* the steppers and the encoder keep running, only the network side waits */
+void scheduleReconnect() {
+    if (!disconnectedAt) disconnectedAt = esp_timer_get_time();
+    if (xEventGroupGetBits(wifi_event_group) & AP_STARTED_BIT) {
+        updateMyIp();
+    } else {
+        sprintf(my_ip_port, "WiFi retry in %ds", reconnectDelayMillis / 1000);
+    }
+    post_display();
+    LOGE(TAG, "WiFi disconnected, retry in %d ms", reconnectDelayMillis);
+    esp_timer_stop(reconnectTimer);
+    esp_timer_start_once(reconnectTimer, reconnectDelayMillis * 1000);
+    reconnectDelayMillis *= 2;
+    if (reconnectDelayMillis > RECONNECT_MAX_MILLIS) reconnectDelayMillis = RECONNECT_MAX_MILLIS;
+}
+
+static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
+{
+    discovery_handle_system_event(ctx, event);
+    switch(event->event_id) {
+    case SYSTEM_EVENT_STA_START:
+        esp_wifi_connect();
+        break;
+    case SYSTEM_EVENT_STA_GOT_IP:
+        xEventGroupSetBits(wifi_event_group, STA_CONNECTED_BIT);
+        updateMyIp();
+        networkGeneration ++;
+        if (disconnectedAt) {
+            LOGI(TAG, "WiFi reconnected after %d ms, %d attempts", (int)((esp_timer_get_time() - disconnectedAt) / 1000), reconnectAttempts);
+            post_display();
+        }
+        disconnectedAt = 0;
+        reconnectAttempts = 0;
+        reconnectDelayMillis = RECONNECT_MIN_MILLIS;
+        break;
+    case SYSTEM_EVENT_STA_DISCONNECTED:
+        xEventGroupClearBits(wifi_event_group, STA_CONNECTED_BIT);
+        if (!connected) {
+            esp_wifi_connect();
+        } else {
+            scheduleReconnect();
+        }
+        break;
+    case SYSTEM_EVENT_AP_START:
+        xEventGroupSetBits(wifi_event_group, AP_STARTED_BIT);
+        updateMyIp();
+        networkGeneration ++;
+        if (connected) post_display();
+        break;
+    case SYSTEM_EVENT_AP_STOP:
+        xEventGroupClearBits(wifi_event_group, AP_STARTED_BIT);
+        networkGeneration ++;
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+static void wifi_conn_init(void)
+{
+    tcpip_adapter_init();
+#ifdef CONFIG_STATIC_ALLOCATION
+    static StaticEventGroup_t wifiEventGroupBuffer;
+    wifi_event_group = xEventGroupCreateStatic(&wifiEventGroupBuffer);
+#else
+    wifi_event_group = xEventGroupCreate();
+#endif
+    esp_timer_create_args_t argsReconnect = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = reconnectTick
+    };
+    ESP_ERROR_CHECK( esp_timer_create(&argsReconnect, &reconnectTimer) );
+    ESP_ERROR_CHECK( esp_event_loop_init(wifi_event_handler, NULL) );
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
+    ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
+    ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
+    applyStationConfig();
+#ifdef CONFIG_WIFI_MODE_STA_AP
+    startSoftAp();
+#endif
+    ESP_ERROR_CHECK( esp_wifi_start() );
+#ifdef CONFIG_WIFI_MODE_AP_FALLBACK
+    esp_timer_create_args_t argsApFallback = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = apFallbackTick
+    };
+    ESP_ERROR_CHECK( esp_timer_create(&argsApFallback, &apFallbackTimer) );
+    esp_timer_start_once(apFallbackTimer, CONFIG_WIFI_AP_FALLBACK_SECONDS * 1000 * 1000);
+#endif
+}
+
+void app_main(void)
+{
+    LOGI("BOOT", "App main");
+    LOGI("BOOT", "esp_timer_init");
+    ESP_ERROR_CHECK_ALLOW_INVALID_STATE(esp_timer_init());
+    LOGI("BOOT", "init_axes");
+    init_axes();    
+    LOGI("BOOT", "start_motion_task");
+    ESP_ERROR_CHECK(start_motion_task(applyStepper));
+    LOGI("BOOT", "nvs_flash_init");
+    ESP_ERROR_CHECK(nvs_flash_init());
+    LOGI("BOOT", "init_mount_config");
+    ESP_ERROR_CHECK(init_mount_config());
+    LOGI("BOOT", "init_astro");
+    init_astro();
+    LOGI("BOOT", "init_pointing");
+    init_pointing();
+    LOGI("BOOT", "init_mount");
+    init_mount();
+    LOGI("BOOT", "init_slew");
+    init_slew(slewCallback, slewCanFlip, slewFlipped);
+    LOGI("BOOT", "init_guide");
+    ESP_ERROR_CHECK(init_guide(guideGetStepRate, guideApplyStepRate, guideGetBacklashSteps, pulseGuidingFinished));
+    LOGI("BOOT", "init_backlash");
+    ESP_ERROR_CHECK(init_backlash(backlashDrive, backlashFinished));
+
+#ifdef CONFIG_FOCUSER_ENABLED
+    LOGI("BOOT", "init_focuser");
+    // no on-board sensor, the temperature is pushed by the client
+    ESP_ERROR_CHECK(init_focuser(NULL));
+#endif
+    LOGI("BOOT", "restorePersistedState");
+    restorePersistedState();
+    LOGI("BOOT", "start_storage_task");
+    ESP_ERROR_CHECK(start_storage_task(storeState));
+    esp_timer_create_args_t argsPersist = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = persistTick
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&argsPersist, &persistTimer));
+    esp_timer_start_periodic(persistTimer, 1000 * 1000);
+    // after the position is restored, the first check must see the real one
+    LOGI("BOOT", "init_limits");
+    ESP_ERROR_CHECK(init_limits(limitsChanged));
+#ifdef CONFIG_DIAGNOSTICS
+    LOGI("BOOT", "init_diag");
+    ESP_ERROR_CHECK(init_diag());
+#endif
+#ifdef CONFIG_BENCHMARK
+    LOGI("BOOT", "run_benchmarks");
+    run_benchmarks();
+#endif
+#ifdef CONFIG_TRACE
+    esp_timer_create_args_t argsTraceStream = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = traceStreamTick
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&argsTraceStream, &traceStreamTimer));
+#endif
+#ifdef CONFIG_CAPTURE
+    esp_timer_create_args_t argsCaptureStream = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = captureStreamTick
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&argsCaptureStream, &captureStreamTimer));
+#endif
+    // created once here, wait_wifi only starts it
+    esp_timer_create_args_t argsAutoDiscover = {
+        .dispatch_method = ESP_TIMER_TASK,
+        .callback = autoDiscoverTick
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&argsAutoDiscover, &autoDiscoverTimer));
+    LOGI("BOOT", "ssd1306_init");
+    if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
+        LOGI(TAG, "Display inited");
+        displayEnabled = true;
+    } else {
+        LOGE(TAG, "Cannot init display, try again in 1 sec");
+        SLEEP(1000);
+        if (ssd1306_init(0, CONFIG_DISPLAY_SCL, CONFIG_DISPLAY_SDA)) {
+            LOGI(TAG, "Display inited");
+            displayEnabled = true;
+        } else {
+            LOGE(TAG, "Cannot init display");
+            displayEnabled = false;
+        }
+    }
+    load_wifi_credentials(&wifiCredentials);
+    updateWifiLines();
+    display_t disp = {
+        .title = "Searching WiFi",
+        .line1 = "WiFi config:",
+        .line2 = wifi_ssid_line,
+        .line3 = wifi_pass_line,
+    };
+    LOGI("BOOT", "updateDisplay");
+    updateDisplay(&disp);
+    LOGI("BOOT", "wifi_conn_init");
+    wifi_conn_init();
+    LOGI("BOOT", "init_discovery");
+    init_discovery(UDP_PORT, CONFIG_SERVER_BROADCAST_PORT_START);
+#ifdef CONFIG_STATIC_ALLOCATION
+    LOGI("BOOT", "xTaskCreateStatic wait_wifi");
+    static StackType_t waitWifiStack[NETWORK_TASK_STACK];
+    static StaticTask_t waitWifiTask;
+    xTaskCreateStaticPinnedToCore(wait_wifi, TAG, NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, waitWifiStack, &waitWifiTask, NETWORK_TASK_CORE);
+#else
+    LOGI("BOOT", "xTaskCreate wait_wifi");
+    xTaskCreatePinnedToCore(wait_wifi, TAG, NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, NULL, NETWORK_TASK_CORE);
+#endif
+}
+
+uint8_t getSideOfPier() {
+    mount_snapshot_t snapshot;
+    get_mount_snapshot(&snapshot);
+    return snapshot.side_of_pier;
+}
+
+
+/* 90  - 21600000 */
+/* 180 - 43200000 */
+/* 270 - 64800000 */
+/* 360 - 86400000 */
+int32_t decMillis2decMecMillis(int32_t decMillis) {
+    if (getSideOfPier()) {
+        return 43200000 - decMillis;
+    } else {
+        return decMillis;
+    }
+}
+
+int32_t decMecMillis2decMillis(int32_t decMecMillis, uint8_t* parseSideOfPier) {
+    decMecMillis = wrap_day_millis(decMecMillis);/* 0 - 360 */
+    if (decMecMillis < 21600000) {
+        if (parseSideOfPier) {
+            *parseSideOfPier = 0;
+        }    
+        return decMecMillis;
+    }
+    if (decMecMillis > 64800000) {
+        if (parseSideOfPier) {
+            *parseSideOfPier = 0;
+        }
+        return decMecMillis - 86400000;
+    }
+    /* 90 - 270 */
+    if (parseSideOfPier) {
+        *parseSideOfPier = 1;
+    }
+    return 43200000 - decMecMillis;
+}
+
+void setSideOfPierWithDecMecMillis(int32_t decMecMillis) {
+    uint8_t side;
+    decMecMillis2decMillis(decMecMillis, &side);
+    mount_snapshot_write_begin()->side_of_pier = side;
+    mount_snapshot_write_end();
+}
+
+
+
+
+
+
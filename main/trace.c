@@ -0,0 +1,61 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_TRACE
+#include "esp_timer.h"
+#include "trace.h"
+
+#define RING_EVENTS CONFIG_TRACE_RING_EVENTS
+
+/*
+ * One ring per core and no locks: a core only writes its own ring and
+ * masks its interrupts for the few stores of an event. Readers copy and
+ * then drop whatever the writer may have lapped meanwhile.
+ */
+typedef struct trace_ring {
+    volatile uint32_t head; //events ever written
+    trace_event_t events[RING_EVENTS];
+} trace_ring_t;
+
+static trace_ring_t rings[portNUM_PROCESSORS];
+
+void IRAM_ATTR trace(uint16_t id, int32_t a, int32_t b) {
+    uint32_t time = (uint32_t)esp_timer_get_time();
+    uint32_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_ring_t* ring = &rings[xPortGetCoreID()];
+    uint32_t head = ring->head;
+    trace_event_t* event = &ring->events[head % RING_EVENTS];
+    event->id = id;
+    event->time = time;
+    event->a = a;
+    event->b = b;
+    __sync_synchronize();
+    ring->head = head + 1;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+int trace_read(uint8_t core, uint32_t* from, uint32_t* head, trace_event_t* events, int max) {
+    if (core >= portNUM_PROCESSORS) return 0;
+    trace_ring_t* ring = &rings[core];
+    uint32_t end = ring->head;
+    uint32_t start = *from;
+    if (end - start > RING_EVENTS) start = end - RING_EVENTS;
+    int count = end - start;
+    if (count > max) count = max;
+    for (int i = 0; i < count; i ++) {
+        events[i] = ring->events[(start + i) % RING_EVENTS];
+    }
+    __sync_synchronize();
+    // events the writer lapped during the copy are garbage, including the slot it may be writing
+    uint32_t lapped = ring->head - RING_EVENTS + 1;
+    int skip = 0;
+    if ((int32_t)(lapped - start) > 0) {
+        skip = lapped - start;
+        if (skip > count) skip = count;
+        for (int i = skip; i < count; i ++) {
+            events[i - skip] = events[i];
+        }
+    }
+    *from = start + skip;
+    *head = end;
+    return count - skip;
+}
+#endif
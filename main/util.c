@@ -1,5 +1,5 @@
-#include "esp_timer.h"
-
-uint64_t currentTimeMillis(){
-    return esp_timer_get_time() / 1000;
+#include "esp_timer.h"
+
+uint64_t currentTimeMillis(){
+    return esp_timer_get_time() / 1000;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "string.h"
+#include "wifi_store.h"
+#include "util.h"
+
+#define TAG "WIFI_STORE"
+
+#define WIFI_NAMESPACE "wifi"
+
+void load_wifi_credentials(wifi_credentials_t* credentials) {
+    memset(credentials, 0, sizeof(wifi_credentials_t));
+    strncpy(credentials->ssid, CONFIG_WIFI_SSID, WIFI_SSID_MAX);
+    strncpy(credentials->pass, CONFIG_WIFI_PASS, WIFI_PASS_MAX);
+
+    nvs_handle handle;
+    if (nvs_open(WIFI_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    wifi_credentials_t stored = { 0 };
+    size_t ssidLen = sizeof(stored.ssid);
+    size_t passLen = sizeof(stored.pass);
+    if (nvs_get_str(handle, "ssid", stored.ssid, &ssidLen) == ESP_OK
+        && nvs_get_str(handle, "pass", stored.pass, &passLen) == ESP_OK) {
+        *credentials = stored;
+        LOGI(TAG, "using stored ssid %s", credentials->ssid);
+    }
+    nvs_close(handle);
+}
+
+esp_err_t save_wifi_credentials(const wifi_credentials_t* credentials) {
+    nvs_handle handle;
+    esp_err_t err = nvs_open(WIFI_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        LOGE(TAG, "nvs open failed: %d", err);
+        return err;
+    }
+    err = nvs_set_str(handle, "ssid", credentials->ssid);
+    if (err == ESP_OK) err = nvs_set_str(handle, "pass", credentials->pass);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if (err != ESP_OK) LOGE(TAG, "saving credentials failed: %d", err);
+    return err;
+}
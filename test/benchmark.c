@@ -0,0 +1,18 @@
+#include "host.h"
+#include "bench.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+
+/*
+ * run_benchmarks() of a CONFIG_BENCHMARK build on the host, for profiling
+ * the control path math with the host tools; the cycles are the wall clock
+ * at CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, not those of the ESP32.
+ */
+
+int main() {
+    host_log_level = ESP_LOG_INFO;
+    CHECK_EQ(ESP_OK, init_mount_config());
+    init_mount();
+    run_benchmarks();
+    return host_test_exit();
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "host.h"
+#include "axis.h"
+#include "capture.h"
+#include "telescope.h"
+
+/*
+ * Replays a capture on the host firmware, faster than real time:
+ *   tools/capture_replay.py record 192.168.4.1 --ring -o night.cap
+ *   build-host/capture_replay night.cap
+ * A mount booted without a journal takes the state of the START record and
+ * captures again, the commands and encoder edges of the file come in at
+ * their times after it, the 32 bit record times unwrapped from the START
+ * record on. Its capture has to have the same commands, edges and step rate
+ * changes at the same times. The mount geometry and the clock are the ones
+ * the host boots with, a capture taken after a CMD_SET_GEOMETRY or a time
+ * sync replays the same only if it holds them.
+ *
+ * Exits with 0 when the replay matches, 1 when it does not, 2 when the file
+ * is no capture that can be replayed.
+ */
+
+/* as a client sends it */
+#define CMD_SET_CAPTURE 32
+
+/* written by tools/capture_replay.py where bytes were lost */
+#define CAPTURE_RECORD_GAP 0
+/* until the station has connected and the command port is open */
+#define BOOT_MICROS (5 * 1000000)
+#define READ_BYTES 4096
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    int64_t elapsed; //micros since the START record
+    const uint8_t* payload;
+} record_t;
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static uint8_t* load(const char* path, int* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    uint8_t* blob = NULL;
+    int capacity = 0, got;
+    *size = 0;
+    do {
+        if (*size == capacity) {
+            capacity = capacity ? 2 * capacity : 64 * 1024;
+            blob = realloc(blob, capacity);
+        }
+        got = fread(blob + *size, 1, capacity - *size, file);
+        *size += got;
+    } while (got > 0);
+    fclose(file);
+    return blob;
+}
+
+/*
+ * The records up to the first gap, their times unwrapped: records follow
+ * each other by far less than the 71 minutes the low 32 bits cover.
+ */
+static int parse(const uint8_t* blob, int size, record_t** records) {
+    int count = 0, capacity = 0, pos = 0;
+    uint32_t last = 0;
+    int64_t elapsed = 0;
+    *records = NULL;
+    while (pos + CAPTURE_HEADER_SIZE <= size) {
+        record_t r = { .type = blob[pos], .len = blob[pos + 1] | blob[pos + 2] << 8 };
+        uint32_t time;
+        memcpy(&time, blob + pos + 3, sizeof(time));
+        r.payload = blob + pos + CAPTURE_HEADER_SIZE;
+        pos += CAPTURE_HEADER_SIZE + r.len;
+        if (pos > size || r.type == CAPTURE_RECORD_GAP) break;
+        if (count) elapsed += (uint32_t)(time - last);
+        last = time;
+        r.elapsed = elapsed;
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            *records = realloc(*records, capacity * sizeof(record_t));
+        }
+        (*records)[count ++] = r;
+    }
+    if (pos < size) printf("replaying the first %d of %d bytes, the capture lost some after them\n", pos, size);
+    return count;
+}
+
+static int8_t channel_axis(uint8_t channel) {
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        if (mount_axes[i].channel.channel == channel) return i;
+    }
+    return -1;
+}
+
+/* what the replaying mount captured so far */
+static uint32_t capture_from;
+static uint8_t* capture_out;
+static int capture_size, capture_capacity;
+
+static void drain_capture() {
+    uint32_t head;
+    do {
+        if (capture_capacity - capture_size < READ_BYTES) {
+            capture_capacity = capture_capacity ? 2 * capture_capacity : 64 * 1024;
+            capture_out = realloc(capture_out, capture_capacity);
+        }
+        int count = capture_read(&capture_from, &head, capture_out + capture_size, READ_BYTES);
+        capture_size += count;
+        capture_from += count;
+    } while (capture_from != head);
+}
+
+/* the mount in the state of the START record, then the records at their times after it */
+static void replay(const record_t* records, int count) {
+    host_start(main_task);
+    host_run_for(BOOT_MICROS);
+    int64_t start = esp_timer_get_time();
+    int32_t snapshot[CAPTURE_SNAPSHOT_FIELDS];
+    memcpy(snapshot, records[0].payload, sizeof(snapshot));
+    restoreCaptureSnapshot(snapshot);
+    const uint8_t capture[2] = { CMD_SET_CAPTURE, CAPTURE_RING };
+    host_udp_send(capture, sizeof(capture));
+    for (int i = 1; i < count; i ++) {
+        const record_t* r = &records[i];
+        switch (r->type) {
+            case CAPTURE_RECORD_COMMAND:
+                host_run_until(start + r->elapsed);
+                host_udp_send(r->payload, r->len);
+                break;
+            case CAPTURE_RECORD_ENCODER: {
+                // the edge came in as the clock got there, before the timers then due
+                host_run_until(start + r->elapsed - 1);
+                int8_t axis = channel_axis(r->payload[0]);
+                if (axis >= 0) host_rencoder_turn(&mount_axes[axis].encoder, (int8_t)r->payload[1]);
+            } break;
+        }
+        drain_capture();
+    }
+    host_run_until(start + records[count - 1].elapsed + 1);
+    drain_capture();
+}
+
+/* raw pulses count from where each mount booted, the diffs that add up to them compare */
+static bool same_record(const record_t* a, const record_t* b) {
+    if (a->type == CAPTURE_RECORD_ENCODER) return a->payload[0] == b->payload[0] && a->payload[1] == b->payload[1];
+    return a->len == b->len && memcmp(a->payload, b->payload, a->len) == 0;
+}
+
+/* every record of a type, in order and within tolerance of its time, the number of them or -1 */
+static int compare(const record_t* captured, int capturedCount, const record_t* replayed, int replayedCount,
+    uint8_t type, int64_t tolerance) {
+    int a = 0, b = 0, count = 0;
+    for (;;) {
+        while (a < capturedCount && captured[a].type != type) a ++;
+        while (b < replayedCount && replayed[b].type != type) b ++;
+        if (a == capturedCount || b == replayedCount) break;
+        int64_t late = replayed[b].elapsed - captured[a].elapsed;
+        if (!same_record(&captured[a], &replayed[b]) || late > tolerance || late < -tolerance) {
+            printf("record %d of type %d differs, captured at %.6f s, replayed at %.6f s\n",
+                count + 1, type, captured[a].elapsed / 1e6, replayed[b].elapsed / 1e6);
+            return -1;
+        }
+        count ++;
+        a ++;
+        b ++;
+    }
+    if (a != capturedCount || b != replayedCount) {
+        printf("%d records of type %d match, then only the %s has more\n", count, type,
+            a == capturedCount ? "replay" : "capture");
+        return -1;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    host_log_level = ESP_LOG_ERROR;
+    if (argc != 2) {
+        printf("usage: %s capture\n", argv[0]);
+        return 2;
+    }
+    int size;
+    uint8_t* blob = load(argv[1], &size);
+    if (!blob) {
+        printf("cannot read %s\n", argv[1]);
+        return 2;
+    }
+    record_t* captured;
+    int capturedCount = parse(blob, size, &captured);
+    // a ring read back after it wrapped starts past its START record
+    if (!capturedCount || captured[0].type != CAPTURE_RECORD_START
+        || captured[0].len != CAPTURE_SNAPSHOT_FIELDS * sizeof(int32_t)) {
+        printf("%s does not start with the START record of this firmware\n", argv[1]);
+        return 2;
+    }
+
+    struct timespec began, ended;
+    clock_gettime(CLOCK_MONOTONIC, &began);
+    replay(captured, capturedCount);
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+
+    record_t* replayed;
+    int replayedCount = parse(capture_out, capture_size, &replayed);
+    int commands = compare(captured, capturedCount, replayed, replayedCount, CAPTURE_RECORD_COMMAND, 0);
+    int edges = compare(captured, capturedCount, replayed, replayedCount, CAPTURE_RECORD_ENCODER, 1);
+    int rates = compare(captured, capturedCount, replayed, replayedCount, CAPTURE_RECORD_RATE, 1);
+    bool same = replayedCount && replayed[0].type == CAPTURE_RECORD_START
+        && replayed[0].len == captured[0].len && !memcmp(replayed[0].payload, captured[0].payload, captured[0].len);
+    if (!same) printf("the replay did not start from the state of the capture\n");
+
+    double wall = (ended.tv_sec - began.tv_sec) + (ended.tv_nsec - began.tv_nsec) / 1e9;
+    printf("replayed %.1f s of capture in %.3f s: %d commands, %d encoder edges, %d step rate changes\n",
+        captured[capturedCount - 1].elapsed / 1e6, wall, commands, edges, rates);
+    return same && commands >= 0 && edges >= 0 && rates >= 0 ? 0 : 1;
+}
@@ -0,0 +1,1450 @@
+#define _GNU_SOURCE
+#include <ucontext.h>
+#include <sched.h>
+#include <unistd.h>
+#include "host.h"
+#include "lwip/sockets.h"
+#include "rencoder.h"
+
+#define TASK_STACK_BYTES (256 * 1024)
+#define MAX_TASKS 16
+#define MAX_SOCKETS 8
+#define FIRST_SOCKET_FD 100
+#define GPIO_PINS 64
+/* tasks switched to without time moving before the scheduler gives up */
+#define MAX_SWITCHES_PER_INSTANT 1000000
+
+int host_log_level = ESP_LOG_INFO;
+int host_test_failures = 0;
+
+int host_test_exit() {
+    if (host_test_failures) {
+        printf("%d check(s) failed\n", host_test_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+void host_error_check_failed(esp_err_t err, const char* file, int line, const char* expression) {
+    printf("ESP_ERROR_CHECK failed: esp_err_t 0x%x at %s:%d\nexpression: %s\n", err, file, line, expression);
+    abort();
+}
+
+void esp_restart(void) {
+    printf("esp_restart()\n");
+    exit(2);
+}
+
+void ets_delay_us(uint32_t us) {
+}
+
+/* clock and critical sections */
+
+static int64_t now = HOST_BOOT_MICROS;
+static bool in_timer_callback;
+static __thread uint32_t thread_id;
+static __thread int critical_nesting;
+static uint32_t next_thread_id = 1;
+
+static uint32_t get_thread_id() {
+    if (!thread_id) thread_id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+    return thread_id;
+}
+
+void vPortCPUInitializeMutex(portMUX_TYPE* mux) {
+    mux->owner = 0;
+    mux->count = 0;
+}
+
+void host_mux_enter(portMUX_TYPE* mux) {
+    uint32_t self = get_thread_id();
+    if (__atomic_load_n(&mux->owner, __ATOMIC_RELAXED) == self) {
+        mux->count ++;
+    } else {
+        uint32_t expected = 0;
+        while (!__atomic_compare_exchange_n(&mux->owner, &expected, self, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            expected = 0;
+            sched_yield();
+        }
+        mux->count = 1;
+    }
+    critical_nesting ++;
+}
+
+void host_mux_exit(portMUX_TYPE* mux) {
+    if (mux->owner != get_thread_id() || mux->count == 0) {
+        printf("portEXIT_CRITICAL of a mux this thread does not hold\n");
+        abort();
+    }
+    critical_nesting --;
+    if (-- mux->count == 0) __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t portSET_INTERRUPT_MASK_FROM_ISR(void) {
+    return 0;
+}
+
+void portCLEAR_INTERRUPT_MASK_FROM_ISR(uint32_t state) {
+}
+
+/* tasks */
+
+typedef bool (*wait_condition_t)(void* object);
+
+typedef struct host_task {
+    ucontext_t context;
+    void* stack;
+    TaskFunction_t code;
+    void* parameters;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    BaseType_t core;
+    bool finished;
+    bool waiting;
+    wait_condition_t condition; //NULL for a plain delay
+    void* object;
+    int64_t deadline;
+} host_task_t;
+
+static host_task_t tasks[MAX_TASKS];
+static int task_count;
+static int last_run = -1;
+static host_task_t* current;
+static ucontext_t scheduler_context;
+static host_task_t idle_tasks[portNUM_PROCESSORS];
+
+static void task_entry() {
+    current->code(current->parameters);
+    current->finished = true;
+}
+
+static host_task_t* create_task(TaskFunction_t code, const char* name, void* parameters, UBaseType_t priority, BaseType_t core) {
+    if (task_count == MAX_TASKS) return NULL;
+    host_task_t* task = &tasks[task_count ++];
+    memset(task, 0, sizeof(host_task_t));
+    task->code = code;
+    task->parameters = parameters;
+    strncpy(task->name, name, configMAX_TASK_NAME_LEN - 1);
+    task->priority = priority;
+    task->core = core;
+    task->stack = malloc(TASK_STACK_BYTES);
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = TASK_STACK_BYTES;
+    task->context.uc_link = &scheduler_context;
+    makecontext(&task->context, task_entry, 0);
+    return task;
+}
+
+static bool is_ready(host_task_t* task) {
+    if (task->finished) return false;
+    if (!task->waiting) return true;
+    if (task->condition && task->condition(task->object)) return true;
+    return now >= task->deadline;
+}
+
+static void run_tasks() {
+    int switches = 0;
+    while (1) {
+        host_task_t* next = NULL;
+        int nextIndex = -1;
+        for (int n = 1; n <= task_count; n ++) {
+            int i = (last_run + n) % task_count;
+            if (is_ready(&tasks[i]) && (!next || tasks[i].priority > next->priority)) {
+                next = &tasks[i];
+                nextIndex = i;
+            }
+        }
+        if (!next) return;
+        if (++ switches > MAX_SWITCHES_PER_INSTANT) {
+            printf("task %s never blocks\n", next->name);
+            abort();
+        }
+        last_run = nextIndex;
+        next->waiting = false;
+        current = next;
+        swapcontext(&scheduler_context, &next->context);
+        current = NULL;
+    }
+}
+
+/*
+ * Blocks the calling task until the condition holds or the ticks passed,
+ * returns whether it holds. Timer callbacks and the test itself never block.
+ */
+static bool wait_for(wait_condition_t condition, void* object, int64_t timeout_micros) {
+    if (condition && condition(object)) return true;
+    if (timeout_micros == 0 || !current) return false;
+    if (critical_nesting) {
+        printf("task %s blocks inside a critical section\n", current->name);
+        abort();
+    }
+    host_task_t* self = current;
+    self->waiting = true;
+    self->condition = condition;
+    self->object = object;
+    self->deadline = timeout_micros < 0 ? INT64_MAX : now + timeout_micros;
+    swapcontext(&self->context, &scheduler_context);
+    self->condition = NULL;
+    return condition && condition(object);
+}
+
+static int64_t ticks_to_micros(TickType_t ticks) {
+    return ticks == portMAX_DELAY ? -1 : (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+        UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+    host_task_t* task = create_task(code, name, parameters, priority, core);
+    if (created) *created = task;
+    return task ? pdPASS : pdFAIL;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+        UBaseType_t priority, StackType_t* stack, StaticTask_t* buffer, BaseType_t core) {
+    // host stacks are bigger than the device ones, the given stack is not used
+    return create_task(code, name, parameters, priority, core);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    wait_for(NULL, NULL, ticks_to_micros(ticks));
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    host_task_t* task = handle ? handle : current;
+    if (!task) return;
+    task->finished = true;
+    if (task == current) swapcontext(&task->context, &scheduler_context);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(now / 1000 / portTICK_PERIOD_MS);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return TASK_STACK_BYTES;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    return task_count + portNUM_PROCESSORS;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu) {
+    return cpu < portNUM_PROCESSORS ? &idle_tasks[cpu] : NULL;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total_run_time) {
+    UBaseType_t count = 0;
+    for (int i = 0; i < portNUM_PROCESSORS && count < size; i ++, count ++) {
+        memset(&status[count], 0, sizeof(TaskStatus_t));
+        status[count].xHandle = &idle_tasks[i];
+        status[count].pcTaskName = i ? "IDLE1" : "IDLE0";
+        status[count].eCurrentState = eReady;
+        status[count].usStackHighWaterMark = 1024;
+        status[count].xCoreID = i;
+        status[count].ulRunTimeCounter = (uint32_t)now;
+    }
+    for (int i = 0; i < task_count && count < size; i ++) {
+        if (tasks[i].finished) continue;
+        memset(&status[count], 0, sizeof(TaskStatus_t));
+        status[count].xHandle = &tasks[i];
+        status[count].pcTaskName = tasks[i].name;
+        status[count].eCurrentState = tasks[i].waiting ? eBlocked : eReady;
+        status[count].uxCurrentPriority = tasks[i].priority;
+        status[count].uxBasePriority = tasks[i].priority;
+        status[count].usStackHighWaterMark = TASK_STACK_BYTES;
+        status[count].xCoreID = tasks[i].core;
+        count ++;
+    }
+    if (total_run_time) *total_run_time = (uint32_t)now;
+    return count;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return current && current->core != tskNO_AFFINITY ? current->core : 0;
+}
+
+/* queues */
+
+typedef struct host_queue {
+    uint8_t* items;
+    UBaseType_t length, item_size;
+    UBaseType_t head, count;
+} host_queue_t;
+
+static bool queue_not_empty(void* object) {
+    return ((host_queue_t*)object)->count > 0;
+}
+
+static bool queue_not_full(void* object) {
+    host_queue_t* queue = object;
+    return queue->count < queue->length;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    host_queue_t* queue = calloc(1, sizeof(host_queue_t));
+    queue->items = calloc(length, item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* buffer) {
+    return xQueueCreate(length, item_size);
+}
+
+static void queue_push(host_queue_t* queue, const void* item) {
+    memcpy(queue->items + (queue->head + queue->count) % queue->length * queue->item_size, item, queue->item_size);
+    queue->count ++;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticks) {
+    host_queue_t* queue = handle;
+    if (!wait_for(queue_not_full, queue, ticks_to_micros(ticks))) return errQUEUE_FULL;
+    queue_push(queue, item);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void* item, BaseType_t* woken) {
+    return xQueueSend(handle, item, 0);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t handle, const void* item) {
+    host_queue_t* queue = handle;
+    if (queue->count == queue->length) queue->count --;
+    queue_push(queue, item);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t ticks) {
+    host_queue_t* queue = handle;
+    if (!wait_for(queue_not_empty, queue, ticks_to_micros(ticks))) return pdFALSE;
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count --;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    return ((host_queue_t*)handle)->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    host_queue_t* queue = xQueueCreate(1, 0);
+    queue->count = 1;
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+    return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    host_queue_t* queue = handle;
+    if (!wait_for(queue_not_empty, queue, ticks_to_micros(ticks))) return pdFALSE;
+    queue->count --;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    host_queue_t* queue = handle;
+    if (queue->count == queue->length) return pdFALSE;
+    queue->count ++;
+    return pdTRUE;
+}
+
+/* event groups */
+
+typedef struct host_event_group {
+    EventBits_t bits;
+    EventBits_t waiting_for; //of the task waiting, only one does in the firmware
+    bool all;
+} host_event_group_t;
+
+static bool event_bits_set(void* object) {
+    host_event_group_t* group = object;
+    EventBits_t set = group->bits & group->waiting_for;
+    return group->all ? set == group->waiting_for : set != 0;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return calloc(1, sizeof(host_event_group_t));
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* buffer) {
+    return xEventGroupCreate();
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t handle, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks) {
+    host_event_group_t* group = handle;
+    group->waiting_for = bits;
+    group->all = all;
+    bool met = wait_for(event_bits_set, group, ticks_to_micros(ticks));
+    EventBits_t result = group->bits;
+    if (met && clear) group->bits &= ~bits;
+    return result;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t handle, EventBits_t bits) {
+    host_event_group_t* group = handle;
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t handle, EventBits_t bits) {
+    host_event_group_t* group = handle;
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t handle) {
+    return ((host_event_group_t*)handle)->bits;
+}
+
+/* esp_timer */
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool active;
+    int64_t due;
+    uint64_t period;
+    uint64_t order; //timers due at the same time fire in the order they were started
+    struct esp_timer* next;
+};
+
+static struct esp_timer* timers;
+static uint64_t timer_order;
+
+esp_err_t esp_timer_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    struct esp_timer* timer = calloc(1, sizeof(struct esp_timer));
+    if (!timer) return ESP_ERR_NO_MEM;
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->next = timers;
+    timers = timer;
+    *out = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start_timer(esp_timer_handle_t timer, uint64_t timeout, uint64_t period) {
+    if (timer->active) return ESP_ERR_INVALID_STATE;
+    timer->active = true;
+    timer->due = now + timeout;
+    timer->period = period;
+    timer->order = timer_order ++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return start_timer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return start_timer(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active) return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->active) return ESP_ERR_INVALID_STATE;
+    for (struct esp_timer** link = &timers; *link; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            free(timer);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+int64_t esp_timer_get_time(void) {
+    return now;
+}
+
+bool host_in_timer_callback() {
+    return in_timer_callback;
+}
+
+static struct esp_timer* next_due_timer() {
+    struct esp_timer* next = NULL;
+    for (struct esp_timer* timer = timers; timer; timer = timer->next) {
+        if (!timer->active) continue;
+        if (!next || timer->due < next->due || (timer->due == next->due && timer->order < next->order)) next = timer;
+    }
+    return next;
+}
+
+static void fire_due_timers() {
+    struct esp_timer* timer;
+    while ((timer = next_due_timer()) && timer->due <= now) {
+        if (timer->period) {
+            timer->due += timer->period;
+            timer->order = timer_order ++;
+        } else {
+            timer->active = false;
+        }
+        in_timer_callback = true;
+        timer->callback(timer->arg);
+        in_timer_callback = false;
+    }
+}
+
+/* heap */
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) return NULL;
+    return malloc(size);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 160 * 1024;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 150 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 110 * 1024;
+}
+
+/* gpio */
+
+static int gpio_levels[GPIO_PINS];
+static bool gpio_driven[GPIO_PINS];
+static gpio_int_type_t gpio_intr[GPIO_PINS];
+static gpio_isr_t gpio_handlers[GPIO_PINS];
+static void* gpio_handler_args[GPIO_PINS];
+static bool isr_service_installed;
+
+esp_err_t gpio_config(const gpio_config_t* config) {
+    for (int pin = 0; pin < GPIO_PINS; pin ++) {
+        if (!(config->pin_bit_mask & (1ULL << pin))) continue;
+        if (pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+        gpio_intr[pin] = config->intr_type;
+        if ((config->mode & GPIO_MODE_INPUT) && !gpio_driven[pin]) {
+            gpio_levels[pin] = config->pull_up_en == GPIO_PULLUP_ENABLE;
+        }
+    }
+    return ESP_OK;
+}
+
+void gpio_pad_select_gpio(uint8_t pin) {
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode) {
+    return pin >= 0 && pin < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull) {
+    if (pin < 0 || pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    if (pull == GPIO_PULLUP_ONLY && !gpio_driven[pin]) gpio_levels[pin] = 1;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) {
+    if (pin < 0 || pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    gpio_intr[pin] = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+    if (pin < 0 || pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    gpio_levels[pin] = level != 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin) {
+    return pin >= 0 && pin < GPIO_NUM_MAX ? gpio_levels[pin] : 0;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    if (isr_service_installed) return ESP_FAIL;
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void* args) {
+    if (!isr_service_installed) return ESP_ERR_INVALID_STATE;
+    if (pin < 0 || pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    gpio_handlers[pin] = handler;
+    gpio_handler_args[pin] = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin) {
+    if (!isr_service_installed) return ESP_ERR_INVALID_STATE;
+    if (pin < 0 || pin >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    gpio_handlers[pin] = NULL;
+    return ESP_OK;
+}
+
+void host_gpio_preset(gpio_num_t pin, int level) {
+    gpio_levels[pin] = level != 0;
+    gpio_driven[pin] = true;
+}
+
+void host_gpio_input(gpio_num_t pin, int level) {
+    int before = gpio_levels[pin];
+    host_gpio_preset(pin, level);
+    level = gpio_levels[pin];
+    bool fire;
+    switch (gpio_intr[pin]) {
+        case GPIO_INTR_POSEDGE: fire = !before && level; break;
+        case GPIO_INTR_NEGEDGE: fire = before && !level; break;
+        case GPIO_INTR_ANYEDGE: fire = before != level; break;
+        case GPIO_INTR_LOW_LEVEL: fire = !level; break;
+        case GPIO_INTR_HIGH_LEVEL: fire = level; break;
+        default: fire = false; break;
+    }
+    if (fire && gpio_handlers[pin]) gpio_handlers[pin](gpio_handler_args[pin]);
+}
+
+int host_gpio_output(gpio_num_t pin) {
+    return gpio_levels[pin];
+}
+
+void host_rencoder_turn(struct rencoder* encoder, int32_t counts) {
+    bool forward = counts > 0;
+    for (int32_t i = 0; i < (forward ? counts : -counts); i ++) {
+        if (encoder->direction != forward) {
+            host_gpio_preset(encoder->b, forward != encoder->reverse);
+            host_gpio_preset(encoder->a, 0);
+            host_gpio_input(encoder->a, 1);
+        } else {
+            host_gpio_input(encoder->b, !gpio_levels[encoder->b]);
+        }
+    }
+}
+
+/* ledc, pulses are integrated whenever the clock moves */
+
+static struct {
+    bool configured;
+    uint32_t freq;
+} ledc_timers[LEDC_TIMER_MAX];
+
+static struct {
+    bool configured;
+    ledc_timer_t timer;
+    uint32_t duty, pending_duty;
+    uint64_t micropulses;
+} ledc_channels[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* config) {
+    if (config->timer_num >= LEDC_TIMER_MAX || config->freq_hz == 0) return ESP_ERR_INVALID_ARG;
+    ledc_timers[config->timer_num].configured = true;
+    ledc_timers[config->timer_num].freq = config->freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config) {
+    if (config->channel >= LEDC_CHANNEL_MAX || config->timer_sel >= LEDC_TIMER_MAX) return ESP_ERR_INVALID_ARG;
+    ledc_channels[config->channel].configured = true;
+    ledc_channels[config->channel].timer = config->timer_sel;
+    ledc_channels[config->channel].duty = config->duty;
+    ledc_channels[config->channel].pending_duty = config->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freq_hz) {
+    if (timer >= LEDC_TIMER_MAX || freq_hz == 0) return ESP_ERR_INVALID_ARG;
+    ledc_timers[timer].freq = freq_hz;
+    return ESP_OK;
+}
+
+uint32_t ledc_get_freq(ledc_mode_t mode, ledc_timer_t timer) {
+    return timer < LEDC_TIMER_MAX ? ledc_timers[timer].freq : 0;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty) {
+    if (channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+    ledc_channels[channel].pending_duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+    ledc_channels[channel].duty = ledc_channels[channel].pending_duty;
+    return ESP_OK;
+}
+
+uint32_t host_ledc_output_freq(ledc_channel_t channel) {
+    if (!ledc_channels[channel].configured || !ledc_channels[channel].duty) return 0;
+    ledc_timer_t timer = ledc_channels[channel].timer;
+    return ledc_timers[timer].configured ? ledc_timers[timer].freq : 0;
+}
+
+uint64_t host_ledc_pulses(ledc_channel_t channel) {
+    return ledc_channels[channel].micropulses / 1000000;
+}
+
+static host_ledc_pulse_callback pulse_callback;
+
+void host_ledc_on_pulses(host_ledc_pulse_callback callback) {
+    pulse_callback = callback;
+}
+
+static void advance_clock(int64_t to) {
+    uint32_t pulses[LEDC_CHANNEL_MAX];
+    for (int i = 0; i < LEDC_CHANNEL_MAX; i ++) {
+        uint64_t before = host_ledc_pulses(i);
+        ledc_channels[i].micropulses += (uint64_t)host_ledc_output_freq(i) * (to - now);
+        pulses[i] = host_ledc_pulses(i) - before;
+    }
+    now = to;
+    for (int i = 0; i < LEDC_CHANNEL_MAX; i ++) {
+        if (pulses[i] && pulse_callback) pulse_callback(i, pulses[i]);
+    }
+}
+
+/* nvs */
+
+#define ESP_ERR_NVS_READ_ONLY (ESP_ERR_NVS_BASE + 0x07)
+#define NVS_KEY_LEN 16
+#define MAX_NVS_HANDLES 16
+
+typedef enum { NVS_TYPE_U32, NVS_TYPE_STR, NVS_TYPE_BLOB } nvs_type_t;
+
+typedef struct nvs_entry {
+    char space[NVS_KEY_LEN];
+    char key[NVS_KEY_LEN];
+    nvs_type_t type;
+    size_t length;
+    uint8_t* data;
+    struct nvs_entry* next;
+} nvs_entry_t;
+
+static nvs_entry_t* nvs_entries;
+static char nvs_spaces[MAX_NVS_HANDLES][NVS_KEY_LEN];
+static struct {
+    bool open;
+    bool writable;
+    char space[NVS_KEY_LEN];
+} nvs_handles[MAX_NVS_HANDLES];
+static int nvs_commit_count, nvs_timer_write_count;
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    while (nvs_entries) {
+        nvs_entry_t* entry = nvs_entries;
+        nvs_entries = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    memset(nvs_spaces, 0, sizeof(nvs_spaces));
+    return ESP_OK;
+}
+
+static bool nvs_space_exists(const char* name, bool create) {
+    for (int i = 0; i < MAX_NVS_HANDLES; i ++) {
+        if (!strcmp(nvs_spaces[i], name)) return true;
+    }
+    for (int i = 0; create && i < MAX_NVS_HANDLES; i ++) {
+        if (!nvs_spaces[i][0]) {
+            strncpy(nvs_spaces[i], name, NVS_KEY_LEN - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode mode, nvs_handle* out_handle) {
+    if (strlen(name) >= NVS_KEY_LEN) return ESP_ERR_INVALID_ARG;
+    if (!nvs_space_exists(name, mode == NVS_READWRITE)) return ESP_ERR_NVS_NOT_FOUND;
+    for (int i = 0; i < MAX_NVS_HANDLES; i ++) {
+        if (nvs_handles[i].open) continue;
+        nvs_handles[i].open = true;
+        nvs_handles[i].writable = mode == NVS_READWRITE;
+        strcpy(nvs_handles[i].space, name);
+        *out_handle = i + 1;
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle handle) {
+    if (handle >= 1 && handle <= MAX_NVS_HANDLES) nvs_handles[handle - 1].open = false;
+}
+
+static nvs_entry_t* nvs_find(nvs_handle handle, const char* key, nvs_type_t type) {
+    for (nvs_entry_t* entry = nvs_entries; entry; entry = entry->next) {
+        if (entry->type == type && !strcmp(entry->space, nvs_handles[handle - 1].space) && !strcmp(entry->key, key)) return entry;
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_check(nvs_handle handle, const char* key, bool write) {
+    if (handle < 1 || handle > MAX_NVS_HANDLES || !nvs_handles[handle - 1].open) return ESP_ERR_INVALID_ARG;
+    if (key && strlen(key) >= NVS_KEY_LEN) return ESP_ERR_INVALID_ARG;
+    if (write && !nvs_handles[handle - 1].writable) return ESP_ERR_NVS_READ_ONLY;
+    if (write && in_timer_callback) nvs_timer_write_count ++;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_set(nvs_handle handle, const char* key, nvs_type_t type, const void* value, size_t length) {
+    esp_err_t err = nvs_check(handle, key, true);
+    if (err != ESP_OK) return err;
+    nvs_entry_t* entry = nvs_find(handle, key, type);
+    if (!entry) {
+        entry = calloc(1, sizeof(nvs_entry_t));
+        strcpy(entry->space, nvs_handles[handle - 1].space);
+        strcpy(entry->key, key);
+        entry->type = type;
+        entry->next = nvs_entries;
+        nvs_entries = entry;
+    }
+    free(entry->data);
+    entry->data = malloc(length ? length : 1);
+    memcpy(entry->data, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_get(nvs_handle handle, const char* key, nvs_type_t type, void* out, size_t* length) {
+    esp_err_t err = nvs_check(handle, key, false);
+    if (err != ESP_OK) return err;
+    nvs_entry_t* entry = nvs_find(handle, key, type);
+    if (!entry) return ESP_ERR_NVS_NOT_FOUND;
+    if (out) {
+        if (*length < entry->length) return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out, entry->data, entry->length);
+    }
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+    esp_err_t err = nvs_check(handle, NULL, true);
+    if (err == ESP_OK) nvs_commit_count ++;
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length) {
+    return nvs_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length) {
+    return nvs_get(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value) {
+    return nvs_set(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length) {
+    return nvs_get(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char* key, uint32_t value) {
+    return nvs_set(handle, key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char* key, uint32_t* out_value) {
+    size_t length = sizeof(uint32_t);
+    return nvs_get(handle, key, NVS_TYPE_U32, out_value, &length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key) {
+    esp_err_t err = nvs_check(handle, key, true);
+    if (err != ESP_OK) return err;
+    for (nvs_entry_t** link = &nvs_entries; *link; link = &(*link)->next) {
+        nvs_entry_t* entry = *link;
+        if (!strcmp(entry->space, nvs_handles[handle - 1].space) && !strcmp(entry->key, key)) {
+            *link = entry->next;
+            free(entry->data);
+            free(entry);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle handle) {
+    esp_err_t err = nvs_check(handle, NULL, true);
+    if (err != ESP_OK) return err;
+    for (nvs_entry_t** link = &nvs_entries; *link; ) {
+        nvs_entry_t* entry = *link;
+        if (!strcmp(entry->space, nvs_handles[handle - 1].space)) {
+            *link = entry->next;
+            free(entry->data);
+            free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+    return ESP_OK;
+}
+
+int host_nvs_commits() {
+    return nvs_commit_count;
+}
+
+bool host_nvs_save(int fd) {
+    for (nvs_entry_t* entry = nvs_entries; entry; entry = entry->next) {
+        if (write(fd, entry, offsetof(nvs_entry_t, data)) != offsetof(nvs_entry_t, data)) return false;
+        if (write(fd, entry->data, entry->length) != entry->length) return false;
+    }
+    return true;
+}
+
+/* reads all of a pipe or a file, short reads are not the end of it */
+static bool read_fully(int fd, void* buf, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        ssize_t got = read(fd, (uint8_t*)buf + done, len - done);
+        if (got <= 0) return false;
+        done += got;
+    }
+    return true;
+}
+
+bool host_nvs_load(int fd) {
+    nvs_flash_erase();
+    nvs_entry_t header;
+    while (read_fully(fd, &header, offsetof(nvs_entry_t, data))) {
+        nvs_entry_t* entry = calloc(1, sizeof(nvs_entry_t));
+        memcpy(entry, &header, offsetof(nvs_entry_t, data));
+        entry->data = malloc(entry->length ? entry->length : 1);
+        if (!read_fully(fd, entry->data, entry->length)) {
+            free(entry->data);
+            free(entry);
+            return false;
+        }
+        nvs_space_exists(entry->space, true);
+        entry->next = nvs_entries;
+        nvs_entries = entry;
+    }
+    return true;
+}
+
+int host_nvs_timer_writes() {
+    return nvs_timer_write_count;
+}
+
+/* wifi, events are delivered like the event loop task does */
+
+#define STATION_CONNECT_MICROS (200 * 1000)
+#define STATION_TIMEOUT_MICROS (3000 * 1000)
+#define MAX_PENDING_EVENTS 16
+
+static system_event_cb_t event_handler;
+static void* event_context;
+static struct {
+    int64_t due;
+    system_event_id_t id;
+} pending_events[MAX_PENDING_EVENTS];
+static int pending_event_count;
+static wifi_mode_t wifi_mode;
+static wifi_config_t wifi_configs[2];
+static bool wifi_started, station_available = true, station_connected, ap_started;
+
+static void post_event(system_event_id_t id, int64_t delay) {
+    if (pending_event_count == MAX_PENDING_EVENTS) return;
+    pending_events[pending_event_count].due = now + delay;
+    pending_events[pending_event_count].id = id;
+    pending_event_count ++;
+}
+
+static int64_t next_event_due() {
+    int64_t due = INT64_MAX;
+    for (int i = 0; i < pending_event_count; i ++) {
+        if (pending_events[i].due < due) due = pending_events[i].due;
+    }
+    return due;
+}
+
+static void deliver_due_events() {
+    while (pending_event_count && next_event_due() <= now) {
+        int first = 0;
+        for (int i = 1; i < pending_event_count; i ++) {
+            if (pending_events[i].due < pending_events[first].due) first = i;
+        }
+        system_event_t event = { .event_id = pending_events[first].id };
+        pending_event_count --;
+        memmove(pending_events + first, pending_events + first + 1, (pending_event_count - first) * sizeof(pending_events[0]));
+        switch (event.event_id) {
+            case SYSTEM_EVENT_STA_GOT_IP:
+                if (!station_available || station_connected) continue;
+                station_connected = true;
+                tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &event.event_info.got_ip.ip_info);
+                break;
+            case SYSTEM_EVENT_STA_DISCONNECTED:
+                station_connected = false;
+                break;
+            case SYSTEM_EVENT_AP_START:
+                ap_started = true;
+                break;
+            case SYSTEM_EVENT_AP_STOP:
+                ap_started = false;
+                break;
+            default:
+                break;
+        }
+        if (event_handler) event_handler(event_context, &event);
+    }
+}
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx) {
+    event_handler = cb;
+    event_context = ctx;
+    return ESP_OK;
+}
+
+void tcpip_adapter_init(void) {
+}
+
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t interface, tcpip_adapter_ip_info_t* info) {
+    memset(info, 0, sizeof(tcpip_adapter_ip_info_t));
+    if (interface == TCPIP_ADAPTER_IF_STA && station_connected) {
+        info->ip.addr = inet_addr("192.168.1.77");
+        info->gw.addr = inet_addr("192.168.1.1");
+        info->netmask.addr = inet_addr("255.255.255.0");
+    } else if (interface == TCPIP_ADAPTER_IF_AP && ap_started) {
+        info->ip.addr = inet_addr("192.168.4.1");
+        info->gw.addr = inet_addr("192.168.4.1");
+        info->netmask.addr = inet_addr("255.255.255.0");
+    }
+    return interface < TCPIP_ADAPTER_IF_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    if (mode >= WIFI_MODE_MAX) return ESP_ERR_INVALID_ARG;
+    bool apBefore = wifi_mode == WIFI_MODE_AP || wifi_mode == WIFI_MODE_APSTA;
+    bool apAfter = mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA;
+    wifi_mode = mode;
+    if (wifi_started && apAfter && !apBefore) post_event(SYSTEM_EVENT_AP_START, 1000);
+    if (wifi_started && apBefore && !apAfter) post_event(SYSTEM_EVENT_AP_STOP, 1000);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode) {
+    *mode = wifi_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* config) {
+    if (interface > WIFI_IF_AP) return ESP_ERR_INVALID_ARG;
+    if (interface == WIFI_IF_AP) {
+        size_t length = strnlen((const char*)config->ap.password, sizeof(config->ap.password));
+        // the driver refuses a WPA network with a password WPA does not accept
+        if (config->ap.authmode != WIFI_AUTH_OPEN && length < 8) return ESP_ERR_INVALID_ARG;
+    }
+    wifi_configs[interface] = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    wifi_started = true;
+    if (wifi_mode == WIFI_MODE_STA || wifi_mode == WIFI_MODE_APSTA) post_event(SYSTEM_EVENT_STA_START, 1000);
+    if (wifi_mode == WIFI_MODE_AP || wifi_mode == WIFI_MODE_APSTA) post_event(SYSTEM_EVENT_AP_START, 1000);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    if (station_connected) post_event(SYSTEM_EVENT_STA_DISCONNECTED, 0);
+    if (ap_started) post_event(SYSTEM_EVENT_AP_STOP, 0);
+    wifi_started = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    if (!wifi_started || (wifi_mode != WIFI_MODE_STA && wifi_mode != WIFI_MODE_APSTA)) return ESP_ERR_INVALID_STATE;
+    if (station_available) {
+        post_event(SYSTEM_EVENT_STA_GOT_IP, STATION_CONNECT_MICROS);
+    } else {
+        post_event(SYSTEM_EVENT_STA_DISCONNECTED, STATION_TIMEOUT_MICROS);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    if (station_connected) post_event(SYSTEM_EVENT_STA_DISCONNECTED, 1000);
+    return ESP_OK;
+}
+
+void host_wifi_station(bool available) {
+    station_available = available;
+    if (!available && station_connected) post_event(SYSTEM_EVENT_STA_DISCONNECTED, 0);
+}
+
+wifi_mode_t host_wifi_mode() {
+    return wifi_mode;
+}
+
+const wifi_config_t* host_wifi_config(wifi_interface_t interface) {
+    return &wifi_configs[interface];
+}
+
+bool host_wifi_station_connected() {
+    return station_connected;
+}
+
+/* mdns, the responder answers from what the firmware registered */
+
+#define MDNS_SERVICES 4
+#define MDNS_TXT_ITEMS 8
+
+typedef struct {
+    char* instance;
+    char* type;
+    char* proto;
+    uint16_t port;
+    char* txt_keys[MDNS_TXT_ITEMS];
+    char* txt_values[MDNS_TXT_ITEMS];
+} mdns_service_t;
+
+static bool mdns_running;
+static char* mdns_hostname;
+static char* mdns_instance;
+static mdns_service_t mdns_services[MDNS_SERVICES];
+
+static char* copy_string(const char* s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void set_string(char** to, const char* s) {
+    free(*to);
+    *to = copy_string(s);
+}
+
+static mdns_service_t* find_service(const char* type, const char* proto) {
+    for (int i = 0; i < MDNS_SERVICES; i ++) {
+        mdns_service_t* service = &mdns_services[i];
+        if (service->type && !strcmp(service->type, type) && !strcmp(service->proto, proto)) return service;
+    }
+    return NULL;
+}
+
+static esp_err_t set_txt_item(mdns_service_t* service, const char* key, const char* value) {
+    for (int i = 0; i < MDNS_TXT_ITEMS; i ++) {
+        if (service->txt_keys[i] && !strcmp(service->txt_keys[i], key)) {
+            set_string(&service->txt_values[i], value);
+            return ESP_OK;
+        }
+    }
+    for (int i = 0; i < MDNS_TXT_ITEMS; i ++) {
+        if (!service->txt_keys[i]) {
+            service->txt_keys[i] = copy_string(key);
+            service->txt_values[i] = copy_string(value);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t mdns_init(void) {
+    if (mdns_running) return ESP_ERR_INVALID_STATE;
+    mdns_running = true;
+    return ESP_OK;
+}
+
+void mdns_free(void) {
+    set_string(&mdns_hostname, NULL);
+    set_string(&mdns_instance, NULL);
+    for (int i = 0; i < MDNS_SERVICES; i ++) {
+        mdns_service_t* service = &mdns_services[i];
+        free(service->instance);
+        free(service->type);
+        free(service->proto);
+        for (int j = 0; j < MDNS_TXT_ITEMS; j ++) {
+            free(service->txt_keys[j]);
+            free(service->txt_values[j]);
+        }
+    }
+    memset(mdns_services, 0, sizeof(mdns_services));
+    mdns_running = false;
+}
+
+esp_err_t mdns_hostname_set(const char* hostname) {
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    set_string(&mdns_hostname, hostname);
+    return ESP_OK;
+}
+
+esp_err_t mdns_instance_name_set(const char* instance_name) {
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    set_string(&mdns_instance, instance_name);
+    return ESP_OK;
+}
+
+/* the strings are copied, as the responder does */
+esp_err_t mdns_service_add(const char* instance_name, const char* service_type, const char* proto,
+        uint16_t port, mdns_txt_item_t txt[], size_t num_items) {
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    if (!service_type || !proto || find_service(service_type, proto)) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < MDNS_SERVICES; i ++) {
+        mdns_service_t* service = &mdns_services[i];
+        if (service->type) continue;
+        service->instance = copy_string(instance_name);
+        service->type = copy_string(service_type);
+        service->proto = copy_string(proto);
+        service->port = port;
+        for (size_t j = 0; j < num_items; j ++) {
+            esp_err_t err = set_txt_item(service, txt[j].key, txt[j].value);
+            if (err != ESP_OK) return err;
+        }
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t mdns_service_txt_item_set(const char* service_type, const char* proto, const char* key, const char* value) {
+    mdns_service_t* service = find_service(service_type, proto);
+    if (!service) return ESP_ERR_NOT_FOUND;
+    return set_txt_item(service, key, value);
+}
+
+const char* host_mdns_hostname() {
+    return mdns_hostname;
+}
+
+const char* host_mdns_instance(const char* service_type, const char* proto) {
+    mdns_service_t* service = find_service(service_type, proto);
+    if (!service) return NULL;
+    return service->instance ? service->instance : mdns_instance;
+}
+
+int host_mdns_port(const char* service_type, const char* proto) {
+    mdns_service_t* service = find_service(service_type, proto);
+    return service ? service->port : -1;
+}
+
+const char* host_mdns_txt(const char* service_type, const char* proto, const char* key) {
+    mdns_service_t* service = find_service(service_type, proto);
+    if (!service) return NULL;
+    for (int i = 0; i < MDNS_TXT_ITEMS; i ++) {
+        if (service->txt_keys[i] && !strcmp(service->txt_keys[i], key)) return service->txt_values[i];
+    }
+    return NULL;
+}
+
+esp_err_t mdns_handle_system_event(void* ctx, system_event_t* event) {
+    return ESP_OK;
+}
+
+/* udp, one client talks to the command port, broadcasts go nowhere */
+
+#define CLIENT_ADDRESS "10.0.0.2"
+#define CLIENT_PORT 50000
+
+typedef struct datagram {
+    struct datagram* next;
+    struct sockaddr_in from;
+    size_t length;
+    uint8_t data[];
+} datagram_t;
+
+typedef struct {
+    datagram_t* head;
+    datagram_t** tail;
+} datagram_queue_t;
+
+static struct {
+    bool open;
+    uint16_t port;
+    int64_t timeout_micros;
+    datagram_queue_t inbox;
+} sockets[MAX_SOCKETS];
+static datagram_queue_t client_inbox;
+
+static void datagram_push(datagram_queue_t* queue, const void* data, size_t length, const struct sockaddr_in* from) {
+    datagram_t* datagram = malloc(sizeof(datagram_t) + length);
+    datagram->next = NULL;
+    datagram->from = *from;
+    datagram->length = length;
+    memcpy(datagram->data, data, length);
+    if (!queue->tail) queue->tail = &queue->head;
+    *queue->tail = datagram;
+    queue->tail = &datagram->next;
+}
+
+static datagram_t* datagram_pop(datagram_queue_t* queue) {
+    datagram_t* datagram = queue->head;
+    if (!datagram) return NULL;
+    queue->head = datagram->next;
+    if (!queue->head) queue->tail = &queue->head;
+    return datagram;
+}
+
+static bool inbox_not_empty(void* object) {
+    return ((datagram_queue_t*)object)->head != NULL;
+}
+
+static int socket_index(int fd) {
+    int index = fd - FIRST_SOCKET_FD;
+    return index >= 0 && index < MAX_SOCKETS && sockets[index].open ? index : -1;
+}
+
+int host_socket(int domain, int type, int protocol) {
+    for (int i = 0; i < MAX_SOCKETS; i ++) {
+        if (sockets[i].open) continue;
+        memset(&sockets[i], 0, sizeof(sockets[i]));
+        sockets[i].open = true;
+        return FIRST_SOCKET_FD + i;
+    }
+    errno = ENFILE;
+    return -1;
+}
+
+int host_bind(int fd, const struct sockaddr* addr, socklen_t len) {
+    int index = socket_index(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    sockets[index].port = ntohs(((const struct sockaddr_in*)addr)->sin_port);
+    return 0;
+}
+
+int host_setsockopt(int fd, int level, int name, const void* value, socklen_t len) {
+    int index = socket_index(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if (level == SOL_SOCKET && name == SO_RCVTIMEO) {
+        const struct timeval* timeout = value;
+        sockets[index].timeout_micros = (int64_t)timeout->tv_sec * 1000000 + timeout->tv_usec;
+    }
+    return 0;
+}
+
+ssize_t host_sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* to, socklen_t tolen) {
+    int index = socket_index(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    const struct sockaddr_in* address = (const struct sockaddr_in*)to;
+    if (address->sin_addr.s_addr == inet_addr(CLIENT_ADDRESS) && ntohs(address->sin_port) == CLIENT_PORT) {
+        struct sockaddr_in from = {
+            .sin_family = AF_INET,
+            .sin_port = htons(sockets[index].port),
+        };
+        datagram_push(&client_inbox, buf, len, &from);
+    }
+    return len;
+}
+
+ssize_t host_recvfrom(int fd, void* buf, size_t len, int flags, struct sockaddr* from, socklen_t* fromlen) {
+    int index = socket_index(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    int64_t timeout = sockets[index].timeout_micros ? sockets[index].timeout_micros : -1;
+    if (!wait_for(inbox_not_empty, &sockets[index].inbox, timeout)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    datagram_t* datagram = datagram_pop(&sockets[index].inbox);
+    // like UDP, whatever does not fit is lost
+    size_t copied = datagram->length < len ? datagram->length : len;
+    memcpy(buf, datagram->data, copied);
+    if (from && fromlen) {
+        socklen_t size = *fromlen < sizeof(struct sockaddr_in) ? *fromlen : sizeof(struct sockaddr_in);
+        memcpy(from, &datagram->from, size);
+        *fromlen = sizeof(struct sockaddr_in);
+    }
+    free(datagram);
+    return copied;
+}
+
+int host_close(int fd) {
+    int index = socket_index(fd);
+    if (index < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    while (sockets[index].inbox.head) free(datagram_pop(&sockets[index].inbox));
+    sockets[index].open = false;
+    return 0;
+}
+
+char* host_inet_ntoa(const void* addr) {
+    static char text[16];
+    const uint8_t* bytes = addr;
+    sprintf(text, "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return text;
+}
+
+bool host_udp_send(const void* buf, size_t len) {
+    struct sockaddr_in from = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CLIENT_PORT),
+        .sin_addr.s_addr = inet_addr(CLIENT_ADDRESS),
+    };
+    for (int i = 0; i < MAX_SOCKETS; i ++) {
+        if (sockets[i].open && sockets[i].port == CONFIG_SERVER_PORT) {
+            datagram_push(&sockets[i].inbox, buf, len, &from);
+            return true;
+        }
+    }
+    return false;
+}
+
+int host_udp_receive(void* buf, size_t max) {
+    datagram_t* datagram = datagram_pop(&client_inbox);
+    if (!datagram) return -1;
+    int length = datagram->length < max ? datagram->length : max;
+    memcpy(buf, datagram->data, length);
+    free(datagram);
+    return length;
+}
+
+/* scheduling */
+
+void host_start(TaskFunction_t main_task) {
+    create_task(main_task, "main", NULL, 1, 0);
+}
+
+void host_run_until(int64_t end) {
+    if (current || in_timer_callback) {
+        printf("host_run_until() from firmware code\n");
+        abort();
+    }
+    while (1) {
+        run_tasks();
+        int64_t next = next_event_due();
+        struct esp_timer* timer = next_due_timer();
+        if (timer && timer->due < next) next = timer->due;
+        for (int i = 0; i < task_count; i ++) {
+            if (!tasks[i].finished && tasks[i].waiting && tasks[i].deadline < next) next = tasks[i].deadline;
+        }
+        if (next > end) break;
+        if (next > now) advance_clock(next);
+        fire_due_timers();
+        deliver_due_events();
+    }
+    if (end > now) advance_clock(end);
+}
+
+void host_run_for(int64_t micros) {
+    host_run_until(now + micros);
+}
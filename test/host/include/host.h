@@ -0,0 +1,105 @@
+#ifndef __HOST_H
+#define __HOST_H
+
+#include "host_idf.h"
+
+/*
+ * Test side of the host IDF. Time is virtual and only moves in
+ * host_run_for() and host_run_until(), which fire the esp_timer callbacks
+ * and WiFi events that fall due and run the FreeRTOS tasks, one at a time,
+ * until every one of them blocks again. Tasks never preempt each other, so
+ * a task that loops without blocking hangs the test.
+ */
+
+/* esp_timer_get_time() when a test starts, about where app_main runs on the device */
+#define HOST_BOOT_MICROS 300000
+
+/* creates the main task running app_main, it starts on the first host_run_for() */
+void host_start(TaskFunction_t main_task);
+void host_run_for(int64_t micros);
+void host_run_until(int64_t micros);
+/* true inside an esp_timer callback, where the device must not wait for flash */
+bool host_in_timer_callback();
+
+/* levels of input pins, an edge runs the isr handler of the pin like the hardware */
+void host_gpio_input(gpio_num_t pin, int level);
+/* sets the level without an interrupt, e.g. a switch already closed at boot */
+void host_gpio_preset(gpio_num_t pin, int level);
+int host_gpio_output(gpio_num_t pin);
+/*
+ * Turns a started rencoder by counts edges on its pins, as the isr counts
+ * them: an A rise takes the direction from B, every other edge counts on.
+ */
+struct rencoder;
+void host_rencoder_turn(struct rencoder* encoder, int32_t counts);
+
+/*
+ * Pulses a LEDC channel put out so far: only a channel set up through
+ * ledc_channel_config() on a timer set up through ledc_timer_config()
+ * reaches its pin, as on the chip.
+ */
+uint64_t host_ledc_pulses(ledc_channel_t channel);
+/* frequency the channel is putting out right now, 0 while idle or not set up */
+uint32_t host_ledc_output_freq(ledc_channel_t channel);
+/*
+ * Called as the clock moves over pulses of a channel, before the timers
+ * due then fire, to turn what the step pin drives, e.g. an encoder.
+ */
+typedef void (*host_ledc_pulse_callback)(ledc_channel_t channel, uint32_t pulses);
+void host_ledc_on_pulses(host_ledc_pulse_callback callback);
+
+/* whether the configured AP answers, it does by default */
+void host_wifi_station(bool available);
+wifi_mode_t host_wifi_mode();
+const wifi_config_t* host_wifi_config(wifi_interface_t interface);
+/* whether the station holds an address, it gets one 200 ms after a connect and gives up after 3 s */
+bool host_wifi_station_connected();
+
+/* what the mdns responder answers a query with, NULL or -1 for nothing registered */
+const char* host_mdns_hostname();
+const char* host_mdns_instance(const char* service_type, const char* proto);
+int host_mdns_port(const char* service_type, const char* proto);
+const char* host_mdns_txt(const char* service_type, const char* proto, const char* key);
+
+/* a datagram from the client to the command port, false while nothing listens there */
+bool host_udp_send(const void* buf, size_t len);
+/* next datagram sent back to the client, its length or -1 when there is none */
+int host_udp_receive(void* buf, size_t max);
+
+/* nvs commits so far, and nvs writes or commits done from esp_timer callbacks */
+int host_nvs_commits();
+int host_nvs_timer_writes();
+/*
+ * The flash across a reboot: the firmware boots once per process, so one
+ * saves what it wrote and the next loads it before host_start().
+ */
+bool host_nvs_save(int fd);
+bool host_nvs_load(int fd);
+
+/* assertions of the host tests, host_test_exit() is the exit code of main() */
+extern int host_test_failures;
+#define CHECK(cond) do {                                                        \
+    if (!(cond)) {                                                              \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);         \
+        host_test_failures ++;                                                  \
+    }                                                                           \
+} while (0)
+#define CHECK_EQ(expected, actual) do {                                         \
+    long long __e = (long long)(expected), __a = (long long)(actual);           \
+    if (__e != __a) {                                                           \
+        printf("%s:%d: expected %s == %lld, got %lld\n", __FILE__, __LINE__,    \
+            #actual, __e, __a);                                                 \
+        host_test_failures ++;                                                  \
+    }                                                                           \
+} while (0)
+#define CHECK_NEAR(expected, actual, tolerance) do {                            \
+    double __e = (double)(expected), __a = (double)(actual);                    \
+    if (!(__a >= __e - (tolerance) && __a <= __e + (tolerance))) {              \
+        printf("%s:%d: expected %s == %g +- %g, got %g\n", __FILE__, __LINE__,  \
+            #actual, __e, (double)(tolerance), __a);                            \
+        host_test_failures ++;                                                  \
+    }                                                                           \
+} while (0)
+int host_test_exit();
+
+#endif
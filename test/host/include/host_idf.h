@@ -0,0 +1,381 @@
+#ifndef __HOST_IDF_H
+#define __HOST_IDF_H
+
+/*
+ * The parts of ESP-IDF and FreeRTOS the controller uses, declared for the
+ * host builds and implemented by host/idf.c on top of a virtual clock. The
+ * headers of the IDF include paths all include this one.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include "sdkconfig.h"
+
+/* esp_err.h */
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NO_FREE_PAGES (ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND (ESP_ERR_NVS_BASE + 0x10)
+
+void host_error_check_failed(esp_err_t err, const char* file, int line, const char* expression);
+#define ESP_ERROR_CHECK(x) do {                                         \
+    esp_err_t __err_rc = (x);                                           \
+    if (__err_rc != ESP_OK) {                                           \
+        host_error_check_failed(__err_rc, __FILE__, __LINE__, #x);      \
+    }                                                                   \
+} while(0)
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define BIT7 0x00000080
+#define BIT6 0x00000040
+#define BIT5 0x00000020
+#define BIT4 0x00000010
+#define BIT3 0x00000008
+#define BIT2 0x00000004
+#define BIT1 0x00000002
+#define BIT0 0x00000001
+
+/* esp_log.h */
+extern int host_log_level;
+#define ESP_LOG_ERROR 1
+#define ESP_LOG_INFO 3
+#define ESP_LOGE(tag, format, ...) do { if (host_log_level >= ESP_LOG_ERROR) printf("E (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, format, ...) do { if (host_log_level >= ESP_LOG_ERROR) printf("W (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, format, ...) do { if (host_log_level >= ESP_LOG_INFO) printf("I (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+
+/* esp_system.h */
+void esp_restart(void);
+
+/* esp_timer.h */
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+} esp_timer_create_args_t;
+esp_err_t esp_timer_init(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time(void);
+
+/* freertos */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef void* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+typedef struct { uint8_t opaque[64]; } StaticTask_t;
+typedef struct { uint8_t opaque[64]; } StaticQueue_t;
+typedef struct { uint8_t opaque[32]; } StaticEventGroup_t;
+
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define portMAX_DELAY (TickType_t)0xffffffffUL
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define configMAX_PRIORITIES 25
+#define configMAX_TASK_NAME_LEN 16
+#define portNUM_PROCESSORS 2
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+/* recursive per thread like the ESP32 port, a spinlock across host threads */
+typedef struct {
+    volatile uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { .owner = 0, .count = 0 }
+void vPortCPUInitializeMutex(portMUX_TYPE* mux);
+void host_mux_enter(portMUX_TYPE* mux);
+void host_mux_exit(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) host_mux_enter(mux)
+#define portEXIT_CRITICAL(mux) host_mux_exit(mux)
+#define portENTER_CRITICAL_ISR(mux) host_mux_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux) host_mux_exit(mux)
+#define taskENTER_CRITICAL(mux) host_mux_enter(mux)
+#define taskEXIT_CRITICAL(mux) host_mux_exit(mux)
+uint32_t portSET_INTERRUPT_MASK_FROM_ISR(void);
+void portCLEAR_INTERRUPT_MASK_FROM_ISR(uint32_t state);
+#define portYIELD_FROM_ISR()
+
+typedef enum { eRunning = 0, eReady, eBlocked, eSuspended, eDeleted } eTaskState;
+typedef struct xTASK_STATUS {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    uint32_t ulRunTimeCounter;
+    StackType_t* pxStackBase;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task, BaseType_t core);
+#define xTaskCreate(code, name, depth, parameters, priority, created) \
+    xTaskCreatePinnedToCore(code, name, depth, parameters, priority, created, tskNO_AFFINITY)
+#define xTaskCreateStatic(code, name, depth, parameters, priority, stack, task) \
+    xTaskCreateStaticPinnedToCore(code, name, depth, parameters, priority, stack, task, tskNO_AFFINITY)
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+TickType_t xTaskGetTickCount(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total_run_time);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xPortGetCoreID(void);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+#define xQueueSendToBack xQueueSend
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+/* a mutex is a queue of one empty item, as in FreeRTOS, taken while it is empty */
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef StaticQueue_t StaticSemaphore_t;
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* buffer);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+
+/* esp_heap_caps.h */
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+void* heap_caps_malloc(size_t size, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+/* rom/ets_sys.h */
+void ets_delay_us(uint32_t us);
+
+/* driver/gpio.h */
+typedef int gpio_num_t;
+#define GPIO_NUM_MAX 40
+#define GPIO_SEL(pin) (1ULL << (pin))
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT = 1,
+    GPIO_MODE_OUTPUT = 2,
+    GPIO_MODE_OUTPUT_OD = 6,
+    GPIO_MODE_INPUT_OUTPUT_OD = 7,
+    GPIO_MODE_INPUT_OUTPUT = 3,
+} gpio_mode_t;
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE = 1,
+    GPIO_INTR_NEGEDGE = 2,
+    GPIO_INTR_ANYEDGE = 3,
+    GPIO_INTR_LOW_LEVEL = 4,
+    GPIO_INTR_HIGH_LEVEL = 5,
+} gpio_int_type_t;
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE = 1 } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE = 1 } gpio_pulldown_t;
+typedef enum { GPIO_PULLUP_ONLY, GPIO_PULLDOWN_ONLY, GPIO_PULLUP_PULLDOWN, GPIO_FLOATING } gpio_pull_mode_t;
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+typedef void (*gpio_isr_t)(void* arg);
+esp_err_t gpio_config(const gpio_config_t* config);
+void gpio_pad_select_gpio(uint8_t pin);
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void* args);
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin);
+
+/* driver/ledc.h */
+typedef enum { LEDC_HIGH_SPEED_MODE = 0, LEDC_LOW_SPEED_MODE, LEDC_SPEED_MODE_MAX } ledc_mode_t;
+typedef enum {
+    LEDC_CHANNEL_0 = 0, LEDC_CHANNEL_1, LEDC_CHANNEL_2, LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4, LEDC_CHANNEL_5, LEDC_CHANNEL_6, LEDC_CHANNEL_7, LEDC_CHANNEL_MAX
+} ledc_channel_t;
+typedef enum { LEDC_TIMER_0 = 0, LEDC_TIMER_1, LEDC_TIMER_2, LEDC_TIMER_3, LEDC_TIMER_MAX } ledc_timer_t;
+typedef enum { LEDC_INTR_DISABLE = 0, LEDC_INTR_FADE_END } ledc_intr_type_t;
+typedef enum { LEDC_TIMER_10_BIT = 10, LEDC_TIMER_13_BIT = 13, LEDC_TIMER_15_BIT = 15 } ledc_timer_bit_t;
+typedef struct {
+    int gpio_num;
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    ledc_intr_type_t intr_type;
+    ledc_timer_t timer_sel;
+    uint32_t duty;
+    int hpoint;
+} ledc_channel_config_t;
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_timer_bit_t duty_resolution;
+    ledc_timer_t timer_num;
+    uint32_t freq_hz;
+} ledc_timer_config_t;
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config);
+esp_err_t ledc_timer_config(const ledc_timer_config_t* config);
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freq_hz);
+uint32_t ledc_get_freq(ledc_mode_t mode, ledc_timer_t timer);
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel);
+
+/* nvs.h, nvs_flash.h */
+typedef uint32_t nvs_handle;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode;
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_open(const char* name, nvs_open_mode mode, nvs_handle* out_handle);
+void nvs_close(nvs_handle handle);
+esp_err_t nvs_commit(nvs_handle handle);
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length);
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length);
+esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value);
+esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length);
+esp_err_t nvs_set_u32(nvs_handle handle, const char* key, uint32_t value);
+esp_err_t nvs_get_u32(nvs_handle handle, const char* key, uint32_t* out_value);
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key);
+esp_err_t nvs_erase_all(nvs_handle handle);
+
+/* esp_wifi.h, esp_event_loop.h */
+typedef enum { WIFI_MODE_NULL = 0, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA, WIFI_MODE_MAX } wifi_mode_t;
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP } wifi_interface_t;
+typedef enum { WIFI_STORAGE_FLASH, WIFI_STORAGE_RAM } wifi_storage_t;
+typedef enum {
+    WIFI_AUTH_OPEN = 0, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK, WIFI_AUTH_WPA2_ENTERPRISE, WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t ssid_len;
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    uint8_t ssid_hidden;
+    uint8_t max_connection;
+    uint16_t beacon_interval;
+} wifi_ap_config_t;
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    bool bssid_set;
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_sta_config_t;
+typedef union {
+    wifi_ap_config_t ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
+typedef struct { int magic; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() { .magic = 0x1F2F3F4F }
+esp_err_t esp_wifi_init(const wifi_init_config_t* config);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* config);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+
+typedef struct { uint32_t addr; } ip4_addr_t;
+typedef struct { ip4_addr_t ip, netmask, gw; } tcpip_adapter_ip_info_t;
+typedef enum { TCPIP_ADAPTER_IF_STA = 0, TCPIP_ADAPTER_IF_AP, TCPIP_ADAPTER_IF_MAX } tcpip_adapter_if_t;
+void tcpip_adapter_init(void);
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t interface, tcpip_adapter_ip_info_t* info);
+
+typedef enum {
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+    SYSTEM_EVENT_STA_LOST_IP,
+    SYSTEM_EVENT_AP_START = 12,
+    SYSTEM_EVENT_AP_STOP,
+    SYSTEM_EVENT_AP_STACONNECTED,
+    SYSTEM_EVENT_AP_STADISCONNECTED,
+    SYSTEM_EVENT_MAX = 32
+} system_event_id_t;
+typedef struct { tcpip_adapter_ip_info_t ip_info; bool ip_changed; } system_event_sta_got_ip_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; } system_event_sta_disconnected_t;
+typedef union {
+    system_event_sta_got_ip_t got_ip;
+    system_event_sta_disconnected_t disconnected;
+} system_event_info_t;
+typedef struct {
+    system_event_id_t event_id;
+    system_event_info_t event_info;
+} system_event_t;
+typedef esp_err_t (*system_event_cb_t)(void* ctx, system_event_t* event);
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx);
+
+/* mdns.h */
+typedef struct { const char* key; const char* value; } mdns_txt_item_t;
+esp_err_t mdns_init(void);
+void mdns_free(void);
+esp_err_t mdns_hostname_set(const char* hostname);
+esp_err_t mdns_instance_name_set(const char* instance_name);
+esp_err_t mdns_service_add(const char* instance_name, const char* service_type, const char* proto,
+    uint16_t port, mdns_txt_item_t txt[], size_t num_items);
+esp_err_t mdns_service_txt_item_set(const char* service_type, const char* proto, const char* key, const char* value);
+esp_err_t mdns_handle_system_event(void* ctx, system_event_t* event);
+
+#endif
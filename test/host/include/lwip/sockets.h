@@ -0,0 +1,33 @@
+#ifndef __HOST_LWIP_SOCKETS_H
+#define __HOST_LWIP_SOCKETS_H
+
+/*
+ * BSD types and byte order from the host, the calls themselves go to the
+ * in-process UDP network of host/idf.c.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "host_idf.h"
+
+int host_socket(int domain, int type, int protocol);
+int host_bind(int fd, const struct sockaddr* addr, socklen_t len);
+int host_setsockopt(int fd, int level, int name, const void* value, socklen_t len);
+ssize_t host_sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* to, socklen_t tolen);
+ssize_t host_recvfrom(int fd, void* buf, size_t len, int flags, struct sockaddr* from, socklen_t* fromlen);
+int host_close(int fd);
+char* host_inet_ntoa(const void* addr);
+
+#define socket host_socket
+#define bind host_bind
+#define setsockopt host_setsockopt
+#define sendto host_sendto
+#define recvfrom host_recvfrom
+#define close host_close
+#undef inet_ntoa
+#define inet_ntoa(addr) host_inet_ntoa(&(addr))
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Configuration of the host builds, the Kconfig defaults with the optional
+ * modules switched on so that their code is built and tested as well.
+ */
+#define CONFIG_WIFI_SSID "observatory"
+#define CONFIG_WIFI_PASS "andromeda"
+#define CONFIG_WIFI_MODE_AP_FALLBACK 1
+#define CONFIG_WIFI_AP_FALLBACK_SECONDS 30
+#define CONFIG_WIFI_AP_SSID "telescope"
+#ifndef CONFIG_WIFI_AP_PASS
+#define CONFIG_WIFI_AP_PASS "stargazer"
+#endif
+#define CONFIG_WIFI_RECONNECT_MAX_SECONDS 60
+#define CONFIG_SERVER_PORT 9333
+#define CONFIG_SERVER_BROADCAST_PORT_START 9334
+#define CONFIG_SERVER_MDNS 1
+#define CONFIG_SERVER_MDNS_HOSTNAME "telescope"
+#define CONFIG_SITE_LATITUDE_ARCSEC 0
+#define CONFIG_SITE_LONGITUDE_ARCSEC 0
+#define CONFIG_PERSIST_INTERVAL_SECONDS 30
+#define CONFIG_DISPLAY_SCL 19
+#define CONFIG_DISPLAY_SDA 22
+
+#define CONFIG_GPIO_RA_RENCODER_A 0
+#define CONFIG_GPIO_RA_RENCODER_B 2
+#define CONFIG_GPIO_RA_RENCODER_PULSES 2400
+#define CONFIG_RA_BACKLASH_PULSES 23
+#define CONFIG_GPIO_RA_EN 12
+#define CONFIG_GPIO_RA_PUL 13
+#define CONFIG_GPIO_RA_DIR 14
+#define CONFIG_RA_RESOLUTION 16
+#define CONFIG_RA_CYCLE_STEPS 5760
+#define CONFIG_RA_GEAR_RATIO 130
+
+#define CONFIG_GPIO_DEC_RENCODER_A 16
+#define CONFIG_GPIO_DEC_RENCODER_B 17
+#define CONFIG_GPIO_DEC_RENCODER_PULSES 2400
+#define CONFIG_DEC_BACKLASH_PULSES 21
+// the Kconfig defaults share the motor pins of both axes, the tests tell them apart
+#define CONFIG_GPIO_DEC_EN 15
+#define CONFIG_GPIO_DEC_PUL 5
+#define CONFIG_GPIO_DEC_DIR 23
+#define CONFIG_DEC_RESOLUTION 16
+#define CONFIG_DEC_CYCLE_STEPS 5760
+#define CONFIG_DEC_GEAR_RATIO 130
+
+#define CONFIG_LIMIT_MERIDIAN_MINUTES 30
+#define CONFIG_MERIDIAN_FLIP 1
+#define CONFIG_MERIDIAN_FLIP_MINUTES 10
+#define CONFIG_LIMIT_DEC_MIN_DEGREES -90
+#define CONFIG_LIMIT_DEC_MAX_DEGREES 270
+#define CONFIG_LIMIT_HORIZON_DEGREES 0
+#define CONFIG_LIMIT_SWITCH_RA 1
+#define CONFIG_GPIO_LIMIT_SWITCH_RA 4
+#define CONFIG_LIMIT_SWITCH_DEC 1
+#define CONFIG_GPIO_LIMIT_SWITCH_DEC 18
+
+// builds without the focuser leave it out altogether
+#ifndef HOST_NO_FOCUSER
+#define CONFIG_FOCUSER_ENABLED 1
+#define CONFIG_GPIO_FOCUSER_EN 25
+#define CONFIG_GPIO_FOCUSER_PUL 26
+#define CONFIG_GPIO_FOCUSER_DIR 27
+#define CONFIG_FOCUSER_STEP_RATE 800
+#define CONFIG_FOCUSER_MAX_POSITION 100000
+#define CONFIG_FOCUSER_BACKLASH_STEPS 50
+// dead reckoning builds leave the encoder out
+#ifndef HOST_FOCUSER_DEAD_RECKONING
+#define CONFIG_FOCUSER_ENCODER 1
+#define CONFIG_GPIO_FOCUSER_RENCODER_A 32
+#define CONFIG_GPIO_FOCUSER_RENCODER_B 33
+#define CONFIG_FOCUSER_STEPS_PER_PULSE 1
+#endif
+#endif
+
+#define CONFIG_SUPPORT_STATIC_ALLOCATION 1
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_DIAGNOSTICS 1
+#define CONFIG_PERF_HISTOGRAMS 1
+#define CONFIG_TRACE 1
+#define CONFIG_TRACE_RING_EVENTS 256
+#define CONFIG_CAPTURE 1
+#define CONFIG_CAPTURE_RING_KB 32
@@ -0,0 +1,160 @@
+#include "host.h"
+#include "astro.h"
+
+/*
+ * The constant time angle helpers of astro.h against the loops they
+ * replaced, wherever those loops gave an answer, and against 64 bit
+ * arithmetic over the whole int32 range, the corners included.
+ */
+
+#define RANDOM_INPUTS 1000000
+
+/* decMecMillis2decMillis before, to [0, 360) */
+static int32_t old_wrap_day(int32_t millis) {
+    while (millis < 0) {
+        millis += 86400000;
+    }
+    while (millis >= 86400000) {
+        millis -= 86400000;
+    }
+    return millis;
+}
+
+/* the wrap_half_day of pointing.c before, to (-180, 180] */
+static int32_t old_wrap_half_day(int32_t millis) {
+    millis %= DAY_MILLIS;
+    if (millis > DAY_MILLIS / 2) millis -= DAY_MILLIS;
+    else if (millis <= -DAY_MILLIS / 2) millis += DAY_MILLIS;
+    return millis;
+}
+
+/* getRaDiff of slew.c before, current - target the short way */
+static int32_t old_ra_diff(int32_t target, int32_t current) {
+    int32_t targetGreater, targetLess;
+
+    targetGreater = target;
+    while(targetGreater > current) targetGreater -= DAY_MILLIS;
+    while(targetGreater < current) targetGreater += DAY_MILLIS;
+
+    targetLess = targetGreater - DAY_MILLIS;
+
+    int32_t diffGreater = current - targetGreater;
+    int32_t diffLess = current - targetLess;
+
+    return abs(diffGreater) < abs(diffLess) ? diffGreater : diffLess;
+}
+
+static int64_t ref_wrap_day(int64_t millis) {
+    return (millis % DAY_MILLIS + DAY_MILLIS) % DAY_MILLIS;
+}
+
+static int64_t ref_wrap_half_day(int64_t millis) {
+    int64_t wrapped = ref_wrap_day(millis);
+    return wrapped > DAY_MILLIS / 2 ? wrapped - DAY_MILLIS : wrapped;
+}
+
+static uint32_t lcg(uint32_t* state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+/* the whole int32 range, a few days around 0 as often */
+static int32_t random_angle(uint32_t* state) {
+    uint32_t r = lcg(state);
+    return r & 1 ? (int32_t)lcg(state) : (int32_t)(lcg(state) % (8 * (uint32_t)DAY_MILLIS)) - 4 * DAY_MILLIS;
+}
+
+static const int32_t corners[] = {
+    INT32_MIN, INT32_MIN + 1, INT32_MAX - 1, INT32_MAX,
+    -2 * DAY_MILLIS, -DAY_MILLIS - 1, -DAY_MILLIS, -DAY_MILLIS + 1,
+    -DAY_MILLIS / 2 - 1, -DAY_MILLIS / 2, -DAY_MILLIS / 2 + 1, -1, 0, 1,
+    DAY_MILLIS / 2 - 1, DAY_MILLIS / 2, DAY_MILLIS / 2 + 1,
+    DAY_MILLIS - 1, DAY_MILLIS, DAY_MILLIS + 1, 2 * DAY_MILLIS,
+    INT32_MIN + DAY_MILLIS / 2, INT32_MAX - DAY_MILLIS / 2,
+};
+#define CORNERS (sizeof(corners) / sizeof(corners[0]))
+
+static int failures_before;
+
+static void check_one(int32_t a, int32_t b) {
+    int32_t day = wrap_day_millis(a), half = wrap_half_day_millis(a), diff = angle_diff_millis(a, b);
+    // in range
+    CHECK(day >= 0 && day < DAY_MILLIS);
+    CHECK(half > -DAY_MILLIS / 2 && half <= DAY_MILLIS / 2);
+    CHECK(diff > -DAY_MILLIS / 2 && diff <= DAY_MILLIS / 2);
+    // the same angle
+    CHECK_EQ(ref_wrap_day(a), day);
+    CHECK_EQ(ref_wrap_half_day(a), half);
+    CHECK_EQ(ref_wrap_half_day((int64_t)a - b), diff);
+    CHECK_EQ(wrap_day_millis(a), ref_wrap_day((int64_t)b + diff));
+
+    // the old code, where it did not overflow
+    CHECK_EQ(old_wrap_day(a), day);
+    CHECK_EQ(old_wrap_half_day(a), half);
+    if (llabs((int64_t)a) < INT32_MAX - 2 * (int64_t)DAY_MILLIS && llabs((int64_t)b) < INT32_MAX - 2 * (int64_t)DAY_MILLIS
+        && llabs((int64_t)a - b) < INT32_MAX - 2 * (int64_t)DAY_MILLIS) {
+        CHECK_EQ(old_ra_diff(b, a), diff);
+    }
+
+    // one line per failing input, not one per check
+    if (host_test_failures != failures_before) {
+        printf("  for a = %d, b = %d\n", a, b);
+        failures_before = host_test_failures;
+    }
+}
+
+static void test_random() {
+    uint32_t state = 1;
+    for (int i = 0; i < RANDOM_INPUTS; i ++) {
+        int32_t a = random_angle(&state);
+        int32_t b = random_angle(&state);
+        check_one(a, b);
+    }
+}
+
+static void test_corners() {
+    for (int i = 0; i < CORNERS; i ++) {
+        for (int j = 0; j < CORNERS; j ++) {
+            check_one(corners[i], corners[j]);
+        }
+    }
+}
+
+/* half a turn either way is +180, whichever side it comes from */
+static void test_ties() {
+    for (int32_t turns = -20; turns <= 20; turns ++) {
+        int32_t tie = DAY_MILLIS / 2 + turns * DAY_MILLIS;
+        CHECK_EQ(DAY_MILLIS / 2, wrap_half_day_millis(tie));
+        CHECK_EQ(DAY_MILLIS / 2, wrap_day_millis(tie));
+    }
+    CHECK_EQ(DAY_MILLIS / 2, wrap_half_day_millis(-DAY_MILLIS / 2));
+    CHECK_EQ(DAY_MILLIS / 2, angle_diff_millis(DAY_MILLIS / 2, 0));
+    CHECK_EQ(DAY_MILLIS / 2, angle_diff_millis(0, DAY_MILLIS / 2));
+    CHECK_EQ(DAY_MILLIS / 2, angle_diff_millis(-DAY_MILLIS / 4, DAY_MILLIS / 4));
+    CHECK_EQ(DAY_MILLIS / 2, angle_diff_millis(INT32_MAX, INT32_MAX - DAY_MILLIS / 2));
+    CHECK_EQ(DAY_MILLIS / 2, angle_diff_millis(INT32_MIN + DAY_MILLIS / 2, INT32_MIN));
+    CHECK_EQ(-DAY_MILLIS / 2 + 1, angle_diff_millis(0, DAY_MILLIS / 2 - 1));
+    CHECK_EQ(DAY_MILLIS / 2 - 1, angle_diff_millis(DAY_MILLIS / 2 - 1, 0));
+}
+
+/* 64 bit differences, INT32_MAX - INT32_MIN is not an int32 */
+static void test_extremes() {
+    CHECK_EQ(ref_wrap_day(INT32_MIN), wrap_day_millis(INT32_MIN));
+    CHECK_EQ(ref_wrap_day(INT32_MAX), wrap_day_millis(INT32_MAX));
+    CHECK_EQ(ref_wrap_half_day(INT32_MIN), wrap_half_day_millis(INT32_MIN));
+    CHECK_EQ(ref_wrap_half_day(INT32_MAX), wrap_half_day_millis(INT32_MAX));
+    CHECK_EQ(ref_wrap_half_day((int64_t)INT32_MAX - INT32_MIN), angle_diff_millis(INT32_MAX, INT32_MIN));
+    CHECK_EQ(ref_wrap_half_day((int64_t)INT32_MIN - INT32_MAX), angle_diff_millis(INT32_MIN, INT32_MAX));
+    CHECK_EQ(-angle_diff_millis(INT32_MAX, INT32_MIN), angle_diff_millis(INT32_MIN, INT32_MAX));
+    CHECK_EQ(0, angle_diff_millis(INT32_MIN, INT32_MIN));
+    CHECK_EQ(0, angle_diff_millis(INT32_MAX, INT32_MAX));
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    test_random();
+    test_corners();
+    test_ties();
+    test_extremes();
+    return host_test_exit();
+}
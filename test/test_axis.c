@@ -0,0 +1,185 @@
+#include "host.h"
+#include "astro.h"
+#include "axis.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+
+/*
+ * The axis_t code against the separate RA and Dec code it replaced, copied
+ * here as it was: the same speeds have to give the same step rates and dir
+ * and enable levels, the same encoder edges the same lash clearing and
+ * actual pulses.
+ */
+
+#define OLD_SPEED_MAX 450000
+#define OLD_SPEED_MIN 150
+
+typedef struct {
+    int dir, en, freq;
+} old_motor_t;
+
+/* setRaStepRate() and setDecStepRate() */
+static int old_set_step_rate(uint32_t millihz_per_speed_q24, bool reverse, int32_t speed, old_motor_t* motor) {
+    if (speed < 0) {
+        motor->dir = reverse ? 1 : 0;
+    } else {
+        motor->dir = reverse ? 0 : 1;
+    }
+    int32_t absSpeed = speed < 0 ? -speed : speed;
+    int freq = 0;
+    if (absSpeed >= OLD_SPEED_MIN) {
+        if (absSpeed > OLD_SPEED_MAX) absSpeed = OLD_SPEED_MAX;
+        freq = (int32_t)(((int64_t)absSpeed * millihz_per_speed_q24) >> 24) / 1000;
+        if (speed < 0) freq = -freq;
+    }
+    motor->en = freq == 0 ? 1 : 0;
+    motor->freq = freq < 0 ? -freq : freq;
+    return freq;
+}
+
+typedef struct {
+    int32_t count;
+    bool direction;
+    int8_t is_clearing_backlash;
+    int32_t backlash_pulses;
+    int32_t actual_pulses;
+} old_encoder_t;
+
+/* ra_encoder_dir_callback() and dec_encoder_dir_callback() */
+static void old_dir_callback(old_encoder_t* e, bool dir, int32_t lash) {
+    if (dir) {
+        if (e->is_clearing_backlash == 1) {
+        } else if (e->is_clearing_backlash == -1) {
+            e->is_clearing_backlash = 1;
+            e->backlash_pulses = e->backlash_pulses - lash;
+        } else {
+            e->is_clearing_backlash = 1;
+            e->backlash_pulses = e->count;
+        }
+    } else {
+        if (e->is_clearing_backlash == 1) {
+            e->is_clearing_backlash = -1;
+            e->backlash_pulses = e->backlash_pulses + lash;
+        } else if (e->is_clearing_backlash == -1) {
+        } else {
+            e->is_clearing_backlash = -1;
+            e->backlash_pulses = e->count;
+        }
+    }
+}
+
+/* ra_encoder_pul_callback() and dec_encoder_pul_callback() */
+static void old_pul_callback(old_encoder_t* e, int32_t pul, int8_t diff, int32_t lash) {
+    if (e->is_clearing_backlash == 1) {
+        if (pul >= e->backlash_pulses + lash) {
+            e->is_clearing_backlash = false;
+            e->actual_pulses += pul - e->backlash_pulses - lash;
+        }
+    } else if (e->is_clearing_backlash == -1) {
+        if (pul <= e->backlash_pulses - lash) {
+            e->is_clearing_backlash = false;
+            e->actual_pulses += pul - e->backlash_pulses + lash;
+        }
+    } else {
+        e->actual_pulses += diff;
+    }
+}
+
+/* the edges host_rencoder_turn() makes, as the rencoder isr hands them on */
+static void old_turn(old_encoder_t* e, int32_t counts, int32_t lash) {
+    bool forward = counts > 0;
+    for (int32_t i = 0; i < (forward ? counts : -counts); i ++) {
+        if (e->direction != forward) {
+            old_dir_callback(e, forward, lash);
+            e->direction = forward;
+        }
+        int8_t diff = forward ? 1 : -1;
+        old_pul_callback(e, e->count + diff, diff, lash);
+        e->count += diff;
+    }
+}
+
+static uint32_t seed = 12345;
+
+static int32_t random_between(int32_t min, int32_t max) {
+    seed = seed * 1103515245 + 12345;
+    return min + (int32_t)((seed >> 8) % (uint32_t)(max - min + 1));
+}
+
+static void test_step_rates() {
+    const int32_t speeds[] = { 0, 1, 149, 150, 151, SPEED_PER_CYCLE, 7 * SPEED_PER_CYCLE / 3,
+        16 * SPEED_PER_CYCLE, 30 * SPEED_PER_CYCLE, 450001, INT32_MAX };
+    for (int a = 0; a < MOUNT_AXES; a ++) {
+        axis_t* axis = &mount_axes[a];
+        bool configured = axis->reverse;
+        for (int r = 0; r < 2; r ++) {
+            axis->reverse = r;
+            for (int i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i ++) {
+                for (int sign = -1; sign <= 1; sign += 2) {
+                    int32_t speed = sign * speeds[i];
+                    if (speed == INT32_MIN) continue;
+                    old_motor_t old;
+                    int freq = old_set_step_rate(*axis->millihz_per_speed_q24, r, speed, &old);
+                    CHECK_EQ(freq, axis_set_step_rate(axis, speed));
+                    CHECK_EQ(freq, axis_get_step_freq(axis, speed));
+                    CHECK_EQ(old.dir, host_gpio_output(axis->dir_pin));
+                    CHECK_EQ(old.en, host_gpio_output(axis->en_pin));
+                    CHECK_EQ(old.freq, host_ledc_output_freq(axis->channel.channel));
+                }
+            }
+        }
+        axis->reverse = configured;
+        axis_set_step_rate(axis, 0);
+    }
+}
+
+/* random walks with reversals inside and beyond the dead band, on both axes */
+static void test_lash_clearing() {
+    for (int a = 0; a < MOUNT_AXES; a ++) {
+        axis_t* axis = &mount_axes[a];
+        old_encoder_t old = {
+            .count = rencoder_value(&axis->encoder),
+            .direction = rencoder_getdirection(&axis->encoder),
+            .is_clearing_backlash = axis->is_clearing_backlash,
+            .backlash_pulses = axis->backlash_pulses,
+            .actual_pulses = axis->actual_pulses,
+        };
+        for (int i = 0; i < 2000; i ++) {
+            int32_t lash = *axis->lash_pulses;
+            int32_t counts = random_between(0, 3) ? random_between(-2 * lash, 2 * lash) : random_between(-3, 3);
+            if (!counts) continue;
+            host_rencoder_turn(&axis->encoder, counts);
+            old_turn(&old, counts, lash);
+            CHECK_EQ(old.count, rencoder_value(&axis->encoder));
+            CHECK_EQ(old.is_clearing_backlash, axis->is_clearing_backlash);
+            CHECK_EQ(old.actual_pulses, axis->actual_pulses);
+            if (host_test_failures) return;
+        }
+        CHECK_EQ(old.actual_pulses, a == AXIS_RA ? get_ra_pulses() : get_dec_pulses());
+    }
+}
+
+/* a new lash applies from the next reversal on, in both */
+static void test_lash_change() {
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    geometry[GEOMETRY_RA_BACKLASH_PULSES] = 5;
+    geometry[GEOMETRY_DEC_BACKLASH_PULSES] = 60;
+    CHECK_EQ(ESP_OK, apply_mount_geometry(geometry));
+    test_lash_clearing();
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    init_astro();
+    CHECK_EQ(ESP_OK, init_mount_config());
+    init_axes();
+    init_mount();
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        axis_start_motor(&mount_axes[i]);
+    }
+    test_step_rates();
+    test_lash_clearing();
+    test_lash_change();
+    return host_test_exit();
+}
@@ -0,0 +1,96 @@
+#include <math.h>
+#include "host.h"
+#include "axis.h"
+#include "backlash.h"
+#include "mount_config.h"
+#include "nvs.h"
+
+/*
+ * Backlash calibration on a booted mount whose gears have a dead band: the
+ * encoders follow the motor pulses only once the lash is taken up. The
+ * measured band is applied at once and stored, never from a timer.
+ */
+
+/* as a client sends it */
+#define CMD_CALIBRATE_BACKLASH 20
+
+#define STEP_MICROS 1000
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+typedef struct {
+    double lash; // encoder pulses
+    double motor, output; // encoder pulses
+    uint64_t pulses;
+} gear_t;
+
+static gear_t gears[MOUNT_AXES];
+
+/* the output is pushed along by either side of the dead band, the encoder counts whole pulses */
+static void turn_gears() {
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        axis_t* axis = &mount_axes[i];
+        gear_t* gear = &gears[i];
+        int offset = i == AXIS_RA ? GEOMETRY_RA_GEAR_RATIO : GEOMETRY_DEC_GEAR_RATIO;
+        double pulsesPerStep = (double)geometry[offset + GEOMETRY_RA_ENCODER_PULSES]
+            / geometry[offset + GEOMETRY_RA_CYCLE_STEPS] / geometry[offset + GEOMETRY_RA_RESOLUTION];
+        uint64_t pulses = host_ledc_pulses(axis->channel.channel);
+        bool positive = host_gpio_output(axis->dir_pin) == (axis->reverse ? 0 : 1);
+        gear->motor += (positive ? 1 : -1) * (double)(pulses - gear->pulses) * pulsesPerStep;
+        gear->pulses = pulses;
+        double before = gear->output;
+        if (gear->motor - gear->output > gear->lash) gear->output = gear->motor - gear->lash;
+        if (gear->motor < gear->output) gear->output = gear->motor;
+        host_rencoder_turn(&axis->encoder, (int32_t)(floor(gear->output) - floor(before)));
+    }
+}
+
+static void run_for(int64_t micros) {
+    for (int64_t t = 0; t < micros; t += STEP_MICROS) {
+        host_run_for(STEP_MICROS);
+        turn_gears();
+    }
+}
+
+static uint32_t stored_backlash(int field) {
+    nvs_handle handle;
+    uint32_t stored[GEOMETRY_FIELDS] = { 0 };
+    size_t len = sizeof(stored);
+    if (nvs_open("mount", NVS_READONLY, &handle) != ESP_OK) return 0;
+    nvs_get_blob(handle, "geometry", stored, &len);
+    nvs_close(handle);
+    return stored[field];
+}
+
+static void calibrate(uint8_t axis, int field, double lash) {
+    gears[axis].lash = lash;
+    uint8_t command[2] = { CMD_CALIBRATE_BACKLASH, axis };
+    CHECK(host_udp_send(command, sizeof(command)));
+    run_for(STEP_MICROS);
+    CHECK(is_calibrating_backlash());
+    run_for(25 * 1000000);
+    CHECK(!is_calibrating_backlash());
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    CHECK_NEAR(lash, geometry[field], 1);
+    CHECK_EQ(geometry[field], stored_backlash(field));
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_start(main_task);
+    run_for(5 * 1000000);
+
+    calibrate(BACKLASH_AXIS_RA, GEOMETRY_RA_BACKLASH_PULSES, 37);
+    calibrate(BACKLASH_AXIS_DEC, GEOMETRY_DEC_BACKLASH_PULSES, 12);
+    // tight gears, the encoder may seem a pulse ahead of the truncated commanded count
+    calibrate(BACKLASH_AXIS_RA, GEOMETRY_RA_BACKLASH_PULSES, 0);
+    CHECK_EQ(0, host_nvs_timer_writes());
+    return host_test_exit();
+}
@@ -0,0 +1,262 @@
+#include <arpa/inet.h>
+#include <math.h>
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host.h"
+#include "axis.h"
+#include "capture.h"
+#include "mount_config.h"
+
+/*
+ * Record and replay on the real firmware, faster than real time: a forked
+ * mount whose motors turn its encoders records a session of commands into
+ * the capture ring, long after boot and across the wrap of the 32 bit record
+ * times, and capture_replay has to change the step rates the same way from
+ * the file. The recording keeps CMD_SET_WIFI, and so the password, out of
+ * the ring.
+ */
+
+/* as a client sends them */
+#define CMD_SET_TRACKING 1
+#define CMD_PULSE_GUIDING 4
+#define CMD_SYNC_TO_TARGET 7
+#define CMD_SLEW_TO_TARGET 8
+#define CMD_SET_WIFI 17
+#define CMD_SET_CAPTURE 32
+
+#define STEP_MICROS 1000
+#define CAPTURE_BYTES (CONFIG_CAPTURE_RING_KB * 1024)
+#define WIFI_PASS "nebula-secret"
+/* the low 32 bits of the record times wrap in the middle of the session */
+#define CAPTURE_AT_MICROS ((1LL << 32) - 30 * 1000000)
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+/* the recording mount, its encoders follow the motors */
+static double motor[MOUNT_AXES];
+static int32_t encoder[MOUNT_AXES];
+
+static void turn_motors(ledc_channel_t channel, uint32_t pulses) {
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        axis_t* axis = &mount_axes[i];
+        if (channel != axis->channel.channel) continue;
+        int offset = i == AXIS_RA ? GEOMETRY_RA_GEAR_RATIO : GEOMETRY_DEC_GEAR_RATIO;
+        double pulsesPerStep = (double)geometry[offset + GEOMETRY_RA_ENCODER_PULSES]
+            / geometry[offset + GEOMETRY_RA_CYCLE_STEPS] / geometry[offset + GEOMETRY_RA_RESOLUTION];
+        bool positive = host_gpio_output(axis->dir_pin) == (axis->reverse ? 0 : 1);
+        motor[i] += (positive ? 1 : -1) * (double)pulses * pulsesPerStep;
+        int32_t turned = (int32_t)floor(motor[i]) - encoder[i];
+        encoder[i] += turned;
+        host_rencoder_turn(&axis->encoder, turned);
+    }
+}
+
+static void send_command(const void* command, size_t len) {
+    CHECK(host_udp_send(command, len));
+    host_run_for(STEP_MICROS);
+}
+
+static void send_coordinates(uint8_t cmd, int32_t ra, int32_t dec) {
+    uint8_t command[9] = { cmd };
+    *(int32_t*)(command + 1) = htonl(ra);
+    *(int32_t*)(command + 5) = htonl(dec);
+    send_command(command, sizeof(command));
+}
+
+static void send_pulse(uint8_t dir, int16_t millis) {
+    uint8_t command[4] = { CMD_PULSE_GUIDING, dir };
+    *(int16_t*)(command + 2) = htons(millis);
+    send_command(command, sizeof(command));
+}
+
+static int read_capture(uint8_t* out, uint32_t from) {
+    uint32_t head;
+    int count = capture_read(&from, &head, out, CAPTURE_BYTES);
+    CHECK_EQ(head, from + count);
+    return count;
+}
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint32_t time;
+    const uint8_t* payload;
+} record_t;
+
+static bool next_record(const uint8_t* blob, int size, int* pos, record_t* record) {
+    if (*pos + CAPTURE_HEADER_SIZE > size) return false;
+    const uint8_t* at = blob + *pos;
+    record->type = at[0];
+    record->len = at[1] | at[2] << 8;
+    memcpy(&record->time, at + 3, sizeof(record->time));
+    record->payload = at + CAPTURE_HEADER_SIZE;
+    *pos += CAPTURE_HEADER_SIZE + record->len;
+    CHECK(*pos <= size);
+    return *pos <= size;
+}
+
+/* a session on the recording mount, writes its capture to fd */
+static int record(int fd) {
+    host_ledc_on_pulses(turn_motors);
+    host_start(main_task);
+    // somewhere to start from the replay has to restore
+    host_run_until(CAPTURE_AT_MICROS - 10 * 1000000);
+    const uint8_t tracking[2] = { CMD_SET_TRACKING, 1 };
+    send_command(tracking, sizeof(tracking));
+    send_coordinates(CMD_SYNC_TO_TARGET, 7 * 3600000, 40 * 240000);
+    host_run_until(CAPTURE_AT_MICROS);
+
+    const uint8_t capture[2] = { CMD_SET_CAPTURE, CAPTURE_RING };
+    send_command(capture, sizeof(capture));
+    CHECK_EQ(CAPTURE_RING, get_capture_mode());
+    host_run_for(3 * 1000000);
+    // from where the mount was synced before the capture
+    send_coordinates(CMD_SLEW_TO_TARGET, 7 * 3600000 + 60000, 40 * 240000 + 30000);
+    host_run_for(40 * 1000000);
+    for (int i = 0; i < 8; i ++) {
+        send_pulse(i % 4, 200 + 50 * i);
+        host_run_for(1500 * 1000);
+    }
+    host_run_for(3 * 1000000);
+
+    static uint8_t blob[CAPTURE_BYTES];
+    int size = read_capture(blob, 0);
+    CHECK(size > 0 && size < CAPTURE_BYTES);
+    CHECK_EQ(size, write(fd, blob, size));
+
+    // the credentials are taken, and kept out of the capture
+    uint8_t wifi[3 + sizeof("observatory") - 1 + sizeof(WIFI_PASS) - 1] = { CMD_SET_WIFI, sizeof("observatory") - 1 };
+    memcpy(wifi + 2, "observatory", sizeof("observatory") - 1);
+    wifi[2 + sizeof("observatory") - 1] = sizeof(WIFI_PASS) - 1;
+    memcpy(wifi + 3 + sizeof("observatory") - 1, WIFI_PASS, sizeof(WIFI_PASS) - 1);
+    CHECK(host_udp_send(wifi, sizeof(wifi)));
+    host_run_for(1000000);
+    CHECK(strcmp((const char*)host_wifi_config(WIFI_IF_STA)->sta.password, WIFI_PASS) == 0);
+    int tail = read_capture(blob, size);
+    for (int i = 0; i + sizeof(WIFI_PASS) - 1 <= tail; i ++) {
+        CHECK(memcmp(blob + i, WIFI_PASS, sizeof(WIFI_PASS) - 1) != 0);
+    }
+    int pos = 0;
+    record_t r;
+    while (next_record(blob, tail, &pos, &r)) {
+        CHECK(r.type != CAPTURE_RECORD_COMMAND || r.payload[0] != CMD_SET_WIFI);
+    }
+    return host_test_exit();
+}
+
+/* capture_replay on a file of the capture, its exit code */
+static int run_replay(const uint8_t* capture, int size) {
+    char path[] = "/tmp/test_capture_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK_EQ(size, write(fd, capture, size));
+    close(fd);
+    pid_t replayer = fork();
+    if (replayer == 0) {
+        execl(CAPTURE_REPLAY, CAPTURE_REPLAY, path, (char*)NULL);
+        exit(127);
+    }
+    int status;
+    waitpid(replayer, &status, 0);
+    unlink(path);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* the capture as recorded replays the same, faster than it took; one step rate off does not */
+static void test_replay(uint8_t* recorded, int size) {
+    int pos = 0, rates = 0;
+    record_t r, start;
+    CHECK(next_record(recorded, size, &pos, &start));
+    CHECK_EQ(CAPTURE_RECORD_START, start.type);
+    bool wrapped = false;
+    uint32_t last = start.time;
+    uint8_t* rate = NULL;
+    while (next_record(recorded, size, &pos, &r)) {
+        if (r.time < last) wrapped = true;
+        last = r.time;
+        if (r.type == CAPTURE_RECORD_RATE && ++ rates == 5) rate = (uint8_t*)r.payload;
+    }
+    double captured = (uint32_t)(last - start.time) / 1e6;
+    CHECK(wrapped);
+    CHECK(captured > 50);
+    CHECK(rate != NULL);
+
+    struct timespec began, ended;
+    clock_gettime(CLOCK_MONOTONIC, &began);
+    CHECK_EQ(0, run_replay(recorded, size));
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    double wall = (ended.tv_sec - began.tv_sec) + (ended.tv_nsec - began.tv_nsec) / 1e9;
+    printf("replayed %.1f s of capture in %.3f s\n", captured, wall);
+    CHECK(wall < captured);
+
+    if (!rate) return;
+    rate[1] ^= 1;
+    CHECK_EQ(1, run_replay(recorded, size));
+    rate[1] ^= 1;
+    // a ring that lost its START record has no state to start from
+    CHECK_EQ(2, run_replay(recorded + CAPTURE_HEADER_SIZE + start.len, size - CAPTURE_HEADER_SIZE - start.len));
+}
+
+/* past the end of the ring the oldest records go, whole, and long payloads keep their length */
+static void test_ring_wraps() {
+    int32_t snapshot[2] = { 1, 2 };
+    CHECK_EQ(ESP_OK, start_capture(CAPTURE_RING, snapshot, sizeof(snapshot)));
+    static char command[300];
+    for (int i = 0; i < sizeof(command); i ++) command[i] = i;
+    capture_command(command, sizeof(command));
+    for (int32_t i = 0; i < 10000; i ++) capture_rate(i % 3, i);
+    capture_command(command, sizeof(command));
+    stop_capture();
+
+    static uint8_t blob[CAPTURE_BYTES];
+    int size = read_capture(blob, 0);
+    CHECK(size > CAPTURE_BYTES - CAPTURE_HEADER_SIZE - sizeof(command));
+    int pos = 0, rates = 0;
+    int32_t expected = -1;
+    record_t r;
+    while (next_record(blob, size, &pos, &r) && r.type == CAPTURE_RECORD_RATE) {
+        int32_t freq;
+        memcpy(&freq, r.payload + 1, sizeof(freq));
+        if (expected >= 0) CHECK_EQ(expected, freq);
+        CHECK_EQ(freq % 3, r.payload[0]);
+        expected = freq + 1;
+        rates ++;
+    }
+    CHECK_EQ(10000, expected);
+    CHECK(rates > 1000);
+    CHECK_EQ(CAPTURE_RECORD_COMMAND, r.type);
+    CHECK_EQ(sizeof(command), r.len);
+    CHECK(memcmp(command, r.payload, sizeof(command)) == 0);
+    CHECK_EQ(size, pos);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    int fds[2];
+    CHECK_EQ(0, pipe(fds));
+    // a process each, the firmware boots once per process
+    pid_t recorder = fork();
+    if (recorder == 0) {
+        close(fds[0]);
+        exit(record(fds[1]));
+    }
+    close(fds[1]);
+    static uint8_t recorded[CAPTURE_BYTES];
+    int size = 0, got;
+    while ((got = read(fds[0], recorded + size, sizeof(recorded) - size)) > 0) size += got;
+    int status;
+    waitpid(recorder, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(size > 0);
+    if (size > 0) test_replay(recorded, size);
+    test_ring_wraps();
+    return host_test_exit();
+}
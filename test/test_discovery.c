@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include "host.h"
+#include "discovery.h"
+#include "protocol.h"
+
+/*
+ * What a client finds through mDNS on a booted mount: the host name, the
+ * command service with its port, and TXT records with the protocol
+ * version, the axes of this build and the status port.
+ */
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static void test_advertised() {
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+
+    CHECK(host_mdns_hostname() && strcmp(host_mdns_hostname(), CONFIG_SERVER_MDNS_HOSTNAME) == 0);
+    CHECK(host_mdns_instance(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO) != NULL);
+    CHECK_EQ(CONFIG_SERVER_PORT, host_mdns_port(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO));
+    CHECK_EQ(-1, host_mdns_port("_other", DISCOVERY_SERVICE_PROTO));
+
+    const char* proto = host_mdns_txt(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, "proto");
+    CHECK(proto && atoi(proto) == PROTOCOL_VERSION);
+    const char* axes = host_mdns_txt(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, "axes");
+#ifdef CONFIG_FOCUSER_ENABLED
+    CHECK(axes && strcmp(axes, "ra,dec,focuser") == 0);
+#else
+    CHECK(axes && strcmp(axes, "ra,dec") == 0);
+#endif
+    const char* status = host_mdns_txt(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, "status");
+    CHECK(status && atoi(status) == CONFIG_SERVER_BROADCAST_PORT_START);
+    CHECK(host_mdns_txt(DISCOVERY_SERVICE_TYPE, DISCOVERY_SERVICE_PROTO, "nothing") == NULL);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    test_advertised();
+    return host_test_exit();
+}
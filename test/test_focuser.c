@@ -0,0 +1,124 @@
+#include <arpa/inet.h>
+#include "host.h"
+#include "axis.h"
+#include "focuser.h"
+
+/*
+ * Focuser moves on a booted mount, over the protocol: the time a move
+ * takes at the configured step rate, where the motor really went and how
+ * far an inward move overshoots to take up the backlash. Built with the
+ * encoder closing the loop and without it, dead reckoning.
+ */
+
+/* as a client sends them */
+#define CMD_FOCUSER_MOVE 21
+#define CMD_FOCUSER_HALT 22
+
+#define STEP_MICROS 1000
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static axis_t* const focuser = &mount_axes[AXIS_FOCUSER];
+static int32_t motor, lowest; // steps the motor really made
+
+/* the step pin turns the motor and the encoder on it */
+static void turn_motor(ledc_channel_t channel, uint32_t pulses) {
+    if (channel != focuser->channel.channel) return;
+    int32_t steps = host_gpio_output(focuser->dir_pin) == (focuser->reverse ? 0 : 1) ? pulses : -(int32_t)pulses;
+    motor += steps;
+    if (motor < lowest) lowest = motor;
+#ifdef CONFIG_FOCUSER_ENCODER
+    host_rencoder_turn(&focuser->encoder, steps / CONFIG_FOCUSER_STEPS_PER_PULSE);
+#endif
+}
+
+static void send_move(int32_t position) {
+    uint8_t command[5] = { CMD_FOCUSER_MOVE };
+    *(int32_t*)(command + 1) = htonl(position);
+    CHECK(host_udp_send(command, sizeof(command)));
+}
+
+/* runs until the focuser stands, gives the time it took */
+static int64_t move(int32_t position) {
+    int64_t start = esp_timer_get_time();
+    send_move(position);
+    lowest = motor;
+    do {
+        host_run_for(STEP_MICROS);
+    } while (is_focuser_moving() && esp_timer_get_time() - start < 60 * 1000000LL);
+    CHECK(!is_focuser_moving());
+    return esp_timer_get_time() - start;
+}
+
+/*
+ * The encoder closes the loop on the exact step, dead reckoning may be a
+ * step off per leg, the LEDC phase decides whether the last pulse is out.
+ */
+#ifdef CONFIG_FOCUSER_ENCODER
+#define POSITION_TOLERANCE 0
+#else
+#define POSITION_TOLERANCE 2
+#endif
+
+static void check_at(int32_t position) {
+    focuser_state_t state;
+    get_focuser_state(&state);
+    CHECK_NEAR(position, motor, POSITION_TOLERANCE);
+    CHECK_NEAR(motor, state.position, POSITION_TOLERANCE);
+    CHECK_EQ(position, state.target);
+    CHECK(!state.moving);
+    CHECK_EQ(0, host_ledc_output_freq(focuser->channel.channel));
+}
+
+/* timer latency, the parse of the command and a correction step, in micros */
+#define SLACK 20000
+
+static void test_outward_move() {
+    int64_t took = move(4000);
+    check_at(4000);
+    CHECK(lowest >= 0);
+    CHECK_NEAR(4000 * 1000000LL / CONFIG_FOCUSER_STEP_RATE, took, SLACK);
+}
+
+/* inward moves go past the target by the backlash and finish outward */
+static void test_inward_move() {
+    int32_t from = motor;
+    int64_t took = move(1000);
+    check_at(1000);
+    CHECK_NEAR(1000 - CONFIG_FOCUSER_BACKLASH_STEPS, lowest, POSITION_TOLERANCE);
+    CHECK_NEAR((from - 1000 + 2 * CONFIG_FOCUSER_BACKLASH_STEPS) * 1000000LL / CONFIG_FOCUSER_STEP_RATE, took, SLACK);
+}
+
+/* a halt stops where the focuser is, one second into the move */
+static void test_halt() {
+    int32_t from = motor;
+    send_move(3000);
+    host_run_for(1000000);
+    uint8_t halt = CMD_FOCUSER_HALT;
+    CHECK(host_udp_send(&halt, 1));
+    host_run_for(STEP_MICROS);
+    CHECK(!is_focuser_moving());
+    focuser_state_t state;
+    get_focuser_state(&state);
+    CHECK_NEAR(from + CONFIG_FOCUSER_STEP_RATE, motor, 2);
+    CHECK_NEAR(motor, state.position, POSITION_TOLERANCE);
+    CHECK_EQ(state.position, state.target);
+    int32_t halted = motor;
+    host_run_for(1000000);
+    CHECK_EQ(halted, motor);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_ledc_on_pulses(turn_motor);
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    test_outward_move();
+    test_inward_move();
+    test_halt();
+    return host_test_exit();
+}
@@ -0,0 +1,203 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include "host.h"
+#include "axis.h"
+#include "guide.h"
+#include "mount_config.h"
+
+/*
+ * Guide pulses through CMD_PULSE_GUIDING on a booted mount, so the rates
+ * come from guideGetStepRate() and guideApplyStepRate() of telescope.c:
+ * while a pulse runs the LEDC channel of its axis steps at the base rate
+ * plus or minus the guide rate, and at the base rate again after it, and
+ * the steps it made beyond the base rate are the correction the pulse asked
+ * for. RA tracks, Dec stands, so a Dec reversal first crosses the gear lash.
+ */
+
+/* as a client sends them */
+#define CMD_SET_TRACKING 1
+#define CMD_PULSE_GUIDING 4
+#define CMD_SET_RA_GUIDE_SPEED 5
+#define CMD_SET_DEC_GUIDE_SPEED 6
+
+#define STEP_MICROS 1000
+#define RA_GUIDE_SPEED (SPEED_PER_CYCLE * 2 / 3)
+#define DEC_GUIDE_SPEED (SPEED_PER_CYCLE / 2)
+/* longer than the burst over the Dec lash takes */
+#define LASH_MICROS (5 * 1000000)
+
+int32_t guideGetStepRate(uint8_t axis);
+
+static const int32_t base_speeds[GUIDE_AXES] = { SPEED_PER_CYCLE, 0 }; //tracking, Dec at rest
+static const int32_t guide_speeds[GUIDE_AXES] = { RA_GUIDE_SPEED, DEC_GUIDE_SPEED };
+/* direction of the last Dec correction, a reversal adds the lash to the next one */
+static int8_t last_dec_sign;
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static void send_command(const void* command, size_t len) {
+    CHECK(host_udp_send(command, len));
+    host_run_for(STEP_MICROS);
+    uint8_t reply[64];
+    while (host_udp_receive(reply, sizeof(reply)) >= 0);
+}
+
+static void send_speed(uint8_t cmd, int32_t speed) {
+    uint8_t command[5] = { cmd };
+    *(int32_t*)(command + 1) = htonl(speed);
+    send_command(command, sizeof(command));
+}
+
+/* the pulse starts as the command task takes it, at once */
+static void send_pulse(uint8_t dir, int16_t millis) {
+    uint8_t command[4] = { CMD_PULSE_GUIDING, dir };
+    *(int16_t*)(command + 2) = htons(millis);
+    CHECK(host_udp_send(command, sizeof(command)));
+    host_run_for(0);
+}
+
+static int8_t dir_sign(uint8_t dir) {
+    return dir == PULSE_GUIDING_DIR_WEST || dir == PULSE_GUIDING_DIR_NORTH ? 1 : -1;
+}
+
+/* the signed step rate the channel of the axis puts out, its dir pin tells the sign */
+static int output_rate(uint8_t axis) {
+    axis_t* motor = &mount_axes[axis];
+    bool negative = host_gpio_output(motor->dir_pin) == (motor->reverse ? 1 : 0);
+    int freq = host_ledc_output_freq(motor->channel.channel);
+    return negative ? -freq : freq;
+}
+
+/* signed microsteps the axis made beyond its base rate while the pulses ran */
+static double guide(uint8_t axis, uint8_t dir, int32_t millis, int count, int32_t gap_millis) {
+    axis_t* motor = &mount_axes[axis];
+    int base = axis_get_step_freq(motor, base_speeds[axis]);
+    int32_t residualBefore = get_pulse_guiding_residual_steps(axis);
+    uint64_t before = host_ledc_pulses(motor->channel.channel);
+    int64_t start = esp_timer_get_time();
+    int64_t reversed = 0;
+    for (int i = 0; i < count; i ++) {
+        uint64_t pulsesAtStart = host_ledc_pulses(motor->channel.channel);
+        send_pulse(dir, millis);
+        bool negative = output_rate(axis) < 0;
+        host_run_for((millis + gap_millis) * 1000);
+        // a reversal of Dec crosses the lash first, at the burst rate
+        for (int64_t t = 0; is_pulse_guiding() && t < LASH_MICROS; t += STEP_MICROS) host_run_for(STEP_MICROS);
+        CHECK(!is_pulse_guiding());
+        if (negative) reversed += host_ledc_pulses(motor->channel.channel) - pulsesAtStart;
+        uint8_t reply[64];
+        while (host_udp_receive(reply, sizeof(reply)) >= 0);
+    }
+    // whole seconds, the base rate adds a whole number of pulses
+    int64_t elapsed = esp_timer_get_time() - start;
+    int64_t window = (elapsed + 999999) / 1000000 * 1000000;
+    host_run_for(window - elapsed);
+    int64_t pulses = host_ledc_pulses(motor->channel.channel) - before;
+    int64_t delivered = pulses - 2 * reversed - (int64_t)base * window / 1000000;
+    int32_t residualAfter = get_pulse_guiding_residual_steps(axis);
+    // what is still owed is delivered with the next pulse
+    return delivered + residualAfter - residualBefore;
+}
+
+/* what the pulses ask for at the guide rate of the axis, and the lash a Dec reversal crosses first */
+static double requested(uint8_t axis, uint8_t dir, int32_t millis, int count) {
+    int8_t sign = dir_sign(dir);
+    double steps = sign * (double)guideGetStepRate(axis) * millis * count / 1000000;
+    if (axis == GUIDE_AXIS_DEC) {
+        if (last_dec_sign == -sign) steps += sign * mount_constants.dec_backlash_steps;
+        last_dec_sign = sign;
+    }
+    return steps;
+}
+
+/* the guide rate of the snapshot, on top of the base rate while the pulse runs and not after */
+static void test_step_rates() {
+    for (uint8_t axis = 0; axis < GUIDE_AXES; axis ++) {
+        CHECK_EQ(axis_get_step_millihz(&mount_axes[axis], guide_speeds[axis]), guideGetStepRate(axis));
+    }
+    const uint8_t dirs[] = { PULSE_GUIDING_DIR_WEST, PULSE_GUIDING_DIR_EAST, PULSE_GUIDING_DIR_NORTH, PULSE_GUIDING_DIR_SOUTH };
+    for (int d = 0; d < sizeof(dirs); d ++) {
+        uint8_t axis = d < 2 ? GUIDE_AXIS_RA : GUIDE_AXIS_DEC;
+        int base = axis_get_step_freq(&mount_axes[axis], base_speeds[axis]);
+        // a short one first, it takes up the lash of a reversal
+        requested(axis, dirs[d], 20, 1);
+        guide(axis, dirs[d], 20, 1, 100);
+        CHECK_EQ(base, output_rate(axis));
+        send_pulse(dirs[d], 500);
+        host_run_for(100 * 1000);
+        CHECK(is_pulse_guiding());
+        CHECK_EQ(axis_get_step_freq(&mount_axes[axis], base_speeds[axis] + dir_sign(dirs[d]) * guide_speeds[axis]),
+            output_rate(axis));
+        // the other axis goes on at its base rate
+        CHECK_EQ(axis_get_step_freq(&mount_axes[!axis], base_speeds[!axis]), output_rate(!axis));
+        host_run_for(500 * 1000);
+        CHECK(!is_pulse_guiding());
+        CHECK_EQ(base, output_rate(axis));
+        requested(axis, dirs[d], 500, 1);
+    }
+}
+
+static void test_single_pulses() {
+    const int32_t lengths[] = { 1, 2, 5, 10, 20, 35, 50, 100, 250, 500, 1000, 2500 };
+    const uint8_t dirs[] = { PULSE_GUIDING_DIR_WEST, PULSE_GUIDING_DIR_EAST, PULSE_GUIDING_DIR_NORTH, PULSE_GUIDING_DIR_SOUTH };
+    for (int d = 0; d < sizeof(dirs); d ++) {
+        uint8_t axis = d < 2 ? GUIDE_AXIS_RA : GUIDE_AXIS_DEC;
+        for (int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i ++) {
+            double want = requested(axis, dirs[d], lengths[i], 1);
+            double got = guide(axis, dirs[d], lengths[i], 1, 100);
+            // one step for the truncated residual, one for the pulse counter
+            CHECK_NEAR(want, got, 2);
+        }
+    }
+}
+
+/* pulses shorter than one step only add up through the residual carried over */
+static void test_short_pulses_accumulate() {
+    double want = requested(GUIDE_AXIS_RA, PULSE_GUIDING_DIR_WEST, 10, 200);
+    double got = guide(GUIDE_AXIS_RA, PULSE_GUIDING_DIR_WEST, 10, 200, 40);
+    CHECK(want > 100);
+    CHECK_NEAR(want, got, 2);
+
+    want = requested(GUIDE_AXIS_DEC, PULSE_GUIDING_DIR_SOUTH, 3, 300);
+    got = guide(GUIDE_AXIS_DEC, PULSE_GUIDING_DIR_SOUTH, 3, 300, 20);
+    CHECK(want < -50);
+    CHECK_NEAR(want, got, 2);
+}
+
+/* a pulse on a guiding axis is coalesced, the correction of both is delivered */
+static void test_coalesced_pulses() {
+    axis_t* motor = &mount_axes[AXIS_RA];
+    int base = axis_get_step_freq(motor, base_speeds[AXIS_RA]);
+    int32_t residualBefore = get_pulse_guiding_residual_steps(GUIDE_AXIS_RA);
+    uint64_t before = host_ledc_pulses(motor->channel.channel);
+    send_pulse(PULSE_GUIDING_DIR_WEST, 400);
+    host_run_for(150 * 1000);
+    send_pulse(PULSE_GUIDING_DIR_WEST, 300);
+    host_run_for(100 * 1000);
+    send_pulse(PULSE_GUIDING_DIR_EAST, 200);
+    host_run_for(1750 * 1000);
+    CHECK(!is_pulse_guiding());
+    int64_t delivered = host_ledc_pulses(motor->channel.channel) - before - 2 * base
+        + get_pulse_guiding_residual_steps(GUIDE_AXIS_RA) - residualBefore;
+    CHECK_NEAR(requested(GUIDE_AXIS_RA, PULSE_GUIDING_DIR_WEST, 500, 1), delivered, 2);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    const uint8_t tracking[2] = { CMD_SET_TRACKING, 1 };
+    send_command(tracking, sizeof(tracking));
+    send_speed(CMD_SET_RA_GUIDE_SPEED, RA_GUIDE_SPEED);
+    send_speed(CMD_SET_DEC_GUIDE_SPEED, DEC_GUIDE_SPEED);
+    host_run_for(1000000);
+    test_step_rates();
+    test_single_pulses();
+    test_short_pulses_accumulate();
+    test_coalesced_pulses();
+    return host_test_exit();
+}
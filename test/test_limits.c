@@ -0,0 +1,322 @@
+#include <arpa/inet.h>
+#include <math.h>
+#include "host.h"
+#include "astro.h"
+#include "axis.h"
+#include "backlash.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+#include "mount_fsm.h"
+#include "mount_limits.h"
+#include "slew.h"
+#include "telescope.h"
+
+/*
+ * Every soft limit and every switch on a booted mount whose motors turn its
+ * encoders: an axis driven into one stops at the next motion update, not
+ * only when the check timer comes round, may always be driven back out, and
+ * a limit tripping takes the mount from a slew or a backlash calibration.
+ */
+
+/* as a client sends them */
+#define CMD_SET_RA_SPEED 2
+#define CMD_SET_DEC_SPEED 3
+#define CMD_SLEW_TO_TARGET 8
+#define CMD_SET_SIDE_OF_PIER 10
+#define CMD_SYNC_TIME 13
+#define CMD_SET_SITE 14
+#define CMD_CALIBRATE_BACKLASH 20
+#define CMD_SET_LIMITS 27
+
+#define STEP_MICROS 1000
+#define LIMIT_TIMEOUT_MICROS (10 * 1000000)
+/* a check of the limit timer and a bit */
+#define CHECK_MICROS (150 * 1000)
+#define DEGREE_MILLIS (DAY_MILLIS / 360)
+#define MILLIS_TO_RAD(M) ((M) * M_PI * 2 / DAY_MILLIS)
+#define FAST_SPEED 450000
+#define LATITUDE_MILLIS (50 * DEGREE_MILLIS)
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+/* the encoders follow the motors */
+static double motor[MOUNT_AXES];
+static int32_t encoder[MOUNT_AXES];
+
+static void turn_motors(ledc_channel_t channel, uint32_t pulses) {
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        axis_t* axis = &mount_axes[i];
+        if (channel != axis->channel.channel) continue;
+        int offset = i == AXIS_RA ? GEOMETRY_RA_GEAR_RATIO : GEOMETRY_DEC_GEAR_RATIO;
+        double pulsesPerStep = (double)geometry[offset + GEOMETRY_RA_ENCODER_PULSES]
+            / geometry[offset + GEOMETRY_RA_CYCLE_STEPS] / geometry[offset + GEOMETRY_RA_RESOLUTION];
+        bool positive = host_gpio_output(axis->dir_pin) == (axis->reverse ? 0 : 1);
+        motor[i] += (positive ? 1 : -1) * (double)pulses * pulsesPerStep;
+        int32_t turned = (int32_t)floor(motor[i]) - encoder[i];
+        encoder[i] += turned;
+        host_rencoder_turn(&axis->encoder, turned);
+    }
+}
+
+static void send_command(const void* command, size_t len) {
+    CHECK(host_udp_send(command, len));
+    host_run_for(STEP_MICROS);
+    uint8_t reply[64];
+    while (host_udp_receive(reply, sizeof(reply)) >= 0);
+}
+
+static void send_int32s(uint8_t cmd, const int32_t* values, int count) {
+    uint8_t command[1 + 4 * LIMIT_FIELDS] = { cmd };
+    for (int i = 0; i < count; i ++) {
+        *(int32_t*)(command + 1 + 4 * i) = htonl(values[i]);
+    }
+    send_command(command, 1 + 4 * count);
+}
+
+/* a speed command is a motion update of its axis */
+static void set_speed(uint8_t axis, int32_t speed) {
+    send_int32s(axis == AXIS_RA ? CMD_SET_RA_SPEED : CMD_SET_DEC_SPEED, &speed, 1);
+}
+
+static void set_limits(int32_t meridian, int32_t decMin, int32_t decMax, int32_t horizon) {
+    const int32_t values[LIMIT_FIELDS] = { meridian, decMin, decMax, horizon };
+    send_int32s(CMD_SET_LIMITS, values, LIMIT_FIELDS);
+    int32_t stored[LIMIT_FIELDS];
+    get_soft_limits(stored);
+    CHECK(memcmp(values, stored, sizeof(stored)) == 0);
+}
+
+static void set_side(int8_t side) {
+    const uint8_t command[2] = { CMD_SET_SIDE_OF_PIER, side };
+    send_command(command, sizeof(command));
+    CHECK_EQ(side, getSideOfPier());
+}
+
+/* the pointing of an hour angle and dec, tracking off */
+static void point_at(int32_t ha, int32_t dec) {
+    set_angles(wrap_day_millis(get_lst_millis() - ha), dec);
+    host_run_for(CHECK_MICROS);
+}
+
+static int step_freq(uint8_t axis) {
+    return host_ledc_output_freq(mount_axes[axis].channel.channel);
+}
+
+static bool positive_dir(uint8_t axis) {
+    return host_gpio_output(mount_axes[axis].dir_pin) == (mount_axes[axis].reverse ? 0 : 1);
+}
+
+static int32_t limit(int field) {
+    int32_t values[LIMIT_FIELDS];
+    get_soft_limits(values);
+    return values[field];
+}
+
+static bool past_dec_max() {
+    return get_dec_mechnical_angle_millis() >= limit(LIMIT_FIELD_DEC_MAX);
+}
+
+static bool past_dec_min() {
+    return get_dec_mechnical_angle_millis() <= limit(LIMIT_FIELD_DEC_MIN);
+}
+
+static bool past_meridian() {
+    int32_t ha = get_hour_angle_millis(get_ra_angle_millis());
+    return getSideOfPier() == 0 ? ha <= -limit(LIMIT_FIELD_MERIDIAN) : ha >= limit(LIMIT_FIELD_MERIDIAN);
+}
+
+static bool past_horizon() {
+    double ha = MILLIS_TO_RAD(get_hour_angle_millis(get_ra_angle_millis()));
+    double dec = MILLIS_TO_RAD(get_dec_angle_millis());
+    double lat = MILLIS_TO_RAD(get_site_latitude_millis());
+    double sinAlt = sin(lat) * sin(dec) + cos(lat) * cos(dec) * cos(ha);
+    return sinAlt <= sin(MILLIS_TO_RAD(limit(LIMIT_FIELD_HORIZON)));
+}
+
+static bool run_until(bool (*condition)(), bool expected) {
+    for (int64_t t = 0; t < LIMIT_TIMEOUT_MICROS && condition() != expected; t += STEP_MICROS) {
+        host_run_for(STEP_MICROS);
+    }
+    return condition() == expected;
+}
+
+/*
+ * Drives the axis at speed into the limit past() tells, stopped by the very
+ * next motion update, then back out at -speed.
+ */
+static void check_limit(const char* name, uint8_t axis, int32_t speed, bool (*past)(), uint8_t flag) {
+    printf("%s\n", name);
+    CHECK(!past());
+    set_speed(axis, speed);
+    CHECK(step_freq(axis) != 0);
+    CHECK(run_until(past, true));
+    set_speed(axis, speed);
+    CHECK_EQ(0, step_freq(axis));
+    host_run_for(CHECK_MICROS);
+    CHECK(get_active_limits() & flag);
+    CHECK_EQ(MOUNT_STATE_FAULT, get_mount_fsm_state());
+    CHECK_EQ(0, step_freq(axis));
+
+    // further in stays refused, the way out is open
+    set_speed(axis, speed);
+    CHECK_EQ(0, step_freq(axis));
+    set_speed(axis, -speed);
+    CHECK(step_freq(axis) != 0);
+    CHECK_EQ(speed < 0, positive_dir(axis));
+    CHECK(run_until(past, false));
+    host_run_for(CHECK_MICROS);
+    set_speed(axis, 0);
+    CHECK(!(get_active_limits() & flag));
+    CHECK(mount_fsm_accepts(MOUNT_EVENT_SLEW_START));
+}
+
+static void test_soft_limits() {
+    // the dec limits do without the clock
+    point_at(0, 20 * DEGREE_MILLIS);
+    int32_t decMec = get_dec_mechnical_angle_millis();
+    set_limits(CONFIG_LIMIT_MERIDIAN_MINUTES * 60 * 1000, decMec - DEGREE_MILLIS / 5, decMec + DEGREE_MILLIS / 5,
+        CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS);
+    check_limit("dec max", AXIS_DEC, FAST_SPEED, past_dec_max, LIMIT_DEC);
+    check_limit("dec min", AXIS_DEC, -FAST_SPEED, past_dec_min, LIMIT_DEC);
+
+    const uint8_t site[9] = { CMD_SET_SITE };
+    *(int32_t*)(site + 1) = htonl(LATITUDE_MILLIS);
+    send_command(site, sizeof(site));
+    uint8_t time[13] = { CMD_SYNC_TIME };
+    int64_t utc = 1790000000LL * 1000000;
+    *(uint32_t*)(time + 1) = htonl((uint32_t)(utc >> 32));
+    *(uint32_t*)(time + 5) = htonl((uint32_t)utc);
+    send_command(time, sizeof(time));
+    CHECK(is_time_synced());
+    set_limits(CONFIG_LIMIT_MERIDIAN_MINUTES * 60 * 1000, CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS,
+        CONFIG_LIMIT_DEC_MAX_DEGREES * DEGREE_MILLIS, CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS);
+
+    // east past the meridian on the normal side, west past it beyond the pole
+    int32_t meridian = limit(LIMIT_FIELD_MERIDIAN);
+    point_at(-meridian + DEGREE_MILLIS / 5, 20 * DEGREE_MILLIS);
+    check_limit("meridian, normal side", AXIS_RA, -FAST_SPEED, past_meridian, LIMIT_MERIDIAN);
+    set_side(1);
+    point_at(meridian - DEGREE_MILLIS / 5, 20 * DEGREE_MILLIS);
+    check_limit("meridian, beyond the pole", AXIS_RA, FAST_SPEED, past_meridian, LIMIT_MERIDIAN);
+    set_side(0);
+
+    // low in the west, the hour angle and dec both take the altitude down
+    point_at(85 * DEGREE_MILLIS, 0);
+    set_limits(meridian, CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS, CONFIG_LIMIT_DEC_MAX_DEGREES * DEGREE_MILLIS,
+        3 * DEGREE_MILLIS);
+    check_limit("horizon, ra", AXIS_RA, FAST_SPEED, past_horizon, LIMIT_HORIZON);
+    point_at(85 * DEGREE_MILLIS, 0);
+    check_limit("horizon, dec", AXIS_DEC, -FAST_SPEED, past_horizon, LIMIT_HORIZON);
+    set_limits(meridian, CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS, CONFIG_LIMIT_DEC_MAX_DEGREES * DEGREE_MILLIS,
+        CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS);
+}
+
+static const gpio_num_t switch_pins[MOUNT_AXES] = {
+    [AXIS_RA] = CONFIG_GPIO_LIMIT_SWITCH_RA,
+    [AXIS_DEC] = CONFIG_GPIO_LIMIT_SWITCH_DEC,
+};
+
+static void release_switch(uint8_t axis) {
+    host_gpio_input(switch_pins[axis], 1);
+    host_run_for(CHECK_MICROS);
+    CHECK_EQ(0, get_active_limits());
+    set_speed(axis, FAST_SPEED);
+    CHECK(step_freq(axis) != 0);
+    set_speed(axis, -FAST_SPEED);
+    CHECK(step_freq(axis) != 0);
+    set_speed(axis, 0);
+}
+
+/* running into a switch blocks the way in, a standing axis either way */
+static void test_switches() {
+    point_at(0, 20 * DEGREE_MILLIS);
+    for (uint8_t axis = 0; axis < MOUNT_AXES; axis ++) {
+        uint8_t flag = axis == AXIS_RA ? LIMIT_SWITCH_RA : LIMIT_SWITCH_DEC;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            printf("%s switch, %s\n", mount_axes[axis].name, sign > 0 ? "positive" : "negative");
+            set_speed(axis, sign * FAST_SPEED);
+            host_run_for(STEP_MICROS);
+            host_gpio_input(switch_pins[axis], 0);
+            // the driver goes off in the isr
+            CHECK_EQ(1, host_gpio_output(mount_axes[axis].en_pin));
+            set_speed(axis, sign * FAST_SPEED);
+            CHECK_EQ(0, step_freq(axis));
+            host_run_for(CHECK_MICROS);
+            CHECK(get_active_limits() & flag);
+            CHECK_EQ(0, step_freq(axis));
+            set_speed(axis, -sign * FAST_SPEED);
+            CHECK(step_freq(axis) != 0);
+            CHECK_EQ(0, host_gpio_output(mount_axes[axis].en_pin));
+            CHECK_EQ(sign < 0, positive_dir(axis));
+            set_speed(axis, 0);
+            release_switch(axis);
+        }
+
+        printf("%s switch, standing\n", mount_axes[axis].name);
+        host_gpio_input(switch_pins[axis], 0);
+        host_run_for(CHECK_MICROS);
+        CHECK(get_active_limits() & flag);
+        set_speed(axis, FAST_SPEED);
+        CHECK_EQ(0, step_freq(axis));
+        set_speed(axis, -FAST_SPEED);
+        CHECK_EQ(0, step_freq(axis));
+        set_speed(axis, 0);
+        release_switch(axis);
+    }
+}
+
+/* a tripped limit takes the motors from whatever drove them there */
+static void test_aborts() {
+    printf("slew into dec max\n");
+    point_at(0, 20 * DEGREE_MILLIS);
+    int32_t decMec = get_dec_mechnical_angle_millis();
+    int32_t meridian = limit(LIMIT_FIELD_MERIDIAN);
+    set_limits(meridian, CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS, decMec + DEGREE_MILLIS / 2,
+        CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS);
+    const int32_t target[2] = { get_ra_angle_millis(), get_dec_angle_millis() + 2 * DEGREE_MILLIS };
+    send_int32s(CMD_SLEW_TO_TARGET, target, 2);
+    CHECK(is_slewing());
+    CHECK(run_until(is_slewing, false));
+    CHECK(get_active_limits() & LIMIT_DEC);
+    CHECK_EQ(MOUNT_STATE_FAULT, get_mount_fsm_state());
+    CHECK_EQ(0, step_freq(AXIS_DEC));
+    CHECK(past_dec_max());
+    set_speed(AXIS_DEC, -FAST_SPEED);
+    CHECK(run_until(past_dec_max, false));
+    host_run_for(CHECK_MICROS);
+    set_speed(AXIS_DEC, 0);
+    set_limits(meridian, CONFIG_LIMIT_DEC_MIN_DEGREES * DEGREE_MILLIS, CONFIG_LIMIT_DEC_MAX_DEGREES * DEGREE_MILLIS,
+        CONFIG_LIMIT_HORIZON_DEGREES * DEGREE_MILLIS);
+    host_run_for(CHECK_MICROS);
+    CHECK_EQ(0, get_active_limits());
+
+    printf("switch under a backlash calibration\n");
+    const uint8_t calibrate[2] = { CMD_CALIBRATE_BACKLASH, BACKLASH_AXIS_DEC };
+    send_command(calibrate, sizeof(calibrate));
+    CHECK(is_calibrating_backlash());
+    CHECK_EQ(MOUNT_STATE_CALIBRATING, get_mount_fsm_state());
+    host_run_for(500 * 1000);
+    host_gpio_input(switch_pins[AXIS_DEC], 0);
+    host_run_for(CHECK_MICROS);
+    CHECK(!is_calibrating_backlash());
+    CHECK_EQ(MOUNT_STATE_FAULT, get_mount_fsm_state());
+    CHECK_EQ(0, step_freq(AXIS_DEC));
+    release_switch(AXIS_DEC);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_ledc_on_pulses(turn_motors);
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    test_soft_limits();
+    test_switches();
+    test_aborts();
+    return host_test_exit();
+}
@@ -0,0 +1,155 @@
+#include <arpa/inet.h>
+#include <math.h>
+#include "host.h"
+#include "astro.h"
+#include "axis.h"
+#include "mount_config.h"
+#include "mount_encoder.h"
+#include "mount_fsm.h"
+#include "slew.h"
+#include "telescope.h"
+
+/*
+ * The automatic meridian flip on a booted mount whose motors turn its
+ * encoders: tracking beyond the pole past MERIDIAN_FLIP_MINUTES flips to
+ * the normal side, slewFlipped relabels RA so the mount points at the same
+ * star, tracking goes on, and the flip takes no longer than 12h of RA at
+ * the flip speed.
+ */
+
+/* as a client sends them */
+#define CMD_SET_TRACKING 1
+#define CMD_SET_SIDE_OF_PIER 10
+#define CMD_SYNC_TIME 13
+#define CMD_SET_SITE 14
+
+#define STEP_MICROS 1000
+#define WAIT_STEP_MICROS (100 * 1000)
+#define DEGREE_MILLIS (DAY_MILLIS / 360)
+#define MINUTE_MILLIS (60 * 1000)
+#define FLIP_CYCLES_PER_DAY (RA_SPEED_MAX / SPEED_PER_CYCLE)
+/* 12h of RA at the flip speed, and the slowing down on the last few degrees */
+#define FLIP_MICROS ((int64_t)DAY_MILLIS / 2 * 1000 / FLIP_CYCLES_PER_DAY)
+#define APPROACH_MICROS (60 * 1000000)
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+/* the encoders follow the motors */
+static double motor[MOUNT_AXES];
+static int32_t encoder[MOUNT_AXES];
+
+static void turn_motors(ledc_channel_t channel, uint32_t pulses) {
+    uint32_t geometry[GEOMETRY_FIELDS];
+    get_mount_geometry(geometry);
+    for (int i = 0; i < MOUNT_AXES; i ++) {
+        axis_t* axis = &mount_axes[i];
+        if (channel != axis->channel.channel) continue;
+        int offset = i == AXIS_RA ? GEOMETRY_RA_GEAR_RATIO : GEOMETRY_DEC_GEAR_RATIO;
+        double pulsesPerStep = (double)geometry[offset + GEOMETRY_RA_ENCODER_PULSES]
+            / geometry[offset + GEOMETRY_RA_CYCLE_STEPS] / geometry[offset + GEOMETRY_RA_RESOLUTION];
+        bool positive = host_gpio_output(axis->dir_pin) == (axis->reverse ? 0 : 1);
+        motor[i] += (positive ? 1 : -1) * (double)pulses * pulsesPerStep;
+        int32_t turned = (int32_t)floor(motor[i]) - encoder[i];
+        encoder[i] += turned;
+        host_rencoder_turn(&axis->encoder, turned);
+    }
+}
+
+static void send_command(const void* command, size_t len) {
+    CHECK(host_udp_send(command, len));
+    host_run_for(STEP_MICROS);
+    uint8_t reply[64];
+    while (host_udp_receive(reply, sizeof(reply)) >= 0);
+}
+
+static void sync_clock_and_site() {
+    uint8_t site[9] = { CMD_SET_SITE };
+    *(int32_t*)(site + 1) = htonl(50 * DEGREE_MILLIS);
+    send_command(site, sizeof(site));
+    uint8_t time[13] = { CMD_SYNC_TIME };
+    int64_t utc = 1790000000LL * 1000000;
+    *(uint32_t*)(time + 1) = htonl((uint32_t)(utc >> 32));
+    *(uint32_t*)(time + 5) = htonl((uint32_t)utc);
+    send_command(time, sizeof(time));
+    CHECK(is_time_synced());
+}
+
+static int32_t hour_angle() {
+    return get_hour_angle_millis(get_ra_angle_millis());
+}
+
+static bool positive_ra_dir() {
+    axis_t* axis = &mount_axes[AXIS_RA];
+    return host_gpio_output(axis->dir_pin) == (axis->reverse ? 0 : 1);
+}
+
+static bool wait_for_slewing(bool slewing, int64_t timeout) {
+    for (int64_t t = 0; t < timeout && is_slewing() != slewing; t += WAIT_STEP_MICROS) {
+        host_run_for(WAIT_STEP_MICROS);
+    }
+    return is_slewing() == slewing;
+}
+
+static void test_flip() {
+    sync_clock_and_site();
+    const uint8_t side[2] = { CMD_SET_SIDE_OF_PIER, 1 };
+    send_command(side, sizeof(side));
+    CHECK_EQ(1, getSideOfPier());
+    // a minute before the flip, beyond the pole
+    const int32_t dec = 20 * DEGREE_MILLIS;
+    set_angles(wrap_day_millis(get_lst_millis() - (CONFIG_MERIDIAN_FLIP_MINUTES - 1) * MINUTE_MILLIS), dec);
+    const uint8_t tracking[2] = { CMD_SET_TRACKING, 1 };
+    send_command(tracking, sizeof(tracking));
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+    int32_t ra = get_ra_angle_millis();
+    CHECK_EQ(DAY_MILLIS / 2 - dec, get_dec_mechnical_angle_millis());
+
+    // tracking holds the star until the hour angle gets to the flip
+    CHECK(wait_for_slewing(true, 2 * MINUTE_MILLIS * 1000LL));
+    int64_t flipStarted = esp_timer_get_time();
+    CHECK(is_meridian_flipping());
+    CHECK_EQ(MOUNT_STATE_SLEWING, get_mount_fsm_state());
+    CHECK(hour_angle() >= CONFIG_MERIDIAN_FLIP_MINUTES * MINUTE_MILLIS);
+    CHECK(hour_angle() < CONFIG_MERIDIAN_FLIP_MINUTES * MINUTE_MILLIS + 2 * 1000);
+    CHECK_NEAR(ra, get_ra_angle_millis(), 1000);
+    // back through counterweight-down at the flip speed
+    CHECK(!positive_ra_dir());
+
+    CHECK(wait_for_slewing(false, FLIP_MICROS + 2 * APPROACH_MICROS));
+    int64_t downtime = esp_timer_get_time() - flipStarted;
+    printf("meridian flip took %.1f min, 12h at the flip speed are %.1f min\n", downtime / 60e6, FLIP_MICROS / 60e6);
+    CHECK(downtime >= FLIP_MICROS - WAIT_STEP_MICROS);
+    CHECK(downtime <= FLIP_MICROS + APPROACH_MICROS);
+    CHECK(!is_meridian_flipping());
+
+    // the normal side, relabelled to the same star, and tracking on
+    CHECK_EQ(0, getSideOfPier());
+    CHECK_NEAR(ra, get_ra_angle_millis(), 2000);
+    CHECK_NEAR(dec, get_dec_angle_millis(), 2000);
+    CHECK_NEAR(dec, get_dec_mechnical_angle_millis(), 2000);
+    CHECK(hour_angle() > -CONFIG_MERIDIAN_FLIP_MINUTES * MINUTE_MILLIS);
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+    host_run_for(WAIT_STEP_MICROS);
+    CHECK_EQ(axis_get_step_freq(&mount_axes[AXIS_RA], SPEED_PER_CYCLE),
+        host_ledc_output_freq(mount_axes[AXIS_RA].channel.channel));
+
+    // and stays there, tracking on past the meridian again is no flip; the encoders
+    // here have no lash, what the firmware takes up after the reversal is lost
+    host_run_for(10 * MINUTE_MILLIS * 1000LL);
+    CHECK(!is_slewing());
+    CHECK_EQ(0, getSideOfPier());
+    CHECK_NEAR(ra, get_ra_angle_millis(), 2000 + RA_PULSES_MILLIS(mount_constants.ra_backlash_pulses));
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_ledc_on_pulses(turn_motors);
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    test_flip();
+    return host_test_exit();
+}
@@ -0,0 +1,191 @@
+#include <arpa/inet.h>
+#include "host.h"
+#include "guide.h"
+#include "mount_fsm.h"
+#include "mount_snapshot.h"
+
+/*
+ * Every state, event and tracking flag through mount_fsm_next() against
+ * the rules of mount_fsm.h written out once more, the published state
+ * taking the same transitions, and pulse guiding on a booted mount leaving
+ * the guiding state behind whether the pulse starts or not.
+ */
+
+/* as a client sends it */
+#define CMD_PULSE_GUIDING 4
+
+#define STEP_MICROS 1000
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static uint8_t expected_next(uint8_t state, uint8_t event, bool tracking) {
+    uint8_t base = tracking ? MOUNT_STATE_TRACKING : MOUNT_STATE_IDLE;
+    if (state >= MOUNT_STATES || event >= MOUNT_EVENTS) return MOUNT_STATE_REFUSED;
+    if (event == MOUNT_EVENT_LIMIT_TRIPPED) return MOUNT_STATE_FAULT;
+    switch (state) {
+        case MOUNT_STATE_IDLE:
+        case MOUNT_STATE_TRACKING:
+            switch (event) {
+                case MOUNT_EVENT_TRACKING_ON: return MOUNT_STATE_TRACKING;
+                case MOUNT_EVENT_TRACKING_OFF: return MOUNT_STATE_IDLE;
+                case MOUNT_EVENT_GUIDE_START: return MOUNT_STATE_GUIDING;
+                case MOUNT_EVENT_SLEW_START: return MOUNT_STATE_SLEWING;
+                case MOUNT_EVENT_CALIBRATE_START: return MOUNT_STATE_CALIBRATING;
+                default: return state;
+            }
+        case MOUNT_STATE_GUIDING:
+            // tracking changes under a pulse, nothing takes the motors from it
+            switch (event) {
+                case MOUNT_EVENT_GUIDE_END: return base;
+                case MOUNT_EVENT_SLEW_START:
+                case MOUNT_EVENT_CALIBRATE_START: return MOUNT_STATE_REFUSED;
+                default: return state;
+            }
+        case MOUNT_STATE_SLEWING:
+        case MOUNT_STATE_CALIBRATING:
+            // only their own end, stale ends and the limits get through
+            switch (event) {
+                case MOUNT_EVENT_SLEW_END: return state == MOUNT_STATE_SLEWING ? base : state;
+                case MOUNT_EVENT_CALIBRATE_END: return state == MOUNT_STATE_CALIBRATING ? base : state;
+                case MOUNT_EVENT_GUIDE_END:
+                case MOUNT_EVENT_LIMITS_CLEARED: return state;
+                default: return MOUNT_STATE_REFUSED;
+            }
+        case MOUNT_STATE_FAULT:
+            // out by the client moving the mount or the limits clearing, not by a pulse or a calibration
+            switch (event) {
+                case MOUNT_EVENT_TRACKING_ON: return MOUNT_STATE_TRACKING;
+                case MOUNT_EVENT_TRACKING_OFF: return MOUNT_STATE_IDLE;
+                case MOUNT_EVENT_MOVE:
+                case MOUNT_EVENT_LIMITS_CLEARED: return base;
+                case MOUNT_EVENT_SLEW_START: return MOUNT_STATE_SLEWING;
+                case MOUNT_EVENT_GUIDE_START:
+                case MOUNT_EVENT_CALIBRATE_START: return MOUNT_STATE_REFUSED;
+                default: return state;
+            }
+    }
+    return MOUNT_STATE_REFUSED;
+}
+
+/* one past the ends and the top of the range as well */
+static void test_table() {
+    for (int state = 0; state <= MOUNT_STATES; state ++) {
+        for (int event = 0; event <= MOUNT_EVENTS; event ++) {
+            for (int tracking = 0; tracking < 2; tracking ++) {
+                uint8_t next = mount_fsm_next(state, event, tracking);
+                uint8_t expected = expected_next(state, event, tracking);
+                if (next != expected) printf("state %d event %d tracking %d\n", state, event, tracking);
+                CHECK_EQ(expected, next);
+                CHECK(next < MOUNT_STATES || next == MOUNT_STATE_REFUSED);
+            }
+        }
+    }
+    CHECK_EQ(MOUNT_STATE_REFUSED, mount_fsm_next(0xff, MOUNT_EVENT_TRACKING_ON, true));
+    CHECK_EQ(MOUNT_STATE_REFUSED, mount_fsm_next(MOUNT_STATE_IDLE, 0xff, true));
+}
+
+static void publish(uint8_t state, int8_t tracking) {
+    mount_snapshot_t* snapshot = mount_snapshot_write_begin();
+    snapshot->state = state;
+    snapshot->tracking = tracking;
+    mount_snapshot_write_end();
+}
+
+/* dispatch, accepts and set_tracking on the published state follow the table */
+static void test_published() {
+    for (uint8_t state = 0; state < MOUNT_STATES; state ++) {
+        for (uint8_t event = 0; event < MOUNT_EVENTS; event ++) {
+            for (int8_t tracking = -1; tracking <= 1; tracking ++) {
+                uint8_t next = mount_fsm_next(state, event, tracking != 0);
+                publish(state, tracking);
+                CHECK_EQ(next != MOUNT_STATE_REFUSED, mount_fsm_accepts(event));
+                CHECK_EQ(state, get_mount_fsm_state());
+                CHECK_EQ(next != MOUNT_STATE_REFUSED, mount_fsm_dispatch(event));
+                CHECK_EQ(next != MOUNT_STATE_REFUSED ? next : state, get_mount_fsm_state());
+            }
+            int8_t newTracking = event % 3 - 1;
+            for (int8_t tracking = -1; tracking <= 1; tracking ++) {
+                uint8_t next = mount_fsm_next(state, newTracking ? MOUNT_EVENT_TRACKING_ON : MOUNT_EVENT_TRACKING_OFF, tracking != 0);
+                publish(state, tracking);
+                CHECK_EQ(next != MOUNT_STATE_REFUSED, mount_fsm_set_tracking(newTracking));
+                mount_snapshot_t snapshot;
+                get_mount_snapshot(&snapshot);
+                CHECK_EQ(next != MOUNT_STATE_REFUSED ? next : state, snapshot.state);
+                CHECK_EQ(next != MOUNT_STATE_REFUSED ? newTracking : tracking, snapshot.tracking);
+            }
+        }
+    }
+    publish(MOUNT_STATE_IDLE, 0);
+}
+
+static void send_pulse(uint8_t dir, int16_t millis) {
+    uint8_t command[4] = { CMD_PULSE_GUIDING, dir };
+    *(int16_t*)(command + 2) = htons(millis);
+    CHECK(host_udp_send(command, sizeof(command)));
+    host_run_for(STEP_MICROS);
+}
+
+/* a pulse guide_pulse() refuses is no guiding, and does not end one that runs */
+static void test_refused_pulse() {
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    CHECK(mount_fsm_set_tracking(1));
+
+    send_pulse(PULSE_GUIDING_DIR_WEST, 0);
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+    send_pulse(0x7f, 200);
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+
+    send_pulse(PULSE_GUIDING_DIR_NORTH, 500);
+    CHECK_EQ(MOUNT_STATE_GUIDING, get_mount_fsm_state());
+    send_pulse(PULSE_GUIDING_DIR_EAST, -5);
+    CHECK(is_pulse_guiding());
+    CHECK_EQ(MOUNT_STATE_GUIDING, get_mount_fsm_state());
+    host_run_for(1000 * 1000);
+    CHECK(!is_pulse_guiding());
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+
+    CHECK(mount_fsm_set_tracking(0));
+    send_pulse(PULSE_GUIDING_DIR_SOUTH, 0);
+    CHECK_EQ(MOUNT_STATE_IDLE, get_mount_fsm_state());
+}
+
+/*
+ * The guide timer and the command task race on the end of guiding: the
+ * state follows whether a pulse runs as the transition is taken, not as
+ * either of them looked before.
+ */
+static void test_follow_guiding() {
+    CHECK(mount_fsm_set_tracking(1));
+    send_pulse(PULSE_GUIDING_DIR_WEST, 500);
+    CHECK(is_pulse_guiding());
+    CHECK_EQ(MOUNT_STATE_GUIDING, get_mount_fsm_state());
+    // the end of a pulse that has been extended meanwhile keeps guiding
+    CHECK(mount_fsm_follow_guiding());
+    CHECK_EQ(MOUNT_STATE_GUIDING, get_mount_fsm_state());
+    // guiding ended just before the pulse started, it guides again
+    publish(MOUNT_STATE_TRACKING, 1);
+    CHECK(mount_fsm_follow_guiding());
+    CHECK_EQ(MOUNT_STATE_GUIDING, get_mount_fsm_state());
+    host_run_for(1000 * 1000);
+    CHECK(!is_pulse_guiding());
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+    // and a slew is not guiding because of a pulse that ended
+    publish(MOUNT_STATE_SLEWING, 1);
+    CHECK(mount_fsm_follow_guiding());
+    CHECK_EQ(MOUNT_STATE_SLEWING, get_mount_fsm_state());
+    publish(MOUNT_STATE_TRACKING, 1);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    test_table();
+    test_published();
+    test_refused_pulse();
+    test_follow_guiding();
+    return host_test_exit();
+}
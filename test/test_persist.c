@@ -0,0 +1,170 @@
+#include "host.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "persist.h"
+
+/*
+ * The mount state journal, first on its own: a reboot after the last
+ * record was torn or lost by a power cut recovers the state before it, and
+ * the journal goes on from there. Then on a booted mount: it is written to
+ * flash on a regular basis, never from the esp_timer task, where a flash
+ * write would hold every other timer for the milliseconds it stalls the
+ * cache, and a tracking session writes little more than the bytes that
+ * changed.
+ */
+
+/* as a client sends it */
+#define CMD_SET_TRACKING 1
+
+#define PERSIST_NAMESPACE "mount"
+#define JOURNAL_SLOTS 32
+#define INTERVAL_MICROS (CONFIG_PERSIST_INTERVAL_SECONDS * 1000000LL)
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static void check_state(const int32_t* expected, const int32_t* actual) {
+    for (int i = 0; i < PERSIST_FIELDS; i ++) {
+        if (expected[i] != actual[i]) printf("field %d\n", i);
+        CHECK_EQ(expected[i], actual[i]);
+    }
+}
+
+/* a reboot of the journal, the state it recovers */
+static void reboot(int32_t* values) {
+    uint32_t mask;
+    CHECK_EQ(ESP_OK, init_persist(values, &mask));
+    CHECK_EQ(PERSIST_ALL_FIELDS, mask);
+}
+
+/* tracking for an interval, and a guide speed change every few */
+static void tick(int32_t* state, int n) {
+    state[PERSIST_RA_PULSES] += 1234 + n;
+    state[PERSIST_ELAPSED] += CONFIG_PERSIST_INTERVAL_SECONDS;
+    if (n % 3 == 0) state[PERSIST_RA_GUIDE_SPEED] += 750;
+    host_run_for(INTERVAL_MICROS);
+    persist_tick(state);
+}
+
+/* the slot holding the record with the highest sequence, its key and bytes */
+static size_t last_record(nvs_handle handle, char* key, uint8_t* record, size_t size) {
+    uint32_t best = 0;
+    size_t bestLen = 0;
+    for (int slot = 0; slot < JOURNAL_SLOTS; slot ++) {
+        char slotKey[8];
+        uint8_t blob[64];
+        size_t len = sizeof(blob);
+        sprintf(slotKey, "j%02d", slot);
+        if (nvs_get_blob(handle, slotKey, blob, &len) != ESP_OK) continue;
+        // the sequence number leads, a varint
+        uint32_t seq = 0;
+        for (int i = 0; i < 5 && i < len; i ++) {
+            seq |= (uint32_t)(blob[i] & 0x7f) << (7 * i);
+            if (!(blob[i] & 0x80)) break;
+        }
+        if (seq < best || len > size) continue;
+        best = seq;
+        bestLen = len;
+        strcpy(key, slotKey);
+        memcpy(record, blob, len);
+    }
+    return bestLen;
+}
+
+typedef enum { TORN, LOST } damage_t;
+
+/* a power cut in the middle of writing the last record */
+static void damage_last_record(damage_t damage) {
+    nvs_handle handle;
+    CHECK_EQ(ESP_OK, nvs_open(PERSIST_NAMESPACE, NVS_READWRITE, &handle));
+    char key[8];
+    uint8_t record[64];
+    size_t len = last_record(handle, key, record, sizeof(record));
+    CHECK(len > 2);
+    if (damage == TORN) {
+        // the last delta cut short
+        CHECK_EQ(ESP_OK, nvs_set_blob(handle, key, record, len - 1));
+    } else {
+        CHECK_EQ(ESP_OK, nvs_erase_key(handle, key));
+    }
+    CHECK_EQ(ESP_OK, nvs_commit(handle));
+    nvs_close(handle);
+}
+
+static void test_damaged_record(damage_t damage) {
+    printf("%s last record\n", damage == TORN ? "torn" : "lost");
+    CHECK_EQ(ESP_OK, nvs_flash_erase());
+    int32_t state[PERSIST_FIELDS], before[PERSIST_FIELDS], recovered[PERSIST_FIELDS];
+    uint32_t mask;
+    CHECK_EQ(ESP_OK, init_persist(recovered, &mask));
+    CHECK_EQ(0, mask);
+    for (int i = 0; i < PERSIST_FIELDS; i ++) state[i] = 1000 * i - 3000;
+    int n = 0;
+    // a snapshot, then records, one ring and a bit so the damaged record follows a compaction
+    for (; n < JOURNAL_SLOTS + 5; n ++) {
+        memcpy(before, state, sizeof(state));
+        tick(state, n);
+    }
+    reboot(recovered);
+    check_state(state, recovered);
+
+    damage_last_record(damage);
+    reboot(recovered);
+    check_state(before, recovered);
+
+    // the journal goes on from the recovered state, the damaged record does not come back
+    memcpy(state, recovered, sizeof(state));
+    for (int i = 0; i < 3; i ++, n ++) tick(state, n);
+    reboot(recovered);
+    check_state(state, recovered);
+}
+
+static void test_booted() {
+    CHECK_EQ(ESP_OK, nvs_flash_erase());
+    persist_stats_t stats, boot;
+    get_persist_stats(&boot);
+    host_start(main_task);
+    host_run_for((CONFIG_PERSIST_INTERVAL_SECONDS + 2) * 1000000LL);
+    get_persist_stats(&stats);
+    // the first tick compacts into a snapshot, nothing was there to replay
+    CHECK_EQ(0, stats.replayed);
+    CHECK_EQ(boot.snapshots + 1, stats.snapshots);
+    int commits = host_nvs_commits();
+    CHECK(commits > 0);
+
+    // tracking moves the ra pulses, a record every interval
+    const uint8_t tracking[2] = { CMD_SET_TRACKING, 1 };
+    CHECK(host_udp_send(tracking, sizeof(tracking)));
+    host_run_for(3 * INTERVAL_MICROS);
+    get_persist_stats(&stats);
+    CHECK(stats.records >= boot.records + 2);
+    CHECK(host_nvs_commits() >= commits + 2);
+    CHECK_EQ(0, host_nvs_timer_writes());
+
+    // an hour of it, compactions included: against the bytes that changed, and a full state every time
+    persist_stats_t start;
+    get_persist_stats(&start);
+    host_run_for(3600 * 1000000LL);
+    get_persist_stats(&stats);
+    uint32_t writes = stats.records + stats.snapshots - start.records - start.snapshots;
+    uint32_t bytes = stats.bytes - start.bytes;
+    uint32_t changed = stats.changed_bytes - start.changed_bytes;
+    printf("an hour of tracking: %u writes, %u bytes for %u changed, a full state each would be %u\n",
+        writes, bytes, changed, writes * (uint32_t)(PERSIST_FIELDS * sizeof(int32_t)));
+    CHECK(writes >= 3600 / CONFIG_PERSIST_INTERVAL_SECONDS - 1);
+    CHECK(changed > 0);
+    CHECK(bytes <= 2 * changed);
+    CHECK(bytes * 4 <= writes * PERSIST_FIELDS * sizeof(int32_t));
+    CHECK_EQ(0, host_nvs_timer_writes());
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    test_damaged_record(TORN);
+    test_damaged_record(LOST);
+    test_booted();
+    return host_test_exit();
+}
@@ -0,0 +1,182 @@
+#include <math.h>
+#include "host.h"
+#include "astro.h"
+#include "pointing.h"
+
+/*
+ * The pointing fit against synthetic TPoint data: sync points whose mount
+ * positions are made from known terms through the model equations, which
+ * the fit has to give back, and the corrections it applies from then on.
+ */
+
+#define DEGREES(d) ((int32_t)((d) * (DAY_MILLIS / 360)))
+#define ARCMIN(m) ((int32_t)((m) * (DAY_MILLIS / 360 / 60)))
+#define MILLIS_TO_RAD(m) ((double)(m) * (2 * M_PI) / DAY_MILLIS)
+#define RAD_TO_MILLIS(r) ((r) * DAY_MILLIS / (2 * M_PI))
+
+#define LATITUDE DEGREES(50)
+/* 2026-10-19T21:00:00Z */
+#define UTC_MICROS 1792443600000000LL
+
+static const char* term_names[POINTING_TERMS] = { "IH", "ID", "ME", "MA", "CH", "NP", "TF" };
+
+typedef struct {
+    double ha, dec; // degrees
+    uint8_t sideOfPier;
+} sync_t;
+
+/* both sides of the pier, over the sky a session would cover */
+static const sync_t syncs[] = {
+    { -60, 10, 0 }, { -30, 45, 0 }, { -10, 75, 0 }, { 20, -20, 1 },
+    { 45, 30, 1 }, { 70, 60, 1 }, { -45, -10, 0 }, { 5, 20, 1 },
+    { 35, 85, 1 }, { -80, 40, 0 }, { 60, 5, 1 }, { -20, -25, 0 },
+};
+#define SYNCS (sizeof(syncs) / sizeof(syncs[0]))
+
+/* mount - sky of the model in the header of pointing.c, for terms in millis */
+static void tpoint(const int32_t* terms, double ha, double dec, uint8_t sideOfPier, double* dh, double* dd) {
+    double h = ha * M_PI / 180, d = dec * M_PI / 180, f = MILLIS_TO_RAD(LATITUDE);
+    double p = sideOfPier ? -1 : 1;
+    double t[POINTING_TERMS];
+    for (int i = 0; i < POINTING_TERMS; i ++) t[i] = terms[i];
+    double arc = t[POINTING_IH] * cos(d) + t[POINTING_ME] * sin(h) * sin(d) - t[POINTING_MA] * cos(h) * sin(d)
+        + p * t[POINTING_CH] + p * t[POINTING_NP] * sin(d) + t[POINTING_TF] * cos(f) * sin(h);
+    *dh = arc / cos(d);
+    *dd = t[POINTING_ID] + t[POINTING_ME] * cos(h) + t[POINTING_MA] * sin(h)
+        + t[POINTING_TF] * (cos(f) * cos(h) * sin(d) - sin(f) * cos(d));
+}
+
+static int32_t sky_ra(double ha) {
+    return wrap_day_millis(get_lst_millis() - (int32_t)(ha * (DAY_MILLIS / 360)));
+}
+
+/* a repeatable few millis of centering error */
+static int32_t noise(int i, int amplitude) {
+    return amplitude ? (int32_t)((i * 7919 + 13) % (2 * amplitude + 1)) - amplitude : 0;
+}
+
+static void add_syncs(const int32_t* terms, int count, int noiseMillis) {
+    for (int i = 0; i < count; i ++) {
+        const sync_t* s = &syncs[i % SYNCS];
+        double dh, dd;
+        tpoint(terms, s->ha, s->dec, s->sideOfPier, &dh, &dd);
+        int32_t ra = sky_ra(s->ha), dec = DEGREES(s->dec);
+        // ha = lst - ra, the mount ahead in hour angle is behind in ra
+        int32_t mountRa = wrap_day_millis(ra - (int32_t)lround(dh) + noise(i, noiseMillis));
+        int32_t mountDec = dec + (int32_t)lround(dd) + noise(i + 5, noiseMillis);
+        add_pointing_point(ra, dec, mountRa, mountDec, s->sideOfPier);
+    }
+}
+
+static void check_terms(const int32_t* terms, int tolerance) {
+    for (int i = 0; i < POINTING_TERMS; i ++) {
+        int32_t fitted = get_pointing_term_millis(i);
+        if (fabs((double)fitted - terms[i]) > tolerance) {
+            printf("term %s fitted %d, made with %d\n", term_names[i], fitted, terms[i]);
+        }
+        CHECK_NEAR(terms[i], fitted, tolerance);
+    }
+}
+
+/* without the time only the index terms are fitted, from the first point on */
+static void test_index_terms_without_time() {
+    const int32_t terms[POINTING_TERMS] = { ARCMIN(4), ARCMIN(-3) };
+    clear_pointing_model();
+    add_syncs(terms, 1, 0);
+    CHECK_EQ(2, get_pointing_term_count());
+    // the sky ra is only taken for an hour angle relative to the same lst
+    check_terms(terms, 2);
+    add_syncs(terms, 6, 0);
+    CHECK_EQ(2, get_pointing_term_count());
+    check_terms(terms, 2);
+    CHECK(get_pointing_rms_millis() <= 2);
+}
+
+/* the terms fitted grow with the points until the full model is determined */
+static void test_term_count() {
+    const int32_t terms[POINTING_TERMS] = { 0 };
+    const uint8_t expected[] = { 0, 2, 4, 6, 7, 7 };
+    for (int count = 0; count < sizeof(expected); count ++) {
+        clear_pointing_model();
+        add_syncs(terms, count, 0);
+        CHECK_EQ(count, get_pointing_point_count());
+        CHECK_EQ(expected[count], get_pointing_term_count());
+    }
+}
+
+static void test_full_model() {
+    const int32_t terms[POINTING_TERMS] = { ARCMIN(5), ARCMIN(-3), ARCMIN(1.5), ARCMIN(-2.5), ARCMIN(1), ARCMIN(-0.75), ARCMIN(0.5) };
+    clear_pointing_model();
+    add_syncs(terms, SYNCS, 0);
+    CHECK_EQ(SYNCS, get_pointing_point_count());
+    CHECK_EQ(POINTING_TERMS, get_pointing_term_count());
+    // the mount positions were rounded to whole millis
+    check_terms(terms, 3);
+    CHECK(get_pointing_rms_millis() <= 2);
+
+    // the model puts the mount where the synthetic one went, and back
+    for (int i = 0; i < SYNCS; i ++) {
+        const sync_t* s = &syncs[i];
+        double dh, dd;
+        tpoint(terms, s->ha, s->dec, s->sideOfPier, &dh, &dd);
+        int32_t ra = sky_ra(s->ha), dec = DEGREES(s->dec);
+        int32_t mountRa = ra, mountDec = dec;
+        pointing_sky_to_mount(&mountRa, &mountDec, s->sideOfPier);
+        CHECK_NEAR(0, angle_diff_millis(ra - (int32_t)lround(dh), mountRa), 3 / cos(s->dec * M_PI / 180));
+        CHECK_NEAR(dec + dd, mountDec, 3);
+        pointing_mount_to_sky(&mountRa, &mountDec, s->sideOfPier);
+        CHECK_NEAR(0, angle_diff_millis(ra, mountRa), 3 / cos(s->dec * M_PI / 180));
+        CHECK_NEAR(dec, mountDec, 3);
+    }
+}
+
+/* centering errors spread into the terms but the rms shows them */
+static void test_noisy_syncs() {
+    const int32_t terms[POINTING_TERMS] = { ARCMIN(-2), ARCMIN(4), ARCMIN(-1), ARCMIN(2), ARCMIN(-1.5), ARCMIN(0.5), ARCMIN(1) };
+    clear_pointing_model();
+    add_syncs(terms, SYNCS, 200);
+    CHECK_EQ(POINTING_TERMS, get_pointing_term_count());
+    check_terms(terms, ARCMIN(0.25));
+    int32_t rms = get_pointing_rms_millis();
+    CHECK(rms > 20);
+    CHECK(rms < 300);
+}
+
+/* the oldest points make room for new ones, a changed mount is fitted again */
+static void test_points_roll_over() {
+    const int32_t before[POINTING_TERMS] = { ARCMIN(10), ARCMIN(10), ARCMIN(10) };
+    const int32_t after[POINTING_TERMS] = { ARCMIN(-1), ARCMIN(2), ARCMIN(-3), ARCMIN(1), ARCMIN(2), ARCMIN(-1), ARCMIN(1) };
+    clear_pointing_model();
+    add_syncs(before, 8, 0);
+    add_syncs(after, POINTING_MAX_POINTS, 0);
+    CHECK_EQ(POINTING_MAX_POINTS, get_pointing_point_count());
+    check_terms(after, 3);
+}
+
+/* syncs all on one star tell the index terms apart from nothing else, the fit drops the rest */
+static void test_degenerate_geometry() {
+    const int32_t terms[POINTING_TERMS] = { ARCMIN(3), ARCMIN(-2) };
+    clear_pointing_model();
+    for (int i = 0; i < 6; i ++) {
+        int32_t ra = sky_ra(0), dec = DEGREES(30);
+        add_pointing_point(ra, dec, wrap_day_millis(ra - terms[POINTING_IH]), dec + terms[POINTING_ID], 0);
+    }
+    CHECK_EQ(2, get_pointing_term_count());
+    check_terms(terms, 2);
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    init_astro();
+    set_site(LATITUDE, 0);
+    init_pointing();
+    test_index_terms_without_time();
+    add_time_sample(esp_timer_get_time(), UTC_MICROS, 0);
+    CHECK(is_time_synced());
+    test_term_count();
+    test_full_model();
+    test_noisy_syncs();
+    test_points_roll_over();
+    test_degenerate_geometry();
+    return host_test_exit();
+}
@@ -0,0 +1,96 @@
+#include "host.h"
+#include "axis.h"
+#include "mount_config.h"
+#include "mount_fsm.h"
+#include "protocol.h"
+
+/*
+ * The AP going away under a tracking mount: the station retries with a
+ * backoff that doubles up to WIFI_RECONNECT_MAX_SECONDS, is back within one
+ * backoff and a failed attempt of the AP returning, and RA keeps stepping at
+ * the tracking rate all the while.
+ */
+
+/* as a client sends them */
+#define CMD_SET_TRACKING 1
+#define CMD_GET_STATUS 12
+
+#define STEP_MICROS 1000
+#define RECONNECT_MIN_MICROS 1000000LL
+#define RECONNECT_MAX_MICROS (CONFIG_WIFI_RECONNECT_MAX_SECONDS * 1000000LL)
+/* how long the host AP takes to refuse a connect, and to accept one */
+#define ATTEMPT_MICROS (3000 * 1000)
+#define CONNECT_MICROS (200 * 1000)
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+static bool status_answered() {
+    uint8_t command = CMD_GET_STATUS, reply[64];
+    // the acks of earlier commands first
+    while (host_udp_receive(reply, sizeof(reply)) >= 0);
+    if (!host_udp_send(&command, 1)) return false;
+    host_run_for(STEP_MICROS);
+    return host_udp_receive(reply, sizeof(reply)) == STATUS_SIZE;
+}
+
+/* runs for micros in steps, false if RA stopped stepping at the tracking rate at any of them */
+static bool track_for(int64_t micros) {
+    ledc_channel_t channel = mount_axes[AXIS_RA].channel.channel;
+    uint32_t freq = axis_get_step_freq(&mount_axes[AXIS_RA], SPEED_PER_CYCLE);
+    uint64_t pulses = host_ledc_pulses(channel);
+    bool steady = true;
+    for (int64_t t = 0; t < micros; t += STEP_MICROS) {
+        host_run_for(STEP_MICROS);
+        if (host_ledc_output_freq(channel) != freq) steady = false;
+    }
+    // not a pulse missing in between the steps either
+    int64_t delivered = host_ledc_pulses(channel) - pulses;
+    CHECK_NEAR((double)freq * micros / 1000000, delivered, 1);
+    return steady;
+}
+
+/* the station drops for dropout, and has to be back within the backoff it got to */
+static void drop_station(int64_t dropout) {
+    CHECK(host_wifi_station_connected());
+    host_wifi_station(false);
+    CHECK(track_for(dropout));
+    CHECK(!host_wifi_station_connected());
+
+    // doubling from a second, the pending delay is at most the time down so far and a second
+    int64_t backoff = dropout + RECONNECT_MIN_MICROS;
+    if (backoff > RECONNECT_MAX_MICROS) backoff = RECONNECT_MAX_MICROS;
+    int64_t bound = backoff + ATTEMPT_MICROS + CONNECT_MICROS;
+    host_wifi_station(true);
+    int64_t back = 0;
+    while (back < bound + STEP_MICROS && !host_wifi_station_connected()) {
+        CHECK(track_for(STEP_MICROS));
+        back += STEP_MICROS;
+    }
+    printf("down %.0f s, back %.1f s after the AP, bound %.1f s\n", dropout / 1e6, back / 1e6, bound / 1e6);
+    CHECK(host_wifi_station_connected());
+    CHECK(back <= bound);
+    CHECK(status_answered());
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    CHECK(host_wifi_station_connected());
+    const uint8_t tracking[2] = { CMD_SET_TRACKING, 1 };
+    CHECK(host_udp_send(tracking, sizeof(tracking)));
+    host_run_for(STEP_MICROS);
+    CHECK_EQ(MOUNT_STATE_TRACKING, get_mount_fsm_state());
+    CHECK(status_answered());
+
+    // a short drop, then one long enough for the backoff to reach its cap
+    drop_station(20 * 1000000LL);
+    CHECK(track_for(10 * 1000000LL));
+    drop_station(5 * RECONNECT_MAX_MICROS);
+    return host_test_exit();
+}
@@ -0,0 +1,140 @@
+#include <pthread.h>
+#include "host.h"
+#include "seqlock.h"
+#include "mount_snapshot.h"
+
+/*
+ * The seqlock and the mount snapshot on it under real concurrency: a
+ * writer thread publishes numbered states while reader threads copy them
+ * as fast as they can. Every copy has to be one whole state, never older
+ * than the one the same reader saw before.
+ */
+
+#define READERS 3
+#define WRITES 1000000
+#define BLOCK_WORDS 64
+
+static volatile bool writing;
+
+/* every field of snapshot n follows from n */
+static void fill_snapshot(mount_snapshot_t* snapshot, uint32_t n) {
+    snapshot->state = n % 7;
+    snapshot->tracking = n % 3 - 1;
+    snapshot->side_of_pier = n & 1;
+    snapshot->ra_speed = n;
+    snapshot->dec_speed = -(int32_t)n;
+    snapshot->ra_guide_speed = n * 3;
+    snapshot->dec_guide_speed = n ^ 0x5a5a5a5a;
+    snapshot->slewing = n % 5 == 0;
+    snapshot->slew_phase = n % 4;
+    snapshot->slew_progress = n % 1001;
+    snapshot->slew_time_to_go_millis = ~n;
+}
+
+static bool whole_snapshot(const mount_snapshot_t* snapshot) {
+    mount_snapshot_t expected;
+    memset(&expected, 0, sizeof(expected));
+    fill_snapshot(&expected, snapshot->ra_speed);
+    return snapshot->state == expected.state && snapshot->tracking == expected.tracking
+        && snapshot->side_of_pier == expected.side_of_pier && snapshot->dec_speed == expected.dec_speed
+        && snapshot->ra_guide_speed == expected.ra_guide_speed && snapshot->dec_guide_speed == expected.dec_guide_speed
+        && snapshot->slewing == expected.slewing && snapshot->slew_phase == expected.slew_phase
+        && snapshot->slew_progress == expected.slew_progress
+        && snapshot->slew_time_to_go_millis == expected.slew_time_to_go_millis;
+}
+
+typedef struct {
+    uint32_t reads, torn, backwards, seen; // seen: states told apart from the one before
+} reader_result_t;
+
+static void* snapshot_writer(void* args) {
+    for (uint32_t n = 1; n <= WRITES; n ++) {
+        fill_snapshot(mount_snapshot_write_begin(), n);
+        mount_snapshot_write_end();
+    }
+    writing = false;
+    return NULL;
+}
+
+static void* snapshot_reader(void* args) {
+    reader_result_t* result = args;
+    int32_t last = 0;
+    while (writing) {
+        mount_snapshot_t snapshot;
+        get_mount_snapshot(&snapshot);
+        result->reads ++;
+        if (!whole_snapshot(&snapshot)) result->torn ++;
+        if (snapshot.ra_speed < last) result->backwards ++;
+        if (snapshot.ra_speed != last) result->seen ++;
+        last = snapshot.ra_speed;
+    }
+    return NULL;
+}
+
+/* a block wider than a cache line, a copy is torn unless all its words agree */
+static seqlock_t block_lock = SEQLOCK_INITIALIZER;
+static volatile uint32_t block[BLOCK_WORDS];
+
+static void* block_writer(void* args) {
+    for (uint32_t n = 1; n <= WRITES; n ++) {
+        seqlock_write_begin(&block_lock);
+        for (int i = 0; i < BLOCK_WORDS; i ++) block[i] = n;
+        seqlock_write_end(&block_lock);
+    }
+    writing = false;
+    return NULL;
+}
+
+static void* block_reader(void* args) {
+    reader_result_t* result = args;
+    uint32_t last = 0;
+    while (writing) {
+        uint32_t copy[BLOCK_WORDS];
+        uint32_t sequence;
+        do {
+            sequence = seqlock_read_begin(&block_lock);
+            for (int i = 0; i < BLOCK_WORDS; i ++) copy[i] = block[i];
+        } while (seqlock_read_retry(&block_lock, sequence));
+        result->reads ++;
+        for (int i = 1; i < BLOCK_WORDS; i ++) {
+            if (copy[i] != copy[0]) {
+                result->torn ++;
+                break;
+            }
+        }
+        if (copy[0] < last) result->backwards ++;
+        if (copy[0] != last) result->seen ++;
+        last = copy[0];
+    }
+    return NULL;
+}
+
+static void stress(const char* name, void* (*writer)(void*), void* (*reader)(void*)) {
+    pthread_t writerThread, readerThreads[READERS];
+    reader_result_t results[READERS];
+    memset(results, 0, sizeof(results));
+    writing = true;
+    for (int i = 0; i < READERS; i ++) {
+        CHECK_EQ(0, pthread_create(&readerThreads[i], NULL, reader, &results[i]));
+    }
+    CHECK_EQ(0, pthread_create(&writerThread, NULL, writer, NULL));
+    pthread_join(writerThread, NULL);
+    for (int i = 0; i < READERS; i ++) {
+        pthread_join(readerThreads[i], NULL);
+        printf("%s reader %d: %u reads of %u states\n", name, i, results[i].reads, results[i].seen);
+        CHECK_EQ(0, results[i].torn);
+        CHECK_EQ(0, results[i].backwards);
+        // the readers really ran alongside the writer
+        CHECK(results[i].seen > 1);
+    }
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    // the readers may start before the first write
+    fill_snapshot(mount_snapshot_write_begin(), 0);
+    mount_snapshot_write_end();
+    stress("snapshot", snapshot_writer, snapshot_reader);
+    stress("block", block_writer, block_reader);
+    return host_test_exit();
+}
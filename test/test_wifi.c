@@ -0,0 +1,114 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "host.h"
+
+/*
+ * A field site without infrastructure WiFi: the SoftAP comes up once the
+ * station gave up searching, always WPA2 protected, and the command server
+ * answers on it. Built without an AP password too, the SoftAP then stays
+ * off rather than open. Credentials set with CMD_SET_WIFI are stored, and
+ * the station joins with them after a reboot.
+ */
+
+/* as a client sends them */
+#define CMD_PING 0
+#define CMD_SET_WIFI 17
+
+#define STEP_MICROS 1000
+#define WIFI_SSID "field-station"
+#define WIFI_PASS "nebula-secret"
+
+void app_main();
+
+static void main_task(void* args) {
+    app_main();
+}
+
+/* a command, and whether the server answered it */
+static bool answered(const void* command, size_t len) {
+    uint8_t reply[64];
+    while (host_udp_receive(reply, sizeof(reply)) >= 0);
+    if (!host_udp_send(command, len)) return false;
+    host_run_for(STEP_MICROS);
+    return host_udp_receive(reply, sizeof(reply)) >= 0;
+}
+
+static int test_ap_fallback() {
+    host_wifi_station(false);
+    host_start(main_task);
+    host_run_for((CONFIG_WIFI_AP_FALLBACK_SECONDS - 1) * 1000000LL);
+    CHECK_EQ(WIFI_MODE_STA, host_wifi_mode());
+
+    host_run_for(5 * 1000000);
+    if (strlen(CONFIG_WIFI_AP_PASS) < 8) {
+        CHECK_EQ(WIFI_MODE_STA, host_wifi_mode());
+        return host_test_exit();
+    }
+    CHECK_EQ(WIFI_MODE_APSTA, host_wifi_mode());
+    const wifi_config_t* ap = host_wifi_config(WIFI_IF_AP);
+    CHECK_EQ(WIFI_AUTH_WPA_WPA2_PSK, ap->ap.authmode);
+    CHECK(strcmp((const char*)ap->ap.ssid, CONFIG_WIFI_AP_SSID) == 0);
+    CHECK(strcmp((const char*)ap->ap.password, CONFIG_WIFI_AP_PASS) == 0);
+
+    const uint8_t ping = CMD_PING;
+    CHECK(answered(&ping, sizeof(ping)));
+    return host_test_exit();
+}
+
+/* new credentials on a booted mount, the flash it leaves written to fd */
+static int set_credentials(int fd) {
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    CHECK(strcmp((const char*)host_wifi_config(WIFI_IF_STA)->sta.ssid, CONFIG_WIFI_SSID) == 0);
+    uint8_t wifi[3 + sizeof(WIFI_SSID) - 1 + sizeof(WIFI_PASS) - 1] = { CMD_SET_WIFI, sizeof(WIFI_SSID) - 1 };
+    memcpy(wifi + 2, WIFI_SSID, sizeof(WIFI_SSID) - 1);
+    wifi[2 + sizeof(WIFI_SSID) - 1] = sizeof(WIFI_PASS) - 1;
+    memcpy(wifi + 3 + sizeof(WIFI_SSID) - 1, WIFI_PASS, sizeof(WIFI_PASS) - 1);
+    // a datagram one byte short of the password is refused, and nothing stored
+    CHECK(answered(wifi, sizeof(wifi) - 1));
+    host_run_for(1000000);
+    CHECK(strcmp((const char*)host_wifi_config(WIFI_IF_STA)->sta.ssid, CONFIG_WIFI_SSID) == 0);
+    CHECK(answered(wifi, sizeof(wifi)));
+    host_run_for(1000000);
+    CHECK(strcmp((const char*)host_wifi_config(WIFI_IF_STA)->sta.ssid, WIFI_SSID) == 0);
+    CHECK(host_nvs_save(fd));
+    return host_test_exit();
+}
+
+/* the stored credentials, not the Kconfig ones, after a reboot */
+static void test_reboot(int fd) {
+    CHECK(host_nvs_load(fd));
+    host_start(main_task);
+    host_run_for(5 * 1000000);
+    const wifi_config_t* sta = host_wifi_config(WIFI_IF_STA);
+    CHECK(strcmp((const char*)sta->sta.ssid, WIFI_SSID) == 0);
+    CHECK(strcmp((const char*)sta->sta.password, WIFI_PASS) == 0);
+    CHECK(host_wifi_station_connected());
+    const uint8_t ping = CMD_PING;
+    CHECK(answered(&ping, sizeof(ping)));
+}
+
+/* a process each, the firmware boots once per process */
+static bool run_child(int (*test)(int), int fd) {
+    pid_t child = fork();
+    if (child == 0) exit(test(fd));
+    int status;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int ap_fallback(int fd) {
+    return test_ap_fallback();
+}
+
+int main() {
+    host_log_level = ESP_LOG_ERROR;
+    CHECK(run_child(ap_fallback, -1));
+    int fds[2];
+    CHECK_EQ(0, pipe(fds));
+    CHECK(run_child(set_credentials, fds[1]));
+    close(fds[1]);
+    test_reboot(fds[0]);
+    return host_test_exit();
+}
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Records, decodes and replays captures of the controller.
+
+A capture holds the state at start, every encoder edge, every command
+datagram but CMD_SET_WIFI and every step rate change, see
+main/include/capture.h.
+
+    capture_replay.py record 192.168.4.1 --seconds 60 -o night.cap
+    capture_replay.py record 192.168.4.1 --ring -o night.cap  # read back a ring capture
+    capture_replay.py dump night.cap
+    capture_replay.py replay night.cap 192.168.4.1 --speed 4
+
+Replay sends the recorded commands to a unit with the same timing (divided
+by --speed), so a session can be reproduced on the bench. Compare a new
+capture of the replay with the original one using dump.
+
+A capture that starts with its START record also replays on the host
+firmware, from that state and faster than real time, with the encoder
+edges as well, and is checked there against the step rates it recorded:
+
+    cmake -S test -B build-host && cmake --build build-host
+    build-host/capture_replay night.cap
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+
+CMD_SET_CAPTURE = 32
+CMD_GET_CAPTURE = 33
+CAPTURE_FRAME_TYPE = 0x44
+
+CAPTURE_OFF = 0
+CAPTURE_RING = 1
+CAPTURE_STREAM = 2
+
+# keep in sync with main/include/capture.h
+CAPTURE_RECORD_GAP = 0  # written by this tool where bytes were lost
+CAPTURE_RECORD_START = 1
+CAPTURE_RECORD_ENCODER = 2
+CAPTURE_RECORD_COMMAND = 3
+CAPTURE_RECORD_RATE = 4
+CAPTURE_HEADER_SIZE = 7
+
+# keep in sync with main/include/persist.h
+SNAPSHOT_FIELDS = [
+    "resetRa", "resetDec", "raPulses", "decPulses", "elapsed",
+    "resetUtcHi", "resetUtcLo", "sideOfPier", "raGuideSpeed", "decGuideSpeed",
+    "tracking", "raSpeed", "decSpeed",
+]
+CHANNEL_NAMES = {0: "RA", 1: "DEC", 2: "FOCUSER"}
+
+
+def parse_frame(data):
+    """Returns (mode, offset, head, bytes) or None."""
+    if len(data) < 12 or data[0] != CAPTURE_FRAME_TYPE:
+        return None
+    mode = data[1]
+    length, offset, head = struct.unpack_from("!HII", data, 2)
+    return mode, offset, head, data[12:12 + length]
+
+
+class Assembler:
+    """Joins slices by offset, marking where the ring dropped bytes."""
+
+    def __init__(self):
+        self.next = 0
+        self.out = bytearray()
+
+    def add(self, offset, data):
+        if offset + len(data) <= self.next:
+            return
+        if offset < self.next:
+            data = data[self.next - offset:]
+            offset = self.next
+        if offset > self.next:
+            # the ring drops whole records, so the slice starts on one
+            self.out += struct.pack("<BHI", CAPTURE_RECORD_GAP, 4, 0) + struct.pack("<I", offset - self.next)
+        self.out += data
+        self.next = offset + len(data)
+
+
+def record_ring(sock, addr, assembler):
+    offset = 0
+    while True:
+        sock.sendto(struct.pack("!BI", CMD_GET_CAPTURE, offset), addr)
+        parsed = parse_frame(sock.recv(2048))
+        if parsed is None:
+            break
+        _, first, head, data = parsed
+        assembler.add(first, data)
+        offset = first + len(data)
+        if not data or offset == head:
+            break
+
+
+def record_stream(sock, addr, seconds, assembler):
+    sock.sendto(struct.pack("!BB", CMD_SET_CAPTURE, CAPTURE_STREAM), addr)
+    deadline = time.time() + seconds
+    try:
+        while time.time() < deadline:
+            try:
+                data = sock.recv(2048)
+            except socket.timeout:
+                continue
+            parsed = parse_frame(data)
+            if parsed:
+                assembler.add(parsed[1], parsed[3])
+    finally:
+        sock.sendto(struct.pack("!BB", CMD_SET_CAPTURE, CAPTURE_OFF), addr)
+    # whatever the last timer tick did not push yet
+    record_tail(sock, addr, assembler)
+
+
+def record_tail(sock, addr, assembler):
+    offset = assembler.next
+    while True:
+        sock.sendto(struct.pack("!BI", CMD_GET_CAPTURE, offset), addr)
+        try:
+            data = sock.recv(2048)
+        except socket.timeout:
+            break
+        parsed = parse_frame(data)
+        if parsed is None or not parsed[3]:
+            break
+        assembler.add(parsed[1], parsed[3])
+        offset = parsed[1] + len(parsed[3])
+
+
+def records(blob):
+    """Yields (type, time in us, payload), the time unwrapped from 32 bits."""
+    pos = 0
+    last = None
+    wraps = 0
+    while pos + CAPTURE_HEADER_SIZE <= len(blob):
+        kind, length, t = struct.unpack_from("<BHI", blob, pos)
+        payload = bytes(blob[pos + CAPTURE_HEADER_SIZE:pos + CAPTURE_HEADER_SIZE + length])
+        pos += CAPTURE_HEADER_SIZE + length
+        if kind != CAPTURE_RECORD_GAP:
+            if last is not None and t < last and last - t > 1 << 31:
+                wraps += 1
+            last = t
+            t += wraps << 32
+        yield kind, t, payload
+
+
+def describe(kind, payload):
+    if kind == CAPTURE_RECORD_GAP:
+        return "GAP %d bytes lost" % struct.unpack("<I", payload)[0]
+    if kind == CAPTURE_RECORD_START:
+        values = struct.unpack("<%di" % (len(payload) // 4), payload)
+        names = SNAPSHOT_FIELDS + ["field%d" % i for i in range(len(SNAPSHOT_FIELDS), len(values))]
+        return "START " + " ".join("%s=%d" % nv for nv in zip(names, values))
+    if kind == CAPTURE_RECORD_ENCODER:
+        channel, diff, pulses = struct.unpack("<Bbi", payload)
+        return "ENCODER %s diff=%d pulses=%d" % (CHANNEL_NAMES.get(channel, channel), diff, pulses)
+    if kind == CAPTURE_RECORD_COMMAND:
+        return "COMMAND %d %s" % (payload[0], payload[1:].hex()) if payload else "COMMAND (empty)"
+    if kind == CAPTURE_RECORD_RATE:
+        channel, freq = struct.unpack("<Bi", payload)
+        return "RATE %s %d Hz" % (CHANNEL_NAMES.get(channel, channel), freq)
+    return "TYPE %d %s" % (kind, payload.hex())
+
+
+def dump(blob):
+    start = None
+    for kind, t, payload in records(blob):
+        if start is None and kind != CAPTURE_RECORD_GAP:
+            start = t
+        gap = kind == CAPTURE_RECORD_GAP or start is None
+        stamp = " " * 12 if gap else "%12.6f" % ((t - start) / 1e6)
+        print(stamp, describe(kind, payload))
+
+
+def replay(blob, sock, addr, speed):
+    commands = [(t, payload) for kind, t, payload in records(blob) if kind == CAPTURE_RECORD_COMMAND]
+    if not commands:
+        print("no commands in the capture")
+        return
+    first = commands[0][0]
+    began = time.time()
+    for t, payload in commands:
+        delay = began + (t - first) / 1e6 / speed - time.time()
+        if delay > 0:
+            time.sleep(delay)
+        sock.sendto(payload, addr)
+        try:
+            while True:
+                sock.recv(2048)
+        except (socket.timeout, BlockingIOError):
+            pass
+    print("%d commands replayed" % len(commands))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="action", required=True)
+    rec = sub.add_parser("record")
+    rec.add_argument("host")
+    rec.add_argument("--port", type=int, default=9333)
+    rec.add_argument("--seconds", type=float, default=60)
+    rec.add_argument("--ring", action="store_true", help="read back a ring capture instead of streaming")
+    rec.add_argument("-o", "--output", default="capture.cap")
+    dmp = sub.add_parser("dump")
+    dmp.add_argument("capture")
+    rep = sub.add_parser("replay")
+    rep.add_argument("capture")
+    rep.add_argument("host")
+    rep.add_argument("--port", type=int, default=9333)
+    rep.add_argument("--speed", type=float, default=1)
+    args = parser.parse_args()
+
+    if args.action == "dump":
+        with open(args.capture, "rb") as f:
+            dump(f.read())
+        return
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    addr = (args.host, args.port)
+    if args.action == "record":
+        sock.settimeout(1)
+        assembler = Assembler()
+        if args.ring:
+            record_ring(sock, addr, assembler)
+        else:
+            record_stream(sock, addr, args.seconds, assembler)
+        with open(args.output, "wb") as f:
+            f.write(assembler.out)
+        print("%d bytes written to %s" % (len(assembler.out), args.output))
+    else:
+        sock.setblocking(False)
+        with open(args.capture, "rb") as f:
+            replay(f.read(), sock, addr, args.speed)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Measures command to step rate change latency, idle and under load.
+
+Needs a unit built with CONFIG_PERF_HISTOGRAMS. The latency is taken on the
+unit, from recvfrom() on the network task to the step rate change on the
+motion task, and read back from the PERF_COMMAND_TO_MOTOR histogram. The
+round trip to the ack is measured here as well.
+
+Both runs toggle the RA speed, so every command also redraws the display.
+The loaded run adds threads that flood the unit with status requests, which
+keeps WiFi and lwip busy on core 0. The RA motor moves, and the speed is set
+back to 0 at the end.
+
+    latency_bench.py 192.168.4.1 --seconds 20 --load-threads 4
+"""
+import argparse
+import socket
+import struct
+import threading
+import time
+
+CMD_SET_RA_SPEED = 2
+CMD_GET_STATUS = 12
+CMD_GET_PERF = 29
+PERF_FRAME_TYPE = 0x48
+PERF_COMMAND_TO_MOTOR = 6
+PERF_BUCKETS = 32
+SPEEDS = (15000, 30000)  # one and two cycles per day on top of tracking
+
+
+def read_histogram(sock, addr, reset):
+    sock.sendto(struct.pack("!BBB", CMD_GET_PERF, PERF_COMMAND_TO_MOTOR, 1 if reset else 0), addr)
+    while True:
+        data = sock.recv(2048)
+        if data and data[0] == PERF_FRAME_TYPE:
+            break
+    count, max_cycles = struct.unpack_from("!II", data, 4)
+    buckets = struct.unpack_from("!%dI" % PERF_BUCKETS, data, 12)
+    return count, max_cycles, buckets
+
+
+def percentile_us(buckets, count, fraction, mhz):
+    """Upper bound of the bucket holding the percentile."""
+    seen = 0
+    for i, n in enumerate(buckets):
+        seen += n
+        if seen >= fraction * count:
+            return ((1 << i) - 1) / mhz
+    return float("inf")
+
+
+def flood(addr, stop, sent):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    request = struct.pack("!B", CMD_GET_STATUS)
+    while not stop.is_set():
+        try:
+            sock.sendto(request, addr)
+            sent[0] += 1
+            while True:
+                sock.recv(2048)
+        except BlockingIOError:
+            pass
+        time.sleep(0.001)
+
+
+def run(addr, seconds, rate, load_threads, mhz):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1)
+    read_histogram(sock, addr, True)
+
+    stop = threading.Event()
+    sent = [0]
+    threads = [threading.Thread(target=flood, args=(addr, stop, sent), daemon=True) for _ in range(load_threads)]
+    for thread in threads:
+        thread.start()
+
+    round_trips = []
+    deadline = time.time() + seconds
+    i = 0
+    try:
+        while time.time() < deadline:
+            began = time.time()
+            sock.sendto(struct.pack("!Bi", CMD_SET_RA_SPEED, SPEEDS[i % 2]), addr)
+            try:
+                sock.recv(2048)
+                round_trips.append((time.time() - began) * 1000)
+            except socket.timeout:
+                pass
+            i += 1
+            time.sleep(max(0, 1 / rate - (time.time() - began)))
+    finally:
+        stop.set()
+        for thread in threads:
+            thread.join()
+        sock.sendto(struct.pack("!Bi", CMD_SET_RA_SPEED, 0), addr)
+
+    count, max_cycles, buckets = read_histogram(sock, addr, False)
+    round_trips.sort()
+    result = {
+        "commands": i,
+        "flood": sent[0],
+        "count": count,
+        "p50": percentile_us(buckets, count, 0.5, mhz),
+        "p99": percentile_us(buckets, count, 0.99, mhz),
+        "max": max_cycles / mhz,
+        "rtt50": round_trips[len(round_trips) // 2] if round_trips else float("nan"),
+        "rtt99": round_trips[int(len(round_trips) * 0.99)] if round_trips else float("nan"),
+    }
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=9333)
+    parser.add_argument("--seconds", type=float, default=20)
+    parser.add_argument("--rate", type=float, default=20, help="speed commands per second")
+    parser.add_argument("--load-threads", type=int, default=4)
+    parser.add_argument("--mhz", type=int, default=240, help="CPU frequency of the unit")
+    args = parser.parse_args()
+    addr = (args.host, args.port)
+
+    print("%-8s %9s %9s %9s %9s %9s %10s %10s" % ("run", "commands", "flood", "p50 us", "p99 us", "max us", "rtt50 ms", "rtt99 ms"))
+    for name, threads in (("idle", 0), ("loaded", args.load_threads)):
+        r = run(addr, args.seconds, args.rate, threads, args.mhz)
+        if not r["count"]:
+            print("%-8s no samples, is CONFIG_PERF_HISTOGRAMS on?" % name)
+            continue
+        print("%-8s %9d %9d %9.1f %9.1f %9.1f %10.2f %10.2f" % (
+            name, r["commands"], r["flood"], r["p50"], r["p99"], r["max"], r["rtt50"], r["rtt99"]))
+
+
+if __name__ == "__main__":
+    main()
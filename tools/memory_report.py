@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Prints the static memory of each module from the linker map.
+
+Objects of the main component are listed one by one, every other component
+as its archive. Run through "make memory-report", or directly:
+
+    memory_report.py build/telescope.map
+"""
+import argparse
+import collections
+import os
+import re
+
+# output sections of the esp32 linker script
+COLUMNS = collections.OrderedDict([
+    ("DRAM data", (".dram0.data",)),
+    ("DRAM bss", (".dram0.bss",)),
+    ("IRAM", (".iram0.vectors", ".iram0.text")),
+    ("RTC", (".rtc.text", ".rtc.data", ".rtc.bss", ".rtc_noinit")),
+    ("flash code", (".flash.text",)),
+    ("flash rodata", (".flash.rodata",)),
+])
+SECTION_COLUMN = {section: column for column, sections in COLUMNS.items() for section in sections}
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)")
+INPUT_SECTION = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+MEMBER = re.compile(r"^(.*?)([^/\\]+\.a)\((.+)\)$")
+
+
+def module_of(path, main_archive):
+    member = MEMBER.match(path)
+    if member is None:
+        return os.path.basename(path)
+    archive, obj = member.group(2), member.group(3)
+    return obj if archive == main_archive else archive
+
+
+def parse(lines, main_archive):
+    sizes = collections.defaultdict(lambda: collections.Counter())
+    column = None
+    pending = None
+    started = False
+    for line in lines:
+        line = line.rstrip("\n")
+        if not started:
+            started = line.startswith("Linker script and memory map")
+            continue
+        if pending is not None:
+            cont = CONTINUATION.match(line)
+            if cont:
+                sizes[module_of(cont.group(3), main_archive)][column] += int(cont.group(2), 16)
+            pending = None
+            continue
+        out = OUTPUT_SECTION.match(line)
+        if out:
+            column = SECTION_COLUMN.get(out.group(1))
+            continue
+        if column is None:
+            continue
+        entry = INPUT_SECTION.match(line)
+        if entry is None or entry.group(1).startswith("*"):
+            continue
+        if entry.group(2) is None:
+            # long section names put address, size and file on the next line
+            pending = entry.group(1)
+        else:
+            sizes[module_of(entry.group(4), main_archive)][column] += int(entry.group(3), 16)
+    return sizes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map")
+    parser.add_argument("--main", default="libmain.a", help="archive whose objects are listed one by one")
+    parser.add_argument("--sort", choices=list(COLUMNS) + ["RAM"], default="RAM")
+    args = parser.parse_args()
+
+    with open(args.map) as f:
+        sizes = parse(f, args.main)
+
+    ram = lambda c: c["DRAM data"] + c["DRAM bss"] + c["IRAM"]
+    key = ram if args.sort == "RAM" else (lambda c: c[args.sort])
+    columns = list(COLUMNS) + ["RAM"]
+    print("%-32s" % "module" + "".join("%14s" % c for c in columns))
+    totals = collections.Counter()
+    for module, counter in sorted(sizes.items(), key=lambda item: -key(item[1])):
+        if not sum(counter.values()):
+            continue
+        totals.update(counter)
+        print("%-32s" % module + "".join("%14d" % counter[c] for c in COLUMNS) + "%14d" % ram(counter))
+    print("%-32s" % "total" + "".join("%14d" % totals[c] for c in COLUMNS) + "%14d" % ram(totals))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Reads the trace rings of the controller and writes Chrome trace JSON.
+
+Open the output in chrome://tracing or https://ui.perfetto.dev.
+
+    trace_to_chrome.py 192.168.4.1 -o trace.json            # dump the rings once
+    trace_to_chrome.py 192.168.4.1 --stream 30 -o trace.json # stream for 30 s
+"""
+import argparse
+import json
+import socket
+import struct
+import time
+
+CMD_GET_TRACE = 30
+CMD_SET_TRACE_STREAM = 31
+TRACE_FRAME_TYPE = 0x52
+CORES = 2
+
+# keep in sync with main/include/trace.h
+TRACE_AXIS_RATE = 1
+TRACE_SLEW_TICK = 2
+TRACE_SLEW_SLOWDOWN = 3
+TRACE_GUIDE_PULSE = 4
+TRACE_COMMAND_BEGIN = 5
+TRACE_COMMAND_END = 6
+
+AXIS_NAMES = {0: "RA", 1: "DEC", 2: "FOCUSER"}
+COMMAND_NAMES = {
+    0: "PING", 1: "SET_TRACKING", 2: "SET_RA_SPEED", 3: "SET_DEC_SPEED",
+    4: "PULSE_GUIDING", 5: "SET_RA_GUIDE_SPEED", 6: "SET_DEC_GUIDE_SPEED",
+    7: "SYNC_TO_TARGET", 8: "SLEW_TO_TARGET", 9: "ABORT_SLEW",
+    10: "SET_SIDE_OF_PIER", 11: "GET_CLOCK", 12: "GET_STATUS", 13: "SYNC_TIME",
+    14: "SET_SITE", 15: "CLEAR_POINTING_MODEL", 16: "GET_POINTING_MODEL",
+    17: "SET_WIFI", 18: "SET_MOUNT_CONFIG", 19: "GET_MOUNT_CONFIG",
+    20: "CALIBRATE_BACKLASH", 21: "FOCUSER_MOVE", 22: "FOCUSER_HALT",
+    23: "FOCUSER_SYNC", 24: "FOCUSER_SET_TEMP_COMP", 25: "FOCUSER_SET_TEMPERATURE",
+    26: "GET_FOCUSER", 27: "SET_LIMITS", 28: "GET_LIMITS", 29: "GET_PERF",
+    30: "GET_TRACE", 31: "SET_TRACE_STREAM", 32: "SET_CAPTURE", 33: "GET_CAPTURE",
+    34: "GET_DIAG",
+}
+
+
+def parse_frame(data):
+    """Returns (core, first, head, [(seq, id, time, a, b)]) or None."""
+    if len(data) < 12 or data[0] != TRACE_FRAME_TYPE:
+        return None
+    core, count = data[1], data[2]
+    first, head = struct.unpack_from("!II", data, 4)
+    events = []
+    for i in range(count):
+        event_id, event_time, a, b = struct.unpack_from("!H2xIii", data, 12 + 16 * i)
+        events.append((first + i, event_id, event_time, a, b))
+    return core, first, head, events
+
+
+class Unwrapper:
+    """Event times are the low 32 bits of esp_timer_get_time()."""
+
+    def __init__(self):
+        self.last = None
+        self.offset = 0
+
+    def __call__(self, t):
+        if self.last is not None and t < self.last and self.last - t > 1 << 31:
+            self.offset += 1 << 32
+        self.last = t
+        return t + self.offset
+
+
+def to_chrome(core, event_id, ts, a, b):
+    base = {"pid": 1, "tid": core, "ts": ts}
+    if event_id == TRACE_AXIS_RATE:
+        name = AXIS_NAMES.get(a, "axis %d" % a)
+        return [dict(base, name=name + " step rate", ph="C", args={"Hz": b})]
+    if event_id == TRACE_SLEW_TICK:
+        return [dict(base, name="slew tick", ph="i", s="t", args={"raDiff": a, "decDiff": b}),
+                dict(base, name="slew distance", ph="C", args={"ra": abs(a), "dec": abs(b)})]
+    if event_id == TRACE_SLEW_SLOWDOWN:
+        return [dict(base, name="slew slowdown", ph="i", s="t", args={"speed": a, "intervalMillis": b})]
+    if event_id == TRACE_GUIDE_PULSE:
+        return [dict(base, name="guide pulse", ph="i", s="t", args={"axis": a >> 8, "dir": a & 0xff, "millis": b})]
+    if event_id == TRACE_COMMAND_BEGIN:
+        return [dict(base, name=COMMAND_NAMES.get(a, "CMD %d" % a), ph="B", args={"len": b})]
+    if event_id == TRACE_COMMAND_END:
+        return [dict(base, name=COMMAND_NAMES.get(a, "CMD %d" % a), ph="E", args={"result": b})]
+    return [dict(base, name="event %d" % event_id, ph="i", s="t", args={"a": a, "b": b})]
+
+
+def dump(sock, addr):
+    frames = []
+    for core in range(CORES):
+        seq = 0
+        while True:
+            sock.sendto(struct.pack("!BBI", CMD_GET_TRACE, core, seq), addr)
+            parsed = parse_frame(sock.recv(2048))
+            if parsed is None:
+                break
+            frames.append(parsed)
+            _, first, head, events = parsed
+            if not events:
+                break
+            seq = first + len(events)
+            if seq == head:
+                break
+    return frames
+
+
+def stream(sock, addr, seconds):
+    frames = []
+    sock.sendto(struct.pack("!BB", CMD_SET_TRACE_STREAM, 1), addr)
+    deadline = time.time() + seconds
+    try:
+        while time.time() < deadline:
+            try:
+                data = sock.recv(2048)
+            except socket.timeout:
+                continue
+            parsed = parse_frame(data)
+            if parsed:
+                frames.append(parsed)
+    finally:
+        sock.sendto(struct.pack("!BB", CMD_SET_TRACE_STREAM, 0), addr)
+    return frames
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=9333)
+    parser.add_argument("--stream", type=float, metavar="SECONDS", help="stream instead of dumping the rings")
+    parser.add_argument("-o", "--output", default="trace.json")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1)
+    addr = (args.host, args.port)
+    frames = stream(sock, addr, args.stream) if args.stream else dump(sock, addr)
+
+    seen = set()
+    per_core = {}
+    for core, _, _, events in frames:
+        for seq, event_id, event_time, a, b in events:
+            if (core, seq) in seen:
+                continue
+            seen.add((core, seq))
+            per_core.setdefault(core, []).append((seq, event_id, event_time, a, b))
+
+    trace = []
+    for core, events in per_core.items():
+        unwrap = Unwrapper()
+        for seq, event_id, event_time, a, b in sorted(events):
+            trace.extend(to_chrome(core, event_id, unwrap(event_time), a, b))
+    for core in per_core:
+        trace.append({"pid": 1, "tid": core, "ph": "M", "name": "thread_name", "args": {"name": "core %d" % core}})
+
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": trace, "displayTimeUnit": "ms"}, f)
+    print("%d events from %d cores written to %s" % (len(seen), len(per_core), args.output))
+
+
+if __name__ == "__main__":
+    main()